@@ -0,0 +1,618 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_bench.c - Time the dumpscan library against a corpus of dumps
+ *
+ * Each phase is run over every dump in the corpus, and the results are
+ * written as JSON, one object per phase, so they can be kept and
+ * compared from one build to the next.  The phases are:
+ *
+ *   parse      ParseDumpFile, with callbacks that only count vnodes
+ *   prescan    Path_PreScan, collecting every vnode
+ *   pathbuild  Path_Build for every vnode
+ *   dirlookup  DirectoryLookup of every vnode in its parent, by vnode
+ *              and then by name
+ *   copy       CopyVNodeData of every vnode with data, to a null XFILE
+ *   repair     ParseDumpFile with the repair callbacks, to a null XFILE
+ *
+ * Allocations are counted by interposing on malloc where we know how
+ * (glibc), and system calls are taken from /proc/self/io where that
+ * exists; otherwise they are reported as null.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+extern XFILE repair_output;
+extern afs_uint32 repair_dumphdr_cb(afs_dump_header *, XFILE *, void *);
+extern afs_uint32 repair_volhdr_cb(afs_vol_header *, XFILE *, void *);
+extern afs_uint32 repair_vnode_cb(afs_vnode *, XFILE *, void *);
+
+/* One dump in the corpus */
+struct corpus {
+  char *path;
+  XFILE X;
+  u_int64 size;
+  path_hashinfo phi;
+};
+
+/* A point-in-time view of the resources we measure */
+struct snapshot {
+  struct timespec when;
+  struct rusage ru;
+  unsigned long allocs;
+  long syscr, syscw;
+};
+
+/* A phase, and the best results seen for it */
+struct phase {
+  char *name;
+  afs_uint32 (*run)(struct corpus *, afs_uint32 *, u_int64 *);
+};
+struct result {
+  int done;
+  double secs, user, sys;
+  unsigned long allocs;
+  long syscr, syscw;
+  afs_uint32 items, errors;
+  u_int64 bytes;
+};
+
+char *argv0;
+static char *outpath, *label;
+static int verbose, nruns;
+static afs_uint32 repairflags;
+static struct corpus *corpus;
+static int ncorpus;
+static afs_uint32 error_count;
+static struct snapshot overhead;
+
+static dump_parser dp;
+static XFILE null_output;
+
+
+#ifdef __GLIBC__
+/* Count allocations.  glibc lets a program replace malloc, and still
+ * exports the real thing under another name.
+ */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+static unsigned long nallocs;
+#define HAVE_ALLOC_COUNT
+
+void *malloc(size_t size)
+{
+  __sync_fetch_and_add(&nallocs, 1);
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+  __sync_fetch_and_add(&nallocs, 1);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  __sync_fetch_and_add(&nallocs, 1);
+  return __libc_realloc(ptr, size);
+}
+#endif
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] dump...\n", argv0);
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -l label    Label to record with the results\n");
+  fprintf(stderr, "  -n runs     Run each phase n times and keep the best [3]\n");
+  fprintf(stderr, "  -o outfile  Put results in file [default stdout]\n");
+  fprintf(stderr, "  -Rxxx       Repair options for the repair phase [0dv]\n");
+  fprintf(stderr, "              (see afsdump_scan)\n");
+  fprintf(stderr, "  -v          Verbose mode (print errors in the dumps)\n");
+  exit(status);
+}
+
+
+/* Parse the repair flags, the same way afsdump_scan does */
+static afs_uint32 parse_repairflags(char *flags)
+{
+  afs_uint32 result = 0;
+  char *x;
+
+  for (x = flags; *x; x++) switch (*x) {
+    case '0': result |= DSFIX_SKIP;   continue;
+    case 'b': result |= DSFIX_RSKIP;  continue;
+    case 'd': result |= DSFIX_VDSYNC; continue;
+    case 'v': result |= DSFIX_VFSYNC; continue;
+    default:  usage(1, "Invalid repair options!");
+  }
+  return result;
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  outpath = label = 0;
+  verbose = 0;
+  nruns = 3;
+  repairflags = DSFIX_SKIP | DSFIX_VDSYNC | DSFIX_VFSYNC;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "hl:n:o:R:v")) != EOF) {
+    switch (c) {
+      case 'l': label        = optarg;                    continue;
+      case 'n': nruns        = atoi(optarg);              continue;
+      case 'o': outpath      = optarg;                    continue;
+      case 'R': repairflags  = parse_repairflags(optarg); continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (nruns < 1) usage(1, "Must run at least once");
+  if (argc == optind) usage(1, "No dumps to benchmark");
+  ncorpus = argc - optind;
+  corpus = malloc(ncorpus * sizeof(struct corpus));
+  if (!corpus) {
+    fprintf(stderr, "%s: out of memory!\n", argv0);
+    exit(2);
+  }
+  memset(corpus, 0, ncorpus * sizeof(struct corpus));
+  for (c = 0; c < ncorpus; c++)
+    corpus[c].path = argv[optind + c];
+}
+
+
+/* A callback to count and maybe print errors */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  error_count++;
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/* A sink for output we don't want */
+static afs_uint32 xf_NULL_do_write(XFILE *X, void *buf, afs_uint32 count)
+{
+  return 0;
+}
+
+
+static void take_snapshot(struct snapshot *S)
+{
+  char buf[64];
+  FILE *F;
+
+  S->syscr = S->syscw = -1;
+  if (F = fopen("/proc/self/io", "r")) {
+    while (fgets(buf, sizeof(buf), F)) {
+      if (!strncmp(buf, "syscr: ", 7)) S->syscr = atol(buf + 7);
+      if (!strncmp(buf, "syscw: ", 7)) S->syscw = atol(buf + 7);
+    }
+    fclose(F);
+  }
+#ifdef HAVE_ALLOC_COUNT
+  S->allocs = nallocs;
+#else
+  S->allocs = 0;
+#endif
+  getrusage(RUSAGE_SELF, &S->ru);
+  clock_gettime(CLOCK_MONOTONIC, &S->when);
+}
+
+
+static double tv_secs(struct timeval *a, struct timeval *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_usec - a->tv_usec) / 1e6;
+}
+
+
+/* Record the difference between two snapshots, if it's the best yet.
+ * Taking a snapshot costs an allocation and a system call or two of its
+ * own; that was measured at startup and is subtracted here.
+ */
+static void record(struct result *P, struct snapshot *a, struct snapshot *b,
+                   afs_uint32 items, u_int64 *bytes)
+{
+  double secs;
+
+  secs = (b->when.tv_sec - a->when.tv_sec)
+       + (b->when.tv_nsec - a->when.tv_nsec) / 1e9;
+  if (P->done && secs >= P->secs) return;
+  P->done = 1;
+  P->secs = secs;
+  P->user = tv_secs(&a->ru.ru_utime, &b->ru.ru_utime);
+  P->sys  = tv_secs(&a->ru.ru_stime, &b->ru.ru_stime);
+  P->allocs = b->allocs - a->allocs - overhead.allocs;
+  P->syscr = (a->syscr < 0) ? -1 : b->syscr - a->syscr - overhead.syscr;
+  P->syscw = (a->syscw < 0) ? -1 : b->syscw - a->syscw - overhead.syscw;
+  P->items = items;
+  P->errors = error_count;
+  cp64(P->bytes, *bytes);
+}
+
+
+static afs_uint32 count_vnode_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  (*(afs_uint32 *)refcon)++;
+  return 0;
+}
+
+
+static afs_uint32 rewind_dump(struct corpus *C)
+{
+  u_int64 where;
+
+  mk64(where, 0, 0);
+  return xfseek(&C->X, &where);
+}
+
+
+static afs_uint32 run_parse(struct corpus *C, afs_uint32 *items, u_int64 *bytes)
+{
+  dump_parser my_p;
+  u_int64 tmp64;
+  afs_uint32 r;
+
+  memset(&my_p, 0, sizeof(my_p));
+  my_p.refcon = items;
+  my_p.cb_vnode_dir   = count_vnode_cb;
+  my_p.cb_vnode_file  = count_vnode_cb;
+  my_p.cb_vnode_link  = count_vnode_cb;
+  my_p.cb_vnode_empty = count_vnode_cb;
+  my_p.cb_vnode_wierd = count_vnode_cb;
+  my_p.cb_error = my_error_cb;
+  my_p.flags = DSFLAG_SEEK;
+
+  if (r = rewind_dump(C)) return r;
+  r = ParseDumpFile(&C->X, &my_p);
+  if (!r) r = xftell(&C->X, &C->size);
+  add64_64(tmp64, *bytes, C->size);
+  cp64(*bytes, tmp64);
+  return r;
+}
+
+
+static afs_uint32 run_prescan(struct corpus *C, afs_uint32 *items, u_int64 *bytes)
+{
+  u_int64 tmp64;
+  afs_uint32 r;
+
+  Path_FreeHashTable(&C->phi);
+  memset(&C->phi, 0, sizeof(C->phi));
+  C->phi.p = &dp;
+  if (r = rewind_dump(C)) return r;
+  r = Path_PreScan(&C->X, &C->phi, 1);
+  *items += C->phi.n_dirs + C->phi.n_files;
+  add64_64(tmp64, *bytes, C->size);
+  cp64(*bytes, tmp64);
+  return r;
+}
+
+
+/* Call fn for each vnode found by the prescan */
+static afs_uint32 each_vnode(struct corpus *C, afs_uint32 *items, u_int64 *bytes,
+                             afs_uint32 (*fn)(struct corpus *, vhash_ent *,
+                                              u_int64 *))
+{
+  vhash_ent *vhe;
+  afs_uint32 r;
+  int i;
+
+  if (!C->phi.hash_table) return 0;
+  for (i = 0; i < (1 << C->phi.hash_size); i++) {
+    for (vhe = C->phi.hash_table[i]; vhe; vhe = vhe->next) {
+      if (r = (fn)(C, vhe, bytes)) return r;
+      (*items)++;
+    }
+  }
+  return 0;
+}
+
+
+static afs_uint32 pathbuild_one(struct corpus *C, vhash_ent *vhe, u_int64 *bytes)
+{
+  char *path = 0;
+  afs_uint32 r;
+
+  r = Path_Build(&C->X, &C->phi, vhe->vnode, &path, 0);
+  if (path) free(path);
+  return (r == DSERR_FMT || r == ENOENT) ? 0 : r;
+}
+
+static afs_uint32 run_pathbuild(struct corpus *C, afs_uint32 *items, u_int64 *bytes)
+{
+  return each_vnode(C, items, bytes, pathbuild_one);
+}
+
+
+static afs_uint32 dirlookup_one(struct corpus *C, vhash_ent *vhe, u_int64 *bytes)
+{
+  vhash_ent *dvhe;
+  u_int64 tmp64;
+  afs_uint32 r, vnode;
+  char *name = 0;
+  int i;
+
+  if (vhe->vnode == 1 || !vhe->parent) return 0;
+  i = vhe->parent & ((1 << C->phi.hash_size) - 1);
+  for (dvhe = C->phi.hash_table[i]; dvhe; dvhe = dvhe->next)
+    if (dvhe->vnode == vhe->parent) break;
+  if (!dvhe || zero64(dvhe->d_offset)) return 0;
+
+  /* Reverse lookup, as Path_Build does it */
+  vnode = vhe->vnode;
+  if (r = xfseek(&C->X, &dvhe->d_offset)) return r;
+  if (r = DirectoryLookup(&C->X, &dp, lo64(dvhe->d_size), &name, &vnode, 0))
+    return r;
+  if (!name) return 0;
+
+  /* Forward lookup, as Path_Follow does it */
+  vnode = 0;
+  r = xfseek(&C->X, &dvhe->d_offset);
+  if (!r) r = DirectoryLookup(&C->X, &dp, lo64(dvhe->d_size), &name, &vnode, 0);
+  free(name);
+  add64_64(tmp64, *bytes, dvhe->d_size);
+  add64_64(*bytes, tmp64, dvhe->d_size);
+  return r;
+}
+
+static afs_uint32 run_dirlookup(struct corpus *C, afs_uint32 *items, u_int64 *bytes)
+{
+  return each_vnode(C, items, bytes, dirlookup_one);
+}
+
+
+static afs_uint32 copy_one(struct corpus *C, vhash_ent *vhe, u_int64 *bytes)
+{
+  u_int64 tmp64;
+  afs_uint32 r;
+
+  if (zero64(vhe->d_offset)) return 0;
+  if (r = xfseek(&C->X, &vhe->d_offset)) return r;
+  if (r = CopyVNodeData(&null_output, &C->X, &vhe->d_size)) return r;
+  add64_64(tmp64, *bytes, vhe->d_size);
+  cp64(*bytes, tmp64);
+  return 0;
+}
+
+static afs_uint32 run_copy(struct corpus *C, afs_uint32 *items, u_int64 *bytes)
+{
+  return each_vnode(C, items, bytes, copy_one);
+}
+
+
+static afs_uint32 repair_count_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  (*(afs_uint32 *)refcon)++;
+  return repair_vnode_cb(v, X, refcon);
+}
+
+static afs_uint32 run_repair(struct corpus *C, afs_uint32 *items, u_int64 *bytes)
+{
+  dump_parser my_p;
+  u_int64 tmp64;
+  afs_uint32 r;
+
+  memset(&my_p, 0, sizeof(my_p));
+  my_p.refcon = items;
+  my_p.cb_dumphdr     = repair_dumphdr_cb;
+  my_p.cb_volhdr      = repair_volhdr_cb;
+  my_p.cb_vnode_dir   = repair_count_cb;
+  my_p.cb_vnode_file  = repair_count_cb;
+  my_p.cb_vnode_link  = repair_count_cb;
+  my_p.cb_vnode_empty = repair_count_cb;
+  my_p.cb_error = my_error_cb;
+  my_p.flags = DSFLAG_SEEK;
+  my_p.repair_flags = repairflags;
+
+  repair_output = null_output;
+  if (r = rewind_dump(C)) return r;
+  r = ParseDumpFile(&C->X, &my_p);
+  if (!r) r = DumpDumpEnd(&repair_output);
+  add64_64(tmp64, *bytes, C->size);
+  cp64(*bytes, tmp64);
+  return r;
+}
+
+
+static struct phase phases[] = {
+  { "parse",     run_parse     },
+  { "prescan",   run_prescan   },
+  { "pathbuild", run_pathbuild },
+  { "dirlookup", run_dirlookup },
+  { "copy",      run_copy      },
+  { "repair",    run_repair    },
+};
+#define NPHASES (sizeof(phases) / sizeof(phases[0]))
+static struct result results[NPHASES];
+
+
+static void run_phase(struct phase *P, struct result *R)
+{
+  struct snapshot before, after;
+  afs_uint32 r, items = 0;
+  u_int64 bytes;
+  int i;
+
+  mk64(bytes, 0, 0);
+  error_count = 0;
+  take_snapshot(&before);
+  for (i = 0; i < ncorpus; i++) {
+    r = (P->run)(&corpus[i], &items, &bytes);
+    if (r && r != DSERR_DONE) {
+      error_count++;
+      if (verbose)
+        afs_com_err(argv0, r, "in %s phase on %s", P->name, corpus[i].path);
+    }
+  }
+  take_snapshot(&after);
+  record(R, &before, &after, items, &bytes);
+}
+
+
+static void print_count(FILE *F, char *name, long n)
+{
+  if (n < 0) fprintf(F, ",\n      \"%s\": null", name);
+  else fprintf(F, ",\n      \"%s\": %ld", name, n);
+}
+
+
+static void print_results(FILE *F)
+{
+  struct result *P;
+  char buf[24];
+  double mb;
+  int i;
+
+  fprintf(F, "{\n  \"label\": \"%s\",\n  \"runs\": %d,\n  \"corpus\": [",
+          label ? label : "", nruns);
+  for (i = 0; i < ncorpus; i++)
+    fprintf(F, "%s\n    { \"path\": \"%s\", \"bytes\": %s }",
+            i ? "," : "", corpus[i].path, decimate_int64(&corpus[i].size, buf));
+  fprintf(F, "\n  ],\n  \"phases\": {");
+  for (i = 0; i < NPHASES; i++) {
+    P = &results[i];
+    mb = (hi64(P->bytes) * 4294967296.0 + lo64(P->bytes)) / 1048576.0;
+    fprintf(F, "%s\n    \"%s\": {", i ? "," : "", phases[i].name);
+    fprintf(F, "\n      \"seconds\": %.6f", P->secs);
+    fprintf(F, ",\n      \"user\": %.6f", P->user);
+    fprintf(F, ",\n      \"sys\": %.6f", P->sys);
+    fprintf(F, ",\n      \"bytes\": %s", decimate_int64(&P->bytes, buf));
+    fprintf(F, ",\n      \"mb_per_s\": %.3f", P->secs > 0 ? mb / P->secs : 0);
+    fprintf(F, ",\n      \"vnodes\": %u", P->items);
+    fprintf(F, ",\n      \"vnodes_per_s\": %.1f",
+            P->secs > 0 ? P->items / P->secs : 0);
+#ifdef HAVE_ALLOC_COUNT
+    print_count(F, "allocs", P->allocs);
+#else
+    print_count(F, "allocs", -1);
+#endif
+    print_count(F, "read_syscalls", P->syscr);
+    print_count(F, "write_syscalls", P->syscw);
+    fprintf(F, ",\n      \"errors\": %u\n    }", P->errors);
+  }
+  fprintf(F, "\n  }\n}\n");
+}
+
+
+/* Main program */
+int main(int argc, char **argv)
+{
+  struct snapshot a, b;
+  afs_uint32 r;
+  FILE *F;
+  int i, run;
+
+  parse_options(argc, argv);
+  initialize_AVds_error_table();
+  initialize_xFil_error_table();
+
+  memset(&null_output, 0, sizeof(null_output));
+  null_output.do_write = xf_NULL_do_write;
+  null_output.is_writable = 1;
+
+  memset(&dp, 0, sizeof(dp));
+  dp.cb_error = my_error_cb;
+  dp.flags = DSFLAG_SEEK;
+
+  for (i = 0; i < ncorpus; i++) {
+    r = xfopen(&corpus[i].X, O_RDONLY, corpus[i].path);
+    if (r) {
+      afs_com_err(argv0, r, "opening %s", corpus[i].path);
+      exit(2);
+    }
+    if (!corpus[i].X.is_seekable) {
+      fprintf(stderr, "%s: %s: dumps must be seekable\n", argv0, corpus[i].path);
+      exit(2);
+    }
+    corpus[i].phi.p = &dp;
+  }
+
+  /* Measure what a snapshot itself costs */
+  memset(&overhead, 0, sizeof(overhead));
+  take_snapshot(&a);
+  take_snapshot(&b);
+  overhead.allocs = b.allocs - a.allocs;
+  overhead.syscr  = b.syscr - a.syscr;
+  overhead.syscw  = b.syscw - a.syscw;
+
+  memset(results, 0, sizeof(results));
+  for (run = 0; run < nruns; run++)
+    for (i = 0; i < NPHASES; i++) run_phase(&phases[i], &results[i]);
+
+  for (i = 0; i < ncorpus; i++) {
+    Path_FreeHashTable(&corpus[i].phi);
+    xfclose(&corpus[i].X);
+  }
+
+  if (outpath) {
+    if (!(F = fopen(outpath, "w"))) {
+      perror(outpath);
+      exit(2);
+    }
+  } else F = stdout;
+  print_results(F);
+  if (F != stdout) fclose(F);
+  return 0;
+}
@@ -0,0 +1,533 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_catalog.c - Add dumps to a catalog
+ *
+ * Each dump is parsed once, noting every vnode's attributes and the
+ * entries of every directory in the dump.  For an incremental dump,
+ * the vnodes and directories that didn't change are taken from the
+ * newest earlier dump of the volume in the catalog.  The directory tree
+ * is then walked from the root to give the rows for the new section;
+ * see catalog.c for the format.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <limits.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+/* What we know about a vnode */
+struct vstate {
+  int present;                 /* we have its attributes */
+  int has_dir;                 /* we have its entries from this dump */
+  int visited;                 /* its entries have become rows */
+  cat_row attr;
+  afs_uint32 entries;          /* first of its entries, or CAT_NONE */
+};
+
+/* A directory entry */
+struct entry {
+  char *name;
+  afs_uint32 vnode, vuniq;
+  afs_uint32 next;             /* next entry in the same directory */
+};
+
+char *argv0;
+static char *catalog_path;
+static int force, verbose;
+static afs_uint32 error_count;
+
+static dump_catalog catalog;
+static afs_dump_header dumphdr;
+static int have_dumphdr, already;
+static afs_uint32 section;     /* index of the section being made */
+
+static struct vstate *vnodes;
+static afs_uint32 nvnodes;
+static struct entry *entries;
+static afs_uint32 nentries, maxentries;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] catalog dump...\n", argv0);
+  fprintf(stderr, "  -f     Add dumps even if they are already in the catalog\n");
+  fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -v     Verbose mode\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  force = verbose = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "fhv")) != EOF) {
+    switch (c) {
+      case 'f': force        = 1;                         continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (argc - optind < 2) usage(1, "A catalog and at least one dump are required");
+  catalog_path = argv[optind++];
+}
+
+
+/* A callback to count and maybe print errors */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  error_count++;
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/* Find the state for a vnode, making room for it if needed */
+static afs_uint32 get_vstate(afs_uint32 vnode, struct vstate **V)
+{
+  afs_uint32 n = nvnodes, i, r;
+
+  r = GrowVnodeArray((void **)&vnodes, &nvnodes, sizeof(struct vstate), vnode);
+  if (r) return r;
+  for (i = n; i < nvnodes; i++) vnodes[i].entries = CAT_NONE;
+  *V = &vnodes[vnode];
+  return 0;
+}
+
+
+/* Add an entry to a directory */
+static afs_uint32 add_entry(afs_uint32 dir, char *name, afs_uint32 vnode,
+                            afs_uint32 vuniq)
+{
+  struct vstate *V;
+  struct entry *E;
+  afs_uint32 r;
+
+  if (r = get_vstate(dir, &V)) return r;
+  if (nentries == maxentries) {
+    maxentries = maxentries ? maxentries * 2 : 4096;
+    E = realloc(entries, maxentries * sizeof(struct entry));
+    if (!E) return ENOMEM;
+    entries = E;
+  }
+  E = &entries[nentries];
+  if (!(E->name = strdup(name))) return ENOMEM;
+  E->vnode = vnode;
+  E->vuniq = vuniq;
+  E->next = V->entries;
+  V->entries = nentries++;
+  return 0;
+}
+
+
+/* Is this dump already in the catalog? */
+static int in_catalog(afs_uint32 volid, afs_uint32 to_date, char *path)
+{
+  afs_uint32 i;
+
+  for (i = 0; i < catalog.nsections; i++) {
+    if (catalog.sections[i].volid == volid
+    &&  catalog.sections[i].to_date == to_date
+    &&  !strcmp(catalog.sections[i].dump_path, path))
+      return 1;
+  }
+  return 0;
+}
+
+
+/* Save the dump header, and stop right there if the dump is already
+ * in the catalog, rather than reading the whole thing for nothing.
+ */
+static afs_uint32 dumphdr_cb(afs_dump_header *hdr, XFILE *X, void *refcon)
+{
+  char *path = refcon;
+
+  dumphdr = *hdr;
+  dumphdr.volname = (unsigned char *)strdup((hdr->field_mask & F_DUMPHDR_VOLNAME)
+                                            ? (char *)hdr->volname : "");
+  if (!dumphdr.volname) return ENOMEM;
+  have_dumphdr = 1;
+  if (!force && in_catalog(hdr->volid, hdr->to_date, path)) {
+    already = 1;
+    return DSERR_DONE;
+  }
+  return 0;
+}
+
+
+static afs_uint32 vnode_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  struct vstate *V;
+  afs_uint32 r;
+
+  if (r = get_vstate(v->vnode, &V)) return r;
+  V->present = 1;
+  V->attr.vnode       = v->vnode;
+  V->attr.vuniq       = v->vuniq;
+  V->attr.type        = v->type;
+  V->attr.mode        = v->mode;
+  V->attr.owner       = v->owner;
+  V->attr.datavers    = v->datavers;
+  V->attr.client_date = v->client_date;
+  V->attr.server_date = v->server_date;
+  V->attr.src         = section;
+  if (v->field_mask & F_VNODE_DATA) {
+    cp64(V->attr.size, v->size);
+    cp64(V->attr.d_offset, v->d_offset);
+  } else {
+    mk64(V->attr.size, 0, 0);
+    mk64(V->attr.d_offset, 0, 0);
+  }
+  return 0;
+}
+
+
+static afs_uint32 dirent_cb(afs_vnode *v, afs_dir_entry *de, XFILE *X, void *refcon)
+{
+  struct vstate *V;
+  afs_uint32 r;
+
+  /* A directory with only . and .. is still one we have the entries of */
+  if (r = get_vstate(v->vnode, &V)) return r;
+  V->has_dir = 1;
+  if (!strcmp(de->name, ".") || !strcmp(de->name, "..")) return 0;
+  return add_entry(v->vnode, de->name, de->vnode, de->uniq);
+}
+
+
+/* Find the newest earlier section for the same volume */
+static afs_uint32 find_base(void)
+{
+  cat_section *S, *best = 0;
+  afs_uint32 i;
+
+  for (i = 0; i < catalog.nsections; i++) {
+    S = &catalog.sections[i];
+    if (S->volid != dumphdr.volid || S->to_date >= dumphdr.to_date) continue;
+    if (!best || S->to_date >= best->to_date) best = S;
+  }
+  return best ? best->index : CAT_NONE;
+}
+
+
+/* Fill in what an incremental dump doesn't have from an earlier section:
+ * vnodes that didn't change, and the entries of directories that didn't.
+ */
+static afs_uint32 inherit(cat_section *S)
+{
+  struct vstate *V, *P;
+  cat_row *rows, *R;
+  char **names;
+  afs_uint32 i, r;
+
+  if (r = Catalog_Load(&catalog, S, &rows, &names)) return r;
+  for (i = 0; i < S->nrows; i++) {
+    R = &rows[i];
+    if (r = get_vstate(R->vnode, &V)) break;
+    if (!V->present) {
+      V->present = 1;
+      V->attr = *R;
+    }
+    if (R->parent == CAT_NONE) continue;
+    if (r = get_vstate(rows[R->parent].vnode, &P)) break;
+    if (P->has_dir) continue;
+    if (r = add_entry(rows[R->parent].vnode, names[R->name], R->vnode, R->vuniq))
+      break;
+  }
+  free(rows);
+  free(names);
+  return r;
+}
+
+
+static int cmp_entry(const void *a, const void *b)
+{
+  return strcmp((*(struct entry **)a)->name, (*(struct entry **)b)->name);
+}
+
+
+static int cmp_name(const void *a, const void *b)
+{
+  return strcmp(*(char **)a, *(char **)b);
+}
+
+
+/* Walk the tree from the root, making a row for each path.  The rows'
+ * names are left in rownames, for the caller to turn into indexes.
+ */
+static afs_uint32 make_rows(cat_row **rowsp, char ***rownamesp, afs_uint32 *nrowsp)
+{
+  struct entry **list = 0, *E, **NL;
+  cat_row *rows = 0, *NR;
+  char **rownames = 0, **NN;
+  afs_uint32 nrows = 0, maxrows = 0, maxlist = 0, n, e, i, r = 0;
+  struct vstate *V;
+
+  if (nvnodes < 2 || !vnodes[1].present) return DSERR_FMT;
+  maxrows = 1024;
+  if (!(rows = malloc(maxrows * sizeof(cat_row)))
+  ||  !(rownames = malloc(maxrows * sizeof(char *)))) {
+    r = ENOMEM;
+    goto fail;
+  }
+  rows[0] = vnodes[1].attr;
+  rows[0].name = rows[0].parent = CAT_NONE;
+  rownames[0] = 0;
+  nrows = 1;
+
+  for (i = 0; i < nrows; i++) {
+    rows[i].first = rows[i].nchild = 0;
+    V = &vnodes[rows[i].vnode];
+    if (rows[i].type != vDirectory || V->visited) continue;
+    V->visited = 1;
+
+    /* Gather the entries that lead somewhere, and sort them */
+    for (n = 0, e = V->entries; e != CAT_NONE; e = E->next) {
+      E = &entries[e];
+      if (E->vnode >= nvnodes || !vnodes[E->vnode].present
+      ||  vnodes[E->vnode].attr.vuniq != E->vuniq)
+        continue;
+      if (n == maxlist) {
+        maxlist = maxlist ? maxlist * 2 : 256;
+        if (!(NL = realloc(list, maxlist * sizeof(struct entry *)))) {
+          r = ENOMEM;
+          goto fail;
+        }
+        list = NL;
+      }
+      list[n++] = E;
+    }
+    qsort(list, n, sizeof(struct entry *), cmp_entry);
+
+    if (nrows + n > maxrows) {
+      while (nrows + n > maxrows) maxrows *= 2;
+      NR = realloc(rows, maxrows * sizeof(cat_row));
+      if (NR) rows = NR;
+      NN = realloc(rownames, maxrows * sizeof(char *));
+      if (NN) rownames = NN;
+      if (!NR || !NN) {
+        r = ENOMEM;
+        goto fail;
+      }
+    }
+    rows[i].first = nrows;
+    rows[i].nchild = n;
+    for (e = 0; e < n; e++) {
+      rows[nrows] = vnodes[list[e]->vnode].attr;
+      rows[nrows].parent = i;
+      rownames[nrows++] = list[e]->name;
+    }
+  }
+  if (list) free(list);
+  *rowsp = rows;
+  *rownamesp = rownames;
+  *nrowsp = nrows;
+  return 0;
+
+fail:
+  if (list) free(list);
+  if (rows) free(rows);
+  if (rownames) free(rownames);
+  return r;
+}
+
+
+/* Make the name dictionary, and give each row the index of its name */
+static afs_uint32 make_names(cat_row *rows, char **rownames, afs_uint32 nrows,
+                             char ***namesp, afs_uint32 *nnamesp)
+{
+  char **names, **found;
+  afs_uint32 i, n;
+
+  if (!(names = malloc(nrows * sizeof(char *) + 1))) return ENOMEM;
+  for (n = 0, i = 1; i < nrows; i++) names[n++] = rownames[i];
+  qsort(names, n, sizeof(char *), cmp_name);
+  for (i = 0, n = 0; i < nrows - 1; i++)
+    if (!n || strcmp(names[n - 1], names[i])) names[n++] = names[i];
+  for (i = 1; i < nrows; i++) {
+    found = bsearch(&rownames[i], names, n, sizeof(char *), cmp_name);
+    rows[i].name = found - names;
+  }
+  *namesp = names;
+  *nnamesp = n;
+  return 0;
+}
+
+
+/* Free what we kept about the last dump */
+static void reset(void)
+{
+  afs_uint32 i;
+
+  for (i = 0; i < nentries; i++) free(entries[i].name);
+  nentries = 0;
+  if (vnodes) free(vnodes);
+  vnodes = 0;
+  nvnodes = 0;
+  if (have_dumphdr) free(dumphdr.volname);
+  have_dumphdr = 0;
+}
+
+
+/* Add one dump to the catalog */
+static afs_uint32 add_dump(char *path)
+{
+  char fullpath[PATH_MAX], **rownames = 0, **names = 0;
+  cat_row *rows = 0;
+  cat_section S;
+  dump_parser dp;
+  afs_uint32 r;
+  XFILE X;
+
+  if (r = xfopen(&X, O_RDONLY, path)) return r;
+  section = catalog.nsections;
+  memset(&S, 0, sizeof(S));
+  if (X.is_seekable && xfsize(&X, &S.dump_size)) mk64(S.dump_size, 0, 0);
+  S.dump_path = realpath(path, fullpath) ? fullpath : path;
+  already = 0;
+
+  memset(&dp, 0, sizeof(dp));
+  dp.refcon         = S.dump_path;
+  dp.cb_error       = my_error_cb;
+  dp.cb_dumphdr     = dumphdr_cb;
+  dp.cb_vnode_dir   = vnode_cb;
+  dp.cb_vnode_file  = vnode_cb;
+  dp.cb_vnode_link  = vnode_cb;
+  dp.cb_vnode_wierd = vnode_cb;
+  dp.cb_dirent      = dirent_cb;
+  if (X.is_seekable) dp.flags = DSFLAG_SEEK;
+  r = ParseDumpFile(&X, &dp);
+  xfclose(&X);
+  if (r) goto out;
+  if (already) {
+    if (verbose) printf("%s: already in the catalog\n", path);
+    goto out;
+  }
+  if (!have_dumphdr) {
+    r = DSERR_FMT;
+    goto out;
+  }
+
+  S.volid     = dumphdr.volid;
+  S.volname   = (char *)dumphdr.volname;
+  S.from_date = dumphdr.from_date;
+  S.to_date   = dumphdr.to_date;
+  S.base      = CAT_NONE;
+
+  if (S.from_date) {
+    S.base = find_base();
+    if (S.base == CAT_NONE)
+      fprintf(stderr, "%s: %s: no earlier dump of volume %u in the catalog; "
+              "some paths will be missing\n", argv0, path, S.volid);
+    else if (r = inherit(&catalog.sections[S.base]))
+      goto out;
+  }
+
+  if ((r = make_rows(&rows, &rownames, &S.nrows))
+  ||  (r = make_names(rows, rownames, S.nrows, &names, &S.nnames))
+  ||  (r = Catalog_Append(&catalog, &S, rows, names)))
+    goto out;
+
+  if (verbose)
+    printf("%s: volume %s (%u), %s dump, %u paths, %u names\n", path,
+           S.volname, S.volid, S.from_date ? "incremental" : "full",
+           S.nrows, S.nnames);
+
+out:
+  if (rows) free(rows);
+  if (rownames) free(rownames);
+  if (names) free(names);
+  reset();
+  return r;
+}
+
+
+int main(int argc, char **argv)
+{
+  afs_uint32 r;
+  int status = 0;
+
+  parse_options(argc, argv);
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+
+  if (r = Catalog_Open(&catalog, catalog_path, 1)) {
+    afs_com_err(argv0, r, "opening %s", catalog_path);
+    exit(2);
+  }
+  for (; optind < argc; optind++) {
+    if (r = add_dump(argv[optind])) {
+      afs_com_err(argv0, r, "adding %s", argv[optind]);
+      status = 1;
+    }
+  }
+  if (error_count)
+    fprintf(stderr, "%s: %u errors in dumps%s\n", argv0, error_count,
+            verbose ? "" : " (use -v to see them)");
+  if (r = Catalog_Close(&catalog)) {
+    afs_com_err(argv0, r, "closing %s", catalog_path);
+    exit(2);
+  }
+  exit(status);
+}
@@ -0,0 +1,695 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_dedup.c - Measure how much file data dumps have in common
+ *
+ * Every file body in every dump is cut into chunks at content-defined
+ * boundaries (FastCDC, using a gear hash), and each chunk is
+ * fingerprinted with the first FP_LEN bytes of its SHA-256.  Since the
+ * boundaries depend only on the data, the same content yields the same
+ * chunks wherever it appears: in successive dumps of a volume, in
+ * clones, or in unrelated volumes.
+ *
+ * Dumps are grouped by volume, and volumes are taken in the order they
+ * first appear on the command line.  For each volume we report the file
+ * data in all its dumps, the distinct chunks among them ("unique"), and
+ * how much of that was not already seen in an earlier volume ("new").
+ * The sum of the new bytes is what a store deduplicating the whole
+ * corpus would have to keep.
+ *
+ * Dumps are first parsed one at a time, only to find where the file data
+ * is; they must be seekable.  The data is then read and hashed by a pool
+ * of threads, each with its own XFILE, in units of up to UNIT_SIZE bytes
+ * of whole files.  Fingerprints are added to one table, in batches, so
+ * the lock is rarely contended.  The table needs 16 bytes per distinct
+ * chunk.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+#include "xf_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+#define FP_LEN     12                  /* bytes of SHA-256 kept */
+#define UNIT_SIZE  (64 << 20)          /* work handed to a thread at once */
+#define BATCH_SIZE 4096                /* chunks added to the table at once */
+#define MIN_TABLE  (1 << 20)           /* initial table entries */
+
+/* A file body in a dump */
+struct range {
+  u_int64 offset;
+  u_int64 size;
+};
+
+/* One dump in the corpus */
+struct dump {
+  char *path;
+  struct volume *V;
+  struct range *ranges;
+  afs_uint32 nranges, maxranges;
+};
+
+/* One volume, and what we found in its dumps */
+struct volume {
+  afs_uint32 volid;
+  char *name;
+  int ndumps;
+  u_int64 files;
+  u_int64 chunks;
+  u_int64 bytes;                       /* all file data */
+  u_int64 unique;                      /* distinct chunks */
+  u_int64 shared;                      /* ... also in an earlier volume */
+};
+
+/* Some work for a thread: consecutive file bodies from one dump */
+struct unit {
+  struct dump *D;
+  afs_uint32 first, count;
+};
+
+/* A fingerprint table entry.  vol is the index + 1 of the last volume
+ * the chunk was seen in, or 0 if the entry is empty.
+ */
+struct fp_ent {
+  unsigned char fp[FP_LEN];
+  afs_uint32 vol;
+};
+
+/* A chunk waiting to be added to the table */
+struct chunk {
+  unsigned char fp[FP_LEN];
+  afs_uint32 len;
+};
+
+/* State for each thread */
+struct worker {
+  pthread_t thread;
+  XFILE X;
+  struct dump *D;                      /* dump X is open on, if any */
+  unsigned char *buf;
+  struct chunk batch[BATCH_SIZE];
+  int nbatch;
+};
+
+char *argv0;
+static int verbose, nthreads;
+static afs_uint32 avg_size, min_size, max_size, buf_size;
+static afs_uint32 mask_s, mask_l, gear[256];
+
+static struct dump *dumps;
+static int ndumps;
+static struct volume *volumes;
+static int nvolumes;
+static afs_uint32 error_count;
+
+static struct fp_ent *table;
+static size_t table_size, table_used;
+
+/* Work for the current volume, shared by the threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct volume *cur_vol;
+static afs_uint32 cur_volnum;
+static struct unit *units;
+static int nunits, maxunits, next_unit;
+static afs_uint32 work_errors;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] dump...\n", argv0);
+  fprintf(stderr, "  -c size     Average chunk size [16k]\n");
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -j n        Use n threads [one per CPU]\n");
+  fprintf(stderr, "  -v          Verbose mode (print errors in the dumps)\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  char *x;
+  int c, bits;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  verbose = 0;
+  avg_size = 16384;
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "c:hj:v")) != EOF) {
+    switch (c) {
+      case 'c':
+        avg_size = strtoul(optarg, &x, 0);
+        if (*x == 'k' || *x == 'K') avg_size <<= 10;
+        continue;
+      case 'j': nthreads     = atoi(optarg);              continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (avg_size < 256 || avg_size > (1 << 20))
+    usage(1, "Chunk size must be between 256 and 1M");
+  if (nthreads < 1) nthreads = 1;
+  if (argc == optind) usage(1, "No dumps to examine");
+
+  /* Chunks are between 1/4 and 8 times the average size, which is
+   * rounded to a power of 2.  Before the average, a cut point must match
+   * one more bit of the hash than usual, and after, one less; this
+   * keeps most chunks close to the average.
+   */
+  for (bits = 8; (1 << (bits + 1)) <= avg_size; bits++);
+  avg_size = 1 << bits;
+  min_size = avg_size / 4;
+  max_size = avg_size * 8;
+  buf_size = max_size * 4;
+  mask_s = ~0U << (32 - (bits + 1));
+  mask_l = ~0U << (32 - (bits - 1));
+
+  ndumps = argc - optind;
+  dumps = calloc(ndumps, sizeof(struct dump));
+  volumes = calloc(ndumps, sizeof(struct volume));
+  if (!dumps || !volumes) {
+    fprintf(stderr, "%s: out of memory!\n", argv0);
+    exit(2);
+  }
+  for (c = 0; c < ndumps; c++)
+    dumps[c].path = argv[optind + c];
+}
+
+
+/* A callback to count and maybe print errors */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  error_count++;
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/* Find the volume a dump belongs to, from its header */
+static afs_uint32 dumphdr_cb(afs_dump_header *hdr, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+  struct volume *V;
+  int i;
+
+  for (i = 0; i < nvolumes; i++)
+    if (volumes[i].volid == hdr->volid) break;
+  V = &volumes[i];
+  if (i == nvolumes) {
+    nvolumes++;
+    V->volid = hdr->volid;
+    if (hdr->field_mask & F_DUMPHDR_VOLNAME)
+      V->name = strdup((char *)hdr->volname);
+  }
+  V->ndumps++;
+  D->V = V;
+  return 0;
+}
+
+
+/* Remember where a file's data is */
+static afs_uint32 file_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+  struct range *R;
+
+  if (!(v->field_mask & F_VNODE_DATA)) return 0;
+  if (D->nranges == D->maxranges) {
+    D->maxranges = D->maxranges ? D->maxranges * 2 : 1024;
+    R = realloc(D->ranges, D->maxranges * sizeof(struct range));
+    if (!R) return ENOMEM;
+    D->ranges = R;
+  }
+  R = &D->ranges[D->nranges++];
+  cp64(R->offset, v->d_offset);
+  cp64(R->size, v->size);
+  return 0;
+}
+
+
+/* Find the file data in a dump */
+static afs_uint32 scan_dump(struct dump *D)
+{
+  dump_parser dp;
+  XFILE X;
+  afs_uint32 r;
+
+  if (r = xfopen(&X, O_RDONLY, D->path)) return r;
+  if (!X.is_seekable) {
+    xfclose(&X);
+    return ERROR_XFILE_NOSEEK;
+  }
+
+  memset(&dp, 0, sizeof(dp));
+  dp.refcon        = D;
+  dp.cb_error      = my_error_cb;
+  dp.cb_dumphdr    = dumphdr_cb;
+  dp.cb_vnode_file = file_cb;
+  dp.flags         = DSFLAG_SEEK;
+  r = ParseDumpFile(&X, &dp);
+  xfclose(&X);
+  if (!r && !D->V) r = DSERR_FMT;     /* no dump header */
+  return r;
+}
+
+
+/* Gear hash values, from a fixed seed so that cut points are the
+ * same from one run to the next
+ */
+static void init_gear(void)
+{
+  afs_uint32 x = 2463534242U;
+  int i;
+
+  for (i = 0; i < 256; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    gear[i] = x;
+  }
+}
+
+
+/* Find the length of the chunk at the start of n bytes of data.
+ * If there is no cut point, all of it (up to max_size) is one chunk,
+ * so the caller must pass at least max_size bytes unless they are the
+ * end of the file.
+ */
+static afs_uint32 find_cut(unsigned char *p, afs_uint32 n)
+{
+  afs_uint32 h = 0, i, normal;
+
+  if (n <= min_size) return n;
+  if (n > max_size) n = max_size;
+  normal = (n < avg_size) ? n : avg_size;
+  for (i = min_size; i < normal; i++) {
+    h = (h << 1) + gear[p[i]];
+    if (!(h & mask_s)) return i + 1;
+  }
+  for (; i < n; i++) {
+    h = (h << 1) + gear[p[i]];
+    if (!(h & mask_l)) return i + 1;
+  }
+  return n;
+}
+
+
+/* Look up a fingerprint, returning its entry, or the empty one where it
+ * belongs.  Called with the lock held.
+ */
+static struct fp_ent *lookup(unsigned char *fp)
+{
+  struct fp_ent *E;
+  size_t i;
+
+  memcpy(&i, fp, sizeof(i));
+  for (i &= table_size - 1; ; i = (i + 1) & (table_size - 1)) {
+    E = &table[i];
+    if (!E->vol || !memcmp(E->fp, fp, FP_LEN)) return E;
+  }
+}
+
+
+/* Double the size of the table.  Called with the lock held. */
+static afs_uint32 grow_table(void)
+{
+  struct fp_ent *old = table, *E;
+  size_t i, old_size = table_size;
+
+  /* Refuse, rather than let the size wrap */
+  if (old_size > (size_t)-1 / 2 / sizeof(struct fp_ent)) return ENOMEM;
+  table = calloc(old_size * 2, sizeof(struct fp_ent));
+  if (!table) {
+    table = old;
+    return ENOMEM;
+  }
+  table_size = old_size * 2;
+  for (i = 0; i < old_size; i++) {
+    if (!old[i].vol) continue;
+    E = lookup(old[i].fp);
+    *E = old[i];
+  }
+  free(old);
+  return 0;
+}
+
+
+/* Add a thread's chunks to the table, and count them against the
+ * current volume
+ */
+static afs_uint32 flush_batch(struct worker *W)
+{
+  struct volume *V = cur_vol;
+  struct fp_ent *E;
+  struct chunk *C;
+  u_int64 tmp64;
+  afs_uint32 r = 0;
+  int i;
+
+  pthread_mutex_lock(&lock);
+  for (i = 0; i < W->nbatch; i++) {
+    C = &W->batch[i];
+    if (table_used >= table_size / 10 * 7 && (r = grow_table())) break;
+    add64_32(tmp64, V->chunks, 1);
+    cp64(V->chunks, tmp64);
+    add64_32(tmp64, V->bytes, C->len);
+    cp64(V->bytes, tmp64);
+    E = lookup(C->fp);
+    if (E->vol == cur_volnum) continue;          /* already in this volume */
+    add64_32(tmp64, V->unique, C->len);
+    cp64(V->unique, tmp64);
+    if (E->vol) {                                /* in an earlier volume */
+      add64_32(tmp64, V->shared, C->len);
+      cp64(V->shared, tmp64);
+    } else {
+      memcpy(E->fp, C->fp, FP_LEN);
+      table_used++;
+    }
+    E->vol = cur_volnum;
+  }
+  pthread_mutex_unlock(&lock);
+  W->nbatch = 0;
+  return r;
+}
+
+
+/* Cut a file body into chunks, and fingerprint them */
+static afs_uint32 chunk_range(struct worker *W, struct range *R)
+{
+  unsigned char hash[SHA256_LEN];
+  sha256_ctx ctx;
+  afs_uint32 r, n, len, have = 0, start = 0;
+  u_int64 left, tmp64;
+
+  if (r = xfseek(&W->X, &R->offset)) return r;
+  cp64(left, R->size);
+  for (;;) {
+    /* Keep at least max_size bytes ahead of us, if there are that many */
+    if (have - start < max_size && !zero64(left)) {
+      memmove(W->buf, W->buf + start, have - start);
+      have -= start;
+      start = 0;
+      mk64(tmp64, 0, buf_size - have);
+      n = gt64(left, tmp64) ? buf_size - have : lo64(left);
+      if (r = xfread(&W->X, W->buf + have, n)) return r;
+      have += n;
+      sub64_32(tmp64, left, n);
+      cp64(left, tmp64);
+    }
+    if (have == start) break;
+
+    len = find_cut(W->buf + start, have - start);
+    Sha256_Init(&ctx);
+    Sha256_Update(&ctx, W->buf + start, len);
+    Sha256_Final(&ctx, hash);
+    memcpy(W->batch[W->nbatch].fp, hash, FP_LEN);
+    W->batch[W->nbatch].len = len;
+    if (++W->nbatch == BATCH_SIZE && (r = flush_batch(W))) return r;
+    start += len;
+  }
+  return 0;
+}
+
+
+/* Take units of work until there are none left */
+static void *worker_main(void *arg)
+{
+  struct worker *W = arg;
+  struct unit *U;
+  afs_uint32 r, i;
+
+  for (;;) {
+    pthread_mutex_lock(&lock);
+    U = (next_unit < nunits) ? &units[next_unit++] : 0;
+    r = 0;
+    if (U && W->D != U->D) {
+      /* xfopen isn't safe to call from several threads at once */
+      if (W->D) xfclose(&W->X);
+      W->D = 0;
+      if (!(r = xfopen(&W->X, O_RDONLY, U->D->path))) W->D = U->D;
+    }
+    pthread_mutex_unlock(&lock);
+    if (!U) break;
+
+    for (i = 0; !r && i < U->count; i++)
+      r = chunk_range(W, &U->D->ranges[U->first + i]);
+    if (r) {
+      afs_com_err(argv0, r, "reading %s", U->D->path);
+      pthread_mutex_lock(&lock);
+      work_errors++;
+      pthread_mutex_unlock(&lock);
+    }
+  }
+  if (W->nbatch && (r = flush_batch(W))) {
+    afs_com_err(argv0, r, "adding to fingerprint table");
+    pthread_mutex_lock(&lock);
+    work_errors++;
+    pthread_mutex_unlock(&lock);
+  }
+  if (W->D) xfclose(&W->X);
+  W->D = 0;
+  return 0;
+}
+
+
+/* Divide the file bodies in a volume's dumps into units of work */
+static afs_uint32 make_units(struct volume *V)
+{
+  struct dump *D;
+  struct unit *U;
+  u_int64 sum, tmp64, limit;
+  afs_uint32 i;
+  int d;
+
+  nunits = next_unit = 0;
+  mk64(sum, 0, 0);
+  mk64(limit, 0, UNIT_SIZE);
+  for (d = 0; d < ndumps; d++) {
+    D = &dumps[d];
+    if (D->V != V) continue;
+    add64_32(tmp64, V->files, D->nranges);
+    cp64(V->files, tmp64);
+    for (i = 0; i < D->nranges; i++) {
+      if (nunits && units[nunits - 1].D == D && lt64(sum, limit)) {
+        units[nunits - 1].count++;
+      } else {
+        if (nunits == maxunits) {
+          maxunits = maxunits ? maxunits * 2 : 256;
+          U = realloc(units, maxunits * sizeof(struct unit));
+          if (!U) return ENOMEM;
+          units = U;
+        }
+        U = &units[nunits++];
+        U->D = D;
+        U->first = i;
+        U->count = 1;
+        mk64(sum, 0, 0);
+      }
+      add64_64(tmp64, sum, D->ranges[i].size);
+      cp64(sum, tmp64);
+    }
+  }
+  return 0;
+}
+
+
+/* Convert a 64-bit count for arithmetic */
+static double dbl(u_int64 *x)
+{
+  return hi64(*x) * 4294967296.0 + lo64(*x);
+}
+
+
+/* Format a fraction of a total as a percentage */
+static char *percent(double part, double total, char *buf)
+{
+  sprintf(buf, "%5.1f%%", total > 0 ? 100.0 * part / total : 0.0);
+  return buf;
+}
+
+
+/* Print the report */
+static void print_report(double secs)
+{
+  struct volume *V;
+  u_int64 bytes, unique, new, files, chunks, tmp64;
+  char b1[21], b2[21], b3[21], b4[21];
+  double ratio;
+  int i;
+
+  mk64(bytes, 0, 0);
+  mk64(unique, 0, 0);
+  mk64(files, 0, 0);
+  mk64(chunks, 0, 0);
+  printf("     VolID Name                     Dumps    Files"
+         "            Bytes           Unique              New  Dedup\n");
+  for (i = 0; i < nvolumes; i++) {
+    V = &volumes[i];
+    sub64_64(new, V->unique, V->shared);
+    ratio = zero64(V->unique) ? 1.0 : dbl(&V->bytes) / dbl(&V->unique);
+    printf("%10u %-24s %5d %8s %16s %16s %16s %5.2fx\n",
+           V->volid, V->name ? V->name : "?", V->ndumps,
+           decimate_int64(&V->files, b4), decimate_int64(&V->bytes, b1),
+           decimate_int64(&V->unique, b2), decimate_int64(&new, b3), ratio);
+    add64_64(tmp64, files, V->files);
+    cp64(files, tmp64);
+    add64_64(tmp64, chunks, V->chunks);
+    cp64(chunks, tmp64);
+    add64_64(tmp64, bytes, V->bytes);
+    cp64(bytes, tmp64);
+    add64_64(tmp64, unique, new);
+    cp64(unique, tmp64);
+  }
+
+  sub64_64(tmp64, bytes, unique);
+  ratio = zero64(unique) ? 1.0 : dbl(&bytes) / dbl(&unique);
+  printf("\n");
+  printf("Volumes:       %d in %d dumps, %s files\n", nvolumes, ndumps,
+         decimate_int64(&files, b1));
+  printf("File data:     %s bytes in %s chunks (%.0f bytes average)\n",
+         decimate_int64(&bytes, b1), decimate_int64(&chunks, b2),
+         zero64(chunks) ? 0.0 : dbl(&bytes) / dbl(&chunks));
+  printf("Unique data:   %s bytes\n", decimate_int64(&unique, b1));
+  printf("Duplicate:     %s bytes (%s)\n", decimate_int64(&tmp64, b1),
+         percent(dbl(&tmp64), dbl(&bytes), b2));
+  printf("Dedup ratio:   %.2fx\n", ratio);
+  printf("Throughput:    %.1f MB/s with %d thread%s\n",
+         secs > 0 ? dbl(&bytes) / secs / 1048576.0 : 0.0,
+         nthreads, nthreads == 1 ? "" : "s");
+}
+
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv)
+{
+  struct worker *workers;
+  unsigned char hash[SHA256_LEN];
+  sha256_ctx ctx;
+  afs_uint32 r;
+  double start;
+  int i, v;
+
+  parse_options(argc, argv);
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+
+  for (i = 0; i < ndumps; i++) {
+    if (r = scan_dump(&dumps[i])) {
+      afs_com_err(argv0, r, "scanning %s", dumps[i].path);
+      exit(1);
+    }
+  }
+  if (error_count)
+    fprintf(stderr, "%s: %u errors in dumps%s\n", argv0, error_count,
+            verbose ? "" : " (use -v to see them)");
+
+  /* The first use of Sha256 picks an implementation; do it before
+   * there are threads to race over it.
+   */
+  Sha256_Init(&ctx);
+  Sha256_Final(&ctx, hash);
+  init_gear();
+
+  table_size = MIN_TABLE;
+  table = calloc(table_size, sizeof(struct fp_ent));
+  workers = calloc(nthreads, sizeof(struct worker));
+  if (!table || !workers) {
+    fprintf(stderr, "%s: out of memory!\n", argv0);
+    exit(2);
+  }
+  for (i = 0; i < nthreads; i++) {
+    if (!(workers[i].buf = malloc(buf_size))) {
+      fprintf(stderr, "%s: out of memory!\n", argv0);
+      exit(2);
+    }
+  }
+
+  start = now();
+  for (v = 0; v < nvolumes; v++) {
+    cur_vol = &volumes[v];
+    cur_volnum = v + 1;
+    if (r = make_units(cur_vol)) {
+      afs_com_err(argv0, r, "dividing work");
+      exit(2);
+    }
+    for (i = 0; i < nthreads; i++) {
+      if (r = pthread_create(&workers[i].thread, 0, worker_main, &workers[i])) {
+        afs_com_err(argv0, r, "starting threads");
+        exit(2);
+      }
+    }
+    for (i = 0; i < nthreads; i++)
+      pthread_join(workers[i].thread, 0);
+  }
+
+  print_report(now() - start);
+  exit(work_errors ? 1 : 0);
+}
@@ -0,0 +1,520 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_diff.c - Show what changed in a volume between two dumps
+ *
+ * Both dumps are parsed once, keeping the attributes of each vnode and
+ * the name it has in its parent directory, in tables indexed by vnode
+ * number.  Then each vnode is classified:
+ *
+ *   added      in the new dump only, or reused with a new uniquifier
+ *   removed    in the old dump only, or reused with a new uniquifier
+ *   renamed    in a different directory, or under a different name
+ *   metadata   owner, group, mode, dates, link count or ACL changed
+ *   data       contents changed
+ *
+ * A vnode may be renamed and changed at once.  Directory contents are
+ * not compared as such; the changes to them are the adds, removes and
+ * renames of their entries.
+ *
+ * File data is read only when the attributes don't settle the matter:
+ * if the sizes differ the data has changed, and if the size, data
+ * version and server modification time are all the same it hasn't.
+ * Otherwise the data in the two dumps is compared.  If one dump isn't
+ * seekable this can't be done, and a file is taken to have changed if
+ * its data version has.
+ *
+ * This is meant for full dumps (or clones) of one volume.  Vnodes
+ * missing from an incremental dump would appear to have been removed.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+
+extern int optind;
+extern char *optarg;
+
+#define ACL_SIZE   (SIZEOF_LARGEDISKVNODE - SIZEOF_SMALLDISKVNODE)
+#define CMP_BUFSIZE 65536
+#define MAX_DEPTH  256
+
+/* What we know about a vnode in one dump */
+struct vrec {
+  afs_uint32 field_mask;       /* 0 if the vnode isn't in the dump */
+  afs_uint32 vuniq;
+  int type;
+  afs_uint16 nlinks;
+  afs_uint16 mode;
+  afs_uint32 datavers;
+  afs_uint32 author;
+  afs_uint32 owner;
+  afs_uint32 group;
+  afs_uint32 client_date;
+  afs_uint32 server_date;
+  u_int64 size;
+  u_int64 d_offset;
+  char *link_target;
+  unsigned char *acl;          /* directories only */
+
+  /* Where the vnode appears in a directory, if it does */
+  char *name;
+  afs_uint32 dparent;
+  afs_uint32 duniq;
+};
+
+/* One of the two dumps */
+struct dump {
+  char *path;
+  XFILE X;
+  int seekable;
+  afs_uint32 volid;
+  char *volname;
+  struct vrec *vnodes;
+  afs_uint32 nvnodes;          /* size of vnodes[] */
+};
+
+char *argv0;
+static int summary_only, show_vnodes, verbose;
+static afs_uint32 error_count;
+static struct dump old, new;
+
+/* Results */
+static afs_uint32 n_added, n_removed, n_renamed, n_meta, n_data, n_same;
+static afs_uint32 n_compared, n_unverified;
+static u_int64 bytes_compared;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] old-dump new-dump\n", argv0);
+  fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -i     Show vnode numbers and uniquifiers\n");
+  fprintf(stderr, "  -s     Print only a summary of the changes\n");
+  fprintf(stderr, "  -v     Verbose mode (print errors in the dumps)\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  summary_only = show_vnodes = verbose = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "hisv")) != EOF) {
+    switch (c) {
+      case 'i': show_vnodes  = 1;                         continue;
+      case 's': summary_only = 1;                         continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (argc - optind != 2) usage(1, "Two dumps are required");
+  old.path = argv[optind];
+  new.path = argv[optind + 1];
+}
+
+
+/* A callback to count and maybe print errors */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  error_count++;
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/* Find the record for a vnode, making room for it if needed */
+static afs_uint32 get_vrec(struct dump *D, afs_uint32 vnode, struct vrec **V)
+{
+  afs_uint32 r;
+
+  r = GrowVnodeArray((void **)&D->vnodes, &D->nvnodes, sizeof(struct vrec),
+                     vnode);
+  if (r) return r;
+  *V = &D->vnodes[vnode];
+  return 0;
+}
+
+
+static afs_uint32 dumphdr_cb(afs_dump_header *hdr, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+
+  D->volid = hdr->volid;
+  if ((hdr->field_mask & F_DUMPHDR_VOLNAME) && !D->volname)
+    D->volname = strdup((char *)hdr->volname);
+  return 0;
+}
+
+
+/* Remember a vnode's attributes */
+static afs_uint32 vnode_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+  struct vrec *V;
+  afs_uint32 r;
+
+  if (r = get_vrec(D, v->vnode, &V)) return r;
+  V->field_mask  = v->field_mask;
+  V->vuniq       = v->vuniq;
+  V->type        = v->type;
+  V->nlinks      = v->nlinks;
+  V->mode        = v->mode;
+  V->datavers    = v->datavers;
+  V->author      = v->author;
+  V->owner       = v->owner;
+  V->group       = v->group;
+  V->client_date = v->client_date;
+  V->server_date = v->server_date;
+  cp64(V->size, v->size);
+  cp64(V->d_offset, v->d_offset);
+
+  if (V->link_target) free(V->link_target);
+  V->link_target = 0;
+  if (v->field_mask & F_VNODE_LINK_TARGET) {
+    if (!(V->link_target = strdup(v->link_target))) return ENOMEM;
+  }
+  if (v->type == vDirectory && (v->field_mask & F_VNODE_ACL)) {
+    if (!V->acl && !(V->acl = malloc(ACL_SIZE))) return ENOMEM;
+    memcpy(V->acl, v->acl, ACL_SIZE);
+  }
+  return 0;
+}
+
+
+/* Remember the name of each directory entry.  A file with several
+ * links gets the name that sorts first, so the choice doesn't depend
+ * on the order of the dump.
+ */
+static afs_uint32 dirent_cb(afs_vnode *v, afs_dir_entry *de, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+  struct vrec *V;
+  afs_uint32 r;
+
+  if (!strcmp(de->name, ".") || !strcmp(de->name, "..")) return 0;
+  if (r = get_vrec(D, de->vnode, &V)) return r;
+  if (V->name && V->duniq == de->uniq
+  &&  (V->dparent < v->vnode
+       || (V->dparent == v->vnode && strcmp(V->name, de->name) <= 0)))
+    return 0;
+  if (V->name) free(V->name);
+  if (!(V->name = strdup(de->name))) return ENOMEM;
+  V->dparent = v->vnode;
+  V->duniq = de->uniq;
+  return 0;
+}
+
+
+/* Parse a dump, leaving it open so file data can be compared later */
+static afs_uint32 scan_dump(struct dump *D)
+{
+  dump_parser dp;
+  afs_uint32 r;
+
+  if (r = xfopen(&D->X, O_RDONLY, D->path)) return r;
+  D->seekable = D->X.is_seekable;
+
+  memset(&dp, 0, sizeof(dp));
+  dp.refcon         = D;
+  dp.cb_error       = my_error_cb;
+  dp.cb_dumphdr     = dumphdr_cb;
+  dp.cb_vnode_dir   = vnode_cb;
+  dp.cb_vnode_file  = vnode_cb;
+  dp.cb_vnode_link  = vnode_cb;
+  dp.cb_vnode_wierd = vnode_cb;
+  dp.cb_dirent      = dirent_cb;
+  if (D->seekable) dp.flags = DSFLAG_SEEK;
+  return ParseDumpFile(&D->X, &dp);
+}
+
+
+/* Build the path of a vnode from the names of it and its parents */
+static char *vnode_path(struct dump *D, afs_uint32 vnode, char *buf, int size)
+{
+  char *names[MAX_DEPTH];
+  struct vrec *V;
+  int depth = 0, len = 0, n;
+
+  while (vnode != 1) {
+    V = (vnode < D->nvnodes) ? &D->vnodes[vnode] : 0;
+    if (!V || !V->name || V->duniq != V->vuniq || depth == MAX_DEPTH) {
+      /* Not reachable from the root */
+      snprintf(buf, size, "?%u", vnode);
+      len = strlen(buf);
+      break;
+    }
+    names[depth++] = V->name;
+    vnode = V->dparent;
+  }
+  if (!depth && !len) snprintf(buf, size, "/");
+  while (depth--) {
+    n = snprintf(buf + len, size - len, "/%s", names[depth]);
+    if (n >= size - len) break;
+    len += n;
+  }
+  return buf;
+}
+
+
+/* Print one change */
+static void report(char *what, struct dump *D, afs_uint32 vnode,
+                   struct dump *D2, char *detail)
+{
+  char path[1024], path2[1024];
+  struct vrec *V = &D->vnodes[vnode];
+
+  if (summary_only) return;
+  printf("%-9s ", what);
+  if (show_vnodes) printf("%10u.%-10u ", vnode, V->vuniq);
+  printf("%s", vnode_path(D, vnode, path, sizeof(path)));
+  if (D2) printf(" -> %s", vnode_path(D2, vnode, path2, sizeof(path2)));
+  if (detail) printf("  [%s]", detail);
+  printf("\n");
+}
+
+
+/* Compare the data of a file in the two dumps */
+static afs_uint32 compare_data(struct vrec *A, struct vrec *B, int *same)
+{
+  static char *buf_a, *buf_b;
+  u_int64 left, off_a, off_b, tmp64;
+  afs_uint32 r, n;
+
+  if (!buf_a && !(buf_a = malloc(CMP_BUFSIZE))) return ENOMEM;
+  if (!buf_b && !(buf_b = malloc(CMP_BUFSIZE))) return ENOMEM;
+
+  *same = 1;
+  n_compared++;
+  cp64(left, A->size);
+  cp64(off_a, A->d_offset);
+  cp64(off_b, B->d_offset);
+  while (!zero64(left)) {
+    n = (hi64(left) || lo64(left) > CMP_BUFSIZE) ? CMP_BUFSIZE : lo64(left);
+    if ((r = xfseek(&old.X, &off_a))
+    ||  (r = xfread(&old.X, buf_a, n))
+    ||  (r = xfseek(&new.X, &off_b))
+    ||  (r = xfread(&new.X, buf_b, n)))
+      return r;
+    add64_32(tmp64, bytes_compared, n);
+    cp64(bytes_compared, tmp64);
+    if (memcmp(buf_a, buf_b, n)) {
+      *same = 0;
+      return 0;
+    }
+    add64_32(tmp64, off_a, n);
+    cp64(off_a, tmp64);
+    add64_32(tmp64, off_b, n);
+    cp64(off_b, tmp64);
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  return 0;
+}
+
+
+/* Decide whether a vnode's contents changed */
+static afs_uint32 data_changed(struct vrec *A, struct vrec *B, int *changed)
+{
+  afs_uint32 r;
+  int same;
+
+  *changed = 0;
+  switch (A->type) {
+    case vSymlink:
+      if (!A->link_target || !B->link_target)
+        *changed = (A->link_target != B->link_target);
+      else
+        *changed = strcmp(A->link_target, B->link_target) != 0;
+      return 0;
+
+    case vFile:
+      if (ne64(A->size, B->size)) *changed = 1;
+      else if (zero64(A->size)) *changed = 0;
+      else if (A->datavers == B->datavers && A->server_date == B->server_date)
+        *changed = 0;
+      else if (!old.seekable || !new.seekable) {
+        n_unverified++;
+        *changed = (A->datavers != B->datavers);
+      } else {
+        if (r = compare_data(A, B, &same)) return r;
+        *changed = !same;
+      }
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+
+/* List the attributes (other than the contents) that changed */
+static int metadata_changed(struct vrec *A, struct vrec *B, char *buf)
+{
+  *buf = 0;
+  if (A->type        != B->type)        strcat(buf, " type");
+  if (A->mode        != B->mode)        strcat(buf, " mode");
+  if (A->owner       != B->owner)       strcat(buf, " owner");
+  if (A->group       != B->group)       strcat(buf, " group");
+  if (A->author      != B->author)      strcat(buf, " author");
+  if (A->nlinks      != B->nlinks)      strcat(buf, " links");
+  if (A->client_date != B->client_date) strcat(buf, " mtime");
+  if ((A->acl || B->acl)
+  &&  (!A->acl || !B->acl || memcmp(A->acl, B->acl, ACL_SIZE)))
+    strcat(buf, " acl");
+  return *buf != 0;
+}
+
+
+/* Classify every vnode in either dump */
+static afs_uint32 diff_dumps(void)
+{
+  struct vrec *A, *B;
+  afs_uint32 vnode, max, r;
+  char detail[64];
+  int changed, renamed, data;
+
+  max = (old.nvnodes > new.nvnodes) ? old.nvnodes : new.nvnodes;
+  for (vnode = 0; vnode < max; vnode++) {
+    A = (vnode < old.nvnodes && old.vnodes[vnode].field_mask)
+      ? &old.vnodes[vnode] : 0;
+    B = (vnode < new.nvnodes && new.vnodes[vnode].field_mask)
+      ? &new.vnodes[vnode] : 0;
+    if (!A && !B) continue;
+
+    if (A && (!B || A->vuniq != B->vuniq)) {
+      report("removed", &old, vnode, 0, 0);
+      n_removed++;
+    }
+    if (B && (!A || A->vuniq != B->vuniq)) {
+      report("added", &new, vnode, 0, 0);
+      n_added++;
+    }
+    if (!A || !B || A->vuniq != B->vuniq) continue;
+
+    changed = 0;
+    renamed = (A->name && A->duniq == A->vuniq)
+           && (B->name && B->duniq == B->vuniq)
+           && (A->dparent != B->dparent || strcmp(A->name, B->name));
+    if (renamed) {
+      report("renamed", &old, vnode, &new, 0);
+      n_renamed++;
+      changed = 1;
+    }
+    if (metadata_changed(A, B, detail)) {
+      report("metadata", &new, vnode, 0, detail + 1);
+      n_meta++;
+      changed = 1;
+    }
+    if (r = data_changed(A, B, &data)) {
+      afs_com_err(argv0, r, "comparing vnode %u", vnode);
+      return r;
+    }
+    if (data) {
+      report("data", &new, vnode, 0, 0);
+      n_data++;
+      changed = 1;
+    }
+    if (!changed) n_same++;
+  }
+  return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  afs_uint32 r;
+  char buf[21];
+
+  parse_options(argc, argv);
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+
+  if (r = scan_dump(&old)) {
+    afs_com_err(argv0, r, "parsing %s", old.path);
+    exit(2);
+  }
+  if (r = scan_dump(&new)) {
+    afs_com_err(argv0, r, "parsing %s", new.path);
+    exit(2);
+  }
+  if (error_count)
+    fprintf(stderr, "%s: %u errors in dumps%s\n", argv0, error_count,
+            verbose ? "" : " (use -v to see them)");
+  if (old.volid != new.volid && !summary_only)
+    printf("# comparing volume %u (%s) with volume %u (%s)\n",
+           old.volid, old.volname ? old.volname : "?",
+           new.volid, new.volname ? new.volname : "?");
+
+  if (r = diff_dumps()) exit(2);
+
+  if (summary_only || verbose) {
+    printf("%u added, %u removed, %u renamed, "
+           "%u metadata changed, %u data changed, %u unchanged\n",
+           n_added, n_removed, n_renamed, n_meta, n_data, n_same);
+    printf("%u files compared (%s bytes)", n_compared,
+           decimate_int64(&bytes_compared, buf));
+    if (n_unverified)
+      printf(", %u judged by data version only", n_unverified);
+    printf("\n");
+  }
+  xfclose(&old.X);
+  xfclose(&new.X);
+  exit((n_added || n_removed || n_renamed || n_meta || n_data) ? 1 : 0);
+}
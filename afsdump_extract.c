@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <fnmatch.h>
 
 #include <afs/stds.h>
 #include <afs/com_err.h>
@@ -57,13 +58,51 @@ static char **file_names;
 static afs_uint32 *file_vnums;
 static int name_count, vnum_count;
 
-static char *input_path, *target;
+static char *input_path, *target, *trace_path, *manifest_path;
 static int quiet, verbose, error_count, dirs_done, extract_all;
 static int nomode, use_realpath, use_vnum;
-static int do_acls, do_headers;
+static int do_acls, do_headers, progress_mb;
 
 static path_hashinfo phi;
 static dump_parser dp;
+static XFILE manifest;
+
+
+/* Requested pathnames are compiled into a tree of path components, so
+ * each vnode path can be checked against all of them in a single walk.
+ * A node matches one component, either literally or as an fnmatch(3)
+ * pattern.  Literal children are kept sorted, so they can be found by
+ * binary search.  A node is terminal if some requested path ends there,
+ * in which case everything below it is wanted as well.
+ */
+typedef struct pm_node {
+  char *name;                  /* Component name or pattern */
+  int terminal;                /* Set if a requested path ends here */
+  int n_lit, n_glob;           /* Number of children of each kind */
+  struct pm_node **lit;        /* Literal children, sorted by name */
+  struct pm_node **glob;       /* Pattern children */
+} pm_node;
+
+/* The matcher state after consuming some path is the set of nodes
+ * reached.  Two special states need no set: pm_all means everything
+ * from here down is wanted, and pm_dead means nothing is.
+ */
+typedef struct {
+  int count;
+  pm_node *nodes[1];
+} pm_state;
+
+static pm_node pm_root;
+static pm_state pm_all, pm_dead;
+static pm_state *pm_start;
+
+/* The matcher state of each directory whose path has been built,
+ * indexed by (vnode >> 1).  Directory vnodes come before file vnodes
+ * in a dump, so this lets us rule out whole subtrees without building
+ * the pathnames of anything inside them.
+ */
+static pm_state **pm_dirstate;
+static afs_uint32 pm_dirstate_size;
 
 /* Print a usage message and exit */
 static void usage(int status, char *msg)
@@ -73,21 +112,217 @@ static void usage(int status, char *msg)
   fprintf(stderr, "  -A     Save ACL's\n");
   fprintf(stderr, "  -H     Save headers\n");
   fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -In    Report progress every n megabytes\n");
   fprintf(stderr, "  -i     Use vnode numbers\n");
+  fprintf(stderr, "  -Mxxx  Write a manifest of vnode data hashes to file xxx\n");
   fprintf(stderr, "  -n     Don't actually create files\n");
   fprintf(stderr, "  -p     Use real pathnames internally\n");
   fprintf(stderr, "  -q     Quiet mode (don't print errors)\n");
+  fprintf(stderr, "  -Txxx  Write a timeline of the extraction to file xxx\n");
   fprintf(stderr, "  -v     Verbose mode\n");
   fprintf(stderr, "The destination directory defaults to .\n");
   fprintf(stderr, "Files may be vnode numbers or volume-relative paths;\n");
   fprintf(stderr, "If vnode numbers are used, files will be extracted\n");
   fprintf(stderr, "a name generated from the vnode number and uniqifier.\n");
   fprintf(stderr, "If paths are used, -p is implied and files will be\n");
-  fprintf(stderr, "into correctly-named files.\n");
+  fprintf(stderr, "into correctly-named files.  Path components may\n");
+  fprintf(stderr, "be shell-style patterns (quote them from the shell).\n");
   exit(status);
 }
 
 
+static int vnum_cmp(const void *a, const void *b)
+{
+  afs_uint32 x = *(afs_uint32 *)a, y = *(afs_uint32 *)b;
+
+  return (x < y) ? -1 : (x > y);
+}
+
+
+/* Find the literal child of a node with the given name.
+ * Returns its index, or -(insertion point) - 1 if there is none.
+ */
+static int pm_find(pm_node *node, char *name, int len)
+{
+  int lo = 0, hi = node->n_lit - 1, mid, c;
+
+  while (lo <= hi) {
+    mid = (lo + hi) / 2;
+    c = strncmp(node->lit[mid]->name, name, len);
+    if (!c && node->lit[mid]->name[len]) c = 1;
+    if (!c) return mid;
+    if (c < 0) lo = mid + 1;
+    else       hi = mid - 1;
+  }
+  return -lo - 1;
+}
+
+
+/* Add a requested pathname to the matcher.  Returns 0 or ENOMEM */
+static int pm_add(char *path)
+{
+  pm_node *node = &pm_root, *child, ***list;
+  pm_node **children;
+  char *x;
+  int len, i, is_glob, *count;
+
+  for (;;) {
+    while (*path == '/') path++;
+    if (!*path) break;
+    for (x = path; *x && *x != '/'; x++);
+    len = x - path;
+    if (len == 1 && path[0] == '.') {
+      path = x;
+      continue;
+    }
+
+    for (is_glob = 0, i = 0; i < len; i++)
+      if (strchr("*?[\\", path[i])) is_glob = 1;
+
+    child = 0;
+    if (is_glob) {
+      for (i = 0; i < node->n_glob; i++)
+        if (!strncmp(node->glob[i]->name, path, len)
+        &&  !node->glob[i]->name[len]) child = node->glob[i];
+      list = &node->glob;
+      count = &node->n_glob;
+      i = node->n_glob;
+    } else {
+      i = pm_find(node, path, len);
+      if (i >= 0) child = node->lit[i];
+      else i = -i - 1;
+      list = &node->lit;
+      count = &node->n_lit;
+    }
+
+    if (!child) {
+      if (!(child = (pm_node *)malloc(sizeof(pm_node)))) return ENOMEM;
+      memset(child, 0, sizeof(pm_node));
+      if (!(child->name = (char *)malloc(len + 1))) return ENOMEM;
+      memcpy(child->name, path, len);
+      child->name[len] = 0;
+      children = (pm_node **)realloc(*list, (*count + 1) * sizeof(pm_node *));
+      if (!children) return ENOMEM;
+      memmove(children + i + 1, children + i, (*count - i) * sizeof(pm_node *));
+      children[i] = child;
+      *list = children;
+      (*count)++;
+    }
+    node = child;
+    path = x;
+  }
+  node->terminal = 1;
+  return 0;
+}
+
+
+/* Advance the matcher by one path component.
+ * Returns the new state, or 0 if out of memory.
+ */
+static pm_state *pm_step(pm_state *s, char *name, int len)
+{
+  pm_state *ns;
+  pm_node *node, *child;
+  char save;
+  int i, j, k, max;
+
+  if (s == &pm_all || s == &pm_dead) return s;
+  if (len == 1 && name[0] == '.') return s;
+
+  for (max = i = 0; i < s->count; i++)
+    max += 1 + s->nodes[i]->n_glob;
+  ns = (pm_state *)malloc(sizeof(pm_state) + max * sizeof(pm_node *));
+  if (!ns) return 0;
+  ns->count = 0;
+
+  save = name[len];
+  name[len] = 0;
+  for (i = 0; i < s->count; i++) {
+    node = s->nodes[i];
+    if ((j = pm_find(node, name, len)) >= 0)
+      ns->nodes[ns->count++] = node->lit[j];
+    for (j = 0; j < node->n_glob; j++)
+      if (!fnmatch(node->glob[j]->name, name, 0))
+        ns->nodes[ns->count++] = node->glob[j];
+  }
+  name[len] = save;
+
+  /* Drop duplicates, and see whether anything terminal was reached */
+  for (i = 0; i < ns->count; i++) {
+    child = ns->nodes[i];
+    if (child->terminal) {
+      free(ns);
+      return &pm_all;
+    }
+    for (j = k = i + 1; j < ns->count; j++)
+      if (ns->nodes[j] != child) ns->nodes[k++] = ns->nodes[j];
+    ns->count = k;
+  }
+  if (!ns->count) {
+    free(ns);
+    return &pm_dead;
+  }
+  return ns;
+}
+
+
+static void pm_free(pm_state *s)
+{
+  if (s && s != &pm_all && s != &pm_dead && s != pm_start) free(s);
+}
+
+
+/* Run the matcher over the components of path, starting from state s.
+ * Returns the resulting state, or 0 if out of memory.
+ */
+static pm_state *pm_walk(pm_state *s, char *path)
+{
+  pm_state *ns, *start = s;
+  char *x;
+
+  for (;;) {
+    while (*path == '/') path++;
+    if (!*path || s == &pm_all || s == &pm_dead) return s;
+    for (x = path; *x && *x != '/'; x++);
+    ns = pm_step(s, path, x - path);
+    if (s != start && s != ns) pm_free(s);
+    if (!ns) return 0;
+    s = ns;
+    path = x;
+  }
+}
+
+
+/* Remember the matcher state for a directory vnode */
+static int pm_setdir(afs_uint32 vnode, pm_state *s)
+{
+  pm_state **tab;
+  afs_uint32 i = vnode >> 1, size;
+
+  if (i >= pm_dirstate_size) {
+    for (size = pm_dirstate_size ? pm_dirstate_size : 1024;
+         size <= i; size <<= 1);
+    tab = (pm_state **)realloc(pm_dirstate, size * sizeof(pm_state *));
+    if (!tab) return ENOMEM;
+    memset(tab + pm_dirstate_size, 0,
+           (size - pm_dirstate_size) * sizeof(pm_state *));
+    pm_dirstate = tab;
+    pm_dirstate_size = size;
+  }
+  pm_free(pm_dirstate[i]);
+  pm_dirstate[i] = s;
+  return 0;
+}
+
+
+static pm_state *pm_getdir(afs_uint32 vnode)
+{
+  if (vnode == 1) return pm_start;
+  if ((vnode >> 1) >= pm_dirstate_size) return 0;
+  return pm_dirstate[vnode >> 1];
+}
+
+
 /* Parse the command-line options */
 static void parse_options(int argc, char **argv)
 {
@@ -98,22 +333,26 @@ static void parse_options(int argc, char **argv)
   else argv0 = argv[0];
 
   /* Initialize options */
-  input_path = 0;
+  input_path = trace_path = manifest_path = 0;
   quiet = verbose = nomode = 0;
   use_realpath = use_vnum = do_acls = do_headers = extract_all = 0;
+  progress_mb = 0;
 
   /* Initialize other stuff */
   error_count = 0;
 
   /* Parse the options */
-  while ((c = getopt(argc, argv, "AHhinpqv")) != EOF) {
+  while ((c = getopt(argc, argv, "AHI:M:T:hinpqv")) != EOF) {
     switch (c) {
       case 'A': do_acls      = 1;                         continue;
       case 'H': do_headers   = 1;                         continue;
+      case 'I': progress_mb  = atoi(optarg);              continue;
       case 'i': use_vnum     = 1;                         continue;
+      case 'M': manifest_path = optarg;                   continue;
       case 'n': nomode       = 1;                         continue;
       case 'p': use_realpath = 1;                         continue;
       case 'q': quiet        = 1;                         continue;
+      case 'T': trace_path   = optarg;                    continue;
       case 'v': verbose      = 1;                         continue;
       case 'h': usage(0, 0);                              exit(0);
       default:  usage(1, "Invalid option!");
@@ -121,6 +360,8 @@ static void parse_options(int argc, char **argv)
   }
 
   if (quiet && verbose) usage(1, "Can't specify both -q and -v");
+  if (progress_mb < 0 || progress_mb >= 4096)
+    usage(1, "Progress interval must be less than 4096 MB");
 
   /* Parse non-option arguments */
   if (argc - optind < 1) usage(1, "Dumpfile name required!");
@@ -140,6 +381,10 @@ static void parse_options(int argc, char **argv)
     }
     file_names = (char **)malloc((name_count + 1) * sizeof(char *));
     file_vnums = (afs_uint32 *)malloc((vnum_count + 1) * sizeof(afs_uint32));
+    if (!file_names || !file_vnums) {
+      fprintf(stderr, "%s: out of memory!\n", argv0);
+      exit(1);
+    }
     if (name_count) use_realpath = 1;
 
     i_name = i_vnum = 0;
@@ -149,6 +394,13 @@ static void parse_options(int argc, char **argv)
     }
     file_names[i_name] = 0;
     file_vnums[i_vnum] = 0;
+    qsort(file_vnums, vnum_count, sizeof(afs_uint32), vnum_cmp);
+    for (i = 0; i < name_count; i++) {
+      if (pm_add(file_names[i])) {
+        fprintf(stderr, "%s: out of memory!\n", argv0);
+        exit(1);
+      }
+    }
   }
 }
 
@@ -222,38 +474,48 @@ static char *datestr(time_t date)
 
 
 /* Should we use this vnode?
- * Return 0 if no, non-0 if yes
+ * Return 0 if no, 1 if selected by path, 2 if selected by vnode number.
+ * The vnode's path is built only if it might be needed; if so, it is
+ * returned in *vnodepath, which the caller must free.
  */
-static int usevnode(XFILE *X, afs_uint32 vnum, char *vnodepath)
+static afs_uint32 usevnode(XFILE *X, afs_vnode *v, char **vnodepath, int *use)
 {
-  int vl, vpl, r, i;
-
-  if (extract_all) return 1;
-
-  for (i = 0; i < vnum_count; i++)
-    if (vnum == file_vnums[i]) return 2;
-
-  if (!vnodepath) return 0;
+  pm_state *s, *ps = 0;
+  afs_uint32 r;
+  char *x;
+  int isdir = (v->field_mask & F_VNODE_TYPE) && v->type == vDirectory;
+
+  *vnodepath = 0;
+  *use = 0;
+  if (extract_all) *use = 1;
+  else if (vnum_count && bsearch(&v->vnode, file_vnums, vnum_count,
+                                 sizeof(afs_uint32), vnum_cmp))
+    *use = 2;
+  else if (!name_count && v->vnode != 1) return 0;
+
+  /* If the parent is known not to match, neither does this vnode */
+  if (!*use && v->vnode != 1 && (v->field_mask & F_VNODE_PARENT)) {
+    ps = pm_getdir(v->parent);
+    if (ps == &pm_dead) {
+      if (isdir) return pm_setdir(v->vnode, &pm_dead);
+      return 0;
+    }
+  }
 
-  /* Special case */
-  if (!strcmp(vnodepath, "/"))
-    return 1;
+  if (use_vnum) return 0;
+  if (r = Path_Build(X, &phi, v->vnode, vnodepath, !use_realpath))
+    return r;
+  if (*use) return 0;
 
-  vl = strlen(vnodepath);
-/*fprintf(stderr, "++ checking %s\n", vnodepath);*/
-  for (i = 0; i < name_count; i++) {
-    vpl = strlen(file_names[i]);
-/*  fprintf(stderr, "   %s\n", file_names[i]);*/
+  /* Match the path, starting from the parent's state if we have it */
+  if (v->vnode == 1) s = pm_start;
+  else if (ps && (x = strrchr(*vnodepath, '/'))) s = pm_walk(ps, x);
+  else s = pm_walk(pm_start, *vnodepath);
+  if (!s) return ENOMEM;
 
-    if (vl > vpl) {
-      r = !strncmp(file_names[i], vnodepath, vpl) && vnodepath[vpl] == '/';
-    } else if (vl < vpl) {
-      r = !strncmp(file_names[i], vnodepath, vl) && file_names[i][vl] == '/';
-    } else {
-      r = !strcmp(file_names[i], vnodepath);
-    }
-    if (r) return 1;
-  }
+  if (s != &pm_dead) *use = 1;
+  if (isdir) return pm_setdir(v->vnode, s);
+  pm_free(s);
   return 0;
 }
 
@@ -292,6 +554,14 @@ static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg,
 }
 
 
+/* A callback to report progress */
+static afs_uint32 progress_cb(dump_progress *P, void *refcon)
+{
+  PrintProgress(argv0, P);
+  return 0;
+}
+
+
 static afs_uint32 dumphdr_cb(afs_dump_header *hdr, XFILE *X, void *refcon)
 {
   return 0;
@@ -310,13 +580,12 @@ static afs_uint32 directory_cb(afs_vnode *v, XFILE *X, void *refcon)
   int r, use;
 
   /* Should we even use this? */
-  if (!use_vnum) {
-    if (r = Path_Build(X, &phi, v->vnode, &vnodepath, !use_realpath))
-      return r;
+  if (r = usevnode(X, v, &vnodepath, &use)) {
+    if (vnodepath) free(vnodepath);
+    return r;
   }
-
-  if (!(use = usevnode(X, v->vnode, vnodepath))) {
-    if (!use_vnum) free(vnodepath);
+  if (!use) {
+    if (vnodepath) free(vnodepath);
     return 0;
   }
 
@@ -363,21 +632,16 @@ static afs_uint32 file_cb(afs_vnode *v, XFILE *X, void *refcon)
   }
 
   /* Should we even use this? */
-  if (!use_vnum) {
-    if (r = Path_Build(X, &phi, v->vnode, &vnodepath, !use_realpath))
-      return r;
-    if (!(use = usevnode(X, v->vnode, vnodepath))) {
-      free(vnodepath);
-      return 0;
-    }
-    if (use == 2) {
-      free(vnodepath);
-      sprintf(vnpx, "#%d:%d", v->vnode, v->vuniq);
-      vnodepath = vnpx;
-    }
-  } else {
-    if (!(use = usevnode(X, v->vnode, 0)))
-      return 0;
+  if (r = usevnode(X, v, &vnodepath, &use)) {
+    if (vnodepath) free(vnodepath);
+    return r;
+  }
+  if (!use) {
+    if (vnodepath) free(vnodepath);
+    return 0;
+  }
+  if (use_vnum || use == 2) {
+    if (vnodepath) free(vnodepath);
     sprintf(vnpx, "#%d:%d", v->vnode, v->vuniq);
     vnodepath = vnpx;
   }
@@ -420,21 +684,16 @@ static afs_uint32 symlink_cb(afs_vnode *v, XFILE *X, void *refcon)
   }
 
   /* Should we even use this? */
-  if (!use_vnum) {
-    if (r = Path_Build(X, &phi, v->vnode, &vnodepath, !use_realpath))
-      return r;
-    if (!(use = usevnode(X, v->vnode, vnodepath))) {
-      free(vnodepath);
-      return 0;
-    }
-    if (use == 2) {
-      free(vnodepath);
-      sprintf(vnpx, "#%d:%d", v->vnode, v->vuniq);
-      vnodepath = vnpx;
-    }
-  } else {
-    if (!(use = usevnode(X, v->vnode, 0)))
-      return 0;
+  if (r = usevnode(X, v, &vnodepath, &use)) {
+    if (vnodepath) free(vnodepath);
+    return r;
+  }
+  if (!use) {
+    if (vnodepath) free(vnodepath);
+    return 0;
+  }
+  if (use_vnum || use == 2) {
+    if (vnodepath) free(vnodepath);
     sprintf(vnpx, "#%d:%d", v->vnode, v->vuniq);
     vnodepath = vnpx;
   }
@@ -488,7 +747,7 @@ static afs_uint32 lose_cb(afs_vnode *v, XFILE *F, void *refcon)
 int main(int argc, char **argv)
 {
   XFILE input_file;
-  afs_uint32 r;
+  afs_uint32 r, tr;
   int code = 0;
 
   parse_options(argc, argv);
@@ -508,8 +767,26 @@ int main(int argc, char **argv)
   memset(&dp, 0, sizeof(dp));
   dp.cb_error       = my_error_cb;
   if (input_file.is_seekable) dp.flags |= DSFLAG_SEEK;
+  if (progress_mb > 0) {
+    dp.cb_progress    = progress_cb;
+    dp.progress_bytes = (afs_uint32)progress_mb << 20;
+  }
+  if (trace_path && (r = xftrace_open(&dp.trace, trace_path, argv0))) {
+    afs_com_err(argv0, r, "opening trace file %s", trace_path);
+    xfclose(&input_file);
+    exit(2);
+  }
   dirs_done = 0;
 
+  if (pm_root.terminal) pm_start = &pm_all;
+  else if (pm_start = (pm_state *)malloc(sizeof(pm_state))) {
+    pm_start->count = 1;
+    pm_start->nodes[0] = &pm_root;
+  } else {
+    afs_com_err(argv0, ENOMEM, "- path matcher initialization failed");
+    exit(1);
+  }
+
   if (!use_vnum) {
     u_int64 where;
 
@@ -535,6 +812,17 @@ int main(int argc, char **argv)
     dp.cb_dumphdr   = dumphdr_cb;
     dp.cb_volhdr    = volhdr_cb;
   }
+  if (manifest_path) {
+    r = xfopen(&manifest, O_RDWR|O_CREAT|O_TRUNC, manifest_path);
+    if (!r) r = xfsetbuf(&manifest, XFBUFSIZE);
+    if (r) {
+      afs_com_err(argv0, r, "opening manifest %s", manifest_path);
+      xfclose(&input_file);
+      exit(2);
+    }
+    dp.flags |= DSFLAG_HASH;
+    dp.manifest = &manifest;
+  }
 
   if (!nomode) {
     mkdir(target, 0755);
@@ -544,6 +832,12 @@ int main(int argc, char **argv)
     }
   }
   r = ParseDumpFile(&input_file, &dp);
+  if (manifest_path) {
+    if (!r) r = xfclose(&manifest);
+    else xfclose(&manifest);
+  }
+  if (dp.trace && (tr = xftrace_close(dp.trace)))
+    afs_com_err(argv0, tr, "writing trace file %s", trace_path);
 
   if (verbose && error_count) fprintf(stderr, "*** %d errors\n", error_count);
   if (r && !quiet) fprintf(stderr, "*** FAILED: %s\n", afs_error_message(r));
@@ -0,0 +1,308 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_findname.c - Find the dumps that have a name
+ *
+ * For each dump, read the name filters written next to it by
+ * afsdump_scan -N, and print the dumps that may have an entry with
+ * the given name (or, with -p, the given path).  Only the filters are
+ * read, so this is fast even for many dumps; with -x, the dumps the
+ * filters can't rule out are then read to be sure.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+#include "xf_errs.h"
+
+#define NAMES_SUFFIX ".names"
+
+extern int optind;
+extern char *optarg;
+
+char *argv0;
+static char *name;
+static char **dump_paths;
+static int n_dumps, use_path, check, verbose;
+
+static int n_ruled_out, n_maybe, n_found, n_unknown;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] name dump...\n", argv0);
+  fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -p     The name is a full path in the volume\n");
+  fprintf(stderr, "  -v     Verbose mode (also list dumps ruled out)\n");
+  fprintf(stderr, "  -x     Read the dumps that may have the name, to be sure\n");
+  fprintf(stderr, "Each dump's filters are read from the dump's name followed by %s\n",
+          NAMES_SUFFIX);
+  fprintf(stderr, "(see afsdump_scan -N).  Dumps without them are read if -x is\n");
+  fprintf(stderr, "given, and otherwise listed as unknown.\n");
+  exit(status);
+}
+
+
+/* Put a path in the form used in the filters: "/a/b/c" */
+static char *normalize_path(char *path)
+{
+  char *result, *x;
+
+  if (!(result = (char *)malloc(strlen(path) + 2))) return 0;
+  for (x = result; *path; path++) {
+    if (*path == '/' && (x == result || x[-1] == '/')) continue;
+    if (x == result) *x++ = '/';
+    *x++ = *path;
+  }
+  if (x > result && x[-1] == '/') x--;
+  *x = 0;
+  return result;
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  use_path = check = verbose = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "hpvx")) != EOF) {
+    switch (c) {
+      case 'p': use_path     = 1;                         continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'x': check        = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (argc - optind < 2) usage(1, "Not enough arguments");
+  name = argv[optind++];
+  dump_paths = argv + optind;
+  n_dumps = argc - optind;
+
+  if (use_path) {
+    if (!(name = normalize_path(name))) {
+      fprintf(stderr, "%s: out of memory\n", argv0);
+      exit(2);
+    }
+    if (!*name) usage(1, "The root directory is in every dump");
+  } else if (!*name || strchr(name, '/'))
+    usage(1, "Invalid name (use -p for a path)");
+}
+
+
+/* A callback to print errors, but only in verbose mode */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/* A callback to check each directory entry for the name */
+static afs_uint32 dirent_cb(afs_vnode *v, afs_dir_entry *de,
+                            XFILE *X, void *refcon)
+{
+  int *found = (int *)refcon;
+
+  if (strcmp(de->name, name)) return 0;
+  *found = 1;
+  return DSERR_DONE;
+}
+
+
+/* A callback to stop at the first file or symlink vnode; directories
+ * come first in a dump, so by then we've seen every entry.  Header-only
+ * vnodes (unchanged directories, in an incremental dump) don't stop it.
+ */
+static afs_uint32 vnode_stop(afs_vnode *v, XFILE *X, void *refcon)
+{
+  return DSERR_DONE;
+}
+
+
+/* Read a dump to see whether it really has the name or path.
+ * Sets *found, and returns an error code.
+ */
+static afs_uint32 check_dump(char *dump_path, int *found)
+{
+  XFILE X;
+  dump_parser dp;
+  path_hashinfo phi;
+  char *path;
+  afs_uint32 r;
+
+  *found = 0;
+  if (r = xfopen(&X, O_RDONLY, dump_path)) return r;
+
+  memset(&dp, 0, sizeof(dp));
+  dp.cb_error = my_error_cb;
+  if (X.is_seekable) dp.flags |= DSFLAG_SEEK;
+
+  if (use_path) {
+    if (!X.is_seekable) {
+      xfclose(&X);
+      return ERROR_XFILE_NOSEEK;
+    }
+    memset(&phi, 0, sizeof(phi));
+    phi.p = &dp;
+    r = Path_PreScan(&X, &phi, 0);
+    if (!r) {
+      /* Path_Follow wants a copy it can take apart */
+      if (!(path = strdup(name))) r = ENOMEM;
+      else {
+        if (!Path_Follow(&X, &phi, path, 0)) *found = 1;
+        free(path);
+      }
+    }
+    Path_FreeHashTable(&phi);
+  } else {
+    dp.refcon         = (void *)found;
+    dp.cb_dirent      = dirent_cb;
+    dp.cb_vnode_file  = vnode_stop;
+    dp.cb_vnode_link  = vnode_stop;
+    r = ParseDumpFile(&X, &dp);
+  }
+  xfclose(&X);
+  return r;
+}
+
+
+static char *datestr(time_t t)
+{
+  static char str[32];
+
+  strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  return str;
+}
+
+
+/* Look for the name in one dump */
+static void find_name(char *dump_path)
+{
+  name_filters NF;
+  name_filter *F;
+  char *names_path;
+  afs_uint32 r;
+  int found;
+
+  if (!(names_path = (char *)malloc(strlen(dump_path) + sizeof(NAMES_SUFFIX)))) {
+    fprintf(stderr, "%s: out of memory\n", argv0);
+    exit(2);
+  }
+  sprintf(names_path, "%s%s", dump_path, NAMES_SUFFIX);
+  r = Filter_Read(&NF, names_path);
+  if (r && r != ENOENT)
+    afs_com_err(argv0, r, "reading %s", names_path);
+  free(names_path);
+
+  if (r) {
+    if (!check) {
+      printf("?      %s (no name filters)\n", dump_path);
+      n_unknown++;
+      return;
+    }
+  } else {
+    F = use_path ? &NF.paths : &NF.names;
+    if (!Filter_Test(F, name)) {
+      if (verbose) printf("no     %s\n", dump_path);
+      n_ruled_out++;
+      Filter_Free(&NF);
+      return;
+    }
+    if (!check) {
+      printf("maybe  %s (%s, %s)\n", dump_path, NF.volname,
+             datestr(NF.to_date));
+      n_maybe++;
+      Filter_Free(&NF);
+      return;
+    }
+    Filter_Free(&NF);
+  }
+
+  if (r = check_dump(dump_path, &found)) {
+    afs_com_err(argv0, r, "reading %s", dump_path);
+    printf("?      %s (unreadable)\n", dump_path);
+    n_unknown++;
+  } else if (found) {
+    printf("yes    %s\n", dump_path);
+    n_found++;
+  } else {
+    if (verbose) printf("no     %s\n", dump_path);
+    n_ruled_out++;
+  }
+}
+
+
+/* Main program */
+int main(int argc, char **argv)
+{
+  int i;
+
+  parse_options(argc, argv);
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+
+  for (i = 0; i < n_dumps; i++)
+    find_name(dump_paths[i]);
+
+  if (verbose)
+    fprintf(stderr, "%d dumps: %d have it, %d may, %d don't, %d unknown\n",
+            n_dumps, n_found, n_maybe, n_ruled_out, n_unknown);
+  return (n_found || n_maybe || n_unknown) ? 0 : 1;
+}
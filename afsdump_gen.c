@@ -0,0 +1,712 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_gen.c - Generate synthetic volume dumps */
+
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <afs/stds.h>
+#include <afs/acl.h>
+#include <afs/prs_fs.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpfmt.h"
+
+extern int optind;
+extern char *optarg;
+
+/* A vnode in the generated volume.  The whole tree is laid out before
+ * anything is written, so that the volume header and directories can
+ * describe it.  Children of a directory are always contiguous.
+ */
+struct gnode {
+  afs_uint32 vnode, uniq;
+  afs_uint32 parent;                 /* index of parent directory */
+  afs_uint32 first, nchild;          /* children, for directories */
+  afs_uint32 nsubdir;                /* subdirectories, for directories */
+  u_int64 size;                      /* file size, for files */
+  unsigned short depth;
+  unsigned char type;                /* vDirectory, vFile, vSymlink */
+  unsigned char kind;                /* '#' or '%' for mount points */
+  unsigned char flags;
+};
+#define G_LARGE   0x01               /* file is larger than 4GB */
+#define G_ZERO    0x02               /* overwrite with a run of zeros */
+#define G_INSERT  0x04               /* insert garbage */
+#define G_TRUNC   0x08               /* write less data than promised */
+
+/* State for the corrupting XFILE which sits in front of the output */
+struct corrupter {
+  XFILE *out;
+  afs_uint32 delay;                  /* bytes to pass before acting */
+  afs_uint32 zeros;                  /* bytes to replace with zeros */
+  afs_uint32 insert;                 /* bytes of garbage to insert */
+};
+
+char *argv0;
+static char *outpath;
+static int verbose;
+static afs_uint32 nvnodes, fanout, maxdepth, dirpct, linkpct, mtptpct;
+static afs_uint32 aclpct, nlarge, largemb, nzero, ninsert, ntrunc;
+static afs_uint32 minsize, maxsize, seed, when;
+
+static struct gnode *nodes;
+static afs_uint32 nnodes;
+static afs_uint32 rng[4];
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options]\n", argv0);
+  fprintf(stderr, "  -n count    Number of vnodes [10000]\n");
+  fprintf(stderr, "  -f fanout   Entries per directory [50]\n");
+  fprintf(stderr, "  -D depth    Maximum directory depth [16]\n");
+  fprintf(stderr, "  -d pct      Percent of entries that are directories [300/fanout]\n");
+  fprintf(stderr, "  -s size     File size, or min-max for log-uniform sizes [0-64k]\n");
+  fprintf(stderr, "  -l pct      Percent of entries that are symlinks [0]\n");
+  fprintf(stderr, "  -m pct      Percent of entries that are mount points [0]\n");
+  fprintf(stderr, "  -a pct      Percent of directories with extended ACLs [0]\n");
+  fprintf(stderr, "  -L n[,MB]   Make n files larger than 4GB [4097MB]\n");
+  fprintf(stderr, "  -z n        Overwrite n vnodes with runs of zeros\n");
+  fprintf(stderr, "  -i n        Insert garbage into n vnodes\n");
+  fprintf(stderr, "  -t n        Truncate the contents of n files\n");
+  fprintf(stderr, "  -r seed     Random number seed [1]\n");
+  fprintf(stderr, "  -T time     Timestamp for vnodes and headers [1000000000]\n");
+  fprintf(stderr, "  -o outfile  Put output in file [default stdout]\n");
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -v          Verbose mode\n");
+  fprintf(stderr, "Sizes may be given with a k, m, or g suffix.\n");
+  exit(status);
+}
+
+
+/* Parse a size with an optional multiplier */
+static afs_uint32 parse_size(char *s, char **end)
+{
+  afs_uint32 n;
+
+  n = strtoul(s, end, 0);
+  switch (**end) {
+    case 'k': case 'K': n <<= 10; (*end)++; break;
+    case 'm': case 'M': n <<= 20; (*end)++; break;
+    case 'g': case 'G': n <<= 30; (*end)++; break;
+  }
+  return n;
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  char *x;
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  outpath = 0;
+  verbose = 0;
+  nvnodes = 10000;
+  fanout = 50;
+  maxdepth = 16;
+  dirpct = linkpct = mtptpct = aclpct = 0;
+  nlarge = nzero = ninsert = ntrunc = 0;
+  largemb = 4097;
+  minsize = 0;
+  maxsize = 65536;
+  seed = 1;
+  when = 1000000000;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "n:f:D:d:s:l:m:a:L:z:i:t:r:T:o:hv")) != EOF) {
+    switch (c) {
+      case 'n': nvnodes      = strtoul(optarg, 0, 0);     continue;
+      case 'f': fanout       = strtoul(optarg, 0, 0);     continue;
+      case 'D': maxdepth     = strtoul(optarg, 0, 0);     continue;
+      case 'd': dirpct       = strtoul(optarg, 0, 0);     continue;
+      case 'l': linkpct      = strtoul(optarg, 0, 0);     continue;
+      case 'm': mtptpct      = strtoul(optarg, 0, 0);     continue;
+      case 'a': aclpct       = strtoul(optarg, 0, 0);     continue;
+      case 'z': nzero        = strtoul(optarg, 0, 0);     continue;
+      case 'i': ninsert      = strtoul(optarg, 0, 0);     continue;
+      case 't': ntrunc       = strtoul(optarg, 0, 0);     continue;
+      case 'r': seed         = strtoul(optarg, 0, 0);     continue;
+      case 'T': when         = strtoul(optarg, 0, 0);     continue;
+      case 'o': outpath      = optarg;                    continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      case 's':
+        minsize = maxsize = parse_size(optarg, &x);
+        if (*x == '-') maxsize = parse_size(x + 1, &x);
+        if (*x || maxsize < minsize) usage(1, "Invalid file size");
+        continue;
+      case 'L':
+        nlarge = strtoul(optarg, &x, 0);
+        if (*x == ',') largemb = strtoul(x + 1, &x, 0);
+        if (*x || largemb < 4096) usage(1, "Large files must be at least 4096MB");
+        continue;
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (argc > optind) usage(1, "Too many arguments!");
+  if (!nvnodes) usage(1, "Must generate at least one vnode");
+  if (!fanout) usage(1, "Fanout must be at least 1");
+  if (!maxdepth) usage(1, "Depth must be at least 1");
+  if (!dirpct) dirpct = fanout > 300 ? 1 : 300 / fanout;
+  if (dirpct + linkpct + mtptpct > 100)
+    usage(1, "Directory, symlink, and mount point percentages exceed 100");
+  if (aclpct > 100) usage(1, "ACL percentage exceeds 100");
+}
+
+
+static void die(const char *context, afs_uint32 code)
+{
+  fprintf(stderr, "%s: %s: %s\n", argv0, context, afs_error_message(code));
+  exit(1);
+}
+
+
+/* xorshift128; we want the same dump from the same seed everywhere */
+static void rnd_init(afs_uint32 s)
+{
+  rng[0] = s ^ 0x6a09e667;
+  rng[1] = 0xbb67ae85;
+  rng[2] = 0x3c6ef372;
+  rng[3] = 0xa54ff53a;
+}
+
+static afs_uint32 rnd(void)
+{
+  afs_uint32 t = rng[0] ^ (rng[0] << 11);
+
+  rng[0] = rng[1];
+  rng[1] = rng[2];
+  rng[2] = rng[3];
+  rng[3] = rng[3] ^ (rng[3] >> 19) ^ t ^ (t >> 8);
+  return rng[3];
+}
+
+static afs_uint32 rnd_range(afs_uint32 n)
+{
+  return n ? rnd() % n : 0;
+}
+
+
+/* Pick a file size.  Sizes are log-uniform between minsize and maxsize,
+ * which is a reasonable approximation of real volumes: lots of small
+ * files, and a few big ones.
+ */
+static afs_uint32 pick_size(void)
+{
+  afs_uint32 lo, hi, bits, minbits, maxbits;
+
+  if (minsize == maxsize) return minsize;
+  for (minbits = 0; minbits < 32 && (minsize >> minbits); minbits++);
+  for (maxbits = 0; maxbits < 32 && (maxsize >> maxbits); maxbits++);
+  bits = minbits + rnd_range(maxbits - minbits + 1);
+  lo = bits ? 1 << (bits - 1) : 0;
+  hi = bits < 32 ? (1 << bits) - 1 : 0xffffffff;
+  if (lo < minsize) lo = minsize;
+  if (hi > maxsize) hi = maxsize;
+  if (hi <= lo) return lo;
+  return lo + rnd_range(hi - lo + 1);
+}
+
+
+/* Mark n distinct vnodes of the given type with flag */
+static void pick_vnodes(afs_uint32 n, int type, int flag, char *what)
+{
+  afs_uint32 i, count;
+
+  for (count = 0, i = 1; i < nnodes; i++)
+    if ((!type || nodes[i].type == type) && !(nodes[i].flags & flag)) count++;
+  if (n > count) {
+    fprintf(stderr, "%s: only %d vnodes available for %s\n", argv0, count, what);
+    n = count;
+  }
+  while (n) {
+    i = 1 + rnd_range(nnodes - 1);
+    if (type && nodes[i].type != type) continue;
+    if (nodes[i].flags & flag) continue;
+    nodes[i].flags |= flag;
+    n--;
+  }
+}
+
+
+/* Lay out the tree.  Directories are filled breadth-first, which keeps
+ * the tree shallow unless the fanout is small.  Directories get odd vnode
+ * numbers and everything else gets even ones, as on a real fileserver.
+ */
+static void build_tree(void)
+{
+  struct gnode *g, *c;
+  afs_uint32 i, j, x, next_dir, next_file, next_uniq, pending;
+
+  nodes = malloc(nvnodes * sizeof(struct gnode));
+  if (!nodes) die("build_tree", ENOMEM);
+  memset(nodes, 0, nvnodes * sizeof(struct gnode));
+
+  nodes[0].vnode = nodes[0].uniq = 1;
+  nodes[0].type = vDirectory;
+  nnodes = 1;
+  next_dir = 3;
+  next_file = 2;
+  next_uniq = 2;
+  pending = 1;
+
+  for (i = 0; i < nnodes && nnodes < nvnodes; i++) {
+    g = &nodes[i];
+    if (g->type != vDirectory) continue;
+    pending--;
+    g->first = nnodes;
+    for (j = 0; j < fanout && nnodes < nvnodes; j++) {
+      c = &nodes[nnodes++];
+      c->parent = i;
+      c->depth = g->depth + 1;
+      c->uniq = next_uniq++;
+      x = rnd_range(100);
+
+      /* Make sure the tree doesn't stop growing early */
+      if (c->depth < maxdepth && (x < dirpct || (!pending && j == fanout - 1))) {
+        c->type = vDirectory;
+        c->vnode = next_dir;
+        next_dir += 2;
+        g->nsubdir++;
+        pending++;
+        continue;
+      }
+
+      c->vnode = next_file;
+      next_file += 2;
+      x = rnd_range(100);
+      if (x < linkpct) {
+        c->type = vSymlink;
+      } else if (x < linkpct + mtptpct) {
+        c->type = vSymlink;
+        c->kind = rnd_range(4) ? '#' : '%';
+      } else {
+        c->type = vFile;
+        mk64(c->size, 0, pick_size());
+      }
+    }
+    g->nchild = nnodes - g->first;
+  }
+  if (nnodes < nvnodes)
+    fprintf(stderr, "%s: tree is full at depth %d; generated only %d vnodes\n",
+            argv0, maxdepth, nnodes);
+
+  pick_vnodes(nlarge, vFile, G_LARGE, "large files");
+  for (i = 1; i < nnodes; i++) {
+    if (nodes[i].flags & G_LARGE)
+      mk64(nodes[i].size, largemb >> 12, (largemb & 0xfff) << 20);
+  }
+  pick_vnodes(nzero, 0, G_ZERO, "zero runs");
+  pick_vnodes(ninsert, 0, G_INSERT, "inserted garbage");
+  pick_vnodes(ntrunc, vFile, G_TRUNC, "truncation");
+}
+
+
+/* Write a directory entry name for a child vnode */
+static void entry_name(struct gnode *g, char *buf)
+{
+  switch (g->type) {
+    case vDirectory: sprintf(buf, "d%u", g->vnode); break;
+    case vFile:      sprintf(buf, "f%u", g->vnode); break;
+    default:         sprintf(buf, "%c%u", g->kind ? 'm' : 'l', g->vnode);
+  }
+}
+
+
+/* Fill in an ACL.  Everything gets the usual pair of entries; some
+ * directories get a pile of random users and groups as well.
+ */
+static void make_acl(afs_vnode *v)
+{
+  struct acl_accessList *acl = (struct acl_accessList *)v->acl;
+  afs_uint32 i, npos, nneg;
+
+  npos = 2;
+  nneg = 0;
+  if (rnd_range(100) < aclpct) {
+    npos += rnd_range(16);
+    nneg = rnd_range(3);
+  }
+  acl->size     = htonl(sizeof(struct acl_accessList) +
+                        (npos + nneg - 1) * sizeof(struct acl_accessEntry));
+  acl->version  = htonl(ACL_ACLVERSION);
+  acl->total    = htonl(npos + nneg);
+  acl->positive = htonl(npos);
+  acl->negative = htonl(nneg);
+  acl->entries[0].id     = htonl(-204);
+  acl->entries[0].rights = htonl(PRSFS_READ   | PRSFS_LOOKUP | PRSFS_INSERT |
+                                 PRSFS_DELETE | PRSFS_WRITE  | PRSFS_LOCK   |
+                                 PRSFS_ADMINISTER);
+  acl->entries[1].id     = htonl(-101);
+  acl->entries[1].rights = htonl(PRSFS_READ | PRSFS_LOOKUP);
+  for (i = 2; i < npos + nneg; i++) {
+    acl->entries[i].id     = htonl(rnd_range(2) ? 1000 + rnd_range(30000)
+                                                : -(205 + rnd_range(5000)));
+    acl->entries[i].rights = htonl(1 + rnd_range(0x7f));
+  }
+}
+
+
+/* The corrupting XFILE.  It passes writes through to the real output,
+ * except that after a set number of bytes it may replace some with
+ * zeros or insert some garbage of its own.
+ */
+static afs_uint32 xf_CORRUPT_do_write(XFILE *X, void *buf, afs_uint32 count)
+{
+  struct corrupter *C = X->refcon;
+  static char zeros[4096];
+  char *p = buf, junk[256];
+  afs_uint32 n, i, r;
+
+  while (count) {
+    if (C->delay) {
+      n = (count < C->delay) ? count : C->delay;
+      if (r = xfwrite(C->out, p, n)) return r;
+      C->delay -= n;
+    } else if (C->insert) {
+      n = (C->insert < sizeof(junk)) ? C->insert : sizeof(junk);
+      for (i = 0; i < n; i++) junk[i] = rnd();
+      if (r = xfwrite(C->out, junk, n)) return r;
+      C->insert -= n;
+      continue;
+    } else if (C->zeros) {
+      n = (count < C->zeros) ? count : C->zeros;
+      if (n > sizeof(zeros)) n = sizeof(zeros);
+      if (r = xfwrite(C->out, zeros, n)) return r;
+      C->zeros -= n;
+    } else {
+      return xfwrite(C->out, p, count);
+    }
+    p += n;
+    count -= n;
+  }
+  return 0;
+}
+
+static afs_uint32 xf_CORRUPT_do_close(XFILE *X)
+{
+  struct corrupter *C = X->refcon;
+
+  return xfclose(C->out);
+}
+
+static void open_corrupter(XFILE *X, struct corrupter *C, XFILE *out)
+{
+  memset(X, 0, sizeof(*X));
+  memset(C, 0, sizeof(*C));
+  C->out = out;
+  X->do_write = xf_CORRUPT_do_write;
+  X->do_close = xf_CORRUPT_do_close;
+  X->is_writable = 1;
+  X->refcon = C;
+}
+
+
+/* Arrange for a vnode to be damaged, if it was chosen for that */
+static void arm_corrupter(struct corrupter *C, struct gnode *g)
+{
+  u_int64 where;
+  char buf[17];
+
+  if (!(g->flags & (G_ZERO | G_INSERT))) return;
+  C->delay = rnd_range(32);
+  if (g->flags & G_ZERO)   C->zeros  = 1 + rnd_range(8192);
+  if (g->flags & G_INSERT) C->insert = 1 + rnd_range(256);
+  if (verbose) {
+    add64_32(where, C->out->filepos, C->delay);
+    fprintf(stderr, "vnode %u: ", g->vnode);
+    if (C->insert) fprintf(stderr, "%u bytes inserted ", C->insert);
+    if (C->zeros)  fprintf(stderr, "%s%u bytes zeroed ",
+                           C->insert ? "and " : "", C->zeros);
+    fprintf(stderr, "at 0x%s\n", hexify_int64(&where, buf));
+  }
+}
+
+
+/* Write file contents.  Each vnode gets its own stream of noise, so that
+ * the output doesn't depend on how the writes are split up.
+ */
+static afs_uint32 write_noise(XFILE *X, afs_uint32 vnode, u_int64 *count)
+{
+  static afs_uint32 buf[XFBUFSIZE / 4];
+  afs_uint32 r, n, i, s;
+  u_int64 remaining, tmp64;
+
+  s = (seed * 2654435761U) ^ vnode;
+  if (!s) s = 1;
+  cp64(remaining, *count);
+  while (hi64(remaining) || lo64(remaining)) {
+    n = (hi64(remaining) || lo64(remaining) > sizeof(buf))
+      ? sizeof(buf) : lo64(remaining);
+    for (i = 0; i < (n + 3) / 4; i++) {
+      s ^= s << 13;
+      s ^= s >> 17;
+      s ^= s << 5;
+      buf[i] = s;
+    }
+    if (r = xfwrite(X, buf, n)) return r;
+    sub64_32(tmp64, remaining, n);
+    cp64(remaining, tmp64);
+  }
+  return 0;
+}
+
+
+static afs_uint32 emit_file(XFILE *X, struct gnode *g)
+{
+  u_int64 count;
+  afs_uint32 r;
+  char buf[17];
+
+  if (hi64(g->size)) {
+    if (r = WriteTagInt32Pair(X, VTAG_DATA_LARGE, hi64(g->size), lo64(g->size)))
+      return r;
+  } else {
+    if (r = WriteTagInt32(X, VTAG_DATA, lo64(g->size))) return r;
+  }
+
+  cp64(count, g->size);
+  if (g->flags & G_TRUNC) {
+    if (hi64(g->size)) mk64(count, 0, rnd());
+    else mk64(count, 0, rnd_range(lo64(g->size)));
+    if (verbose)
+      fprintf(stderr, "vnode %u: truncated to 0x%s bytes\n",
+              g->vnode, hexify_int64(&count, buf));
+  }
+  return write_noise(X, g->vnode, &count);
+}
+
+
+static afs_uint32 emit_symlink(XFILE *X, struct gnode *g)
+{
+  u_int64 tmp64;
+  char target[64];
+
+  if (g->kind)
+    sprintf(target, "%ccell%u.example.com:vol.%u.", g->kind,
+            rnd_range(10), rnd_range(100000));
+  else
+    sprintf(target, "../d%u/f%u", 1 + 2 * rnd_range(nnodes / 2 + 1),
+            2 * rnd_range(nnodes / 2 + 1));
+  mk64(tmp64, 0, strlen(target));
+  return DumpVNodeData(X, target, &tmp64);
+}
+
+
+static afs_uint32 emit_dir(XFILE *X, struct gnode *g)
+{
+  dir_state *DS;
+  afs_uint32 r, i;
+  char name[16];
+
+  if (r = Dir_Init(&DS)) return r;
+  if ((r = Dir_AddEntry(DS, ".",  g->vnode, g->uniq)) ||
+      (r = Dir_AddEntry(DS, "..", nodes[g->parent].vnode,
+                                  nodes[g->parent].uniq))) {
+    Dir_Free(DS);
+    return r;
+  }
+  for (i = g->first; i < g->first + g->nchild; i++) {
+    entry_name(&nodes[i], name);
+    if (r = Dir_AddEntry(DS, name, nodes[i].vnode, nodes[i].uniq)) {
+      Dir_Free(DS);
+      return r;
+    }
+  }
+  if (!(r = Dir_Finalize(DS)))
+    r = Dir_EmitData(DS, X, 1);
+  Dir_Free(DS);
+  return r;
+}
+
+
+static afs_uint32 emit_vnode(XFILE *X, struct corrupter *C, struct gnode *g)
+{
+  afs_vnode vnode;
+  afs_uint32 r;
+
+  arm_corrupter(C, g);
+  memset(&vnode, 0, sizeof(vnode));
+  vnode.field_mask  = F_VNODE_TYPE   | F_VNODE_NLINKS
+                    | F_VNODE_PARENT | F_VNODE_DVERS
+                    | F_VNODE_AUTHOR | F_VNODE_OWNER
+                    | F_VNODE_GROUP  | F_VNODE_MODE
+                    | F_VNODE_CDATE  | F_VNODE_SDATE;
+  vnode.vnode       = g->vnode;
+  vnode.vuniq       = g->uniq;
+  vnode.type        = g->type;
+  vnode.nlinks      = 1;
+  vnode.parent      = g == nodes ? 0 : nodes[g->parent].vnode;
+  vnode.datavers    = 1 + rnd_range(10);
+  vnode.author      = vnode.owner = 1000 + rnd_range(100);
+  vnode.group       = rnd_range(10);
+  vnode.mode        = 0644;
+  vnode.client_date = when - rnd_range(86400 * 365);
+  vnode.server_date = when;
+  switch (g->type) {
+    case vDirectory:
+      vnode.field_mask |= F_VNODE_ACL;
+      vnode.nlinks = 2 + g->nsubdir;
+      vnode.mode = 0755;
+      make_acl(&vnode);
+      if (r = DumpVNode(X, &vnode)) return r;
+      return emit_dir(X, g);
+
+    case vSymlink:
+      if (!g->kind) vnode.mode = 0755;
+      if (r = DumpVNode(X, &vnode)) return r;
+      return emit_symlink(X, g);
+
+    default:
+      if (r = DumpVNode(X, &vnode)) return r;
+      return emit_file(X, g);
+  }
+}
+
+
+static void emit(void)
+{
+  afs_dump_header dumphdr;
+  afs_vol_header volhdr;
+  struct corrupter C;
+  afs_uint32 r, i, diskused;
+  char volname[32];
+  XFILE OX, X;
+
+  if (outpath) r = xfopen(&OX, O_RDWR|O_CREAT|O_TRUNC, outpath);
+  else         r = xfopen_FILE(&OX, O_RDWR, stdout);
+  if (!r) r = xfsetbuf(&OX, XFBUFSIZE);
+  if (r) die("xfopen", r);
+  open_corrupter(&X, &C, &OX);
+
+  /* Disk usage is in kbytes; large files get clamped, as real servers do */
+  for (diskused = 0, i = 0; i < nnodes; i++) {
+    if (hi64(nodes[i].size)) diskused += 0x3fffff;
+    else diskused += (lo64(nodes[i].size) + 1023) >> 10;
+    if (nodes[i].type != vFile) diskused++;
+  }
+  sprintf(volname, "gen.%u", seed);
+
+  /* Dump the dump header */
+  memset(&dumphdr, 0, sizeof(dumphdr));
+  dumphdr.field_mask = F_DUMPHDR_VOLID | F_DUMPHDR_VOLNAME
+                     | F_DUMPHDR_FROM  | F_DUMPHDR_TO;
+  dumphdr.magic   = DUMPBEGINMAGIC;
+  dumphdr.version = DUMPVERSION;
+  dumphdr.volid = 536870912 + seed % 1000000;
+  dumphdr.volname = (unsigned char *)volname;
+  dumphdr.from_date = 0;
+  dumphdr.to_date = when;
+  if ((r = DumpDumpHeader(&X, &dumphdr))) die("dump header", r);
+
+  /* Dump the volume header */
+  memset(&volhdr, 0, sizeof(volhdr));
+  volhdr.field_mask = F_VOLHDR_VOLID       | F_VOLHDR_VOLVERS
+                    | F_VOLHDR_VOLNAME     | F_VOLHDR_INSERV
+                    | F_VOLHDR_BLESSED     | F_VOLHDR_VOLUNIQ
+                    | F_VOLHDR_VOLTYPE     | F_VOLHDR_PARENT
+                    | F_VOLHDR_MAXQ        | F_VOLHDR_DISKUSED
+                    | F_VOLHDR_NFILES      | F_VOLHDR_ACCOUNT
+                    | F_VOLHDR_OWNER       | F_VOLHDR_CREATE_DATE
+                    | F_VOLHDR_ACCESS_DATE | F_VOLHDR_UPDATE_DATE
+                    | F_VOLHDR_EXPIRE_DATE | F_VOLHDR_BACKUP_DATE
+                    | F_VOLHDR_OFFLINE_MSG | F_VOLHDR_MOTD
+                    | F_VOLHDR_WEEKUSE     | F_VOLHDR_DAYUSE
+                    | F_VOLHDR_DAYUSE_DATE;
+  volhdr.volid = dumphdr.volid;
+  volhdr.volvers = 1;
+  volhdr.volname = (unsigned char *)volname;
+  volhdr.flag_inservice = 1;
+  volhdr.flag_blessed = 1;
+  volhdr.voluniq = nnodes + 1;
+  volhdr.voltype = 0;
+  volhdr.parent_volid = dumphdr.volid;
+  volhdr.nfiles = nnodes;
+  volhdr.diskused = diskused;
+  volhdr.maxquota = diskused + 10000;
+  volhdr.create_date = when;
+  volhdr.update_date = when;
+  volhdr.offline_msg = (unsigned char *)"Generated by afsdump_gen";
+  volhdr.motd_msg = (unsigned char *)"";
+  if ((r = DumpVolumeHeader(&X, &volhdr))) die("vol header", r);
+
+  /* Directories first, then everything else, as the volserver does */
+  for (i = 0; i < nnodes; i++) {
+    if (nodes[i].type != vDirectory) continue;
+    if (r = emit_vnode(&X, &C, &nodes[i])) die("directory", r);
+  }
+  for (i = 0; i < nnodes; i++) {
+    if (nodes[i].type == vDirectory) continue;
+    if (r = emit_vnode(&X, &C, &nodes[i])) die("vnode", r);
+  }
+
+  if ((r = DumpDumpEnd(&X))) die("dump end", r);
+  if ((r = xfclose(&X))) die("close", r);
+}
+
+
+int main(int argc, char **argv)
+{
+  afs_uint32 i, ndirs, nfiles, nlinks, nmtpts;
+
+  parse_options(argc, argv);
+  initialize_AVds_error_table();
+  initialize_xFil_error_table();
+
+  rnd_init(seed);
+  build_tree();
+
+  if (verbose) {
+    ndirs = nfiles = nlinks = nmtpts = 0;
+    for (i = 0; i < nnodes; i++) {
+      switch (nodes[i].type) {
+        case vDirectory: ndirs++;  break;
+        case vFile:      nfiles++; break;
+        default:         if (nodes[i].kind) nmtpts++; else nlinks++;
+      }
+    }
+    fprintf(stderr, "%u directories, %u files, %u symlinks, %u mount points\n",
+            ndirs, nfiles, nlinks, nmtpts);
+  }
+
+  emit();
+  return 0; /* success */
+}
@@ -0,0 +1,742 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_grep.c - Search the file data in dumps for patterns
+ *
+ * Every file body in each dump is searched for any of a set of literal
+ * strings and regular expressions, and each match is reported as the
+ * dump, the path of the file, the byte offset of the match within the
+ * file, and the pattern that matched.
+ *
+ * The literal strings are all searched for at once, in one pass over
+ * the data, with an Aho-Corasick automaton.  It is built as a complete
+ * DFA over classes of bytes (all the bytes that appear in no pattern
+ * are one class, and with -i, the two cases of a letter are one class),
+ * so each byte of data costs one table lookup.  The table is limited
+ * to MAX_DFA_SIZE bytes, which is plenty for thousands of patterns.
+ * -i applies to all the patterns, wherever it is on the command line.
+ *
+ * While the automaton is at its start state, bytes that can't begin a
+ * match are skipped.  If only one byte can, memchr() does the skipping.
+ * If at most MAX_VEC_START bytes can, and this is an x86-64, the data is
+ * compared against each of them 16 bytes at a time with SSE2, or 32
+ * at a time with AVX2 if the processor has it; otherwise each skipped
+ * byte costs a lookup in is_start.
+ * Regular expressions (POSIX extended) are matched a line at a time,
+ * where lines end at a newline or a NUL, and lines longer than MAX_LINE
+ * are cut short.
+ *
+ * Each dump is indexed (see dumpfs.c) and its files divided into units
+ * of at most UNIT_SIZE bytes, which a pool of threads search in
+ * parallel (see DumpFS_RunUnits).  A unit is read with a little extra at the end, so matches
+ * that cross into the next unit are found, and each match is reported
+ * by the unit it starts in.  Matches are sorted before they are
+ * printed, so the output is the same however many threads there are.
+ *
+ * As with grep, the exit status is 0 if anything matched, 1 if nothing
+ * did, and 2 if there was an error.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <regex.h>
+#include <time.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define USE_SIMD
+#include <immintrin.h>
+#endif
+
+extern int optind;
+extern char *optarg;
+
+#define UNIT_SIZE  (4 << 20)           /* data handed to a thread at once */
+#define MAX_LINE   65536               /* longest line seen by a regex */
+#define MAX_DFA_SIZE (256 << 20)       /* biggest transition table */
+#define MAX_VEC_START 16               /* most start bytes to compare */
+
+/* A pattern to search for */
+struct pattern {
+  char *text;                          /* as given */
+  int is_regex;
+  afs_uint32 len;                      /* literals only */
+  regex_t re;                          /* regexes only */
+  int next;                            /* next literal with the same end */
+};
+
+/* The automaton for the literals.  State 0 is the start state. */
+struct matcher {
+  unsigned char class_of[256];         /* class of each byte */
+  afs_uint32 nclasses;
+  afs_uint32 nstates;
+  afs_uint32 *delta;                   /* nstates x nclasses transitions */
+  int *match;                          /* first literal ending here, or -1 */
+  afs_uint32 *out;                     /* next state on the failure chain
+                                          with a match, or 0 */
+  unsigned char is_start[256];         /* bytes that leave the start state */
+  int nstart;
+  unsigned char starts[MAX_VEC_START]; /* the bytes, if there are few */
+  unsigned char vstarts[MAX_VEC_START][32];  /* the same, 32 of each */
+  afs_uint32 (*skip)(unsigned char *,  /* finds the next of them */
+                     afs_uint32, afs_uint32);
+};
+
+/* A match, found by a thread */
+struct match {
+  afs_uint32 node;                     /* the file, in the dumpfs */
+  u_int64 offset;                      /* where in the file */
+  int pattern;
+};
+
+/* State for each thread */
+struct worker {
+  unsigned char *buf;
+  struct match *matches;
+  afs_uint32 nmatches, maxmatches;
+};
+
+char *argv0;
+static int verbose, nthreads, ignore_case, list_files;
+static afs_uint32 overlap;
+
+static struct pattern *patterns;
+static int npatterns, maxpatterns, nliterals;
+static struct matcher M;
+
+/* Work for the current dump, shared by the threads */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   /* work_errors */
+static dumpfs FS;
+static char *cur_dump;
+static struct match *matches;
+static afs_uint32 nmatches, maxmatches;
+static afs_uint32 work_errors;
+static u_int64 bytes_searched;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] dump...\n", argv0);
+  fprintf(stderr, "  -e string   Search for string (may be repeated)\n");
+  fprintf(stderr, "  -f file     Search for each line of file\n");
+  fprintf(stderr, "  -r regex    Search for a regular expression (may be repeated)\n");
+  fprintf(stderr, "  -R file     Search for the regular expression on each line of file\n");
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -i          Ignore case\n");
+  fprintf(stderr, "  -j threads  Number of threads to search with (default: one per CPU)\n");
+  fprintf(stderr, "  -l          List only the files that match\n");
+  fprintf(stderr, "  -v          Verbose mode (errors in dumps, and timing)\n");
+  exit(status);
+}
+
+
+static void add_pattern(char *text, int is_regex)
+{
+  struct pattern *P;
+
+  if (!*text) usage(2, "Empty pattern");
+  if (npatterns == maxpatterns) {
+    maxpatterns = maxpatterns ? maxpatterns * 2 : 64;
+    if (!(P = realloc(patterns, maxpatterns * sizeof(struct pattern)))) {
+      fprintf(stderr, "%s: out of memory!\n", argv0);
+      exit(2);
+    }
+    patterns = P;
+  }
+  P = &patterns[npatterns];
+  memset(P, 0, sizeof(*P));
+  P->next = -1;
+  P->is_regex = is_regex;
+  if (!(P->text = strdup(text))) {
+    fprintf(stderr, "%s: out of memory!\n", argv0);
+    exit(2);
+  }
+  if (!is_regex) P->len = strlen(text);
+  npatterns++;
+}
+
+
+static void add_pattern_file(char *path, int is_regex)
+{
+  char line[MAX_LINE], *x;
+  FILE *F;
+
+  if (!(F = fopen(path, "r"))) {
+    afs_com_err(argv0, errno, "opening %s", path);
+    exit(2);
+  }
+  while (fgets(line, sizeof(line), F)) {
+    if (x = strchr(line, '\n')) *x = 0;
+    if (*line) add_pattern(line, is_regex);
+  }
+  fclose(F);
+}
+
+
+/* Parse the command-line options.  Regexes are compiled once all the
+ * options are seen, so -i applies to every pattern.
+ */
+static void parse_options(int argc, char **argv)
+{
+  char errbuf[256];
+  int c, i, r;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  verbose = ignore_case = list_files = 0;
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "R:e:f:hij:lr:v")) != EOF) {
+    switch (c) {
+      case 'e': add_pattern(optarg, 0);                   continue;
+      case 'f': add_pattern_file(optarg, 0);              continue;
+      case 'r': add_pattern(optarg, 1);                   continue;
+      case 'R': add_pattern_file(optarg, 1);              continue;
+      case 'i': ignore_case  = 1;                         continue;
+      case 'j': nthreads     = atoi(optarg);              continue;
+      case 'l': list_files   = 1;                         continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(2, "Invalid option!");
+    }
+  }
+
+  if (nthreads < 1) nthreads = 1;
+  if (!npatterns) usage(2, "No patterns given");
+  if (argc == optind) usage(2, "No dumps given");
+
+  for (i = 0; i < npatterns; i++) {
+    if (!patterns[i].is_regex) continue;
+    r = regcomp(&patterns[i].re, patterns[i].text,
+                REG_EXTENDED | (ignore_case ? REG_ICASE : 0));
+    if (r) {
+      regerror(r, &patterns[i].re, errbuf, sizeof(errbuf));
+      fprintf(stderr, "%s: %s: %s\n", argv0, patterns[i].text, errbuf);
+      exit(2);
+    }
+  }
+}
+
+
+/* A callback to print errors, but only in verbose mode */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/** Skipping to where a match can begin **/
+
+/* Each returns the index of the first byte in buf[i..len) that can
+ * begin a match, or len if there is none.
+ */
+static afs_uint32 skip_c(unsigned char *buf, afs_uint32 i, afs_uint32 len)
+{
+  while (i < len && !M.is_start[buf[i]]) i++;
+  return i;
+}
+
+
+static afs_uint32 skip_memchr(unsigned char *buf, afs_uint32 i, afs_uint32 len)
+{
+  unsigned char *p;
+
+  if (!(p = memchr(buf + i, M.starts[0], len - i))) return len;
+  return p - buf;
+}
+
+
+#ifdef USE_SIMD
+/* Compare 16 bytes at a time against each start byte.  SSE2 is part of
+ * x86-64, so this needs no check.  The next byte is tried first, since
+ * with many start bytes it often is one.
+ */
+static afs_uint32 skip_sse2(unsigned char *buf, afs_uint32 i, afs_uint32 len)
+{
+  __m128i data, hit;
+  int j, mask;
+
+  if (i < len && M.is_start[buf[i]]) return i;
+  for (; i + 16 <= len; i += 16) {
+    data = _mm_loadu_si128((__m128i *)(buf + i));
+    hit = _mm_cmpeq_epi8(data, _mm_loadu_si128((__m128i *)M.vstarts[0]));
+    for (j = 1; j < M.nstart; j++)
+      hit = _mm_or_si128(hit, _mm_cmpeq_epi8(data,
+                                _mm_loadu_si128((__m128i *)M.vstarts[j])));
+    if (mask = _mm_movemask_epi8(hit)) return i + __builtin_ctz(mask);
+  }
+  return skip_c(buf, i, len);
+}
+
+
+/* The same, 32 bytes at a time */
+__attribute__((target("avx2")))
+static afs_uint32 skip_avx2(unsigned char *buf, afs_uint32 i, afs_uint32 len)
+{
+  __m256i data, hit;
+  int j;
+  unsigned int mask;
+
+  if (i < len && M.is_start[buf[i]]) return i;
+  for (; i + 32 <= len; i += 32) {
+    data = _mm256_loadu_si256((__m256i *)(buf + i));
+    hit = _mm256_cmpeq_epi8(data, _mm256_loadu_si256((__m256i *)M.vstarts[0]));
+    for (j = 1; j < M.nstart; j++)
+      hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data,
+                                _mm256_loadu_si256((__m256i *)M.vstarts[j])));
+    if (mask = _mm256_movemask_epi8(hit)) return i + __builtin_ctz(mask);
+  }
+  return skip_c(buf, i, len);
+}
+#endif
+
+
+/** The Aho-Corasick automaton **/
+
+static void build_matcher(void)
+{
+  struct pattern *P;
+  afs_uint32 i, c, s, t, f, total = 1, *fail, *queue, qhead, qtail;
+  unsigned char used[256], *x;
+
+  /* Sort the bytes into classes; -i folds case here */
+  memset(used, 0, sizeof(used));
+  for (i = 0; i < npatterns; i++) {
+    if (patterns[i].is_regex) continue;
+    for (x = (unsigned char *)patterns[i].text; *x; x++)
+      used[ignore_case ? tolower(*x) : *x] = 1;
+    if (patterns[i].len > MAX_DFA_SIZE - total) break;
+    total += patterns[i].len;
+  }
+  memset(M.class_of, 0, sizeof(M.class_of));
+  M.nclasses = 1;
+  for (c = 0; c < 256; c++)
+    if (used[c]) M.class_of[c] = M.nclasses++;
+  if (ignore_case)
+    for (c = 0; c < 256; c++)
+      M.class_of[c] = M.class_of[tolower(c)];
+
+  /* There is a state for each byte of the literals, at worst */
+  if (i < npatterns
+  ||  (double)total * M.nclasses * sizeof(afs_uint32) > MAX_DFA_SIZE) {
+    fprintf(stderr, "%s: too many literals; the matcher would be too big\n",
+            argv0);
+    exit(2);
+  }
+
+  /* Build the trie; 0 means no child, since nothing goes to the root */
+  M.delta = calloc((size_t)total * M.nclasses, sizeof(afs_uint32));
+  M.match = malloc(total * sizeof(int));
+  M.out   = calloc(total, sizeof(afs_uint32));
+  fail    = calloc(total, sizeof(afs_uint32));
+  queue   = malloc(total * sizeof(afs_uint32));
+  if (!M.delta || !M.match || !M.out || !fail || !queue) {
+    fprintf(stderr, "%s: out of memory building the matcher!\n", argv0);
+    exit(2);
+  }
+  for (s = 0; s < total; s++) M.match[s] = -1;
+  M.nstates = 1;
+  for (i = 0; i < npatterns; i++) {
+    P = &patterns[i];
+    if (P->is_regex) continue;
+    nliterals++;
+    for (s = 0, x = (unsigned char *)P->text; *x; x++) {
+      c = M.class_of[*x];
+      if (!M.delta[s * M.nclasses + c])
+        M.delta[s * M.nclasses + c] = M.nstates++;
+      s = M.delta[s * M.nclasses + c];
+    }
+    P->next = M.match[s];
+    M.match[s] = i;
+  }
+
+  /* Fill in the failure transitions, breadth first.  When a state is
+   * reached, its row holds only its children; the states it fails to
+   * are shallower, so their rows are already complete.
+   */
+  qhead = qtail = 0;
+  queue[qtail++] = 0;
+  while (qhead < qtail) {
+    s = queue[qhead++];
+    for (c = 0; c < M.nclasses; c++) {
+      t = M.delta[s * M.nclasses + c];
+      f = s ? M.delta[fail[s] * M.nclasses + c] : 0;
+      if (t) {
+        fail[t] = f;
+        M.out[t] = (M.match[f] >= 0) ? f : M.out[f];
+        queue[qtail++] = t;
+      } else M.delta[s * M.nclasses + c] = f;
+    }
+  }
+  free(fail);
+  free(queue);
+
+  M.nstart = 0;
+  for (c = 0; c < 256; c++) {
+    M.is_start[c] = (M.delta[M.class_of[c]] != 0);
+    if (M.is_start[c]) {
+      if (M.nstart < MAX_VEC_START) {
+        M.starts[M.nstart] = c;
+        memset(M.vstarts[M.nstart], c, 32);
+      }
+      M.nstart++;
+    }
+  }
+
+  /* Pick the fastest way to skip to the next start byte */
+  M.skip = (M.nstart == 1) ? skip_memchr : skip_c;
+#ifdef USE_SIMD
+  if (M.nstart > 1 && M.nstart <= MAX_VEC_START) {
+    M.skip = skip_sse2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) M.skip = skip_avx2;
+  }
+#endif
+}
+
+
+/** Searching **/
+
+static afs_uint32 add_match(struct worker *W, afs_uint32 node,
+                            u_int64 *offset, int pattern)
+{
+  struct match *NM;
+
+  if (W->nmatches == W->maxmatches) {
+    W->maxmatches = W->maxmatches ? W->maxmatches * 2 : 256;
+    NM = realloc(W->matches, W->maxmatches * sizeof(struct match));
+    if (!NM) return ENOMEM;
+    W->matches = NM;
+  }
+  NM = &W->matches[W->nmatches++];
+  NM->node = node;
+  NM->pattern = pattern;
+  cp64(NM->offset, *offset);
+  return 0;
+}
+
+
+/* Search buf[start..len) for the literals, reporting those that begin
+ * before limit.  base is the file offset of buf[0].
+ */
+static afs_uint32 search_literals(struct worker *W, dumpfs_unit *U,
+                                  unsigned char *buf, afs_uint32 start,
+                                  afs_uint32 limit, afs_uint32 len,
+                                  u_int64 *base)
+{
+  afs_uint32 i, s = 0, t, begin, r;
+  u_int64 where;
+  int pat;
+
+  for (i = start; i < len; i++) {
+    /* At the start state, skip what can't begin a match */
+    if (!s && (i = M.skip(buf, i, len)) >= limit) break;
+    s = M.delta[s * M.nclasses + M.class_of[buf[i]]];
+    for (t = (M.match[s] >= 0) ? s : M.out[s]; t; t = M.out[t]) {
+      for (pat = M.match[t]; pat >= 0; pat = patterns[pat].next) {
+        begin = i + 1 - patterns[pat].len;
+        if (begin >= limit) continue;
+        add64_32(where, *base, begin);
+        if (r = add_match(W, U->node, &where, pat)) return r;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/* Search the lines that begin in buf[start..limit) for the regexes */
+static afs_uint32 search_regexes(struct worker *W, dumpfs_unit *U,
+                                 unsigned char *buf, afs_uint32 start,
+                                 afs_uint32 limit, afs_uint32 len,
+                                 u_int64 *base)
+{
+  afs_uint32 i, end, r;
+  unsigned char save;
+  regmatch_t pm;
+  u_int64 where;
+  int pat;
+
+  /* The first line begins after the first line end, unless it begins
+   * exactly at start (buf[start - 1] is a line end, or the file starts).
+   */
+  i = start;
+  if (start && buf[start - 1] && buf[start - 1] != '\n') {
+    while (i < limit && buf[i] && buf[i] != '\n') i++;
+    i++;
+  }
+  for (; i < limit; i = end + 1) {
+    for (end = i; end < len && buf[end] && buf[end] != '\n'; end++)
+      if (end - i == MAX_LINE) break;
+    save = buf[end];                   /* buf has a spare byte at len */
+    buf[end] = 0;
+    for (pat = 0; pat < npatterns; pat++) {
+      if (!patterns[pat].is_regex) continue;
+      if (regexec(&patterns[pat].re, (char *)buf + i, 1, &pm, 0)) continue;
+      add64_32(where, *base, i + pm.rm_so);
+      if (r = add_match(W, U->node, &where, pat)) {
+        buf[end] = save;
+        return r;
+      }
+    }
+    buf[end] = save;
+    if (end - i == MAX_LINE) {
+      /* Skip the rest of an overlong line */
+      while (end < len && buf[end] && buf[end] != '\n') end++;
+    }
+  }
+  return 0;
+}
+
+
+/* Search one unit */
+static afs_uint32 search_unit(struct worker *W, dumpfs_unit *U)
+{
+  dumpfs_file *F = &FS.files[U->node];
+  afs_uint32 want, got, n, start, r;
+  u_int64 base, where;
+
+  /* Start a byte early, so regexes can tell whether a line starts here */
+  start = (nliterals < npatterns && !zero64(U->start)) ? 1 : 0;
+  sub64_32(base, U->start, start);
+  want = start + U->len + overlap;
+  for (got = 0; got < want; got += n) {
+    add64_32(where, base, got);
+    if (r = DumpFS_Read(&FS, F, &where, W->buf + got, want - got, &n))
+      return r;
+    if (!n) break;
+  }
+
+  if (nliterals &&
+      (r = search_literals(W, U, W->buf, start, start + U->len, got, &base)))
+    return r;
+  if (nliterals < npatterns &&
+      (r = search_regexes(W, U, W->buf, start, start + U->len, got, &base)))
+    return r;
+  return 0;
+}
+
+
+/* Called by DumpFS_RunUnits for each unit, with the thread's worker */
+static void search_cb(dumpfs *FS, dumpfs_unit *U, afs_uint32 i, void *arg)
+{
+  afs_uint32 r;
+
+  if (r = search_unit((struct worker *)arg, U)) {
+    afs_com_err(argv0, r, "searching vnode %d in %s",
+                FS->files[U->node].vnode, cur_dump);
+    pthread_mutex_lock(&lock);
+    work_errors++;
+    pthread_mutex_unlock(&lock);
+  }
+}
+
+
+static int compare_matches(const void *a, const void *b)
+{
+  const struct match *A = a, *B = b;
+
+  if (A->node != B->node) return (A->node < B->node) ? -1 : 1;
+  if (lt64(A->offset, B->offset)) return -1;
+  if (gt64(A->offset, B->offset)) return 1;
+  return A->pattern - B->pattern;
+}
+
+
+/* Collect the matches the threads found, and print them in order */
+static afs_uint32 print_matches(struct worker *workers)
+{
+  struct match *NM;
+  afs_uint32 i, total, last = DUMPFS_NONE, r = 0;
+  char *path = 0, offbuf[21];
+  u_int64 where;
+
+  for (total = i = 0; i < nthreads; i++) total += workers[i].nmatches;
+  if (total > maxmatches) {
+    if (!(NM = realloc(matches, total * sizeof(struct match)))) return ENOMEM;
+    matches = NM;
+    maxmatches = total;
+  }
+  for (nmatches = i = 0; i < nthreads; i++) {
+    if (workers[i].nmatches)
+      memcpy(matches + nmatches, workers[i].matches,
+             workers[i].nmatches * sizeof(struct match));
+    nmatches += workers[i].nmatches;
+    workers[i].nmatches = 0;
+  }
+  qsort(matches, nmatches, sizeof(struct match), compare_matches);
+
+  for (i = 0; i < nmatches; i++) {
+    if (matches[i].node != last) {
+      last = matches[i].node;
+      if (path) free(path);
+      path = 0;
+      if (DumpFS_Path(&FS, &FS.files[last], &path)) {
+        /* Not reachable from the root; name it by vnode instead */
+        if (!(path = malloc(32))) return ENOMEM;
+        sprintf(path, "[vnode %d]", FS.files[last].vnode);
+      }
+      if (list_files) printf("%s:%s\n", cur_dump, path);
+    }
+    if (list_files) continue;
+    cp64(where, matches[i].offset);
+    printf("%s:%s:%s: %s\n", cur_dump, path, decimate_int64(&where, offbuf),
+           patterns[matches[i].pattern].text);
+  }
+  if (path) free(path);
+  return r;
+}
+
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv)
+{
+  struct worker *workers;
+  void **args;
+  dumpfs_unit *units;
+  afs_uint32 nunits;
+  dump_parser dp;
+  u_int64 tmp64;
+  afs_uint32 r, i, maxlen = 0, errors = 0, total = 0;
+  double t0 = 0;
+
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+  parse_options(argc, argv);
+  build_matcher();
+
+  /* Units are read with enough extra to finish any match that starts in
+   * them: the longest literal, or a whole line for the regexes.
+   */
+  for (i = 0; i < npatterns; i++)
+    if (!patterns[i].is_regex && patterns[i].len > maxlen)
+      maxlen = patterns[i].len;
+  overlap = maxlen ? maxlen - 1 : 0;
+  if (nliterals < npatterns && overlap < MAX_LINE) overlap = MAX_LINE;
+
+  workers = calloc(nthreads, sizeof(struct worker));
+  args = calloc(nthreads, sizeof(void *));
+  if (!workers || !args) {
+    fprintf(stderr, "%s: out of memory!\n", argv0);
+    exit(2);
+  }
+  for (i = 0; i < nthreads; i++) {
+    if (!(workers[i].buf = malloc(UNIT_SIZE + overlap + 2))) {
+      fprintf(stderr, "%s: out of memory!\n", argv0);
+      exit(2);
+    }
+    args[i] = &workers[i];
+  }
+
+  memset(&dp, 0, sizeof(dp));
+  dp.cb_error = my_error_cb;
+  if (verbose) t0 = now();
+  for (; optind < argc; optind++) {
+    cur_dump = argv[optind];
+    if (r = DumpFS_Open(&FS, cur_dump, &dp)) {
+      afs_com_err(argv0, r, "indexing %s", cur_dump);
+      errors++;
+      continue;
+    }
+    if (r = DumpFS_Units(&FS, UNIT_SIZE, &units, &nunits)) {
+      afs_com_err(argv0, r, "dividing up %s", cur_dump);
+      errors++;
+      DumpFS_Close(&FS);
+      continue;
+    }
+    for (i = 0; i < nunits; i++) {
+      add64_32(tmp64, bytes_searched, units[i].len);
+      cp64(bytes_searched, tmp64);
+    }
+
+    work_errors = 0;
+    if (r = DumpFS_RunUnits(&FS, units, nunits, nthreads, search_cb, args)) {
+      afs_com_err(argv0, r, "searching %s", cur_dump);
+      errors++;
+    }
+    errors += work_errors;
+    if (units) free(units);
+
+    if (r = print_matches(workers)) {
+      afs_com_err(argv0, r, "collecting matches in %s", cur_dump);
+      errors++;
+    }
+    total += nmatches;
+    DumpFS_Close(&FS);
+  }
+
+  if (verbose) {
+    char sizebuf[21];
+    u_int64 bytes;
+
+    t0 = now() - t0;
+    cp64(bytes, bytes_searched);
+    fprintf(stderr, "%s: %s bytes searched, %u matches, in %.2f seconds\n",
+            argv0, decimate_int64(&bytes, sizebuf), total, t0);
+  }
+  fflush(stdout);
+  if (errors) exit(2);
+  exit(total ? 0 : 1);
+}
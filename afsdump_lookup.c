@@ -0,0 +1,239 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_lookup.c - Find a path in a catalog of dumps
+ *
+ * For each dump in the catalog that has the path (or, with -t, for the
+ * newest dump of each volume made at or before a given time), print the
+ * dump and what the path was then, and which dump has its data.  With
+ * -l, the dumps without the path are listed too.  Without a path, just
+ * list the dumps.
+ */
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+char *argv0;
+static char *catalog_path, *path, *volume;
+static int list;
+static time_t when;
+
+static dump_catalog catalog;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] catalog [path]\n", argv0);
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -l          List every dump, even those without the path\n");
+  fprintf(stderr, "  -t time     Use the newest dump of each volume at or before time\n");
+  fprintf(stderr, "              (seconds since 1970, or YYYY-MM-DD[ HH:MM[:SS]])\n");
+  fprintf(stderr, "  -V volume   Use only dumps of volume (name or ID)\n");
+  exit(status);
+}
+
+
+/* Parse a time, in seconds or as a local date and time */
+static int parse_time(char *str, time_t *t)
+{
+  struct tm tm;
+  char *x;
+
+  *t = strtoul(str, &x, 10);
+  if (x != str && !*x) return 0;
+
+  memset(&tm, 0, sizeof(tm));
+  if (sscanf(str, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+             &tm.tm_hour, &tm.tm_min, &tm.tm_sec) < 3)
+    return -1;
+  tm.tm_year -= 1900;
+  tm.tm_mon -= 1;
+  tm.tm_isdst = -1;
+  if ((*t = mktime(&tm)) == (time_t)-1) return -1;
+  return 0;
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  path = volume = 0;
+  list = 0;
+  when = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "hlt:V:")) != EOF) {
+    switch (c) {
+      case 'l': list         = 1;                         continue;
+      case 'V': volume       = optarg;                    continue;
+      case 't':
+        if (parse_time(optarg, &when)) usage(1, "Invalid time");
+        continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (argc == optind) usage(1, "No catalog specified");
+  catalog_path = argv[optind++];
+  if (optind < argc) path = argv[optind++];
+  if (optind < argc) usage(1, "Too many arguments");
+  if (!path) list = 1;
+}
+
+
+static char *datestr(time_t t)
+{
+  static char str[32];
+
+  strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", localtime(&t));
+  return str;
+}
+
+
+/* Decide whether a section is one we want */
+static int wanted(cat_section *S)
+{
+  cat_section *T;
+  afs_uint32 i;
+  char *x;
+
+  if (volume && strcmp(volume, S->volname)
+  &&  (strtoul(volume, &x, 10) != S->volid || *x))
+    return 0;
+  if (!when) return 1;
+  if (S->to_date > when) return 0;
+
+  /* Is there a newer one of the same volume? */
+  for (i = 0; i < catalog.nsections; i++) {
+    T = &catalog.sections[i];
+    if (T->volid == S->volid && T->to_date <= when
+    &&  (T->to_date > S->to_date
+         || (T->to_date == S->to_date && T->index > S->index)))
+      return 0;
+  }
+  return 1;
+}
+
+
+static void print_section(cat_section *S)
+{
+  printf("%s  %-22s %10u  %-11s  %s\n", datestr(S->to_date), S->volname,
+         S->volid, S->from_date ? "incremental" : "full", S->dump_path);
+}
+
+
+static char *type_name(afs_uint32 type)
+{
+  switch (type) {
+    case vFile:      return "file";
+    case vDirectory: return "dir";
+    case vSymlink:   return "symlink";
+    default:         return "?";
+  }
+}
+
+
+static void print_row(cat_section *S, cat_row *R)
+{
+  char buf[21];
+
+  printf("    %-7s %04o %6u %12s  %s  vnode %u.%u\n", type_name(R->type),
+         R->mode, R->owner, decimate_int64(&R->size, buf),
+         datestr(R->client_date), R->vnode, R->vuniq);
+  if (zero64(R->size)) return;
+  if (R->src < catalog.nsections)
+    printf("    data at offset %s in %s%s\n", decimate_int64(&R->d_offset, buf),
+           catalog.sections[R->src].dump_path,
+           R->src == S->index ? "" : " (an earlier dump)");
+  else
+    printf("    data in a dump missing from the catalog\n");
+}
+
+
+int main(int argc, char **argv)
+{
+  cat_section *S;
+  cat_row R;
+  afs_uint32 i, row, r, found = 0;
+
+  parse_options(argc, argv);
+  initialize_AVds_error_table();
+  initialize_xFil_error_table();
+
+  if (r = Catalog_Open(&catalog, catalog_path, 0)) {
+    afs_com_err(argv0, r, "opening %s", catalog_path);
+    exit(2);
+  }
+
+  for (i = 0; i < catalog.nsections; i++) {
+    S = &catalog.sections[i];
+    if (!wanted(S)) continue;
+    if (!path) {
+      print_section(S);
+      found++;
+      continue;
+    }
+    if (r = Catalog_Lookup(&catalog, S, path, &row, &R)) {
+      afs_com_err(argv0, r, "looking up %s in %s", path, S->dump_path);
+      continue;
+    }
+    if (row == CAT_NONE && !list) continue;
+    print_section(S);
+    if (row == CAT_NONE) {
+      printf("    not present\n");
+      continue;
+    }
+    print_row(S, &R);
+    found++;
+  }
+
+  Catalog_Close(&catalog);
+  exit(found ? 0 : 1);
+}
@@ -0,0 +1,475 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_merge.c - Merge a full dump and its incrementals into one dump
+ *
+ * Given a full dump and a chain of incremental dumps of the same volume,
+ * oldest first, this writes a full dump of the volume as of the last
+ * incremental, as if it had been taken then.  Restoring it is the same
+ * as restoring each dump in turn.
+ *
+ * The dumps are parsed in order, keeping in one table indexed by vnode
+ * number the dump and offsets of the newest complete copy of each
+ * vnode.  (Incremental dumps include every directory, but those that
+ * haven't changed are just a vnode number and uniquifier; those don't
+ * count.)  Starting at the root, the directories in the table are then
+ * walked to find which vnodes are still part of the volume; vnodes that
+ * were deleted since they were last dumped are left out.  Finally, the
+ * volume header from the last dump and each remaining vnode, directories
+ * first, are copied as they are from the dump they were found in.
+ *
+ * All the dumps must be seekable.  The chain is checked using the dump
+ * times in the dump headers: each incremental must start no later than
+ * the previous dump ended.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+#include "xf_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+#define COPY_BUFSIZE (1 << 20)
+
+/* The newest copy of a vnode */
+struct vrec {
+  afs_uint32 vuniq;
+  int type;
+  int dump;                    /* index + 1 of the dump it is in; 0 if none */
+  int live;                    /* reachable from the root */
+  u_int64 offset;              /* where the vnode starts */
+  u_int64 end;                 /* where it (and its data) ends */
+  u_int64 d_offset;            /* where its data is */
+  u_int64 size;                /* size of its data */
+};
+
+/* One of the dumps being merged */
+struct dump {
+  char *path;
+  XFILE X;
+  afs_dump_header hdr;
+  u_int64 vh_offset, vh_end;   /* where the volume header is */
+  afs_uint32 nvnodes;          /* complete vnodes in this dump */
+  afs_uint32 used;             /* ... that are in the output */
+};
+
+char *argv0;
+static char *outpath;
+static int force, verbose;
+static afs_uint32 error_count;
+
+static struct dump *dumps;
+static int ndumps;
+static struct vrec *vnodes;
+static afs_uint32 nvnodes;
+static afs_uint32 n_live, n_dropped, n_dangling;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] full-dump incremental...\n", argv0);
+  fprintf(stderr, "  -f          Merge even if the dump times don't form a chain\n");
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -o outfile  Put output in file [default stdout]\n");
+  fprintf(stderr, "  -v          Verbose mode\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  outpath = 0;
+  force = verbose = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "fho:v")) != EOF) {
+    switch (c) {
+      case 'f': force        = 1;                         continue;
+      case 'o': outpath      = optarg;                    continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (argc == optind) usage(1, "No dumps to merge");
+  ndumps = argc - optind;
+  if (!(dumps = calloc(ndumps, sizeof(struct dump)))) {
+    fprintf(stderr, "%s: out of memory!\n", argv0);
+    exit(2);
+  }
+  for (c = 0; c < ndumps; c++)
+    dumps[c].path = argv[optind + c];
+}
+
+
+/* A callback to count and maybe print errors */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  error_count++;
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+static afs_uint32 dumphdr_cb(afs_dump_header *hdr, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+
+  D->hdr = *hdr;
+  if (hdr->field_mask & F_DUMPHDR_VOLNAME) {
+    if (!(D->hdr.volname = (unsigned char *)strdup((char *)hdr->volname)))
+      return ENOMEM;
+  }
+  return 0;
+}
+
+
+/* Note where the volume header is.  The parser has already read the
+ * tag of whatever follows it.
+ */
+static afs_uint32 volhdr_cb(afs_vol_header *hdr, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+  afs_uint32 r;
+  u_int64 where;
+
+  if (r = xftell(X, &where)) return r;
+  cp64(D->vh_offset, hdr->offset);
+  sub64_32(D->vh_end, where, 1);
+  return 0;
+}
+
+
+/* Record a vnode, replacing any copy from an older dump */
+static afs_uint32 vnode_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  struct dump *D = refcon;
+  struct vrec *V;
+  afs_uint32 r;
+  u_int64 where;
+
+  r = GrowVnodeArray((void **)&vnodes, &nvnodes, sizeof(struct vrec),
+                     v->vnode);
+  if (r) return r;
+  if (r = xftell(X, &where)) return r;
+
+  V = &vnodes[v->vnode];
+  V->vuniq = v->vuniq;
+  V->type  = v->type;
+  V->dump  = D - dumps + 1;
+  cp64(V->offset, v->offset);
+  sub64_32(V->end, where, 1);
+  if (v->field_mask & F_VNODE_DATA) {
+    cp64(V->d_offset, v->d_offset);
+    cp64(V->size, v->size);
+  } else {
+    mk64(V->d_offset, 0, 0);
+    mk64(V->size, 0, 0);
+  }
+  D->nvnodes++;
+  return 0;
+}
+
+
+/* Parse a dump, leaving it open to copy from later */
+static afs_uint32 scan_dump(struct dump *D)
+{
+  dump_parser dp;
+  afs_uint32 r;
+
+  if (r = xfopen(&D->X, O_RDONLY, D->path)) return r;
+  if (!D->X.is_seekable) return ERROR_XFILE_NOSEEK;
+
+  memset(&dp, 0, sizeof(dp));
+  dp.refcon         = D;
+  dp.cb_error       = my_error_cb;
+  dp.cb_dumphdr     = dumphdr_cb;
+  dp.cb_volhdr      = volhdr_cb;
+  dp.cb_vnode_dir   = vnode_cb;
+  dp.cb_vnode_file  = vnode_cb;
+  dp.cb_vnode_link  = vnode_cb;
+  dp.cb_vnode_wierd = vnode_cb;
+  dp.flags          = DSFLAG_SEEK;
+  if (r = ParseDumpFile(&D->X, &dp)) return r;
+  if (!D->hdr.field_mask) return DSERR_FMT;       /* no dump header */
+  if (zero64(D->vh_end)) return DSERR_FMT;        /* no volume header */
+  return 0;
+}
+
+
+/* Make sure the dumps are a full dump and a chain of incrementals
+ * of the same volume
+ */
+static int check_chain(void)
+{
+  struct dump *D, *prev;
+  int i, bad = 0;
+
+  for (i = 0; i < ndumps; i++) {
+    D = &dumps[i];
+    if (!(D->hdr.field_mask & F_DUMPHDR_VOLID)
+    ||  !(D->hdr.field_mask & F_DUMPHDR_FROM)) {
+      fprintf(stderr, "%s: %s: no volume ID or dump times\n", argv0, D->path);
+      bad = 1;
+      continue;
+    }
+    if (!i) {
+      if (D->hdr.from_date) {
+        fprintf(stderr, "%s: %s is not a full dump\n", argv0, D->path);
+        bad = 1;
+      }
+      continue;
+    }
+    prev = &dumps[i - 1];
+    if (D->hdr.volid != prev->hdr.volid) {
+      fprintf(stderr, "%s: %s is of volume %u, not %u\n", argv0, D->path,
+              D->hdr.volid, prev->hdr.volid);
+      bad = 1;
+    } else if (D->hdr.from_date > prev->hdr.to_date) {
+      fprintf(stderr, "%s: %s starts at %u, after %s ends at %u\n", argv0,
+              D->path, D->hdr.from_date, prev->path, prev->hdr.to_date);
+      bad = 1;
+    } else if (D->hdr.to_date < prev->hdr.to_date) {
+      fprintf(stderr, "%s: %s is older than %s\n", argv0,
+              D->path, prev->path);
+      bad = 1;
+    }
+  }
+  return bad;
+}
+
+
+/* Mark each entry of a directory as live, and remember subdirectories
+ * that still need to be walked
+ */
+static afs_uint32 dirent_cb(afs_vnode *v, afs_dir_entry *de, XFILE *X, void *refcon)
+{
+  afs_uint32 **stack = refcon, *next = stack[0];
+  struct vrec *V;
+
+  if (!strcmp(de->name, ".") || !strcmp(de->name, "..")) return 0;
+  V = (de->vnode < nvnodes) ? &vnodes[de->vnode] : 0;
+  if (!V || !V->dump || V->vuniq != de->uniq) {
+    if (verbose)
+      fprintf(stderr, "%s: no vnode %u.%u for entry %s\n", argv0,
+              de->vnode, de->uniq, de->name);
+    n_dangling++;
+    return 0;
+  }
+  if (V->live) return 0;
+  V->live = 1;
+  n_live++;
+  if (V->type == vDirectory) {
+    *next++ = de->vnode;
+    stack[0] = next;
+  }
+  return 0;
+}
+
+
+/* Find the vnodes that can be reached from the root directory */
+static afs_uint32 mark_live(void)
+{
+  afs_uint32 *stack, *sp[1], vnode;
+  struct vrec *V;
+  struct dump *D;
+  dump_parser dp;
+  afs_uint32 r;
+
+  if (nvnodes < 2 || !vnodes[1].dump) {
+    fprintf(stderr, "%s: no root directory\n", argv0);
+    return DSERR_FMT;
+  }
+
+  /* Each directory is pushed at most once */
+  if (!(stack = malloc(nvnodes * sizeof(afs_uint32)))) return ENOMEM;
+  memset(&dp, 0, sizeof(dp));
+  dp.refcon    = sp;
+  dp.cb_error  = my_error_cb;
+  dp.cb_dirent = dirent_cb;
+
+  vnodes[1].live = 1;
+  n_live = 1;
+  stack[0] = 1;
+  sp[0] = stack + 1;
+  while (sp[0] > stack) {
+    vnode = *--sp[0];
+    V = &vnodes[vnode];
+    if (zero64(V->size)) continue;
+    D = &dumps[V->dump - 1];
+    if ((r = xfseek(&D->X, &V->d_offset))
+    ||  (r = ParseDirectory(&D->X, &dp, lo64(V->size), 0))) {
+      free(stack);
+      return r;
+    }
+  }
+  free(stack);
+  n_dropped = 0;
+  for (vnode = 0; vnode < nvnodes; vnode++)
+    if (vnodes[vnode].dump && !vnodes[vnode].live) n_dropped++;
+  return 0;
+}
+
+
+/* Copy a range of a dump to the output */
+static afs_uint32 copy_range(XFILE *OX, XFILE *X, u_int64 *start, u_int64 *end)
+{
+  static char buf[COPY_BUFSIZE];
+  u_int64 left, tmp64;
+  afs_uint32 r, n;
+
+  if (r = xfseek(X, start)) return r;
+  sub64_64(left, *end, *start);
+  while (!zero64(left)) {
+    n = (hi64(left) || lo64(left) > COPY_BUFSIZE) ? COPY_BUFSIZE : lo64(left);
+    if (r = xfread(X, buf, n)) return r;
+    if (r = xfwrite(OX, buf, n)) return r;
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  return 0;
+}
+
+
+/* Write the merged dump */
+static afs_uint32 write_dump(XFILE *OX)
+{
+  struct dump *last = &dumps[ndumps - 1];
+  afs_dump_header hdr;
+  struct vrec *V;
+  afs_uint32 vnode, r;
+  int pass;
+
+  hdr = last->hdr;
+  hdr.field_mask |= F_DUMPHDR_FROM | F_DUMPHDR_TO;
+  hdr.from_date = 0;
+  if (r = DumpDumpHeader(OX, &hdr)) return r;
+  if (r = copy_range(OX, &last->X, &last->vh_offset, &last->vh_end)) return r;
+
+  /* Directories (odd vnode numbers) first, then everything else */
+  for (pass = 1; pass >= 0; pass--) {
+    for (vnode = pass; vnode < nvnodes; vnode += 2) {
+      V = &vnodes[vnode];
+      if (!V->live) continue;
+      r = copy_range(OX, &dumps[V->dump - 1].X, &V->offset, &V->end);
+      if (r) return r;
+      dumps[V->dump - 1].used++;
+    }
+  }
+  return DumpDumpEnd(OX);
+}
+
+
+int main(int argc, char **argv)
+{
+  afs_uint32 r;
+  XFILE OX;
+  int i;
+
+  parse_options(argc, argv);
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+
+  for (i = 0; i < ndumps; i++) {
+    if (r = scan_dump(&dumps[i])) {
+      afs_com_err(argv0, r, "parsing %s", dumps[i].path);
+      exit(2);
+    }
+  }
+  if (error_count)
+    fprintf(stderr, "%s: %u errors in dumps%s\n", argv0, error_count,
+            verbose ? "" : " (use -v to see them)");
+  if (check_chain() && !force) {
+    fprintf(stderr, "%s: not a chain of dumps (use -f to merge anyway)\n",
+            argv0);
+    exit(1);
+  }
+
+  if (r = mark_live()) {
+    afs_com_err(argv0, r, "walking directories");
+    exit(2);
+  }
+  if (n_dangling)
+    fprintf(stderr, "%s: %u directory entries have no vnode\n",
+            argv0, n_dangling);
+
+  if (outpath) r = xfopen(&OX, O_RDWR|O_CREAT|O_TRUNC, outpath);
+  else         r = xfopen_FILE(&OX, O_RDWR, stdout);
+  if (!r) r = xfsetbuf(&OX, XFBUFSIZE);
+  if (r) {
+    afs_com_err(argv0, r, "opening %s", outpath ? outpath : "output");
+    exit(2);
+  }
+  if ((r = write_dump(&OX)) || (r = xfclose(&OX))) {
+    afs_com_err(argv0, r, "writing %s", outpath ? outpath : "output");
+    exit(2);
+  }
+
+  if (verbose) {
+    for (i = 0; i < ndumps; i++)
+      fprintf(stderr, "%s: %u of %u vnodes\n", dumps[i].path,
+              dumps[i].used, dumps[i].nvnodes);
+    fprintf(stderr, "%u vnodes written, %u deleted vnodes dropped\n",
+            n_live, n_dropped);
+  }
+  for (i = 0; i < ndumps; i++)
+    xfclose(&dumps[i].X);
+  exit(0);
+}
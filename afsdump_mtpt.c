@@ -59,6 +59,7 @@ extern afs_uint32 repair_vnode_cb(afs_vnode *, XFILE *, void *);
 char *argv0;
 static char *input_path, *gendump_path;
 static int quiet, verbose, error_count;
+static int compress, zlevel;
 
 static dump_parser dp;
 
@@ -75,6 +76,7 @@ static void usage(int status, char *msg)
   fprintf(stderr, "  -h     Print this help message\n");
   fprintf(stderr, "  -q     Quiet mode (don't print errors)\n");
   fprintf(stderr, "  -v     Verbose mode\n");
+  fprintf(stderr, "  -zn    Compress output with zstd at level n\n");
   exit(status);
 }
 
@@ -92,15 +94,17 @@ static void parse_options(int argc, char **argv)
   /* Initialize options */
   input_path = gendump_path = "-";
   quiet = verbose = 0;
+  compress = zlevel = 0;
 
   /* Initialize other stuff */
   error_count = 0;
 
   /* Parse the options */
-  while ((c = getopt(argc, argv, "hqv")) != EOF) {
+  while ((c = getopt(argc, argv, "hqvz:")) != EOF) {
     switch (c) {
       case 'q': quiet        = 1;      continue;
       case 'v': verbose      = 1;      continue;
+      case 'z': compress = 1; zlevel = atoi(optarg); continue;
       case 'h': usage(0, 0);           exit(0);
       default:  usage(1, "Invalid option!");
     }
@@ -312,9 +316,16 @@ static afs_uint32 error_cb(afs_uint32 err, int fatal, void *refcon,
 /* Setup for generating a repaired dump */
 static afs_uint32 setup_output(XFILE *output_file)
 {
+  static XFILE raw_output;
   afs_uint32 r;
 
-  r = xfopen(output_file, O_RDWR|O_CREAT|O_TRUNC, gendump_path);
+  if (compress) {
+    r = xfopen(&raw_output, O_RDWR|O_CREAT|O_TRUNC, gendump_path);
+    if (!r) r = xfopen_zstdseek(output_file, O_RDWR, &raw_output, zlevel, -1);
+  } else {
+    r = xfopen(output_file, O_RDWR|O_CREAT|O_TRUNC, gendump_path);
+  }
+  if (!r) r = xfsetbuf(output_file, XFBUFSIZE);
   if (r) return r;
 
   dp.refcon = output_file;
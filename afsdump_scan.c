@@ -53,12 +53,17 @@ extern afs_uint32 repair_volhdr_cb(afs_vol_header *, XFILE *, void *);
 extern afs_uint32 repair_vnode_cb(afs_vnode *, XFILE *, void *);
 
 char *argv0;
-static char *input_path, *gendump_path;
+static char *input_path, *gendump_path, *trace_path, *manifest_path;
+static char *names_path;
 static afs_uint32 printflags, repairflags;
-static int quiet, verbose, error_count;
+static int quiet, verbose, error_count, readahead, dostats, progress_mb;
 
 static path_hashinfo phi;
 static dump_parser dp;
+static dump_stats stats;
+static xfstats out_stats;
+static XFILE manifest;
+static name_filters filters;
 
 
 /* Print a usage message and exit */
@@ -81,9 +86,19 @@ static void usage(int status, char *msg)
   fprintf(stderr, "          b = Seek backward to find skipped tags\n");
   fprintf(stderr, "          d = Resync after vnode data\n");
   fprintf(stderr, "          v = Resync after corrupted vnodes\n");
+  fprintf(stderr, "  -bn    Read ahead up to n buffers of a non-seekable dump\n");
+  fprintf(stderr, "         (default 8; 0 disables read-ahead)\n");
   fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -In    Report progress every n megabytes\n");
+  fprintf(stderr, "  -Mxxx  Write a manifest of vnode data hashes to file xxx\n");
+  fprintf(stderr, "  -Nxxx  Write name filters for afsdump_findname to file xxx\n");
+  fprintf(stderr, "         (usually the dump's name followed by .names)\n");
   fprintf(stderr, "  -gxxx  Generate a new dump in file xxx\n");
+  fprintf(stderr, "         (ZSTD:[level::]xxx to compress it with zstd)\n");
   fprintf(stderr, "  -q     Quiet mode (don't print errors)\n");
+  fprintf(stderr, "  -S     Print parser statistics at the end\n");
+  fprintf(stderr, "  -Txxx  Write a timeline of the parse to file xxx\n");
+  fprintf(stderr, "         (Chrome trace format, for chrome://tracing or Perfetto)\n");
   fprintf(stderr, "  -v     Verbose mode\n");
   exit(status);
 }
@@ -144,20 +159,27 @@ static void parse_options(int argc, char **argv)
   else argv0 = argv[0];
 
   /* Initialize options */
-  input_path = gendump_path = 0;
+  input_path = gendump_path = trace_path = manifest_path = names_path = 0;
   printflags = repairflags = 0;
-  quiet = verbose = 0;
+  quiet = verbose = dostats = progress_mb = 0;
+  readahead = -1;
 
   /* Initialize other stuff */
   error_count = 0;
 
   /* Parse the options */
-  while ((c = getopt(argc, argv, "P:R:g:hqv")) != EOF) {
+  while ((c = getopt(argc, argv, "I:M:N:P:R:ST:b:g:hqv")) != EOF) {
     switch (c) {
       case 'P': printflags   = parse_printflags(optarg);  continue;
       case 'R': repairflags  = parse_repairflags(optarg); continue;
+      case 'b': readahead    = atoi(optarg);              continue;
+      case 'I': progress_mb  = atoi(optarg);              continue;
+      case 'M': manifest_path = optarg;                   continue;
+      case 'N': names_path   = optarg;                    continue;
       case 'g': gendump_path = optarg;                    continue;
       case 'q': quiet        = 1;                         continue;
+      case 'S': dostats      = 1;                         continue;
+      case 'T': trace_path   = optarg;                    continue;
       case 'v': verbose      = 1;                         continue;
       case 'h': usage(0, 0);                              exit(0);
       default:  usage(1, "Invalid option!");
@@ -165,6 +187,8 @@ static void parse_options(int argc, char **argv)
   }
 
   if (quiet && verbose) usage(1, "Can't specify both -q and -v");
+  if (progress_mb < 0 || progress_mb >= 4096)
+    usage(1, "Progress interval must be less than 4096 MB");
 
   /* Parse non-option arguments */
   if (argc - optind > 1) usage(1, "Too many arguments!");
@@ -187,6 +211,14 @@ static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg,
 }
 
 
+/* A callback to report progress */
+static afs_uint32 progress_cb(dump_progress *P, void *refcon)
+{
+  PrintProgress(argv0, P);
+  return 0;
+}
+
+
 /* A callback to print the path of a vnode. */
 static afs_uint32 print_vnode_path(afs_vnode *v, XFILE *X, void *refcon)
 {
@@ -215,6 +247,7 @@ static afs_uint32 setup_repair(void)
   afs_uint32 r;
 
   r = xfopen(&repair_output, O_RDWR|O_CREAT|O_TRUNC, gendump_path);
+  if (!r) r = xfsetbuf(&repair_output, XFBUFSIZE);
   if (r) return r;
 
   dp.cb_dumphdr     = repair_dumphdr_cb;
@@ -230,8 +263,8 @@ static afs_uint32 setup_repair(void)
 /* Main program */
 int main(int argc, char **argv)
 {
-  XFILE input_file;
-  afs_uint32 r;
+  XFILE input_file, raw_input;
+  afs_uint32 r, tr;
   int code = 0;
 
   parse_options(argc, argv);
@@ -251,14 +284,32 @@ int main(int argc, char **argv)
   memset(&dp, 0, sizeof(dp));
   dp.cb_error     = my_error_cb;
   dp.repair_flags = repairflags;
+  if (progress_mb > 0) {
+    dp.cb_progress    = progress_cb;
+    dp.progress_bytes = (afs_uint32)progress_mb << 20;
+  }
   if (input_file.is_seekable) dp.flags |= DSFLAG_SEEK;
   else {
     if (repairflags)
       fprintf(stderr, "Repair modes available only for seekable dumps\n");
     if (printflags & DSPRINT_PATH)
       fprintf(stderr, "Path-printing available only for seekable dumps\n");
-    if (repairflags || (printflags & DSPRINT_PATH))
+    if (names_path)
+      fprintf(stderr, "Name filters available only for seekable dumps\n");
+    if (repairflags || (printflags & DSPRINT_PATH) || names_path)
       exit(1);
+
+    /* Let a separate thread do the reading, so I/O overlaps parsing */
+    if (readahead) {
+      raw_input = input_file;
+      r = xfopen_readahead(&input_file, O_RDONLY, &raw_input,
+                           readahead < 0 ? 0 : readahead, 0);
+      if (r) {
+        afs_com_err(argv0, r, "starting read-ahead on %s", input_path);
+        xfclose(&raw_input);
+        exit(2);
+      }
+    }
   }
 
   if (gendump_path && (r = setup_repair())) {
@@ -267,12 +318,20 @@ int main(int argc, char **argv)
     exit(2);
   }
 
-  if (printflags & DSPRINT_PATH) {
+  if (trace_path && (r = xftrace_open(&dp.trace, trace_path, argv0))) {
+    afs_com_err(argv0, r, "opening trace file %s", trace_path);
+    xfclose(&input_file);
+    exit(2);
+  }
+  if (gendump_path) repair_output.trace = dp.trace;
+
+  if ((printflags & DSPRINT_PATH) || names_path) {
     u_int64 where;
 
     dp.print_flags = printflags & DSPRINT_DEBUG;
     memset(&phi, 0, sizeof(phi));
     phi.p = &dp;
+    if (names_path) phi.filters = &filters;
 
     if ((r = xftell(&input_file, &where))
     ||  (r = Path_PreScan(&input_file, &phi, 0))
@@ -281,7 +340,19 @@ int main(int argc, char **argv)
       xfclose(&input_file);
       exit(2);
     }
+  }
+
+  if (names_path) {
+    r = Filter_Write(&filters, names_path);
+    Filter_Free(&filters);
+    if (r) {
+      afs_com_err(argv0, r, "writing name filters to %s", names_path);
+      xfclose(&input_file);
+      exit(2);
+    }
+  }
 
+  if (printflags & DSPRINT_PATH) {
     dp.cb_vnode_dir   = print_vnode_path;
     dp.cb_vnode_file  = print_vnode_path;
     dp.cb_vnode_link  = print_vnode_path;
@@ -289,6 +360,25 @@ int main(int argc, char **argv)
     dp.cb_vnode_wierd = print_vnode_path;
   }
 
+  if (manifest_path) {
+    r = xfopen(&manifest, O_RDWR|O_CREAT|O_TRUNC, manifest_path);
+    if (!r) r = xfsetbuf(&manifest, XFBUFSIZE);
+    if (r) {
+      afs_com_err(argv0, r, "opening manifest %s", manifest_path);
+      xfclose(&input_file);
+      exit(2);
+    }
+    dp.flags |= DSFLAG_HASH;
+    dp.manifest = &manifest;
+  }
+
+  if (dostats) {
+    memset(&stats, 0, sizeof(stats));
+    memset(&out_stats, 0, sizeof(out_stats));
+    dp.stats = &stats;
+    if (gendump_path) repair_output.stats = &out_stats;
+  }
+
   dp.print_flags  = printflags;
   r = ParseDumpFile(&input_file, &dp);
   xfclose(&input_file);
@@ -297,6 +387,21 @@ int main(int argc, char **argv)
     if (!r) r = xfclose(&repair_output);
     else xfclose(&repair_output);
   }
+  if (manifest_path) {
+    if (!r) r = xfclose(&manifest);
+    else xfclose(&manifest);
+  }
+  if (dp.trace && (tr = xftrace_close(dp.trace)))
+    afs_com_err(argv0, tr, "writing trace file %s", trace_path);
+
+  if (dostats) {
+    char buf[21];
+
+    PrintDumpStats(&stats);
+    if (gendump_path)
+      printf(" Bytes written:   %s in %d calls\n",
+             decimate_int64(&out_stats.bytes_written, buf), out_stats.n_write);
+  }
 
   if (verbose && error_count) fprintf(stderr, "*** %d errors\n", error_count);
   if (r && !quiet) fprintf(stderr, "*** FAILED: %s\n", afs_error_message(r));
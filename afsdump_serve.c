@@ -0,0 +1,649 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* afsdump_serve.c - Serve files from dumps over a local socket
+ *
+ * Restoring a file from a dump with afsdump_extract means prescanning
+ * the whole dump first, every time.  afsdump_serve instead keeps an
+ * index of each dump it uses in memory (see dumpfs.c), so that any
+ * number of lookups, listings and reads cost one pass over the dump.
+ * Dumps in a catalog (see afsdump_catalog) need no pass at all: their
+ * index is loaded from the catalog, and reads go straight to the data,
+ * which for an incremental dump may be in an earlier dump.
+ *
+ * Clients connect to a Unix-domain socket and send requests, each a
+ * line of tab-separated fields.  Each reply starts with a line that is
+ * either "OK ..." or "ERR code message":
+ *
+ *   DUMPS                       OK n, then n lines: dump, source, loaded
+ *   LOOKUP dump path            OK vnode uniq type size
+ *   LIST dump path              OK n, then n lines: name, vnode, uniq,
+ *                                                   type, size
+ *   READ dump path [off [len]]  OK n, then n bytes of data
+ *   QUIT
+ *
+ * AFS names may contain tabs and newlines, so in requests and replies,
+ * a backslash, tab, newline or carriage return within a field is sent
+ * as \\, \t, \n or \r.
+ *
+ * Only dumps named on the command line or in the catalog can be used,
+ * and anyone who can connect to the socket can read them, so put it in
+ * a directory only the intended clients can reach.  Indexes are kept
+ * for the most recently used dumps, up to a limit (-n).
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+#define MAX_LINE    8192            /* Longest request */
+#define MAX_FIELDS  6               /* Most fields in a request */
+#define READ_CHUNK  65536           /* Data read per trip through the lock */
+
+extern int optind;
+extern char *optarg;
+
+char *argv0;
+static char *catalog_path, *socket_path;
+static char **dump_args;
+static int n_dump_args, max_active, verbose;
+
+typedef struct {
+  char *path;                  /* Where the dump is */
+  cat_section *S;              /* Its catalog section, if any */
+  afs_uint32 used;             /* When it was last used */
+  int busy;                    /* Number of requests using it */
+  int loading;                 /* Is a request building the index? */
+  int loaded;                  /* Is there an index? */
+  dumpfs fs;                   /* The index */
+} served_dump;
+
+static dump_catalog catalog;
+static dump_parser error_parser;
+static served_dump *dumps;
+static int n_dumps;
+static afs_uint32 use_clock;
+
+/* The state of the dumps is under serve_lock, which is held only
+ * briefly.  Building an index takes a pass over the dump or a read of
+ * the catalog, so it is done without serve_lock; the dump is marked as
+ * loading meanwhile, and other requests for it wait on load_cond.  The
+ * parser and the catalog can't be used by two threads at once, so the
+ * indexing itself is under parse_lock.  Once a dump is loaded, lookups
+ * and reads need no lock; a dump is busy while requests are using it,
+ * and is not unloaded until it isn't.  Clients are sent their replies
+ * without any lock.
+ */
+static pthread_mutex_t serve_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t load_cond = PTHREAD_COND_INITIALIZER;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] socket [dump...]\n", argv0);
+  fprintf(stderr, "  -c catalog  Also serve the dumps in catalog, using its index\n");
+  fprintf(stderr, "  -h          Print this help message\n");
+  fprintf(stderr, "  -n count    Keep indexes for up to count dumps (default 32)\n");
+  fprintf(stderr, "  -v          Verbose mode (log loads and errors)\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  catalog_path = 0;
+  max_active = 32;
+  verbose = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "c:hn:v")) != EOF) {
+    switch (c) {
+      case 'c': catalog_path = optarg;                    continue;
+      case 'n': max_active   = atoi(optarg);              continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (max_active < 1) usage(1, "Invalid count");
+  if (argc == optind) usage(1, "No socket specified");
+  socket_path = argv[optind++];
+  dump_args = argv + optind;
+  n_dump_args = argc - optind;
+  if (!n_dump_args && !catalog_path) usage(1, "No dumps to serve");
+}
+
+
+/* A callback to print errors, but only in verbose mode */
+static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg, ...)
+{
+  va_list alist;
+
+  if (verbose) {
+    va_start(alist, msg);
+    afs_com_err_va(argv0, code, msg, alist);
+    va_end(alist);
+  }
+  return 0;
+}
+
+
+/* Parse a decimal number into a 64-bit value */
+static int parse_int64(char *str, u_int64 *val)
+{
+  u_int64 x8, x2;
+
+  if (!*str) return -1;
+  mk64(*val, 0, 0);
+  for (; *str; str++) {
+    if (*str < '0' || *str > '9' || hi64(*val) >= 0x10000000) return -1;
+    cp64(x8, *val);
+    shift_int64(&x8, 3);
+    cp64(x2, *val);
+    shift_int64(&x2, 1);
+    add64_64(*val, x8, x2);
+    add64_32(x8, *val, *str - '0');
+    cp64(*val, x8);
+  }
+  return 0;
+}
+
+
+static char *type_name(afs_uint32 type)
+{
+  switch (type) {
+    case vFile:      return "file";
+    case vDirectory: return "dir";
+    case vSymlink:   return "symlink";
+    default:         return "?";
+  }
+}
+
+
+/* Write a field, escaping the characters that frame the protocol */
+static void put_field(FILE *out, char *str)
+{
+  for (; *str; str++) {
+    switch (*str) {
+      case '\\': fputs("\\\\", out); break;
+      case '\t': fputs("\\t", out);  break;
+      case '\n': fputs("\\n", out);  break;
+      case '\r': fputs("\\r", out);  break;
+      default:   putc(*str, out);   break;
+    }
+  }
+}
+
+
+/* Undo put_field's escapes, in place.  Returns nonzero if str has an
+ * escape that put_field wouldn't have written.
+ */
+static int unescape(char *str)
+{
+  char *x;
+
+  for (x = str; *str; str++) {
+    if (*str != '\\') {
+      *x++ = *str;
+      continue;
+    }
+    switch (*++str) {
+      case '\\': *x++ = '\\'; break;
+      case 't':  *x++ = '\t'; break;
+      case 'n':  *x++ = '\n'; break;
+      case 'r':  *x++ = '\r'; break;
+      default:   return -1;
+    }
+  }
+  *x = 0;
+  return 0;
+}
+
+
+/** Dumps and their indexes **/
+
+static served_dump *find_dump(char *path)
+{
+  int i;
+
+  for (i = 0; i < n_dumps; i++)
+    if (!strcmp(dumps[i].path, path)) return &dumps[i];
+  return 0;
+}
+
+
+/* Make room for one more index, by dropping the ones used least
+ * recently.  Busy dumps are kept even if that means going over, and
+ * indexes being built count against the limit.
+ */
+static void make_room(void)
+{
+  served_dump *oldest;
+  int i, n_loaded;
+
+  for (;;) {
+    oldest = 0;
+    for (n_loaded = i = 0; i < n_dumps; i++) {
+      if (!dumps[i].loaded && !dumps[i].loading) continue;
+      n_loaded++;
+      if (dumps[i].busy || dumps[i].loading) continue;
+      if (!oldest || dumps[i].used < oldest->used) oldest = &dumps[i];
+    }
+    if (n_loaded < max_active || !oldest) return;
+    DumpFS_Close(&oldest->fs);
+    oldest->loaded = 0;
+    if (verbose) fprintf(stderr, "%s: unloaded %s\n", argv0, oldest->path);
+  }
+}
+
+
+/* Load a dump's index if needed, and mark it busy.  If another request
+ * is loading it, wait for that instead.
+ */
+static afs_uint32 use_dump(served_dump *D)
+{
+  afs_uint32 r = 0;
+
+  pthread_mutex_lock(&serve_lock);
+  D->used = ++use_clock;
+  while (D->loading) pthread_cond_wait(&load_cond, &serve_lock);
+  if (!D->loaded) {
+    make_room();
+    D->loading = 1;
+    pthread_mutex_unlock(&serve_lock);
+
+    pthread_mutex_lock(&parse_lock);
+    if (D->S) r = DumpFS_OpenCatalog(&D->fs, &catalog, D->S);
+    else r = DumpFS_Open(&D->fs, D->path, &error_parser);
+    pthread_mutex_unlock(&parse_lock);
+
+    pthread_mutex_lock(&serve_lock);
+    D->loading = 0;
+    if (!r) {
+      D->loaded = 1;
+      if (verbose)
+        fprintf(stderr, "%s: loaded %s from %s\n", argv0, D->path,
+                D->S ? "the catalog" : "a scan");
+    }
+    pthread_cond_broadcast(&load_cond);
+  }
+  if (!r) D->busy++;
+  pthread_mutex_unlock(&serve_lock);
+  return r;
+}
+
+
+static void release_dump(served_dump *D)
+{
+  pthread_mutex_lock(&serve_lock);
+  D->busy--;
+  pthread_mutex_unlock(&serve_lock);
+}
+
+
+/** Requests **/
+
+static void reply_error(FILE *out, afs_uint32 code)
+{
+  fprintf(out, "ERR %u %s\n", code, afs_error_message(code));
+}
+
+
+/* Only whether each dump is loaded can change, so that is all that
+ * needs copying under the lock.
+ */
+static void do_dumps(FILE *out)
+{
+  char *loaded;
+  int i;
+
+  if (!(loaded = malloc(n_dumps + 1))) {
+    reply_error(out, ENOMEM);
+    return;
+  }
+  pthread_mutex_lock(&serve_lock);
+  for (i = 0; i < n_dumps; i++) loaded[i] = dumps[i].loaded;
+  pthread_mutex_unlock(&serve_lock);
+
+  fprintf(out, "OK %d\n", n_dumps);
+  for (i = 0; i < n_dumps; i++) {
+    put_field(out, dumps[i].path);
+    fprintf(out, "\t%s\t%d\n", dumps[i].S ? "catalog" : "scan", loaded[i]);
+  }
+  free(loaded);
+}
+
+
+static void do_lookup(FILE *out, served_dump *D, char *path)
+{
+  dumpfs_file F;
+  afs_uint32 r;
+  char buf[21];
+
+  if (r = use_dump(D)) {
+    reply_error(out, r);
+    return;
+  }
+  if (r = DumpFS_Lookup(&D->fs, path, &F)) reply_error(out, r);
+  else fprintf(out, "OK %u\t%u\t%s\t%s\n", F.vnode, F.vuniq,
+               type_name(F.type), decimate_int64(&F.size, buf));
+  release_dump(D);
+}
+
+
+static void do_list(FILE *out, served_dump *D, char *path)
+{
+  dumpfs_file F, E;
+  afs_uint32 r, i;
+  char buf[21], *name;
+
+  if (r = use_dump(D)) {
+    reply_error(out, r);
+    return;
+  }
+  if (!(r = DumpFS_Lookup(&D->fs, path, &F)) && F.type != vDirectory)
+    r = ENOTDIR;
+  if (r) reply_error(out, r);
+  else {
+    fprintf(out, "OK %u\n", F.nchild);
+    for (i = 0; !DumpFS_ReadDir(&D->fs, &F, i, &name, &E); i++) {
+      put_field(out, name);
+      fprintf(out, "\t%u\t%u\t%s\t%s\n", E.vnode, E.vuniq,
+              type_name(E.type), decimate_int64(&E.size, buf));
+    }
+  }
+  release_dump(D);
+}
+
+
+/* Send some or all of a file's data, a chunk at a time.  Returns
+ * nonzero if the connection can't continue.
+ */
+static int do_read(FILE *out, served_dump *D, char *path,
+                   char *offset_str, char *length_str)
+{
+  dumpfs_file F;
+  u_int64 offset, length, left, tmp64;
+  afs_uint32 r, n, nread;
+  char buf[21], *chunk = 0;
+
+  mk64(offset, 0, 0);
+  if ((offset_str && parse_int64(offset_str, &offset))
+  ||  (length_str && parse_int64(length_str, &length))) {
+    reply_error(out, EINVAL);
+    return 0;
+  }
+
+  if (r = use_dump(D)) {
+    reply_error(out, r);
+    return 0;
+  }
+  r = DumpFS_Lookup(&D->fs, path, &F);
+  if (!r && F.type == vDirectory) r = EISDIR;
+  if (!r && !zero64(F.size) && F.src == DUMPFS_NONE) r = ENOENT;
+  if (!r && !(chunk = malloc(READ_CHUNK))) r = ENOMEM;
+  if (r) {
+    reply_error(out, r);
+    release_dump(D);
+    return 0;
+  }
+
+  /* Work out what to send */
+  if (gt64(offset, F.size)) cp64(offset, F.size);
+  sub64_64(left, F.size, offset);
+  if (length_str && lt64(length, left)) cp64(left, length);
+  fprintf(out, "OK %s\n", decimate_int64(&left, buf));
+
+  while (!zero64(left)) {
+    n = (hi64(left) || lo64(left) > READ_CHUNK) ? READ_CHUNK : lo64(left);
+    if (r = DumpFS_Read(&D->fs, &F, &offset, chunk, n, &nread)) {
+      my_error_cb(r, 0, 0, "reading %s from %s", path, D->path);
+      break;
+    }
+    if (fwrite(chunk, n, 1, out) != 1) {
+      r = errno;
+      break;
+    }
+    add64_32(tmp64, offset, n);
+    cp64(offset, tmp64);
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  free(chunk);
+  release_dump(D);
+  return r ? -1 : 0;
+}
+
+
+/* Carry out one request.  Returns nonzero to close the connection. */
+static int do_request(FILE *out, int argc, char **argv)
+{
+  served_dump *D = 0;
+
+  if (!strcmp(argv[0], "QUIT")) return 1;
+  if (!strcmp(argv[0], "DUMPS") && argc == 1) {
+    do_dumps(out);
+    return 0;
+  }
+
+  if (argc >= 3 && !(D = find_dump(argv[1]))) {
+    reply_error(out, ENOENT);
+    return 0;
+  }
+  if (!strcmp(argv[0], "LOOKUP") && argc == 3)
+    do_lookup(out, D, argv[2]);
+  else if (!strcmp(argv[0], "LIST") && argc == 3)
+    do_list(out, D, argv[2]);
+  else if (!strcmp(argv[0], "READ") && argc >= 3 && argc <= 5)
+    return do_read(out, D, argv[2], argc > 3 ? argv[3] : 0,
+                   argc > 4 ? argv[4] : 0);
+  else
+    reply_error(out, EINVAL);
+  return 0;
+}
+
+
+/* Serve one client, until it goes away or asks to */
+static void *serve_client(void *arg)
+{
+  int fd = (int)(long)arg, argc, i;
+  char line[MAX_LINE], *argv[MAX_FIELDS], *x;
+  FILE *in, *out;
+
+  in = fdopen(fd, "r");
+  out = fdopen(dup(fd), "w");
+  if (!in || !out) {
+    if (in) fclose(in);
+    else close(fd);
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), in)) {
+    if (!(x = strchr(line, '\n'))) {
+      reply_error(out, ENAMETOOLONG);
+      break;
+    }
+    *x = 0;
+    if (x > line && x[-1] == '\r') x[-1] = 0;
+
+    for (argc = 0, x = line; argc < MAX_FIELDS; ) {
+      argv[argc++] = x;
+      if (!(x = strchr(x, '\t'))) break;
+      *x++ = 0;
+    }
+    if (x) {
+      reply_error(out, E2BIG);
+      break;
+    }
+    for (i = 0; i < argc && !unescape(argv[i]); i++);
+    if (i < argc) {
+      reply_error(out, EINVAL);
+      if (fflush(out)) break;
+      continue;
+    }
+    if (do_request(out, argc, argv)) break;
+    if (fflush(out)) break;
+  }
+  fclose(out);
+  fclose(in);
+  return 0;
+}
+
+
+/* Set up the list of dumps, from the command line and the catalog */
+static afs_uint32 setup_dumps(void)
+{
+  served_dump *D;
+  afs_uint32 i, r;
+
+  if (catalog_path && (r = Catalog_Open(&catalog, catalog_path, 0))) {
+    afs_com_err(argv0, r, "opening %s", catalog_path);
+    return r;
+  }
+  dumps = malloc((n_dump_args + catalog.nsections + 1) * sizeof(served_dump));
+  if (!dumps) return ENOMEM;
+  memset(dumps, 0, (n_dump_args + catalog.nsections + 1) * sizeof(served_dump));
+
+  /* A dump in the catalog more than once is served from its last section */
+  for (i = 0; i < catalog.nsections; i++) {
+    if (!(D = find_dump(catalog.sections[i].dump_path))) {
+      D = &dumps[n_dumps++];
+      D->path = catalog.sections[i].dump_path;
+    }
+    D->S = &catalog.sections[i];
+  }
+  for (i = 0; i < n_dump_args; i++) {
+    if (find_dump(dump_args[i])) continue;
+    dumps[n_dumps++].path = dump_args[i];
+  }
+  return 0;
+}
+
+
+/* Create the socket, replacing any stale one */
+static int make_socket(void)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd;
+
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", argv0);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+  if (!lstat(socket_path, &st) && S_ISSOCK(st.st_mode)) unlink(socket_path);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+  ||  bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+  ||  listen(fd, 64) < 0) {
+    afs_com_err(argv0, errno, "creating socket %s", socket_path);
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+
+/* Main program */
+int main(int argc, char **argv)
+{
+  pthread_t thread;
+  pthread_attr_t attr;
+  int lfd, fd, i, n;
+
+  parse_options(argc, argv);
+  initialize_acfg_error_table();
+  initialize_AVds_error_table();
+  initialize_rxk_error_table();
+  initialize_u_error_table();
+  initialize_vl_error_table();
+  initialize_vols_error_table();
+  initialize_xFil_error_table();
+
+  if (setup_dumps()) exit(2);
+
+  /* Keep the dumps named on the command line hot from the start */
+  error_parser.cb_error = my_error_cb;
+  for (n = i = 0; i < n_dumps && n < max_active; i++) {
+    if (dumps[i].S) continue;
+    n++;
+    if (use_dump(&dumps[i]))
+      fprintf(stderr, "%s: can't index %s; will try again when asked\n",
+              argv0, dumps[i].path);
+    else release_dump(&dumps[i]);
+  }
+
+  if ((lfd = make_socket()) < 0) exit(2);
+  signal(SIGPIPE, SIG_IGN);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (verbose)
+    fprintf(stderr, "%s: serving %d dumps on %s\n", argv0, n_dumps, socket_path);
+
+  for (;;) {
+    if ((fd = accept(lfd, 0, 0)) < 0) {
+      if (errno == EINTR) continue;
+      afs_com_err(argv0, errno, "accepting connection");
+      exit(2);
+    }
+    if (pthread_create(&thread, &attr, serve_client, (void *)(long)fd)) {
+      fprintf(stderr, "%s: can't start a thread for a client\n", argv0);
+      close(fd);
+    }
+  }
+}
@@ -79,6 +79,7 @@ static void usage(int status, char *msg)
   fprintf(stderr, "  -Annn  Add all rights for ID nnn to every directory\n");
   fprintf(stderr, "  -h     Print this help message\n");
   fprintf(stderr, "  -gxxx  Generate a new dump in file xxx\n");
+  fprintf(stderr, "         (ZSTD:[level::]xxx to compress it with zstd)\n");
   fprintf(stderr, "  -q     Quiet mode (don't print errors)\n");
   fprintf(stderr, "  -v     Verbose mode\n");
   exit(status);
@@ -251,6 +252,7 @@ static afs_uint32 setup_repair(void)
   afs_uint32 r;
 
   r = xfopen(&repair_output, O_RDWR, gendump_path);
+  if (!r) r = xfsetbuf(&repair_output, XFBUFSIZE);
   if (r) return r;
 
   dp.cb_dumphdr     = repair_dumphdr_cb;
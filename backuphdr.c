@@ -32,9 +32,10 @@
 
 #include "dumpscan.h"
 #include "dumpscan_errs.h"
+#include "internal.h"
 #include "stagehdr.h"
 
-afs_uint32 try_backuphdr(XFILE *X, char *tag, tagged_field *field,
+afs_uint32 try_backuphdr(XFILE *X, unsigned char *tag, tagged_field *field,
                       afs_uint32 value, tag_parse_info *pi,
                       void *g_refcon, void *l_refcon)
 {
@@ -52,11 +53,16 @@ afs_uint32 try_backuphdr(XFILE *X, char *tag, tagged_field *field,
   if (r) return r;
 
   /* Do something with it... */
+  progress_total(X, p, &bh.dumplen);
   if (p->print_flags & DSPRINT_BCKHDR) PrintBackupHdr(&bh);
   if (p->cb_bckhdr) {
+    struct timespec t0;
+
     r = xftell(X, &where);
+    cb_timer_start(p, &t0, "cb_bckhdr");
     if (!r && p->cb_bckhdr)
       r = (p->cb_bckhdr)(&bh, X, p->refcon);
+    cb_timer_stop(p, &t0);
     if (p->flags & DSFLAG_SEEK) {
       if (!r) r = xfseek(X, &where);
       else xfseek(X, &where);
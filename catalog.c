@@ -0,0 +1,699 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* catalog.c - Catalogs of many dumps
+ *
+ * A catalog records, for each dump added to it, where the dump is, what
+ * volume and dates it covers, and every path in the volume at the time
+ * of the dump, with the vnode's attributes and where its data is.  It
+ * is meant to answer "which dumps have this file, and what did it look
+ * like then" without reading any of the dumps.
+ *
+ * The catalog is a file header followed by one section per dump, each
+ * written once and never changed; adding a dump appends a section.
+ * All integers are in network byte order; 64-bit ones are written high
+ * word first.
+ *
+ *   File header:  magic, version, 8 bytes reserved
+ *   Section:      header, name dictionary, block index, columns
+ *
+ * The section header gives its own length and that of the section, the
+ * volume ID, dump dates, the section it inherited entries from (see
+ * below), the number of rows, names and name blocks, the size of the
+ * dump, the offsets of everything else within the section, and finally
+ * the volume name and the path of the dump, each null-terminated.
+ *
+ * The name dictionary holds each distinct name in the volume once, in
+ * sorted (strcmp) order, so a name's index sorts the same as the name.
+ * Names are front-coded in blocks of CAT_BLOCK: each is a byte giving
+ * how much it shares with the one before, a byte giving the length of
+ * the rest, and the rest.  The first name of each block shares nothing,
+ * and the block index gives where each block starts.
+ *
+ * There is one row for each path, in breadth-first order from the root
+ * (row 0), with the entries of each directory together and sorted by
+ * name.  A directory's row gives the first row and number of its
+ * entries, so a path is looked up one name at a time, each with a
+ * binary search of the name dictionary and then of the directory.
+ * Only the few values needed are read.  The row data is stored a
+ * column at a time, with the widths in col_width[].
+ *
+ * An incremental dump has only the vnodes that changed, so the rest of
+ * its rows are copied from the newest earlier section of the volume.
+ * Each row records the section of the dump that has its data (src).
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+#define CAT_MAGIC     0x41464443       /* "AFDC" */
+#define CAT_VERSION   1
+#define CAT_SECMAGIC  0x43536563       /* "CSec" */
+#define CAT_FILEHDR   16               /* size of file header */
+#define CAT_SECHDR    188              /* size of section header, but names */
+#define CAT_BLOCK     16               /* names per block */
+#define CAT_MAXNAME   255
+
+static int col_width[CAT_NCOLS] = { 4, 4, 4, 4, 4, 4, 1, 2, 4, 4, 4, 4, 8, 8, 4 };
+
+
+static afs_uint32 ReadInt64(XFILE *X, u_int64 *val)
+{
+  afs_uint32 r, hi, lo;
+
+  if ((r = ReadInt32(X, &hi)) || (r = ReadInt32(X, &lo))) return r;
+  mk64(*val, hi, lo);
+  return 0;
+}
+
+
+static afs_uint32 WriteInt64(XFILE *X, u_int64 *val)
+{
+  afs_uint32 r;
+
+  if (r = WriteInt32(X, hi64(*val))) return r;
+  return WriteInt32(X, lo64(*val));
+}
+
+
+/* Seek to an offset within a section */
+static afs_uint32 seek_section(dump_catalog *D, cat_section *S, u_int64 *off)
+{
+  u_int64 where;
+
+  add64_64(where, S->offset, *off);
+  return xfseek(&D->X, &where);
+}
+
+
+/* Seek to a value in a column */
+static afs_uint32 seek_col(dump_catalog *D, cat_section *S, int col, afs_uint32 row)
+{
+  u_int64 where, tmp64;
+
+  add64_64(tmp64, S->offset, S->cols[col]);
+  add64_32(where, tmp64, row * col_width[col]);
+  return xfseek(&D->X, &where);
+}
+
+
+/* Store a row's value for a column in buf, or get it from there */
+static void put_col(unsigned char *buf, int col, cat_row *R)
+{
+  afs_uint32 val = 0, lo = 0;
+
+  switch (col) {
+    case CAT_COL_NAME:    val = R->name;        break;
+    case CAT_COL_PARENT:  val = R->parent;      break;
+    case CAT_COL_FIRST:   val = R->first;       break;
+    case CAT_COL_NCHILD:  val = R->nchild;      break;
+    case CAT_COL_VNODE:   val = R->vnode;       break;
+    case CAT_COL_VUNIQ:   val = R->vuniq;       break;
+    case CAT_COL_TYPE:    val = R->type;        break;
+    case CAT_COL_MODE:    val = R->mode;        break;
+    case CAT_COL_OWNER:   val = R->owner;       break;
+    case CAT_COL_DVERS:   val = R->datavers;    break;
+    case CAT_COL_CDATE:   val = R->client_date; break;
+    case CAT_COL_SDATE:   val = R->server_date; break;
+    case CAT_COL_SRC:     val = R->src;         break;
+    case CAT_COL_SIZE:
+      val = hi64(R->size);
+      lo = lo64(R->size);
+      break;
+    case CAT_COL_DOFFSET:
+      val = hi64(R->d_offset);
+      lo = lo64(R->d_offset);
+      break;
+  }
+  switch (col_width[col]) {
+    case 1: buf[0] = val;                               break;
+    case 2: buf[0] = val >> 8;  buf[1] = val;           break;
+    case 8:
+      buf[4] = lo >> 24;  buf[5] = lo >> 16;
+      buf[6] = lo >> 8;   buf[7] = lo;
+      /* fall through */
+    case 4:
+      buf[0] = val >> 24; buf[1] = val >> 16;
+      buf[2] = val >> 8;  buf[3] = val;
+      break;
+  }
+}
+
+
+static void get_col(unsigned char *buf, int col, cat_row *R)
+{
+  afs_uint32 val = 0, lo = 0;
+
+  switch (col_width[col]) {
+    case 1: val = buf[0];                               break;
+    case 2: val = (buf[0] << 8) | buf[1];               break;
+    case 8:
+      lo = (buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7];
+      /* fall through */
+    case 4:
+      val = (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+      break;
+  }
+  switch (col) {
+    case CAT_COL_NAME:    R->name        = val; break;
+    case CAT_COL_PARENT:  R->parent      = val; break;
+    case CAT_COL_FIRST:   R->first       = val; break;
+    case CAT_COL_NCHILD:  R->nchild      = val; break;
+    case CAT_COL_VNODE:   R->vnode       = val; break;
+    case CAT_COL_VUNIQ:   R->vuniq       = val; break;
+    case CAT_COL_TYPE:    R->type        = val; break;
+    case CAT_COL_MODE:    R->mode        = val; break;
+    case CAT_COL_OWNER:   R->owner       = val; break;
+    case CAT_COL_DVERS:   R->datavers    = val; break;
+    case CAT_COL_CDATE:   R->client_date = val; break;
+    case CAT_COL_SDATE:   R->server_date = val; break;
+    case CAT_COL_SRC:     R->src         = val; break;
+    case CAT_COL_SIZE:    mk64(R->size, val, lo);     break;
+    case CAT_COL_DOFFSET: mk64(R->d_offset, val, lo); break;
+  }
+}
+
+
+/* Read a section header */
+static afs_uint32 read_section(dump_catalog *D, u_int64 *where, cat_section *S)
+{
+  XFILE *X = &D->X;
+  afs_uint32 r, magic, hdrlen;
+  int i;
+
+  memset(S, 0, sizeof(*S));
+  cp64(S->offset, *where);
+  if (r = xfseek(X, where)) return r;
+  if (r = ReadInt32(X, &magic)) return r;
+  if (magic != CAT_SECMAGIC) return DSERR_CATALOG;
+  if ((r = ReadInt32(X, &hdrlen))
+  ||  (r = ReadInt64(X, &S->length))
+  ||  (r = ReadInt32(X, &S->volid))
+  ||  (r = ReadInt32(X, &S->from_date))
+  ||  (r = ReadInt32(X, &S->to_date))
+  ||  (r = ReadInt32(X, &S->base))
+  ||  (r = ReadInt32(X, &S->nrows))
+  ||  (r = ReadInt32(X, &S->nnames))
+  ||  (r = ReadInt32(X, &S->nblocks))
+  ||  (r = ReadInt64(X, &S->dump_size))
+  ||  (r = ReadInt64(X, &S->names))
+  ||  (r = ReadInt64(X, &S->restarts)))
+    return r;
+  for (i = 0; i < CAT_NCOLS; i++)
+    if (r = ReadInt64(X, &S->cols[i])) return r;
+  if (r = ReadString(X, (unsigned char **)&S->volname)) return r;
+  if (r = ReadString(X, (unsigned char **)&S->dump_path)) {
+    free(S->volname);
+    S->volname = 0;
+    return r;
+  }
+  if (hdrlen != CAT_SECHDR + strlen(S->volname) + strlen(S->dump_path) + 2) {
+    free(S->volname);
+    free(S->dump_path);
+    S->volname = S->dump_path = 0;
+    return DSERR_CATALOG;
+  }
+  return 0;
+}
+
+
+/* Open a catalog, creating it if asked to, and read the section headers.
+ * A section cut short (by a crash while it was being added) is ignored,
+ * and will be overwritten by the next one added.
+ */
+afs_uint32 Catalog_Open(dump_catalog *D, char *path, int create)
+{
+  u_int64 size, where, tmp64;
+  cat_section S, *NS;
+  afs_uint32 r, magic, version, maxsections = 0;
+
+  memset(D, 0, sizeof(*D));
+  r = xfopen_path(&D->X, create ? O_RDWR | O_CREAT : O_RDONLY, path, 0644);
+  if (r) return r;
+  if (r = xfsize(&D->X, &size)) goto fail;
+
+  if (zero64(size)) {
+    if (!create) {
+      r = DSERR_CATALOG;
+      goto fail;
+    }
+    if ((r = WriteInt32(&D->X, CAT_MAGIC))
+    ||  (r = WriteInt32(&D->X, CAT_VERSION))
+    ||  (r = WriteInt32(&D->X, 0))
+    ||  (r = WriteInt32(&D->X, 0)))
+      goto fail;
+    mk64(D->end, 0, CAT_FILEHDR);
+    return 0;
+  }
+
+  if (ReadInt32(&D->X, &magic) || ReadInt32(&D->X, &version)
+  ||  magic != CAT_MAGIC || version != CAT_VERSION) {
+    r = DSERR_CATALOG;
+    goto fail;
+  }
+
+  mk64(where, 0, CAT_FILEHDR);
+  while (lt64(where, size)) {
+    if (read_section(D, &where, &S)) break;
+    add64_64(tmp64, where, S.length);
+    if (gt64(tmp64, size)) {
+      free(S.volname);
+      free(S.dump_path);
+      break;
+    }
+    if (D->nsections == maxsections) {
+      maxsections = maxsections ? maxsections * 2 : 64;
+      NS = realloc(D->sections, maxsections * sizeof(cat_section));
+      if (!NS) {
+        r = ENOMEM;
+        goto fail;
+      }
+      D->sections = NS;
+    }
+    S.index = D->nsections;
+    D->sections[D->nsections++] = S;
+    cp64(where, tmp64);
+  }
+  cp64(D->end, where);
+  return 0;
+
+fail:
+  Catalog_Close(D);
+  return r;
+}
+
+
+afs_uint32 Catalog_Close(dump_catalog *D)
+{
+  afs_uint32 i, r = 0;
+
+  for (i = 0; i < D->nsections; i++) {
+    free(D->sections[i].volname);
+    free(D->sections[i].dump_path);
+  }
+  if (D->sections) free(D->sections);
+  D->sections = 0;
+  D->nsections = 0;
+  if (D->X.do_close) r = xfclose(&D->X);
+  memset(&D->X, 0, sizeof(D->X));
+  return r;
+}
+
+
+/* Front-code a sorted list of names; returns the encoded names in
+ * *bufp and their length in *lenp, and the block index in *index.
+ */
+static afs_uint32 encode_names(char **names, afs_uint32 nnames,
+                               unsigned char **bufp, afs_uint32 *lenp,
+                               afs_uint32 **index)
+{
+  unsigned char *buf, *p;
+  afs_uint32 i, len, shared, size = 0;
+  char *prev = "";
+
+  for (i = 0; i < nnames; i++) {
+    if ((len = strlen(names[i])) > CAT_MAXNAME) return DSERR_BOGUS;
+    size += 2 + len;
+  }
+  if (!(buf = malloc(size ? size : 1))) return ENOMEM;
+  if (!(*index = malloc((nnames / CAT_BLOCK + 1) * sizeof(afs_uint32)))) {
+    free(buf);
+    return ENOMEM;
+  }
+
+  for (p = buf, i = 0; i < nnames; i++) {
+    len = strlen(names[i]);
+    shared = 0;
+    if (i % CAT_BLOCK) {
+      while (shared < len && prev[shared] == names[i][shared]) shared++;
+    } else {
+      (*index)[i / CAT_BLOCK] = p - buf;
+    }
+    *p++ = shared;
+    *p++ = len - shared;
+    memcpy(p, names[i] + shared, len - shared);
+    p += len - shared;
+    prev = names[i];
+  }
+  *bufp = buf;
+  *lenp = p - buf;
+  return 0;
+}
+
+
+/* Add a section for a dump.  The caller fills in the volume and dump
+ * information in S; the rows and name dictionary are as described above.
+ * On success, S is filled in the rest of the way, and the catalog has
+ * its own copy.
+ */
+afs_uint32 Catalog_Append(dump_catalog *D, cat_section *S, cat_row *rows,
+                          char **names)
+{
+  XFILE *X = &D->X;
+  unsigned char *nbuf = 0, *cbuf = 0;
+  afs_uint32 *index = 0, nlen, hdrlen, r, i;
+  u_int64 off, tmp64;
+  cat_section *NS;
+  int c;
+
+  if (r = encode_names(names, S->nnames, &nbuf, &nlen, &index)) return r;
+  S->nblocks = (S->nnames + CAT_BLOCK - 1) / CAT_BLOCK;
+
+  /* Lay out the section */
+  hdrlen = CAT_SECHDR + strlen(S->volname) + strlen(S->dump_path) + 2;
+  mk64(S->names, 0, hdrlen);
+  add64_32(S->restarts, S->names, nlen);
+  add64_32(off, S->restarts, S->nblocks * 4);
+  for (c = 0; c < CAT_NCOLS; c++) {
+    cp64(S->cols[c], off);
+    add64_32(tmp64, off, S->nrows * col_width[c]);
+    cp64(off, tmp64);
+  }
+  cp64(S->length, off);
+  cp64(S->offset, D->end);
+  S->index = D->nsections;
+
+  /* Write it */
+  if (r = xfseek(X, &D->end)) goto out;
+  if ((r = WriteInt32(X, CAT_SECMAGIC))
+  ||  (r = WriteInt32(X, hdrlen))
+  ||  (r = WriteInt64(X, &S->length))
+  ||  (r = WriteInt32(X, S->volid))
+  ||  (r = WriteInt32(X, S->from_date))
+  ||  (r = WriteInt32(X, S->to_date))
+  ||  (r = WriteInt32(X, S->base))
+  ||  (r = WriteInt32(X, S->nrows))
+  ||  (r = WriteInt32(X, S->nnames))
+  ||  (r = WriteInt32(X, S->nblocks))
+  ||  (r = WriteInt64(X, &S->dump_size))
+  ||  (r = WriteInt64(X, &S->names))
+  ||  (r = WriteInt64(X, &S->restarts)))
+    goto out;
+  for (c = 0; c < CAT_NCOLS; c++)
+    if (r = WriteInt64(X, &S->cols[c])) goto out;
+  if ((r = WriteString(X, (unsigned char *)S->volname))
+  ||  (r = WriteString(X, (unsigned char *)S->dump_path))
+  ||  (nlen && (r = xfwrite(X, nbuf, nlen))))
+    goto out;
+  for (i = 0; i < S->nblocks; i++)
+    if (r = WriteInt32(X, index[i])) goto out;
+
+  if (!(cbuf = malloc(S->nrows * 8 + 1))) {
+    r = ENOMEM;
+    goto out;
+  }
+  for (c = 0; c < CAT_NCOLS; c++) {
+    for (i = 0; i < S->nrows; i++)
+      put_col(cbuf + i * col_width[c], c, &rows[i]);
+    if (r = xfwrite(X, cbuf, S->nrows * col_width[c])) goto out;
+  }
+
+  /* Remember it */
+  NS = realloc(D->sections, (D->nsections + 1) * sizeof(cat_section));
+  if (!NS) {
+    r = ENOMEM;
+    goto out;
+  }
+  D->sections = NS;
+  NS = &D->sections[D->nsections];
+  *NS = *S;
+  NS->volname = strdup(S->volname);
+  NS->dump_path = strdup(S->dump_path);
+  if (!NS->volname || !NS->dump_path) {
+    r = ENOMEM;
+    goto out;
+  }
+  D->nsections++;
+  add64_64(tmp64, D->end, S->length);
+  cp64(D->end, tmp64);
+
+out:
+  if (nbuf) free(nbuf);
+  if (index) free(index);
+  if (cbuf) free(cbuf);
+  return r;
+}
+
+
+/* Read all the rows and names of a section.  The names are returned in
+ * a single allocation, which the caller frees, as are the rows.
+ */
+afs_uint32 Catalog_Load(dump_catalog *D, cat_section *S, cat_row **rowsp,
+                        char ***namesp)
+{
+  unsigned char *nbuf = 0, *cbuf = 0, *p, *end;
+  char **names = 0, *pool, *prev;
+  cat_row *rows = 0;
+  afs_uint32 nlen, pool_size, i, r;
+  u_int64 tmp64;
+  int c;
+
+  *rowsp = 0;
+  *namesp = 0;
+  sub64_64(tmp64, S->restarts, S->names);
+  nlen = lo64(tmp64);
+  if (!(nbuf = malloc(nlen + 1))
+  ||  !(cbuf = malloc(S->nrows * 8 + 1))
+  ||  !(rows = calloc(S->nrows + 1, sizeof(cat_row)))) {
+    r = ENOMEM;
+    goto fail;
+  }
+
+  /* The names; first find how much room they need */
+  if ((r = seek_section(D, S, &S->names))
+  ||  (r = xfread(&D->X, nbuf, nlen)))
+    goto fail;
+  end = nbuf + nlen;
+  for (pool_size = 0, p = nbuf, i = 0; i < S->nnames; i++) {
+    if (p + 2 > end || p + 2 + p[1] > end) {
+      r = DSERR_CATALOG;
+      goto fail;
+    }
+    pool_size += p[0] + p[1] + 1;
+    p += 2 + p[1];
+  }
+  if (!(names = malloc(S->nnames * sizeof(char *) + pool_size + 1))) {
+    r = ENOMEM;
+    goto fail;
+  }
+  pool = (char *)(names + S->nnames);
+  prev = "";
+  for (p = nbuf, i = 0; i < S->nnames; i++) {
+    if (p[0] > strlen(prev)) {
+      r = DSERR_CATALOG;
+      goto fail;
+    }
+    names[i] = pool;
+    memcpy(pool, prev, p[0]);
+    memcpy(pool + p[0], p + 2, p[1]);
+    pool[p[0] + p[1]] = 0;
+    pool += p[0] + p[1] + 1;
+    prev = names[i];
+    p += 2 + p[1];
+  }
+
+  /* The rows */
+  for (c = 0; c < CAT_NCOLS; c++) {
+    if ((r = seek_section(D, S, &S->cols[c]))
+    ||  (r = xfread(&D->X, cbuf, S->nrows * col_width[c])))
+      goto fail;
+    for (i = 0; i < S->nrows; i++)
+      get_col(cbuf + i * col_width[c], c, &rows[i]);
+  }
+  free(nbuf);
+  free(cbuf);
+  *rowsp = rows;
+  *namesp = names;
+  return 0;
+
+fail:
+  if (nbuf) free(nbuf);
+  if (cbuf) free(cbuf);
+  if (rows) free(rows);
+  if (names) free(names);
+  return r;
+}
+
+
+/* Read one row of a section */
+afs_uint32 Catalog_GetRow(dump_catalog *D, cat_section *S, afs_uint32 row,
+                          cat_row *R)
+{
+  unsigned char buf[8];
+  afs_uint32 r;
+  int c;
+
+  if (row >= S->nrows) return DSERR_CATALOG;
+  for (c = 0; c < CAT_NCOLS; c++) {
+    if ((r = seek_col(D, S, c, row))
+    ||  (r = xfread(&D->X, buf, col_width[c])))
+      return r;
+    get_col(buf, c, R);
+  }
+  return 0;
+}
+
+
+/* Read one value from a column */
+static afs_uint32 get_value(dump_catalog *D, cat_section *S, int col,
+                            afs_uint32 row, afs_uint32 *val)
+{
+  unsigned char buf[8];
+  cat_row R;
+  afs_uint32 r;
+
+  if ((r = seek_col(D, S, col, row))
+  ||  (r = xfread(&D->X, buf, col_width[col])))
+    return r;
+  get_col(buf, col, &R);
+  switch (col) {
+    case CAT_COL_NAME:   *val = R.name;   break;
+    case CAT_COL_PARENT: *val = R.parent; break;
+    case CAT_COL_FIRST:  *val = R.first;  break;
+    case CAT_COL_NCHILD: *val = R.nchild; break;
+    default:             return DSERR_PANIC;
+  }
+  return 0;
+}
+
+
+/* Read the next name in a block, given the one before it */
+static afs_uint32 next_name(XFILE *X, char *name)
+{
+  unsigned char len[2];
+  afs_uint32 r;
+
+  if (r = xfread(X, len, 2)) return r;
+  if (len[0] > strlen(name)) return DSERR_CATALOG;
+  if (r = xfread(X, name + len[0], len[1])) return r;
+  name[len[0] + len[1]] = 0;
+  return 0;
+}
+
+
+/* Find a name in the dictionary; *id is CAT_NONE if it isn't there */
+static afs_uint32 find_name(dump_catalog *D, cat_section *S, char *name,
+                            afs_uint32 *id)
+{
+  char cur[2 * CAT_MAXNAME + 1];
+  afs_uint32 lo, hi, mid, off, r, i;
+  u_int64 where;
+  int cmp;
+
+  *id = CAT_NONE;
+  if (!S->nblocks || strlen(name) > CAT_MAXNAME) return 0;
+
+  /* Find the last block starting with a name no greater than this one */
+  lo = 0;
+  hi = S->nblocks;
+  while (hi - lo > 1) {
+    mid = (lo + hi) / 2;
+    add64_32(where, S->restarts, mid * 4);
+    if ((r = seek_section(D, S, &where))
+    ||  (r = ReadInt32(&D->X, &off)))
+      return r;
+    add64_32(where, S->names, off);
+    cur[0] = 0;
+    if ((r = seek_section(D, S, &where))
+    ||  (r = next_name(&D->X, cur)))
+      return r;
+    if (strcmp(cur, name) <= 0) lo = mid;
+    else hi = mid;
+  }
+
+  /* Then look through it */
+  add64_32(where, S->restarts, lo * 4);
+  if ((r = seek_section(D, S, &where))
+  ||  (r = ReadInt32(&D->X, &off)))
+    return r;
+  add64_32(where, S->names, off);
+  if (r = seek_section(D, S, &where)) return r;
+  cur[0] = 0;
+  for (i = lo * CAT_BLOCK; i < S->nnames && i < (lo + 1) * CAT_BLOCK; i++) {
+    if (r = next_name(&D->X, cur)) return r;
+    cmp = strcmp(cur, name);
+    if (!cmp) *id = i;
+    if (cmp >= 0) break;
+  }
+  return 0;
+}
+
+
+/* Look up a path, relative to the root of the volume.  On success, *rowp
+ * is the row of the path and R is filled in, or *rowp is CAT_NONE if
+ * the path isn't in the section.
+ */
+afs_uint32 Catalog_Lookup(dump_catalog *D, cat_section *S, char *path,
+                          afs_uint32 *rowp, cat_row *R)
+{
+  afs_uint32 row = 0, id, first, nchild, lo, hi, mid, val, r;
+  char buf[CAT_MAXNAME + 1], *name, *end;
+
+  *rowp = CAT_NONE;
+  if (!S->nrows) return 0;
+  for (name = path; *name; name = end) {
+    while (*name == '/') name++;
+    for (end = name; *end && *end != '/'; end++);
+    if (end == name || (end - name == 1 && *name == '.')) continue;
+
+    if (end - name == 2 && name[0] == '.' && name[1] == '.') {
+      if (r = get_value(D, S, CAT_COL_PARENT, row, &val)) return r;
+      if (val != CAT_NONE) row = val;
+      continue;
+    }
+
+    if (end - name > CAT_MAXNAME) return 0;
+    memcpy(buf, name, end - name);
+    buf[end - name] = 0;
+    if (r = find_name(D, S, buf, &id)) return r;
+    if (id == CAT_NONE) return 0;
+
+    if ((r = get_value(D, S, CAT_COL_FIRST, row, &first))
+    ||  (r = get_value(D, S, CAT_COL_NCHILD, row, &nchild)))
+      return r;
+    lo = first;
+    hi = first + nchild;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (r = get_value(D, S, CAT_COL_NAME, mid, &val)) return r;
+      if (val == id) break;
+      if (val < id) lo = mid + 1;
+      else hi = mid;
+    }
+    if (lo >= hi) return 0;
+    row = mid;
+  }
+  if (r = Catalog_GetRow(D, S, row, R)) return r;
+  *rowp = row;
+  return 0;
+}
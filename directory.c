@@ -74,8 +74,8 @@ static int namehash(char *name, int buckets, int seed)
   return tval ? hval < 0 ? buckets - tval : tval : 0;
 }
 
-afs_uint32 parse_directory(XFILE *X, dump_parser *p, afs_vnode *v,
-                        afs_uint32 size, int toeof)
+static afs_uint32 scan_directory(XFILE *X, dump_parser *p, afs_vnode *v,
+                              afs_uint32 size, int toeof)
 {
   afs_dir_entry de;
   int pgno, i, l, n;
@@ -94,6 +94,7 @@ afs_uint32 parse_directory(XFILE *X, dump_parser *p, afs_vnode *v,
       return r;
     }
     if ((p->flags & DSFLAG_SEEK) && (r = xftell(X, &where))) return r;
+    if (p->stats) p->stats->dir_pages++;
     if (page.header.tag != htons(1234)) {
       if (p->cb_error)
         (p->cb_error)(DSERR_MAGIC, 1, p->err_refcon,
@@ -126,8 +127,14 @@ afs_uint32 parse_directory(XFILE *X, dump_parser *p, afs_vnode *v,
       de.uniq  = ntohl(page.entry[i].vunique);
       if (p->print_flags & DSPRINT_DIR)
         printf("  %10d %10d  %s\n", de.vnode, de.uniq, de.name);
-      if (p->cb_dirent && (r = (p->cb_dirent)(v, &de, X, p->refcon)))
-        return r;
+      if (p->cb_dirent) {
+        struct timespec t0;
+
+        cb_timer_start(p, &t0, "cb_dirent");
+        r = (p->cb_dirent)(v, &de, X, p->refcon);
+        cb_timer_stop(p, &t0);
+        if (r) return r;
+      }
       i += ((l + 16) >> 5);
     }
   }
@@ -136,6 +143,20 @@ afs_uint32 parse_directory(XFILE *X, dump_parser *p, afs_vnode *v,
 }
 
 
+afs_uint32 parse_directory(XFILE *X, dump_parser *p, afs_vnode *v,
+                        afs_uint32 size, int toeof)
+{
+  afs_uint32 r;
+
+  xftrace_begin(p->trace, "parse", "directory");
+  if (v) xftrace_arg32(p->trace, "vnode", v->vnode);
+  xftrace_arg32(p->trace, "size", size);
+  r = scan_directory(X, p, v, size, toeof);
+  xftrace_end(p->trace);
+  return r;
+}
+
+
 afs_uint32 ParseDirectory(XFILE *X, dump_parser *p, afs_uint32 size, int toeof)
 {
   parse_directory(X, p, 0, size, toeof);
@@ -200,6 +221,7 @@ afs_uint32 DirectoryLookup(XFILE *X, dump_parser *p, afs_uint32 size,
   my_p.err_refcon = p->err_refcon;
   my_p.cb_error = p->cb_error;
   my_p.cb_dirent  = dirlookup_cb;
+  my_p.trace      = p->trace;
 
   r = parse_directory(X, &my_p, 0, size, 0);
   if (!r) r = DSERR_DONE;
@@ -31,7 +31,8 @@
 #include "dumpscan.h"
 #include "dumpfmt.h"
 
-#define COPYBUFSIZE 65536
+/* Data copied in chunks this big bypasses any xfsetbuf buffer on OX */
+#define COPYBUFSIZE XFBUFSIZE
 
 afs_uint32 DumpDumpHeader(XFILE *OX, afs_dump_header *hdr)
 {
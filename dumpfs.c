@@ -0,0 +1,678 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* dumpfs.c - Random access to the files in a dump
+ *
+ * A dumpfs is an index of the files in one dump, held in memory, that
+ * lets a file be found by path and its data read from anywhere in it,
+ * without reading the rest of the dump.  The index comes either from
+ * one pass over the dump (DumpFS_Open), or from the dump's section of
+ * a catalog (DumpFS_OpenCatalog), which costs no pass at all.  With a
+ * catalog, the data of an unchanged file in an incremental dump is
+ * read from the earlier dump that has it.
+ *
+ * Opening and closing a dumpfs are not thread-safe, but once it is open
+ * it doesn't change, so any number of threads may look up files and
+ * read them at once.  Dumps that are plain files are read with pread();
+ * others, such as compressed dumps, are read through an XFILE, one
+ * thread at a time.  For programs that go through all the data in a
+ * dump, DumpFS_Units divides it into pieces, and DumpFS_RunUnits hands
+ * them out to a pool of threads.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+#include "xf_errs.h"
+
+/* A dump with data in it */
+struct dumpfs_source {
+  char *path;                  /* Where the dump is */
+  afs_uint32 state;            /* 0 until opened, then DUMPFS_OPEN or error */
+  int fd;                      /* For positional reads, or -1 */
+  XFILE X;                     /* For everything else... */
+  pthread_mutex_t lock;        /* ... used under this lock */
+};
+#define DUMPFS_OPEN 0xffffffff
+
+/* Sources are opened when first read from */
+static pthread_mutex_t open_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A directory entry, while a dump is being indexed */
+typedef struct {
+  afs_uint32 parent;           /* Vnode of directory */
+  afs_uint32 vnode;            /* Vnode of entry */
+  char *name;
+} scan_entry;
+
+typedef struct {
+  dumpfs_file *files;
+  afs_uint32 nfiles, maxfiles;
+  scan_entry *ents;
+  afs_uint32 nents, maxents;
+} scan_state;
+
+
+static afs_uint32 make_sources(dumpfs *FS, afs_uint32 n)
+{
+  afs_uint32 i;
+
+  FS->sources = (struct dumpfs_source *)malloc(n * sizeof(struct dumpfs_source));
+  if (!FS->sources) return ENOMEM;
+  memset(FS->sources, 0, n * sizeof(struct dumpfs_source));
+  for (i = 0; i < n; i++) {
+    FS->sources[i].fd = -1;
+    pthread_mutex_init(&FS->sources[i].lock, 0);
+  }
+  FS->nsources = n;
+  return 0;
+}
+
+
+/** Indexing a dump **/
+
+static afs_uint32 vnode_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  scan_state *ss = (scan_state *)refcon;
+  dumpfs_file *F;
+
+  if (ss->nfiles == ss->maxfiles) {
+    ss->maxfiles = ss->maxfiles ? ss->maxfiles * 2 : 1024;
+    F = (dumpfs_file *)realloc(ss->files, ss->maxfiles * sizeof(dumpfs_file));
+    if (!F) return ENOMEM;
+    ss->files = F;
+  }
+  F = &ss->files[ss->nfiles++];
+  memset(F, 0, sizeof(*F));
+  F->vnode  = v->vnode;
+  F->vuniq  = v->vuniq;
+  F->parent = DUMPFS_NONE;
+  if (v->field_mask & F_VNODE_TYPE) F->type = v->type;
+  if (v->field_mask & F_VNODE_DATA) {
+    cp64(F->size, v->size);
+    cp64(F->d_offset, v->d_offset);
+  }
+  return 0;
+}
+
+
+static afs_uint32 dirent_cb(afs_vnode *v, afs_dir_entry *de,
+                            XFILE *X, void *refcon)
+{
+  scan_state *ss = (scan_state *)refcon;
+  scan_entry *E;
+
+  if (!strcmp(de->name, ".") || !strcmp(de->name, "..")) return 0;
+  if (ss->nents == ss->maxents) {
+    ss->maxents = ss->maxents ? ss->maxents * 2 : 1024;
+    E = (scan_entry *)realloc(ss->ents, ss->maxents * sizeof(scan_entry));
+    if (!E) return ENOMEM;
+    ss->ents = E;
+  }
+  E = &ss->ents[ss->nents];
+  E->parent = v->vnode;
+  E->vnode  = de->vnode;
+  if (!(E->name = strdup(de->name))) return ENOMEM;
+  ss->nents++;
+  return 0;
+}
+
+
+static int file_cmp(const void *a, const void *b)
+{
+  afs_uint32 va = ((dumpfs_file *)a)->vnode, vb = ((dumpfs_file *)b)->vnode;
+
+  return (va < vb) ? -1 : (va > vb) ? 1 : 0;
+}
+
+
+static int entry_cmp(const void *a, const void *b)
+{
+  scan_entry *ea = (scan_entry *)a, *eb = (scan_entry *)b;
+
+  if (ea->parent != eb->parent) return (ea->parent < eb->parent) ? -1 : 1;
+  return strcmp(ea->name, eb->name);
+}
+
+
+/* Find the node for a vnode; files[] is sorted by vnode number */
+static afs_uint32 find_node(dumpfs *FS, afs_uint32 vnode)
+{
+  afs_uint32 lo = 0, hi = FS->nfiles, mid;
+
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (FS->files[mid].vnode == vnode) return mid;
+    if (FS->files[mid].vnode < vnode) lo = mid + 1;
+    else hi = mid;
+  }
+  return DUMPFS_NONE;
+}
+
+
+/* Turn what was collected from a dump into an index */
+static afs_uint32 build_index(dumpfs *FS, scan_state *ss)
+{
+  afs_uint32 i, j, dir, node;
+
+  qsort(ss->files, ss->nfiles, sizeof(dumpfs_file), file_cmp);
+  qsort(ss->ents, ss->nents, sizeof(scan_entry), entry_cmp);
+  FS->files  = ss->files;
+  FS->nfiles = ss->nfiles;
+  ss->files  = 0;
+  for (i = 0; i < FS->nfiles; i++) FS->files[i].node = i;
+  if ((FS->root = find_node(FS, 1)) == DUMPFS_NONE) return DSERR_FMT;
+  FS->files[FS->root].parent = FS->root;
+
+  if (ss->nents) {
+    FS->names = (char **)malloc(ss->nents * sizeof(char *));
+    FS->entries = (afs_uint32 *)malloc(ss->nents * sizeof(afs_uint32));
+    if (!FS->names || !FS->entries) return ENOMEM;
+  }
+
+  /* Entries for vnodes not in the dump, or in directories not in the
+   * dump, are dropped; the rest are in order by directory already.
+   */
+  for (i = 0; i < ss->nents; i = j) {
+    dir = find_node(FS, ss->ents[i].parent);
+    if (dir != DUMPFS_NONE) FS->files[dir].first = FS->nentries;
+    for (j = i; j < ss->nents && ss->ents[j].parent == ss->ents[i].parent; j++) {
+      node = find_node(FS, ss->ents[j].vnode);
+      if (dir == DUMPFS_NONE || node == DUMPFS_NONE) {
+        free(ss->ents[j].name);
+        continue;
+      }
+      if (FS->files[node].parent == DUMPFS_NONE)
+        FS->files[node].parent = dir;
+      FS->names[FS->nentries]   = ss->ents[j].name;
+      FS->entries[FS->nentries] = node;
+      FS->nentries++;
+      FS->files[dir].nchild++;
+    }
+  }
+  ss->nents = 0;
+  return 0;
+}
+
+
+/* Index a dump, with one pass over it */
+afs_uint32 DumpFS_Open(dumpfs *FS, char *path, dump_parser *p)
+{
+  dump_parser dp;
+  scan_state ss;
+  XFILE X;
+  afs_uint32 r, i;
+
+  memset(FS, 0, sizeof(*FS));
+  memset(&ss, 0, sizeof(ss));
+  if (r = xfopen(&X, O_RDONLY, path)) return r;
+  if (!X.is_seekable) {
+    xfclose(&X);
+    return ERROR_XFILE_NOSEEK;
+  }
+
+  memset(&dp, 0, sizeof(dp));
+  if (p) {
+    dp.cb_error        = p->cb_error;
+    dp.err_refcon      = p->err_refcon;
+    dp.repair_flags    = p->repair_flags;
+    dp.cb_progress     = p->cb_progress;
+    dp.progress_bytes  = p->progress_bytes;
+    dp.progress_vnodes = p->progress_vnodes;
+    dp.trace           = p->trace;
+  }
+  dp.refcon         = (void *)&ss;
+  dp.flags          = DSFLAG_SEEK;
+  dp.cb_vnode_dir   = vnode_cb;
+  dp.cb_vnode_file  = vnode_cb;
+  dp.cb_vnode_link  = vnode_cb;
+  dp.cb_vnode_empty = vnode_cb;
+  dp.cb_vnode_wierd = vnode_cb;
+  dp.cb_dirent      = dirent_cb;
+  r = ParseDumpFile(&X, &dp);
+  xfclose(&X);
+
+  if (!r) r = build_index(FS, &ss);
+  if (!r) r = make_sources(FS, 1);
+  if (!r && !(FS->sources[0].path = strdup(path))) r = ENOMEM;
+
+  if (ss.files) free(ss.files);
+  for (i = 0; i < ss.nents; i++) free(ss.ents[i].name);
+  if (ss.ents) free(ss.ents);
+  if (r) DumpFS_Close(FS);
+  return r;
+}
+
+
+/* Index a dump, from its section of a catalog.  Each row of the section
+ * is a node, and the entries of a directory are the rows of its
+ * children, which the catalog keeps together and sorted by name.
+ */
+afs_uint32 DumpFS_OpenCatalog(dumpfs *FS, dump_catalog *C, cat_section *S)
+{
+  cat_row *rows;
+  dumpfs_file *F;
+  afs_uint32 r, i;
+
+  memset(FS, 0, sizeof(*FS));
+  if (r = Catalog_Load(C, S, &rows, &FS->catalog_names)) return r;
+
+  FS->nfiles = FS->nentries = S->nrows;
+  FS->files = (dumpfs_file *)malloc(S->nrows * sizeof(dumpfs_file));
+  FS->names = (char **)malloc(S->nrows * sizeof(char *));
+  FS->entries = (afs_uint32 *)malloc(S->nrows * sizeof(afs_uint32));
+  if (!FS->files || !FS->names || !FS->entries) {
+    r = ENOMEM;
+    goto fail;
+  }
+  for (i = 0; i < S->nrows; i++) {
+    F = &FS->files[i];
+    F->node   = i;
+    F->vnode  = rows[i].vnode;
+    F->vuniq  = rows[i].vuniq;
+    F->type   = rows[i].type;
+    F->parent = (rows[i].parent == CAT_NONE) ? i : rows[i].parent;
+    F->first  = rows[i].first;
+    F->nchild = rows[i].nchild;
+    F->src    = (rows[i].src < C->nsections) ? rows[i].src : DUMPFS_NONE;
+    cp64(F->size, rows[i].size);
+    cp64(F->d_offset, rows[i].d_offset);
+    FS->names[i] = (rows[i].name == CAT_NONE) ? "" : FS->catalog_names[rows[i].name];
+    FS->entries[i] = i;
+  }
+  FS->root = 0;
+
+  if (r = make_sources(FS, C->nsections)) goto fail;
+  for (i = 0; i < C->nsections; i++)
+    if (!(FS->sources[i].path = strdup(C->sections[i].dump_path))) {
+      r = ENOMEM;
+      goto fail;
+    }
+  free(rows);
+  return 0;
+
+fail:
+  free(rows);
+  DumpFS_Close(FS);
+  return r;
+}
+
+
+void DumpFS_Close(dumpfs *FS)
+{
+  struct dumpfs_source *DS;
+  afs_uint32 i;
+
+  for (i = 0; i < FS->nsources; i++) {
+    DS = &FS->sources[i];
+    if (DS->state == DUMPFS_OPEN) {
+      if (DS->fd >= 0) close(DS->fd);
+      else xfclose(&DS->X);
+    }
+    if (DS->path) free(DS->path);
+    pthread_mutex_destroy(&DS->lock);
+  }
+  if (FS->sources) free(FS->sources);
+  if (FS->names) {
+    if (!FS->catalog_names)
+      for (i = 0; i < FS->nentries; i++) free(FS->names[i]);
+    free(FS->names);
+  }
+  if (FS->catalog_names) free(FS->catalog_names);
+  if (FS->entries) free(FS->entries);
+  if (FS->files) free(FS->files);
+  memset(FS, 0, sizeof(*FS));
+}
+
+
+/** Finding files **/
+
+/* Compare a path component (not null-terminated) to a name */
+static int name_cmp(char *comp, int len, char *name)
+{
+  int c = strncmp(comp, name, len);
+
+  if (c) return c;
+  return name[len] ? -1 : 0;
+}
+
+
+/* Look up a path, relative to the root of the volume */
+afs_uint32 DumpFS_Lookup(dumpfs *FS, char *path, dumpfs_file *F)
+{
+  afs_uint32 node = FS->root, lo, hi, mid;
+  dumpfs_file *D;
+  char *end;
+  int len, c;
+
+  while (*path) {
+    if (*path == '/') {
+      path++;
+      continue;
+    }
+    for (end = path; *end && *end != '/'; end++);
+    len = end - path;
+    D = &FS->files[node];
+
+    if (len == 1 && *path == '.') {
+      path = end;
+      continue;
+    }
+    if (len == 2 && path[0] == '.' && path[1] == '.') {
+      if (D->parent != DUMPFS_NONE) node = D->parent;
+      path = end;
+      continue;
+    }
+    if (D->type != vDirectory) return ENOTDIR;
+
+    lo = D->first;
+    hi = lo + D->nchild;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      c = name_cmp(path, len, FS->names[mid]);
+      if (!c) break;
+      if (c < 0) hi = mid;
+      else lo = mid + 1;
+    }
+    if (lo >= hi) return ENOENT;
+    node = FS->entries[mid];
+    path = end;
+  }
+  *F = FS->files[node];
+  return 0;
+}
+
+
+/* Get entry number i of a directory (not counting . and ..).  The name
+ * is valid until the dumpfs is closed.
+ */
+afs_uint32 DumpFS_ReadDir(dumpfs *FS, dumpfs_file *D, afs_uint32 i,
+                          char **name, dumpfs_file *F)
+{
+  if (D->type != vDirectory) return ENOTDIR;
+  if (i >= D->nchild) return ENOENT;
+  *name = FS->names[D->first + i];
+  *F = FS->files[FS->entries[D->first + i]];
+  return 0;
+}
+
+
+/* Build the path of a file, as a string which the caller must free.
+ * A file with several names (hard links) gets the first one found.
+ */
+afs_uint32 DumpFS_Path(dumpfs *FS, dumpfs_file *F, char **path)
+{
+  afs_uint32 node, parent, i, depth, len = 0;
+  dumpfs_file *D;
+  char **names, *x;
+
+  /* Find how deep the file is, so only that many names are kept */
+  *path = 0;
+  for (depth = 0, node = F->node; node != FS->root; node = parent) {
+    parent = FS->files[node].parent;
+    if (parent == DUMPFS_NONE || depth == FS->nfiles) return ENOENT;
+    depth++;
+  }
+  if (!(names = (char **)malloc((depth + 1) * sizeof(char *)))) return ENOMEM;
+
+  for (depth = 0, node = F->node; node != FS->root; node = parent) {
+    parent = FS->files[node].parent;
+    D = &FS->files[parent];
+    for (i = D->first; i < D->first + D->nchild && FS->entries[i] != node; i++);
+    if (i == D->first + D->nchild) {
+      free(names);
+      return ENOENT;
+    }
+    names[depth++] = FS->names[i];
+    len += strlen(FS->names[i]) + 1;
+  }
+
+  if (!(*path = (char *)malloc(len + 2))) {
+    free(names);
+    return ENOMEM;
+  }
+  strcpy(*path, "/");
+  for (x = *path; depth--; x += strlen(x)) sprintf(x, "/%s", names[depth]);
+  free(names);
+  return 0;
+}
+
+
+/** Reading data **/
+
+static afs_uint32 get_source(dumpfs *FS, afs_uint32 src,
+                             struct dumpfs_source **DSp)
+{
+  struct dumpfs_source *DS;
+  afs_uint32 r;
+
+  if (src >= FS->nsources) return ENOENT;
+  DS = &FS->sources[src];
+  pthread_mutex_lock(&open_lock);
+  if (!DS->state) {
+    /* Plain files are read directly; anything else goes through xfopen */
+    if (!strchr(DS->path, ':')) {
+      if ((DS->fd = open(DS->path, O_RDONLY)) < 0) DS->state = errno;
+      else DS->state = DUMPFS_OPEN;
+    } else if (r = xfopen(&DS->X, O_RDONLY, DS->path)) {
+      DS->state = r;
+    } else if (!DS->X.is_seekable) {
+      xfclose(&DS->X);
+      DS->state = ERROR_XFILE_NOSEEK;
+    } else DS->state = DUMPFS_OPEN;
+  }
+  r = (DS->state == DUMPFS_OPEN) ? 0 : DS->state;
+  pthread_mutex_unlock(&open_lock);
+  *DSp = DS;
+  return r;
+}
+
+
+/* Read up to count bytes of a file's data, starting at offset.
+ * Fewer are read only at the end of the file.
+ */
+afs_uint32 DumpFS_Read(dumpfs *FS, dumpfs_file *F, u_int64 *offset,
+                       void *buf, afs_uint32 count, afs_uint32 *nread)
+{
+  struct dumpfs_source *DS;
+  u_int64 where, left;
+  afs_uint32 r;
+  off_t pos;
+  ssize_t n;
+  char *x;
+
+  *nread = 0;
+  if (!lt64(*offset, F->size) || !count) return 0;
+  sub64_64(left, F->size, *offset);
+  if (!hi64(left) && lo64(left) < count) count = lo64(left);
+  add64_64(where, F->d_offset, *offset);
+  if (r = get_source(FS, F->src, &DS)) return r;
+
+  if (DS->fd < 0) {
+    pthread_mutex_lock(&DS->lock);
+    if (!(r = xfseek(&DS->X, &where)))
+      r = xfread(&DS->X, buf, count);
+    pthread_mutex_unlock(&DS->lock);
+    if (!r) *nread = count;
+    return r;
+  }
+
+  if (sizeof(off_t) < 8 && hi64(where)) return EFBIG;
+#ifdef NATIVE_INT64
+  pos = (off_t)where;
+#else
+  pos = (sizeof(off_t) < 8) ? lo64(where)
+      : (((off_t)hi64(where) << 16) << 16) | lo64(where);
+#endif
+  for (x = (char *)buf; count; ) {
+    n = pread(DS->fd, x, count, pos);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    if (!n) return ERROR_XFILE_EOF;
+    x += n;
+    pos += n;
+    count -= n;
+    *nread += n;
+  }
+  return 0;
+}
+
+
+/** Dividing the data among threads **/
+
+/* Divide the data of every file into units of at most unit_len bytes,
+ * in order by node and then offset.  The list, which the caller must
+ * free, is empty if there is no data.
+ */
+afs_uint32 DumpFS_Units(dumpfs *FS, afs_uint32 unit_len,
+                        dumpfs_unit **unitsp, afs_uint32 *nunitsp)
+{
+  dumpfs_unit *units = 0, *U;
+  dumpfs_file *F;
+  afs_uint32 i, piece, nunits = 0, maxunits = 0;
+  u_int64 where, left, tmp64;
+
+  *unitsp = 0;
+  *nunitsp = 0;
+  if (!unit_len) return EINVAL;
+  for (i = 0; i < FS->nfiles; i++) {
+    F = &FS->files[i];
+    if (F->type != vFile || F->src == DUMPFS_NONE || zero64(F->size))
+      continue;
+    piece = 0;
+    for (mk64(where, 0, 0); lt64(where, F->size); cp64(where, tmp64)) {
+      if (nunits == maxunits) {
+        if (maxunits > 0x7fffffff / sizeof(dumpfs_unit)) {
+          free(units);
+          return ENOMEM;
+        }
+        maxunits = maxunits ? maxunits * 2 : 1024;
+        if (!(U = (dumpfs_unit *)realloc(units, maxunits * sizeof(dumpfs_unit)))) {
+          if (units) free(units);
+          return ENOMEM;
+        }
+        units = U;
+      }
+      U = &units[nunits++];
+      U->node = i;
+      U->piece = piece++;
+      cp64(U->start, where);
+      sub64_64(left, F->size, where);
+      U->len = (!hi64(left) && lo64(left) < unit_len) ? lo64(left) : unit_len;
+      add64_32(tmp64, where, unit_len);
+    }
+  }
+  *unitsp = units;
+  *nunitsp = nunits;
+  return 0;
+}
+
+
+/* The work queue shared by DumpFS_RunUnits' threads */
+struct unit_queue {
+  pthread_mutex_t lock;
+  dumpfs *FS;
+  dumpfs_unit *units;
+  afs_uint32 nunits, next;
+  dumpfs_unit_cb cb;
+};
+
+struct unit_worker {
+  pthread_t thread;
+  struct unit_queue *Q;
+  void *arg;
+};
+
+static void *unit_worker_main(void *arg)
+{
+  struct unit_worker *W = (struct unit_worker *)arg;
+  struct unit_queue *Q = W->Q;
+  afs_uint32 i;
+
+  for (;;) {
+    pthread_mutex_lock(&Q->lock);
+    i = (Q->next < Q->nunits) ? Q->next++ : Q->nunits;
+    pthread_mutex_unlock(&Q->lock);
+    if (i == Q->nunits) return 0;
+    (Q->cb)(Q->FS, &Q->units[i], i, W->arg);
+  }
+}
+
+
+/* Call cb on every unit, from up to nthreads threads, which take the
+ * units in order as they become free.  cb is also given the index of
+ * the unit and the argument for the thread it is called from, args[t],
+ * so each thread can have its own buffers and results.  If a thread
+ * can't be started, the ones that did and this one do the work.
+ */
+afs_uint32 DumpFS_RunUnits(dumpfs *FS, dumpfs_unit *units, afs_uint32 nunits,
+                           int nthreads, dumpfs_unit_cb cb, void **args)
+{
+  struct unit_queue Q;
+  struct unit_worker *workers;
+  int t, started;
+
+  if (!nunits) return 0;
+  if (nthreads < 1) nthreads = 1;
+  if ((afs_uint32)nthreads > nunits) nthreads = nunits;
+  if (!(workers = (struct unit_worker *)malloc(nthreads * sizeof(*workers))))
+    return ENOMEM;
+
+  memset(&Q, 0, sizeof(Q));
+  pthread_mutex_init(&Q.lock, 0);
+  Q.FS = FS;
+  Q.units = units;
+  Q.nunits = nunits;
+  Q.cb = cb;
+  for (t = 0; t < nthreads; t++) {
+    workers[t].Q = &Q;
+    workers[t].arg = args[t];
+  }
+
+  /* Thread 0 is this one */
+  for (started = 1; started < nthreads; started++)
+    if (pthread_create(&workers[started].thread, 0, unit_worker_main,
+                       &workers[started]))
+      break;
+  unit_worker_main(&workers[0]);
+  for (t = 1; t < started; t++)
+    pthread_join(workers[t].thread, 0);
+
+  pthread_mutex_destroy(&Q.lock);
+  free(workers);
+  return 0;
+}
@@ -161,6 +161,16 @@ typedef struct {
 } afs_vol_header;
 
 
+/** SHA-256 message digest state **/
+#define SHA256_LEN 32
+typedef struct {
+  afs_uint32 state[8];
+  u_int64 count;               /* Bytes hashed so far */
+  unsigned char buf[64];       /* Partial block */
+  afs_uint32 buflen;
+} sha256_ctx;
+
+
 /** AFS vnode **/
 #define F_VNODE_TYPE          0x00000001
 #define F_VNODE_NLINKS        0x00000002
@@ -178,6 +188,7 @@ typedef struct {
 #define F_VNODE_PARTIAL       0x00002000 /* Partial vnode continuation (no header) */
 #define F_VNODE_LINK_TARGET   0x00004000 /* Symlink target present */
 #define F_VNODE_SIZE_HI       0x00008000 /* Set if high 32 bits of size are present */
+#define F_VNODE_HASH          0x00010000 /* Set if hash of the data is present */
 typedef struct {
   u_int64 offset;              /* Where in the input stream is it? */
   afs_uint32 field_mask;       /* What fields are present? */
@@ -196,6 +207,7 @@ typedef struct {
   u_int64 size;                /* Size of data */
   u_int64 d_offset;            /* Where in the input stream is the data? */
   char *link_target;           /* Target of symbolic link */
+  unsigned char hash[SHA256_LEN];  /* SHA-256 of data (DSFLAG_HASH) */
   unsigned char acl[SIZEOF_LARGEDISKVNODE - SIZEOF_SMALLDISKVNODE];
 } afs_vnode;
 
@@ -225,6 +237,25 @@ typedef struct {
 #define DKIND_STRING    0x40  /* ASCIIZ string */
 #define DKIND_SPECIAL   0x50  /* Custom parser */
 #define DKIND_MASK     (~0x0f)
+
+/** Statistics kept while parsing, if the parser has a place for them **/
+typedef struct {
+  xfstats io;                  /* I/O on the dump itself */
+  afs_uint32 tags[6];          /* Tags parsed, by kind (DKIND_xxx >> 4) */
+  afs_uint32 n_dirs;           /* Directory vnodes */
+  afs_uint32 n_files;          /* File vnodes */
+  afs_uint32 n_links;          /* Symlink vnodes */
+  afs_uint32 n_empty;          /* Vnodes with no type */
+  afs_uint32 n_wierd;          /* Vnodes of unknown type */
+  afs_uint32 dir_pages;        /* Directory pages parsed */
+  afs_uint32 null_skips;       /* Runs of nulls skipped (DSFIX_SKIP) */
+  afs_uint32 shifts;           /* Inserted data found (DSFIX_RSKIP) */
+  afs_uint32 resyncs;          /* Attempts to resync after a vnode */
+  afs_uint32 n_callbacks;      /* Calls to callbacks, other than cb_error */
+  double cb_time;              /* Seconds spent in those callbacks */
+  double total_time;           /* Seconds spent in ParseDumpFile */
+} dump_stats;
+
 struct tag_parse_info {
   void *err_refcon;
   afs_uint32 (*cb_error)(afs_uint32, int, void *, char *, ...);
@@ -233,6 +264,7 @@ struct tag_parse_info {
 #define TPFLAG_RSKIP  0x0002
   int shift_offset;
   u_int64 shift_start;
+  dump_stats *stats;
 };
 struct tagged_field {
   char tag;        /* Tag character */
@@ -244,6 +276,19 @@ struct tagged_field {
 };
 
 
+/** Progress report, passed to cb_progress **/
+typedef struct {
+  u_int64 offset;              /* Current position in the dump */
+  u_int64 total;               /* Size of the dump (0 if unknown) */
+  afs_uint32 vnodes;           /* Vnodes parsed so far */
+  double elapsed;              /* Seconds since parsing started */
+  double rate;                 /* Bytes/sec since the last report */
+  double avg_rate;             /* Bytes/sec since parsing started */
+  double eta;                  /* Seconds left (-1 if unknown) */
+  int done;                    /* Set in the final report */
+} dump_progress;
+
+
 /** Control structure for parsing volume dumps **/
 typedef struct {
   /* Callback functions:
@@ -279,8 +324,22 @@ typedef struct {
   /* This function is called for each directory entry, if set */
   afs_uint32 (*cb_dirent)(afs_vnode *, afs_dir_entry *, XFILE *, void *);
 
+  /* This function is called by ParseDumpFile every progress_bytes bytes
+   * or progress_vnodes vnodes, whichever comes first (0 means no limit),
+   * and once more at the end.  It is checked only between vnodes.
+   * Path_PreScan passes it on, but with its own refcon.
+   */
+  afs_uint32 (*cb_progress)(dump_progress *, void *);
+  afs_uint32 progress_bytes;
+  afs_uint32 progress_vnodes;
+
   int flags;            /* Flags and options */
 #define DSFLAG_SEEK     0x0001  /* Input file is seekable */
+#define DSFLAG_HASH     0x0002  /* Compute a SHA-256 hash of vnode data.
+                                 * If the input isn't seekable, data that
+                                 * is used (directories, with cb_dirent,
+                                 * and anything with a data callback) is
+                                 * not hashed. */
 
   int print_flags;      /* Flags to control what is printed */
 #define DSPRINT_BCKHDR  0x0001  /* Print backup system header */
@@ -300,11 +359,45 @@ typedef struct {
 #define DSFIX_VDSYNC    0x0004  /* Resync location after vnode data */
 #define DSFIX_VFSYNC    0x0008  /* Try to resync after bad vnode */
 
+  dump_stats *stats;    /* If set, counters for ParseDumpFile to update.
+                         * The caller zeroes these; they accumulate. */
+
+  xftrace *trace;       /* If set, ParseDumpFile records a span here for
+                         * each header, vnode, directory, and callback,
+                         * and for I/O on the dump if the XFILE isn't
+                         * already being traced. */
+
+  XFILE *manifest;      /* If set, ParseDumpFile writes a line here for
+                         * each vnode, before its callback, giving the
+                         * vnode, uniquifier, data version, size, and
+                         * (with DSFLAG_HASH) hash of the data. */
+
   /** Things below this point for internal use only **/
   afs_uint32 vol_uniquifier;
+  dump_progress progress;
+  struct timespec progress_start, progress_last;
+  u_int64 progress_first, progress_next;
+  afs_uint32 progress_nextv;
 } dump_parser;
 
 
+/** Name filters, for ruling out dumps without reading them **/
+typedef struct {
+  afs_uint32 nbits;          /* Size of filter (bits; a power of 2) */
+  afs_uint32 nhash;          /* Number of bits set per name */
+  afs_uint32 count;          /* Number of names added */
+  unsigned char *bits;       /* The filter itself */
+} name_filter;
+typedef struct {
+  afs_uint32 volid;          /* VolID of volume in dump */
+  afs_uint32 from_date;      /* Reference date */
+  afs_uint32 to_date;        /* Date of dump */
+  unsigned char *volname;    /* Name of volume in dump */
+  name_filter paths;         /* Full pathname of every entry */
+  name_filter names;         /* Last component of every entry */
+} name_filters;
+
+
 /** Hash table and control info for pathname manipulation **/
 typedef struct vhash_ent {
   struct vhash_ent *next;    /* Pointer to next entry */
@@ -313,6 +406,7 @@ typedef struct vhash_ent {
   u_int64 v_offset;          /* Offset to start of vnode */
   u_int64 d_offset;          /* Offset to data (0 if none) */
   u_int64 d_size;            /* Size of data */
+  char *name;                /* Name in parent (only with filters) */
 } vhash_ent;
 typedef struct {
   afs_uint32 n_vnodes;          /* Number of vnodes in volume */
@@ -321,9 +415,110 @@ typedef struct {
   int hash_size;             /* Hash table size (bits) */
   vhash_ent **hash_table;    /* Hash table */
   dump_parser *p;            /* Dump parser to use */
+  name_filters *filters;     /* If set, prescan fills in these */
+  vhash_ent *links;          /* Extra names of hard links */
 } path_hashinfo;
 
 
+/** Catalogs of many dumps (see catalog.c for the format) **/
+#define CAT_NONE        0xffffffff  /* No name, parent, or section */
+#define CAT_COL_NAME    0       /* Columns of a catalog section */
+#define CAT_COL_PARENT  1
+#define CAT_COL_FIRST   2
+#define CAT_COL_NCHILD  3
+#define CAT_COL_VNODE   4
+#define CAT_COL_VUNIQ   5
+#define CAT_COL_TYPE    6
+#define CAT_COL_MODE    7
+#define CAT_COL_OWNER   8
+#define CAT_COL_DVERS   9
+#define CAT_COL_CDATE   10
+#define CAT_COL_SDATE   11
+#define CAT_COL_SIZE    12
+#define CAT_COL_DOFFSET 13
+#define CAT_COL_SRC     14
+#define CAT_NCOLS       15
+typedef struct {
+  afs_uint32 name;             /* Index in name dictionary; CAT_NONE for root */
+  afs_uint32 parent;           /* Row of parent directory; CAT_NONE for root */
+  afs_uint32 first;            /* First row of entries (directories) */
+  afs_uint32 nchild;           /* Number of entries (directories) */
+  afs_uint32 vnode;            /* Vnode number */
+  afs_uint32 vuniq;            /* Uniquifier */
+  afs_uint32 type;             /* Vnode type */
+  afs_uint32 mode;             /* UNIX mode bits */
+  afs_uint32 owner;            /* Owner UID */
+  afs_uint32 datavers;         /* Data version */
+  afs_uint32 client_date;      /* Last modified date from client */
+  afs_uint32 server_date;      /* Last modified date on server */
+  u_int64 size;                /* Size of data */
+  u_int64 d_offset;            /* Where in its dump is the data? */
+  afs_uint32 src;              /* Section of the dump with the data */
+} cat_row;
+typedef struct {
+  u_int64 offset;              /* Where in the catalog is it? */
+  u_int64 length;              /* Length of the section */
+  afs_uint32 index;            /* Section number */
+  afs_uint32 volid;            /* Volume ID */
+  char *volname;               /* Volume name */
+  afs_uint32 from_date;        /* Reference date (0 for a full dump) */
+  afs_uint32 to_date;          /* Date of dump */
+  char *dump_path;             /* Where the dump is */
+  u_int64 dump_size;           /* Size of the dump */
+  afs_uint32 base;             /* Section entries were inherited from */
+  afs_uint32 nrows;            /* Number of rows (paths) */
+  afs_uint32 nnames;           /* Number of distinct names */
+  afs_uint32 nblocks;          /* Number of blocks of names */
+  u_int64 names;               /* Offsets within the section of the names, */
+  u_int64 restarts;            /* ... the index of name blocks, */
+  u_int64 cols[CAT_NCOLS];     /* ... and each column */
+} cat_section;
+typedef struct {
+  XFILE X;                     /* The catalog itself */
+  cat_section *sections;       /* Its sections, in order */
+  afs_uint32 nsections;
+  u_int64 end;                 /* Where the next section goes */
+} dump_catalog;
+
+
+/** Random access to the files in a dump (see dumpfs.c) **/
+#define DUMPFS_NONE     0xffffffff  /* No parent or source */
+typedef struct {
+  afs_uint32 node;             /* Index of this file in the dumpfs */
+  afs_uint32 vnode;            /* Vnode number */
+  afs_uint32 vuniq;            /* Uniquifier */
+  afs_uint32 type;             /* Vnode type (0 if not known) */
+  afs_uint32 parent;           /* Node of parent directory */
+  afs_uint32 first;            /* First entry (directories) */
+  afs_uint32 nchild;           /* Number of entries (directories) */
+  afs_uint32 src;              /* Source (dump) with the data */
+  u_int64 size;                /* Size of data */
+  u_int64 d_offset;            /* Where in its dump is the data? */
+} dumpfs_file;
+typedef struct {
+  dumpfs_file *files;          /* Every vnode (or path) in the dump */
+  afs_uint32 nfiles;
+  afs_uint32 root;             /* Node of the root directory */
+  char **names;                /* Directory entries: their names, */
+  afs_uint32 *entries;         /* ... and nodes; by directory, then name */
+  afs_uint32 nentries;
+
+  /** Things below this point for internal use only **/
+  char **catalog_names;        /* Name dictionary (from a catalog) */
+  struct dumpfs_source *sources;
+  afs_uint32 nsources;
+} dumpfs;
+
+/* A piece of a file's data, for dividing the work among threads */
+typedef struct {
+  afs_uint32 node;             /* Node of the file */
+  afs_uint32 piece;            /* Which piece of the file (0 is first) */
+  u_int64 start;               /* Offset of the piece in the file */
+  afs_uint32 len;              /* Length of the piece */
+} dumpfs_unit;
+typedef void (*dumpfs_unit_cb)(dumpfs *, dumpfs_unit *, afs_uint32, void *);
+
+
 /** Function prototypes **/
 /** Only the functions declared below are public interfaces **/
 /** Maybe someday, I'll write man pages for these **/
@@ -360,6 +555,12 @@ extern afs_uint32 ParseDumpFile(XFILE *, dump_parser *);
 extern afs_uint32 ParseDumpHeader(XFILE *, dump_parser *);
 extern afs_uint32 ParseVolumeHeader(XFILE *, dump_parser *);
 extern afs_uint32 ParseVNode(XFILE *, dump_parser *);
+extern void PrintDumpStats(dump_stats *);
+
+/* util.c - Utilities for programs that parse dumps */
+#define DS_MAXVNODE 0x2000000  /* Larger vnode numbers are bogus */
+extern afs_uint32 GrowVnodeArray(void **, afs_uint32 *, size_t, afs_uint32);
+extern void PrintProgress(char *, dump_progress *);
 
 
 /* directory.c - Directory parsing, lookup, and generation */
@@ -386,4 +587,41 @@ extern void Path_FreeHashTable(path_hashinfo *);
 extern afs_uint32 Path_Follow(XFILE *, path_hashinfo *, char *, vhash_ent *);
 extern afs_uint32 Path_Build(XFILE *, path_hashinfo *, afs_uint32, char **, int);
 
+/* namefilter.c - Filters of the names in a dump */
+extern afs_uint32 Filter_Init(name_filter *, afs_uint32);
+extern void Filter_Add(name_filter *, char *);
+extern int Filter_Test(name_filter *, char *);
+extern void Filter_Free(name_filters *);
+extern afs_uint32 Filter_Write(name_filters *, char *);
+extern afs_uint32 Filter_Read(name_filters *, char *);
+
+/* catalog.c - Catalogs of many dumps */
+extern afs_uint32 Catalog_Open(dump_catalog *, char *, int);
+extern afs_uint32 Catalog_Close(dump_catalog *);
+extern afs_uint32 Catalog_Append(dump_catalog *, cat_section *, cat_row *, char **);
+extern afs_uint32 Catalog_Load(dump_catalog *, cat_section *, cat_row **, char ***);
+extern afs_uint32 Catalog_Lookup(dump_catalog *, cat_section *, char *,
+                                 afs_uint32 *, cat_row *);
+extern afs_uint32 Catalog_GetRow(dump_catalog *, cat_section *, afs_uint32, cat_row *);
+
+/* dumpfs.c - Random access to the files in a dump */
+extern afs_uint32 DumpFS_Open(dumpfs *, char *, dump_parser *);
+extern afs_uint32 DumpFS_OpenCatalog(dumpfs *, dump_catalog *, cat_section *);
+extern void DumpFS_Close(dumpfs *);
+extern afs_uint32 DumpFS_Lookup(dumpfs *, char *, dumpfs_file *);
+extern afs_uint32 DumpFS_ReadDir(dumpfs *, dumpfs_file *, afs_uint32,
+                                 char **, dumpfs_file *);
+extern afs_uint32 DumpFS_Read(dumpfs *, dumpfs_file *, u_int64 *,
+                              void *, afs_uint32, afs_uint32 *);
+extern afs_uint32 DumpFS_Path(dumpfs *, dumpfs_file *, char **);
+extern afs_uint32 DumpFS_Units(dumpfs *, afs_uint32, dumpfs_unit **,
+                               afs_uint32 *);
+extern afs_uint32 DumpFS_RunUnits(dumpfs *, dumpfs_unit *, afs_uint32, int,
+                                  dumpfs_unit_cb, void **);
+
+/* sha256.c - SHA-256 message digests */
+extern void Sha256_Init(sha256_ctx *);
+extern void Sha256_Update(sha256_ctx *, void *, afs_uint32);
+extern void Sha256_Final(sha256_ctx *, unsigned char *);
+
 #endif
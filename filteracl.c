@@ -1,5 +1,6 @@
 #include <sys/fcntl.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <afs/stds.h>
 #include <afs/acl.h>
 #include <afs/prs_fs.h>
@@ -109,13 +110,22 @@ static afs_uint32 error_cb(afs_uint32 err, int fatal, void *refcon,
 
 int main(int argc, char **argv)
 {
-  XFILE Xin, Xout;
+  XFILE Xin, Xout, Xraw;
   dump_parser dp;
   afs_uint32 r;
+  int compress = 0, zlevel = 0;
 
   progname = argv[0];
   acl_mask = ntohl(PRSFS_READ | PRSFS_LOOKUP);
 
+  /* -zn compresses the output with zstd at level n */
+  if (argc > 1 && argv[1][0] == '-' && argv[1][1] == 'z') {
+    compress = 1;
+    zlevel = atoi(argv[1] + 2);
+    argc--;
+    argv++;
+  }
+
   initialize_xFil_error_table();
   initialize_AVds_error_table();
   if (argc > 1) {
@@ -142,7 +152,13 @@ int main(int argc, char **argv)
   dp.cb_error       = error_cb;
   if (Xin.is_seekable) dp.flags |= DSFLAG_SEEK;
 
-  r = xfopen_FILE(&Xout, O_WRONLY, stdout);
+  if (compress) {
+    r = xfopen_FILE(&Xraw, O_WRONLY, stdout);
+    if (!r) r = xfopen_zstdseek(&Xout, O_WRONLY, &Xraw, zlevel, -1);
+  } else {
+    r = xfopen_FILE(&Xout, O_WRONLY, stdout);
+  }
+  if (!r) r = xfsetbuf(&Xout, XFBUFSIZE);
   if (r) {
     afs_com_err(progname, r, "opening stdout");
     exit(1);
@@ -241,6 +241,7 @@ void emit(void)
 
   if (outpath) r = xfopen(&X, O_RDWR|O_CREAT|O_TRUNC, outpath);
   else         r = xfopen_FILE(&X, O_RDWR, stdout);
+  if (!r) r = xfsetbuf(&X, XFBUFSIZE);
   if (r) die("xfopen", r);
 
   /* Dump the dump header */
@@ -52,4 +52,10 @@ extern afs_uint32 try_backuphdr(XFILE *X, unsigned char *tag, tagged_field *fiel
 /* util.c - Random utilities */
 extern afs_uint32 handle_return(int, XFILE *, unsigned char, dump_parser *);
 extern void prep_pi(dump_parser *, tag_parse_info *);
+extern void progress_start(XFILE *, dump_parser *);
+extern void progress_total(XFILE *, dump_parser *, u_int64 *);
+extern afs_uint32 progress_report(XFILE *, dump_parser *, int);
+extern afs_uint32 progress_vnode(XFILE *, dump_parser *);
+extern void cb_timer_start(dump_parser *, struct timespec *, char *);
+extern void cb_timer_stop(dump_parser *, struct timespec *);
 extern afs_uint32 match_next_vnode(XFILE *, dump_parser *, u_int64 *, afs_uint32);
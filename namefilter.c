@@ -0,0 +1,228 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* namefilter.c - Filters of the names in a dump
+ *
+ * A name filter is a Bloom filter over the names in a dump: one over
+ * the full pathname of every entry, and one over just the last
+ * component.  Either will say for certain that a name is NOT in the
+ * dump, and otherwise that it may be; with the sizes used here, about
+ * one name in a hundred that isn't there will be reported as maybe.
+ * The filters are built during the path prescan (see pathname.c) and
+ * written to a small file next to the dump, so that a search of many
+ * dumps need only read the dumps that may actually have the name.
+ *
+ * The file holds a magic number, a version, the volume ID and dump
+ * dates, the null-terminated volume name, and then the path filter
+ * and the name filter.  Each filter is its size in bits, the number of
+ * bits set per name, the number of names added, and then the bits.
+ * All integers are in network byte order.
+ */
+
+#include <sys/types.h>
+#include <sys/fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dumpscan.h"
+#include "dumpscan_errs.h"
+
+#define NF_MAGIC      0x4146444e       /* "AFDN" */
+#define NF_VERSION    1
+#define NF_BITS       10               /* Bits per name */
+#define NF_HASHES     7                /* Bits set per name */
+#define NF_MINBITS    1024
+#define NF_MAXBITS    0x80000000
+
+
+/* Finish a hash, so every input bit affects every output bit */
+static afs_uint32 fmix32(afs_uint32 h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+
+/* Compute two independent hashes of a name.  Bit i of the filter for
+ * a name is then h1 + i * h2; h2 is odd, so these are all different.
+ */
+static void hash_name(char *name, afs_uint32 *h1, afs_uint32 *h2)
+{
+  unsigned char *s = (unsigned char *)name;
+  afs_uint32 a = 0x811c9dc5, b = 0x9e3779b9;
+
+  for (; *s; s++) {
+    a = (a ^ *s) * 0x01000193;
+    b = (b + *s) * 0x2f0b3a49;
+    b ^= b >> 15;
+  }
+  *h1 = fmix32(a);
+  *h2 = fmix32(b ^ a) | 1;
+}
+
+
+/* Set up an empty filter sized for about nitems names */
+afs_uint32 Filter_Init(name_filter *F, afs_uint32 nitems)
+{
+  memset(F, 0, sizeof(*F));
+  for (F->nbits = NF_MINBITS;
+       F->nbits < NF_MAXBITS && F->nbits / NF_BITS < nitems;
+       F->nbits <<= 1);
+  F->nhash = NF_HASHES;
+  F->bits = (unsigned char *)malloc(F->nbits / 8);
+  if (!F->bits) return ENOMEM;
+  memset(F->bits, 0, F->nbits / 8);
+  return 0;
+}
+
+
+/* Add a name to a filter */
+void Filter_Add(name_filter *F, char *name)
+{
+  afs_uint32 h1, h2, bit, i;
+
+  hash_name(name, &h1, &h2);
+  for (i = 0; i < F->nhash; i++) {
+    bit = (h1 + i * h2) & (F->nbits - 1);
+    F->bits[bit >> 3] |= 1 << (bit & 7);
+  }
+  F->count++;
+}
+
+
+/* Test whether a name may have been added to a filter.
+ * Returns 0 if it certainly was not.
+ */
+int Filter_Test(name_filter *F, char *name)
+{
+  afs_uint32 h1, h2, bit, i;
+
+  if (!F->bits) return 1;
+  hash_name(name, &h1, &h2);
+  for (i = 0; i < F->nhash; i++) {
+    bit = (h1 + i * h2) & (F->nbits - 1);
+    if (!(F->bits[bit >> 3] & (1 << (bit & 7)))) return 0;
+  }
+  return 1;
+}
+
+
+/* Free the contents of a set of filters */
+void Filter_Free(name_filters *NF)
+{
+  if (NF->volname) free(NF->volname);
+  if (NF->paths.bits) free(NF->paths.bits);
+  if (NF->names.bits) free(NF->names.bits);
+  memset(NF, 0, sizeof(*NF));
+}
+
+
+static afs_uint32 write_filter(XFILE *X, name_filter *F)
+{
+  afs_uint32 r;
+
+  if ((r = WriteInt32(X, F->nbits))
+  ||  (r = WriteInt32(X, F->nhash))
+  ||  (r = WriteInt32(X, F->count)))
+    return r;
+  return xfwrite(X, F->bits, F->nbits / 8);
+}
+
+
+static afs_uint32 read_filter(XFILE *X, name_filter *F)
+{
+  afs_uint32 r;
+
+  if ((r = ReadInt32(X, &F->nbits))
+  ||  (r = ReadInt32(X, &F->nhash))
+  ||  (r = ReadInt32(X, &F->count)))
+    return r;
+  if (F->nbits < NF_MINBITS || F->nbits > NF_MAXBITS
+  ||  (F->nbits & (F->nbits - 1))
+  ||  F->nhash < 1 || F->nhash > 32)
+    return DSERR_NAMEFILTER;
+  F->bits = (unsigned char *)malloc(F->nbits / 8);
+  if (!F->bits) return ENOMEM;
+  return xfread(X, F->bits, F->nbits / 8);
+}
+
+
+/* Write a set of filters to a file */
+afs_uint32 Filter_Write(name_filters *NF, char *path)
+{
+  XFILE X;
+  afs_uint32 r;
+
+  r = xfopen_path(&X, O_RDWR | O_CREAT | O_TRUNC, path, 0644);
+  if (r) return r;
+  if ((r = WriteInt32(&X, NF_MAGIC))
+  ||  (r = WriteInt32(&X, NF_VERSION))
+  ||  (r = WriteInt32(&X, NF->volid))
+  ||  (r = WriteInt32(&X, NF->from_date))
+  ||  (r = WriteInt32(&X, NF->to_date))
+  ||  (r = WriteString(&X, NF->volname ? NF->volname
+                                       : (unsigned char *)""))
+  ||  (r = write_filter(&X, &NF->paths))
+  ||  (r = write_filter(&X, &NF->names))) {
+    xfclose(&X);
+    return r;
+  }
+  return xfclose(&X);
+}
+
+
+/* Read a set of filters from a file */
+afs_uint32 Filter_Read(name_filters *NF, char *path)
+{
+  XFILE X;
+  afs_uint32 r, magic, version;
+
+  memset(NF, 0, sizeof(*NF));
+  r = xfopen_path(&X, O_RDONLY, path, 0);
+  if (r) return r;
+  if ((r = ReadInt32(&X, &magic))
+  ||  (r = ReadInt32(&X, &version))
+  ||  magic != NF_MAGIC || version != NF_VERSION
+  ||  (r = ReadInt32(&X, &NF->volid))
+  ||  (r = ReadInt32(&X, &NF->from_date))
+  ||  (r = ReadInt32(&X, &NF->to_date))
+  ||  (r = ReadString(&X, &NF->volname))
+  ||  (r = read_filter(&X, &NF->paths))
+  ||  (r = read_filter(&X, &NF->names))) {
+    if (r != ENOMEM) r = DSERR_NAMEFILTER;
+    Filter_Free(NF);
+    xfclose(&X);
+    return r;
+  }
+  xfclose(&X);
+  return 0;
+}
@@ -26,12 +26,34 @@
  * the rights to redistribute these changes.
  */
 
-/* null-search.c - search for nulls in data files */
+/* null-search.c - search for corruption in data files
+ *
+ * Bad drives, drivers and tapes leave recognizable marks in the data
+ * they mangle: runs of NULs, whole blocks of NULs where a write was
+ * lost, blocks filled with one byte, and blocks that are a copy of the
+ * block before them.  This reads the data of every file in a dump and
+ * reports each file with a run of at least -n NULs, or with any such
+ * block, along with a map of the suspect blocks.  Blocks are -b bytes,
+ * counted from the start of the file.
+ *
+ * A seekable dump is indexed first (see dumpfs.c), and its files are
+ * divided into units of at most UNIT_SIZE bytes, which a pool of
+ * threads read and check in parallel (see DumpFS_RunUnits).  A dump on
+ * a pipe is checked as it is read, by one thread.  Either way, each
+ * block is checked with memcmp(), and NULs are counted a word at a
+ * time; bytes are looked at one at a time only in words that have a
+ * NUL in them.
+ *
+ * The exit status is 0 if nothing bad was found, 1 if some files
+ * looked bad, and 2 if there were errors.
+ */
 
+#include <sys/types.h>
 #include <sys/fcntl.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <afs/stds.h>
 #include <afs/com_err.h>
@@ -43,22 +65,67 @@
 #include <afs/vlserver.h>
 
 #include "dumpscan.h"
+#include "xf_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+#define UNIT_SIZE  (4 << 20)           /* data handed to a thread at once */
+
+/* Kinds of suspect blocks */
+#define BLK_ZERO    1                  /* all NULs */
+#define BLK_FILL    2                  /* one other byte, over and over */
+#define BLK_REPEAT  3                  /* the same as the block before */
+static char *kind_names[] = { 0, "zero", "fill", "repeat" };
+
+/* For finding NULs a word at a time */
+#define ONES   ((unsigned long)-1 / 0xff)
+#define HIGHS  (ONES * 0x80)
+#define HAS_NUL(w) (((w) - ONES) & ~(w) & HIGHS)
+
+/* A run of suspect blocks of one kind */
+struct region {
+  afs_uint32 first, last;
+  int kind;
+};
+
+/* What was found in some stretch of a file */
+struct scan {
+  afs_uint32 len;
+  afs_uint32 nulls;
+  afs_uint32 lead, trail;              /* NULs at the start, and the end */
+  afs_uint32 maxrun;                   /* longest run of NULs */
+  struct region *regions;
+  afs_uint32 nregions, maxregions;
+};
+
+/* What was found in each unit of a seekable dump */
+struct result {
+  afs_uint32 error;
+  struct scan S;
+};
 
 char *argv0;
 static char *input_path = 0;
-static int quiet = 0, showpaths = 0, searchcount = 1;
+static int quiet = 0, showpaths = 0, searchcount = 1, nthreads;
+static afs_uint32 block_size = 4096, unit_len;
 static int error_count = 0, bad_count = 0;
-static path_hashinfo phi;
 static dump_parser dp;
 
+/* Results of the threads, one per unit */
+static struct result *results;
+
 /* Print a usage message and exit */
 static void usage(int status, char *msg)
 {
   if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
   fprintf(stderr, "Usage: %s [options] [file]\n", argv0);
-  fprintf(stderr, "  -h     Print this help message\n");
-  fprintf(stderr, "  -p     Print paths of bad vnodes\n");
-  fprintf(stderr, "  -q     Quiet mode (don't print errors)\n");
+  fprintf(stderr, "  -b size    Block size (default 4096; a multiple of 512)\n");
+  fprintf(stderr, "  -h         Print this help message\n");
+  fprintf(stderr, "  -j threads Number of threads (default: one per CPU)\n");
+  fprintf(stderr, "  -n count   Report runs of at least count NULs (default 1)\n");
+  fprintf(stderr, "  -p         Print paths of bad vnodes\n");
+  fprintf(stderr, "  -q         Quiet mode (don't print errors)\n");
   exit(status);
 }
 
@@ -70,20 +137,29 @@ static void parse_options(int argc, char **argv)
 
   if (argv0 = strrchr(argv[0], '/')) argv0++;
   else argv0 = argv[0];
+  nthreads = sysconf(_SC_NPROCESSORS_ONLN);
 
   /* Parse the options */
-  while ((c = getopt(argc, argv, "n:hpq")) != EOF) {
+  while ((c = getopt(argc, argv, "b:j:n:hpq")) != EOF) {
     switch (c) {
+      case 'b': block_size   = atoi(optarg); continue;
+      case 'j': nthreads     = atoi(optarg); continue;
       case 'n': searchcount  = atoi(optarg); continue;
       case 'p': showpaths    = 1;            continue;
       case 'q': quiet        = 1;            continue;
       case 'h': usage(0, 0);
-      default:  usage(1, "Invalid option!");
+      default:  usage(2, "Invalid option!");
     }
   }
 
-  if (argc - optind > 1) usage(1, "Too many arguments!");
+  if (argc - optind > 1) usage(2, "Too many arguments!");
+  if (!block_size || block_size % 512) usage(2, "Invalid block size!");
+  if (nthreads < 1) nthreads = 1;
   input_path = (argc == optind) ? "-" : argv[optind];
+
+  /* Units are a whole number of blocks */
+  unit_len = (UNIT_SIZE / block_size) * block_size;
+  if (!unit_len) unit_len = block_size;
 }
 
 
@@ -98,46 +174,298 @@ static afs_uint32 my_error_cb(afs_uint32 code, int fatal, void *ref, char *msg,
     afs_com_err_va(argv0, code, msg, alist);
     va_end(alist);
   }
+  return 0;
 }
 
 
-/* A callback to process file vnodes */
-static afs_uint32 my_file_cb(afs_vnode *v, XFILE *X, void *refcon)
+/** Checking the data **/
+
+/* Add a block to the map, joining it to the last run if it can */
+static afs_uint32 add_region(struct scan *S, afs_uint32 first,
+                             afs_uint32 last, int kind)
+{
+  struct region *R;
+
+  if (S->nregions) {
+    R = &S->regions[S->nregions - 1];
+    if (R->kind == kind && R->last + 1 == first) {
+      R->last = last;
+      return 0;
+    }
+  }
+  if (S->nregions == S->maxregions) {
+    S->maxregions = S->maxregions ? S->maxregions * 2 : 16;
+    R = realloc(S->regions, S->maxregions * sizeof(struct region));
+    if (!R) return ENOMEM;
+    S->regions = R;
+  }
+  R = &S->regions[S->nregions++];
+  R->first = first;
+  R->last = last;
+  R->kind = kind;
+  return 0;
+}
+
+
+/* Count the NULs in some data, and track the runs of them */
+static void count_nulls(struct scan *S, unsigned char *p, afs_uint32 n)
 {
-  static char buf[1024];
-  afs_uint32 size, nulls, cnulls, maxcnulls, n, r;
-  char *name = 0;
-  int i;
-
-  nulls = cnulls = maxcnulls = 0;
-  size = v->size;
-  if ((r = xfseek(X, &v->d_offset))) return r;
-  while (size) {
-    n = (size > 1024) ? 1024 : size;
-    if (r = xfread(X, buf, n)) return r;
-    for (i = 0; i < n; i++) {
-      if (buf[i]) {
-        if (cnulls > maxcnulls) maxcnulls = cnulls;
-        cnulls = 0;
-      } else {
-        nulls++;
-        cnulls++;
+  unsigned long w;
+  afs_uint32 i;
+
+  /* Load each word with memcpy; it compiles to a plain load */
+  for (; n >= sizeof(w); p += sizeof(w), n -= sizeof(w)) {
+    memcpy(&w, p, sizeof(w));
+    if (!w) {
+      if (S->lead == S->len) S->lead += sizeof(w);
+      S->nulls += sizeof(w);
+      S->trail += sizeof(w);
+    } else if (!HAS_NUL(w)) {
+      if (S->trail > S->maxrun) S->maxrun = S->trail;
+      S->trail = 0;
+    } else {
+      for (i = 0; i < sizeof(w); i++) {
+        if (p[i]) {
+          if (S->trail > S->maxrun) S->maxrun = S->trail;
+          S->trail = 0;
+        } else {
+          if (S->lead == S->len + i) S->lead++;
+          S->nulls++;
+          S->trail++;
+        }
       }
     }
-    size -= n;
-  }
-  if (maxcnulls >= searchcount) {
-    bad_count++;
-    if (showpaths) Path_Build(X, &phi, v->vnode, &name, 0);
-    if (name) {
-      printf("*** BAD %d (%s) - %d nulls, %d consecutive\n",
-             v->vnode, name, nulls, maxcnulls);
-      free(name);
+    S->len += sizeof(w);
+  }
+  for (; n; p++, n--) {
+    if (*p) {
+      if (S->trail > S->maxrun) S->maxrun = S->trail;
+      S->trail = 0;
     } else {
-      printf("*** BAD %d - %d nulls, %d consecutive\n",
-             v->vnode, nulls, maxcnulls);
+      if (S->lead == S->len) S->lead++;
+      S->nulls++;
+      S->trail++;
+    }
+    S->len++;
+  }
+}
+
+
+/* Check len bytes at buf + pre, which start with block number block.
+ * If pre is nonzero, the block before them is at buf.
+ */
+static afs_uint32 scan_data(struct scan *S, unsigned char *buf,
+                            afs_uint32 pre, afs_uint32 len, afs_uint32 block)
+{
+  unsigned char *p = buf + pre;
+  afs_uint32 n, r;
+  int kind;
+
+  S->len = S->nulls = S->lead = S->trail = S->maxrun = 0;
+  S->nregions = 0;
+  for (; len; p += n, len -= n, block++) {
+    n = (len < block_size) ? len : block_size;
+    kind = 0;
+    if (n == block_size) {
+      if (!memcmp(p, p + 1, n - 1)) kind = *p ? BLK_FILL : BLK_ZERO;
+      else if ((p > buf) && !memcmp(p, p - n, n)) kind = BLK_REPEAT;
     }
+    if (kind && (r = add_region(S, block, block, kind))) return r;
+
+    if (kind == BLK_ZERO) {
+      if (S->lead == S->len) S->lead += n;
+      S->nulls += n;
+      S->trail += n;
+      S->len += n;
+    } else if (kind == BLK_FILL) {
+      if (S->trail > S->maxrun) S->maxrun = S->trail;
+      S->trail = 0;
+      S->len += n;
+    } else count_nulls(S, p, n);
   }
+  if (S->trail > S->maxrun) S->maxrun = S->trail;
+  return 0;
+}
+
+
+/* Add what was found in the next piece of a file to what was found in
+ * the pieces before it.
+ */
+static afs_uint32 merge_scan(struct scan *V, struct scan *S)
+{
+  afs_uint32 i, r;
+
+  if (S->lead == S->len) V->trail += S->len;
+  else {
+    V->trail += S->lead;
+    if (V->trail > V->maxrun) V->maxrun = V->trail;
+    V->trail = S->trail;
+  }
+  if (S->maxrun > V->maxrun) V->maxrun = S->maxrun;
+  if (V->trail > V->maxrun) V->maxrun = V->trail;
+  V->nulls += S->nulls;
+  V->len += S->len;
+  for (i = 0; i < S->nregions; i++) {
+    r = add_region(V, S->regions[i].first, S->regions[i].last,
+                   S->regions[i].kind);
+    if (r) return r;
+  }
+  return 0;
+}
+
+
+/* Print what was found in a file, if it looks bad */
+static void report(afs_uint32 vnode, char *name, struct scan *V)
+{
+  struct region *R;
+  afs_uint32 i;
+
+  if (V->maxrun < searchcount && !V->nregions) return;
+  bad_count++;
+  if (name) {
+    printf("*** BAD %d (%s) - %d nulls, %d consecutive\n",
+           vnode, name, V->nulls, V->maxrun);
+  } else {
+    printf("*** BAD %d - %d nulls, %d consecutive\n",
+           vnode, V->nulls, V->maxrun);
+  }
+  for (i = 0; i < V->nregions; i++) {
+    R = &V->regions[i];
+    if (R->first == R->last)
+      printf("    block  %u: %s\n", R->first, kind_names[R->kind]);
+    else
+      printf("    blocks %u-%u: %s\n", R->first, R->last, kind_names[R->kind]);
+  }
+}
+
+
+/** Checking a dump on a pipe, as it is read **/
+
+static unsigned char *stream_buf;
+
+/* A callback to check the data of file vnodes */
+static afs_uint32 my_file_cb(afs_vnode *v, XFILE *X, void *refcon)
+{
+  struct scan V, S;
+  u_int64 left, tmp64;
+  afs_uint32 n, pre = 0, block = 0, r = 0;
+
+  memset(&V, 0, sizeof(V));
+  memset(&S, 0, sizeof(S));
+  cp64(left, v->size);
+  while (!zero64(left)) {
+    n = (hi64(left) || lo64(left) > unit_len) ? unit_len : lo64(left);
+    if (r = xfread(X, stream_buf + pre, n)) break;
+    if (r = scan_data(&S, stream_buf, pre, n, block)) break;
+    if (r = merge_scan(&V, &S)) break;
+
+    /* Keep the last block, to compare the next one with */
+    if (n == unit_len) {
+      memcpy(stream_buf, stream_buf + pre + n - block_size, block_size);
+      pre = block_size;
+    }
+    block += n / block_size;
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  if (!r) report(v->vnode, 0, &V);
+  if (V.regions) free(V.regions);
+  if (S.regions) free(S.regions);
+  return r;
+}
+
+
+/** Checking a seekable dump, in parallel **/
+
+/* Called by DumpFS_RunUnits for each unit, with the thread's buffer */
+static void check_cb(dumpfs *FS, dumpfs_unit *U, afs_uint32 i, void *arg)
+{
+  unsigned char *buf = arg;
+  dumpfs_file *F = &FS->files[U->node];
+  afs_uint32 pre, want, got, n, r;
+  u_int64 where, tmp64;
+
+  /* Read the block before, too, to compare the first one with */
+  pre = zero64(U->start) ? 0 : block_size;
+  sub64_32(where, U->start, pre);
+  want = pre + U->len;
+  for (got = 0, r = 0; got < want; got += n) {
+    if (r = DumpFS_Read(FS, F, &where, buf + got, want - got, &n)) break;
+    if (!n) {
+      r = ERROR_XFILE_EOF;
+      break;
+    }
+    add64_32(tmp64, where, n);
+    cp64(where, tmp64);
+  }
+  if (!r) r = scan_data(&results[i].S, buf, pre, U->len,
+                        U->piece * (unit_len / block_size));
+  results[i].error = r;
+}
+
+
+/* Check every file in the dump, and report the bad ones in order */
+static afs_uint32 scan_parallel(void)
+{
+  dumpfs FS;
+  dumpfs_unit *units = 0;
+  unsigned char **bufs = 0;
+  struct result *R;
+  struct scan V;
+  char *name;
+  afs_uint32 nunits, i, r;
+  int t;
+
+  if (r = DumpFS_Open(&FS, input_path, &dp)) return r;
+  if (r = DumpFS_Units(&FS, unit_len, &units, &nunits)) goto out;
+  results = calloc(nunits + 1, sizeof(struct result));
+  bufs = calloc(nthreads, sizeof(unsigned char *));
+  if (!results || !bufs) {
+    r = ENOMEM;
+    goto out;
+  }
+  for (t = 0; t < nthreads; t++)
+    if (!(bufs[t] = malloc(unit_len + block_size))) {
+      r = ENOMEM;
+      goto out;
+    }
+  if (r = DumpFS_RunUnits(&FS, units, nunits, nthreads, check_cb, (void **)bufs))
+    goto out;
+
+  memset(&V, 0, sizeof(V));
+  for (i = 0; i < nunits; i++) {
+    R = &results[i];
+    if (R->error) {
+      /* Nothing is known about this unit, so no run crosses it */
+      my_error_cb(R->error, 0, 0, "reading vnode %d",
+                  FS.files[units[i].node].vnode);
+      V.trail = 0;
+    } else if (r = merge_scan(&V, &R->S)) break;
+
+    if (i + 1 == nunits || units[i + 1].node != units[i].node) {
+      name = 0;
+      if (showpaths) DumpFS_Path(&FS, &FS.files[units[i].node], &name);
+      report(FS.files[units[i].node].vnode, name, &V);
+      if (name) free(name);
+      V.len = V.nulls = V.trail = V.maxrun = V.nregions = 0;
+    }
+  }
+  if (V.regions) free(V.regions);
+
+out:
+  if (results) {
+    for (i = 0; i < nunits; i++)
+      if (results[i].S.regions) free(results[i].S.regions);
+    free(results);
+    results = 0;
+  }
+  if (bufs) {
+    for (t = 0; t < nthreads; t++)
+      if (bufs[t]) free(bufs[t]);
+    free(bufs);
+  }
+  if (units) free(units);
+  DumpFS_Close(&FS);
   return r;
 }
 
@@ -163,27 +491,26 @@ int main(int argc, char **argv)
 
   memset(&dp, 0, sizeof(dp));
   dp.cb_error      = my_error_cb;
-  if (input_file.is_seekable) dp.flags |= DSFLAG_SEEK;
-  if (showpaths) {
-    u_int64 where;
-
-    memset(&phi, 0, sizeof(phi));
-    phi.p = &dp;
-
-    if ((r = xftell(&input_file, &where))
-    ||  (r = Path_PreScan(&input_file, &phi, 0))
-    ||  (r = xfseek(&input_file, &where))) {
-      afs_com_err(argv0, r, "- path initialization failed");
+  if (input_file.is_seekable && strcmp(input_path, "-")) {
+    xfclose(&input_file);
+    r = scan_parallel();
+  } else {
+    if (showpaths) {
+      afs_com_err(argv0, ERROR_XFILE_NOSEEK, "- -p needs a seekable dump");
       xfclose(&input_file);
       exit(2);
     }
+    if (!(stream_buf = malloc(unit_len + block_size))) {
+      afs_com_err(argv0, ENOMEM, "- allocating buffers");
+      exit(2);
+    }
+    dp.cb_file_data = my_file_cb;
+    r = ParseDumpFile(&input_file, &dp);
+    xfclose(&input_file);
   }
 
-  dp.cb_vnode_file = my_file_cb;
-  r = ParseDumpFile(&input_file, &dp);
-  xfclose(&input_file);
-
   if (error_count) printf("*** %d errors\n", error_count);
   if (bad_count)   printf("*** %d bad files\n", bad_count);
   if (r && !quiet) printf("*** FAILED: %s\n", afs_error_message(r));
+  exit((r || error_count) ? 2 : bad_count ? 1 : 0);
 }
@@ -96,6 +96,7 @@ static afs_uint32 parse_dumphdr(XFILE *X, unsigned char *tag, tagged_field *fiel
     return DSERR_MAGIC;
   }
 
+  xftrace_begin(p->trace, "parse", "dump header");
   if (p->print_flags & DSPRINT_DUMPHDR)
     printf("%s [%s = 0x%s]\n", field->label,
       decimate_int64(&hdr.offset, 0), hexify_int64(&hdr.offset, 0));
@@ -106,8 +107,12 @@ static afs_uint32 parse_dumphdr(XFILE *X, unsigned char *tag, tagged_field *fiel
   r = ParseTaggedData(X, dumphdr_fields, tag, pi, g_refcon, (void *)&hdr);
 
   if (!r && p->cb_dumphdr) {
+    struct timespec t0;
+
     r = xftell(X, &where);
+    cb_timer_start(p, &t0, "cb_dumphdr");
     if (!r) r = (p->cb_dumphdr)(&hdr, X, p->refcon);
+    cb_timer_stop(p, &t0);
     if (p->flags & DSFLAG_SEEK) {
       if (!r) r = xfseek(X, &where);
       else xfseek(X, &where);
@@ -115,6 +120,7 @@ static afs_uint32 parse_dumphdr(XFILE *X, unsigned char *tag, tagged_field *fiel
   }
   if (hdr.field_mask & F_DUMPHDR_VOLNAME)
     free(hdr.volname);
+  xftrace_end(p->trace);
   return r;
 }
 
@@ -203,13 +209,63 @@ static afs_uint32 parse_dumpend(XFILE *X, unsigned char *tag, tagged_field *fiel
 
 afs_uint32 ParseDumpFile(XFILE *X, dump_parser *p)
 {
+  struct timespec t0, t1;
   tag_parse_info pi;
   unsigned char tag;
+  xfstats *old_stats = X->stats;
+  xftrace *old_trace = X->trace;
   afs_uint32 r;
 
+  /* Count I/O on the dump, unless someone else already is */
+  if (p->stats) {
+    if (!X->stats) X->stats = &p->stats->io;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+  }
+  if (!X->trace) X->trace = p->trace;
+  xftrace_begin(p->trace, "parse", "ParseDumpFile");
   prep_pi(p, &pi);
+  progress_start(X, p);
   r = ParseTaggedData(X, top_fields, &tag, &pi, (void *)p, 0);
-  return handle_return(r, X, tag, p);
+  r = handle_return(r, X, tag, p);
+  if (!r) r = progress_report(X, p, 1);
+  else progress_report(X, p, 1);
+  xftrace_end(p->trace);
+  X->trace = old_trace;
+  if (p->stats) {
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    p->stats->total_time += (t1.tv_sec - t0.tv_sec)
+                          + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    X->stats = old_stats;
+  }
+  return r;
+}
+
+
+/* Print statistics collected while parsing */
+void PrintDumpStats(dump_stats *s)
+{
+  static char *kinds[] = { "noop", "byte", "int16", "int32", "string",
+                           "special" };
+  char buf[21];
+  int i;
+
+  printf("* PARSER STATISTICS\n");
+  printf(" Bytes read:      %s\n", decimate_int64(&s->io.bytes_read, buf));
+  printf(" Bytes skipped:   %s\n", decimate_int64(&s->io.bytes_skipped, buf));
+  printf(" Calls:           %d read, %d skip, %d seek, %d tell\n",
+         s->io.n_read, s->io.n_skip, s->io.n_seek, s->io.n_tell);
+  printf(" Tags:           ");
+  for (i = 0; i < 6; i++)
+    if (s->tags[i]) printf(" %d %s", s->tags[i], kinds[i]);
+  printf("\n");
+  printf(" Vnodes:          %d dir, %d file, %d link, %d empty, %d other\n",
+         s->n_dirs, s->n_files, s->n_links, s->n_empty, s->n_wierd);
+  printf(" Dir pages:       %d\n", s->dir_pages);
+  printf(" Repairs:         %d null skips, %d shifts, %d resyncs\n",
+         s->null_skips, s->shifts, s->resyncs);
+  printf(" Time:            %.3fs total, %.3fs library, "
+         "%.3fs in %d callbacks\n", s->total_time,
+         s->total_time - s->cb_time, s->cb_time, s->n_callbacks);
 }
 
 
@@ -98,6 +98,7 @@ afs_uint32 ParseTaggedData(XFILE *X, tagged_field *fields, unsigned char *tag,
                        p1, p2, p3);
       }
       pi->shift_offset = 0;
+      if (pi->stats) pi->stats->shifts++;
       if (r = ReadByte(X, tag)) return r;
     }
     if (!*tag && (pi->flags & TPFLAG_SKIP)) {
@@ -112,6 +113,7 @@ afs_uint32 ParseTaggedData(XFILE *X, tagged_field *fields, unsigned char *tag,
       }
       pi->shift_offset += count;
       cp64(pi->shift_start, where);
+      if (pi->stats) pi->stats->null_skips++;
       if (pi->cb_error) {
         sub64_32(tmp64a, where, 1);
         (pi->cb_error)(DSERR_FMT, 0, pi->err_refcon,
@@ -122,6 +124,7 @@ afs_uint32 ParseTaggedData(XFILE *X, tagged_field *fields, unsigned char *tag,
 
     for (i = 0; fields[i].tag && fields[i].tag != *tag; i++);
     if (!fields[i].tag) return 0;
+    if (pi->stats) pi->stats->tags[(fields[i].kind & DKIND_MASK) >> 4]++;
 
     switch (fields[i].kind & DKIND_MASK) {
     case DKIND_NOOP:
@@ -40,6 +40,8 @@
 #include <afs/acl.h>
 #include <afs/prs_fs.h>
 
+#define HASH_BUFSIZE (256 * 1024)   /* Chunk size for hashing vnode data */
+
 static afs_uint32 LastGoodVNode = 0;
 static afs_uint32 store_vnode(XFILE *, unsigned char *, tagged_field *, afs_uint32,
                            tag_parse_info *, void *, void *);
@@ -49,6 +51,7 @@ static afs_uint32 parse_vdata(XFILE *, unsigned char *, tagged_field *, afs_uint
                            tag_parse_info *, void *, void *);
 static afs_uint32 parse_vdata_large(XFILE *, unsigned char *, tagged_field *, afs_uint32,
                            tag_parse_info *, void *, void *);
+static afs_uint32 write_manifest(XFILE *, afs_vnode *);
 
 /** Field list for vnodes **/
 static tagged_field vnode_fields[] = {
@@ -75,6 +78,7 @@ static afs_uint32 resync_vnode(XFILE *X, dump_parser *p, afs_vnode *v,
   afs_uint32 r;
   int i;
 
+  if (p->stats) p->stats->resyncs++;
   if (r = xftell(X, &expected_where)) return r;
   cp64(where, expected_where);
 
@@ -127,6 +131,8 @@ afs_uint32 parse_vnode(XFILE *X, unsigned char *tag, tagged_field *field,
   sub64_32(v.offset, where, 1);
   if (r = ReadInt32(X, &v.vnode)) return r;
   if (r = ReadInt32(X, &v.vuniq)) return r;
+  xftrace_begin(p->trace, "parse", "vnode");
+  xftrace_arg32(p->trace, "vnode", v.vnode);
 
   mk64(offset2k, 0, 2048);
   if (!LastGoodVNode
@@ -189,11 +195,24 @@ afs_uint32 parse_vnode(XFILE *X, unsigned char *tag, tagged_field *field,
       }
     else               cb = p->cb_vnode_empty;
 
-    if (cb) {
+    if (p->stats) {
+      if (!(v.field_mask & F_VNODE_TYPE)) p->stats->n_empty++;
+      else if (v.type == vFile)           p->stats->n_files++;
+      else if (v.type == vDirectory)      p->stats->n_dirs++;
+      else if (v.type == vSymlink)        p->stats->n_links++;
+      else                                p->stats->n_wierd++;
+    }
+
+    if (p->manifest) r = write_manifest(p->manifest, &v);
+
+    if (cb && !r) {
+      struct timespec t0;
       u_int64 where;
 
       r = xftell(X, &where);
+      cb_timer_start(p, &t0, "cb_vnode");
       if (!r) r = (cb)(&v, X, p->refcon);
+      cb_timer_stop(p, &t0);
       if (p->flags & DSFLAG_SEEK) {
         if (!r) r = xfseek(X, &where);
         else xfseek(X, &where);
@@ -204,7 +223,9 @@ afs_uint32 parse_vnode(XFILE *X, unsigned char *tag, tagged_field *field,
 out:
   if (v.field_mask & F_VNODE_LINK_TARGET)
     free(v.link_target);
+  xftrace_end(p->trace);
 
+  if (!r) r = progress_vnode(X, p);
   return r;
 }
 
@@ -375,10 +396,72 @@ static afs_uint32 parse_acl(XFILE *X, unsigned char *tag, tagged_field *field,
 }
 
 
+/* Hash len bytes of vnode data which are already in memory */
+static void hash_vbuf(afs_vnode *v, void *data, afs_uint32 len)
+{
+  sha256_ctx ctx;
+
+  Sha256_Init(&ctx);
+  Sha256_Update(&ctx, data, len);
+  Sha256_Final(&ctx, v->hash);
+  v->field_mask |= F_VNODE_HASH;
+}
+
+
+/* Read vnode data through the hash, in large chunks.
+ * On return, X is positioned at the end of the data.
+ */
+static afs_uint32 hash_vdata(XFILE *X, afs_vnode *v)
+{
+  unsigned char *buf;
+  sha256_ctx ctx;
+  u_int64 left, chunk, tmp64;
+  afs_uint32 n, size, r = 0;
+
+  /* The buffer is per call, so parsers in different threads don't
+   * share it; small files get a small one.
+   */
+  mk64(chunk, 0, HASH_BUFSIZE);
+  size = gt64(v->size, chunk) ? HASH_BUFSIZE : lo64(v->size);
+  if (!(buf = (unsigned char *)malloc(size ? size : 1))) return ENOMEM;
+
+  Sha256_Init(&ctx);
+  cp64(left, v->size);
+  while (!zero64(left)) {
+    n = gt64(left, chunk) ? HASH_BUFSIZE : lo64(left);
+    if (r = xfread(X, buf, n)) break;
+    Sha256_Update(&ctx, buf, n);
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  free(buf);
+  if (r) return r;
+  Sha256_Final(&ctx, v->hash);
+  v->field_mask |= F_VNODE_HASH;
+  return 0;
+}
+
+
+/* Write a vnode's line in the manifest: the vnode, uniquifier, data
+ * version, size, and SHA-256 hash of the data ("-" if not hashed).
+ */
+static afs_uint32 write_manifest(XFILE *M, afs_vnode *v)
+{
+  char size[21], hash[2 * SHA256_LEN + 1];
+  int i;
+
+  if (v->field_mask & F_VNODE_HASH)
+    for (i = 0; i < SHA256_LEN; i++) sprintf(hash + 2 * i, "%02x", v->hash[i]);
+  else strcpy(hash, "-");
+  return xfprintf(M, "%d %d %d %s %s\n", v->vnode, v->vuniq,
+                  v->datavers, decimate_int64(&v->size, size), hash);
+}
+
+
 /* Parse or skip over the vnode data */
-static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
-                           afs_uint32 value, tag_parse_info *pi,
-                           void *g_refcon, void *l_refcon)
+static afs_uint32 read_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
+                          afs_uint32 value, tag_parse_info *pi,
+                          void *g_refcon, void *l_refcon)
 {
   dump_parser *p = (dump_parser *)g_refcon;
   afs_uint32 (*cb)(afs_vnode *, XFILE *, void *);
@@ -404,7 +487,19 @@ static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
       printf("bytes at %s (0x%s)\n",
              decimate_int64(&v->d_offset, 0), hexify_int64(&v->d_offset, 0));
     }
-    
+
+    /* If something below wants the data, hash it first and come back.
+     * Otherwise, it is hashed instead of being skipped, at the end.
+     */
+    if ((p->flags & DSFLAG_HASH) && (p->flags & DSFLAG_SEEK)
+    &&  ((v->type == vFile && p->cb_file_data)
+         || (v->type == vDirectory
+             && (p->cb_dir_data || p->cb_dirent
+                 || (p->print_flags & DSPRINT_DIR))))) {
+      if (r = hash_vdata(X, v)) return r;
+      if (r = xfseek(X, &v->d_offset)) return r;
+    }
+
     switch (v->type) {
       case vSymlink:
         v->link_target = (char *)malloc(get64(v->size) + 1);
@@ -413,6 +508,8 @@ static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
           v->link_target[get64(v->size)] = 0;
           v->field_mask |= F_VNODE_LINK_TARGET;
           used++;
+          if (p->flags & DSFLAG_HASH)
+            hash_vbuf(v, v->link_target, get64(v->size));
           if (p->print_flags & DSPRINT_VNODE)
             printf("Target:       %s\n", v->link_target);
         } else {
@@ -430,8 +527,10 @@ static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
         }
         break;
     }
-  } else if (p->print_flags & DSPRINT_VNODE) {
-    printf("%sEmpty\n", field->label);
+  } else {
+    if (p->flags & DSFLAG_HASH) hash_vbuf(v, "", 0);
+    if (p->print_flags & DSPRINT_VNODE)
+      printf("%sEmpty\n", field->label);
   }
 
   cb = 0;
@@ -444,14 +543,22 @@ static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
   }
 
   if (cb && (!used || (p->flags & DSFLAG_SEEK))) {
+    struct timespec t0;
+
     if (used && (r = xfseek(X, &v->d_offset))) return r;
+    cb_timer_start(p, &t0, "cb_data");
     r = (cb)(v, X, p->refcon);
+    cb_timer_stop(p, &t0);
     if (r) return r;
     used++;
   }
 
   if (!used) {
-    if ((r = xfskip64(X, &v->size))) return r;
+    if ((p->flags & DSFLAG_HASH) && !(v->field_mask & F_VNODE_HASH)) {
+      if ((r = hash_vdata(X, v))) return r;
+    } else {
+      if ((r = xfskip64(X, &v->size))) return r;
+    }
   }
 
   if (p->repair_flags & DSFIX_VDSYNC) {
@@ -461,6 +568,22 @@ static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
   return ReadByte(X, tag);
 }
 
+/* Same, as one span in the trace */
+static afs_uint32 parse_vdata(XFILE *X, unsigned char *tag, tagged_field *field,
+                           afs_uint32 value, tag_parse_info *pi,
+                           void *g_refcon, void *l_refcon)
+{
+  dump_parser *p = (dump_parser *)g_refcon;
+  afs_vnode *v = (afs_vnode *)l_refcon;
+  afs_uint32 r;
+
+  xftrace_begin(p->trace, "parse", "data");
+  r = read_vdata(X, tag, field, value, pi, g_refcon, l_refcon);
+  xftrace_arg(p->trace, "size", &v->size);
+  xftrace_end(p->trace);
+  return r;
+}
+
 /* Parse or skip over the vnode data for a "large" vnode (a vnode over 4G) */
 static afs_uint32 parse_vdata_large(XFILE *X, unsigned char *tag,
                                  tagged_field *field, afs_uint32 value,
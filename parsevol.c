@@ -31,6 +31,7 @@
 #include "dumpscan.h"
 #include "dumpscan_errs.h"
 #include "dumpfmt.h"
+#include "internal.h"
 
 static afs_uint32 store_volhdr   (XFILE *, unsigned char *, tagged_field *,
                                afs_uint32, tag_parse_info *, void *, void *);
@@ -82,6 +83,7 @@ afs_uint32 parse_volhdr(XFILE *X, unsigned char *tag, tagged_field *field,
   memset(&hdr, 0, sizeof(hdr));
   if (r = xftell(X, &where)) return r;
   sub64_32(hdr.offset, where, 1);
+  xftrace_begin(p->trace, "parse", "volume header");
   if (p->print_flags & DSPRINT_VOLHDR)
     printf("%s [%s = 0x%s]\n", field->label,
            decimate_int64(&hdr.offset, 0), hexify_int64(&hdr.offset, 0));
@@ -89,8 +91,12 @@ afs_uint32 parse_volhdr(XFILE *X, unsigned char *tag, tagged_field *field,
   r = ParseTaggedData(X, volhdr_fields, tag, pi, g_refcon, (void *)&hdr);
 
   if (!r && p->cb_volhdr) {
+    struct timespec t0;
+
     r = xftell(X, &where);
+    cb_timer_start(p, &t0, "cb_volhdr");
     if (!r) r = (p->cb_volhdr)(&hdr, X, p->refcon);
+    cb_timer_stop(p, &t0);
     if (p->flags & DSFLAG_SEEK) {
       if (!r) r = xfseek(X, &where);
       else xfseek(X, &where);
@@ -104,6 +110,7 @@ afs_uint32 parse_volhdr(XFILE *X, unsigned char *tag, tagged_field *field,
     free(hdr.offline_msg);
   if (hdr.field_mask & F_VOLHDR_MOTD)
     free(hdr.motd_msg);
+  xftrace_end(p->trace);
   return r;
 }
 
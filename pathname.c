@@ -29,6 +29,7 @@
 /* pathname.c - Pathname lookup and traversal */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "dumpscan.h"
@@ -38,6 +39,9 @@
 #define BUCKET_SIZE 32
 #define vnode_hash(phi,vnode) ((vnode) & ((1 << (phi)->hash_size) - 1))
 
+/* Deepest path that will be added to a name filter */
+#define MAX_DEPTH 256
+
 
 static vhash_ent *get_vhash_ent(path_hashinfo *phi, afs_uint32 vnode, int make)
 {
@@ -140,19 +144,122 @@ static afs_uint32 dirent_cb(afs_vnode *v, afs_dir_entry *de,
   vhe = get_vhash_ent(phi, de->vnode, 1);
   if (!vhe) return ENOMEM;
   vhe->parent = v->vnode;
+  if (phi->filters) {
+    if (vhe->name) {
+      /* Another name for a vnode we've seen; keep it separately */
+      vhe = (vhash_ent *)malloc(sizeof(vhash_ent));
+      if (!vhe) return ENOMEM;
+      memset(vhe, 0, sizeof(vhash_ent));
+      vhe->vnode = de->vnode;
+      vhe->parent = v->vnode;
+      vhe->next = phi->links;
+      phi->links = vhe;
+    }
+    if (!(vhe->name = strdup(de->name))) return ENOMEM;
+  }
+  return 0;
+}
+
+
+static afs_uint32 dumphdr_cb(afs_dump_header *hdr, XFILE *X, void *refcon)
+{
+  path_hashinfo *phi = (path_hashinfo *)refcon;
+  name_filters *NF = phi->filters;
+
+  NF->volid     = hdr->volid;
+  NF->from_date = hdr->from_date;
+  NF->to_date   = hdr->to_date;
+  if (hdr->volname && !NF->volname
+  &&  !(NF->volname = (unsigned char *)strdup((char *)hdr->volname)))
+    return ENOMEM;
   return 0;
 }
 
 
+/* Add the full path of the entry for vhe to the path filter.  Entries
+ * whose parents we never saw (and so have no path) are left out.
+ */
+static afs_uint32 add_path(path_hashinfo *phi, vhash_ent *vhe,
+                           char **buf, int *bufsize)
+{
+  char *names[MAX_DEPTH], *x;
+  int depth = 0, len = 0, i;
+  afs_uint32 vnum;
+
+  names[depth++] = vhe->name;
+  len += strlen(vhe->name) + 1;
+  for (vnum = vhe->parent; vnum != 1; vnum = vhe->parent) {
+    vhe = get_vhash_ent(phi, vnum, 0);
+    if (!vhe || !vhe->name || depth == MAX_DEPTH) return 0;
+    names[depth++] = vhe->name;
+    len += strlen(vhe->name) + 1;
+  }
+
+  if (len + 1 > *bufsize) {
+    if (!(x = (char *)realloc(*buf, len + 1))) return ENOMEM;
+    *buf = x;
+    *bufsize = len + 1;
+  }
+  for (x = *buf, i = depth - 1; i >= 0; i--) {
+    *x++ = '/';
+    strcpy(x, names[i]);
+    x += strlen(x);
+  }
+  Filter_Add(&phi->filters->paths, *buf);
+  return 0;
+}
+
+
+/* Add every name and path in the volume to the filters.  The filters
+ * are sized for the names the prescan actually found; in an incremental
+ * dump, that can be far fewer than the volume's file count.
+ */
+static afs_uint32 add_names(path_hashinfo *phi)
+{
+  name_filters *NF = phi->filters;
+  vhash_ent *vhe;
+  char *buf = 0;
+  int i, bufsize = 0;
+  afs_uint32 r = 0, nnames = 0;
+
+  if (phi->hash_table) {
+    for (i = 0; i < (1 << phi->hash_size); i++)
+      for (vhe = phi->hash_table[i]; vhe; vhe = vhe->next)
+        if (vhe->name) nnames++;
+  }
+  for (vhe = phi->links; vhe; vhe = vhe->next) nnames++;
+
+  if (Filter_Init(&NF->paths, nnames) || Filter_Init(&NF->names, nnames))
+    return ENOMEM;
+  if (!phi->hash_table) return 0;
+  for (i = 0; !r && i < (1 << phi->hash_size); i++)
+    for (vhe = phi->hash_table[i]; !r && vhe; vhe = vhe->next)
+      if (vhe->name) {
+        Filter_Add(&NF->names, vhe->name);
+        r = add_path(phi, vhe, &buf, &bufsize);
+      }
+  for (vhe = phi->links; !r && vhe; vhe = vhe->next) {
+    Filter_Add(&NF->names, vhe->name);
+    r = add_path(phi, vhe, &buf, &bufsize);
+  }
+  if (buf) free(buf);
+  return r;
+}
+
+
 /* Prescan the vnodes in a dump file, collecting information that will
  * be useful in generating and following pathnames.  
+ * If phi->filters is set, also build name filters for the dump.
  */
 afs_uint32 Path_PreScan(XFILE *X, path_hashinfo *phi, int full)
 {
   dump_parser my_p, *p = phi->p;
+  name_filters *filters = phi->filters;
+  afs_uint32 r;
 
   memset(phi, 0, sizeof(path_hashinfo));
   phi->p = p;
+  phi->filters = filters;
   memset(&my_p, 0, sizeof(my_p));
   my_p.refcon       = (void *)phi;
   my_p.cb_volhdr    = volhdr_cb;
@@ -163,10 +270,12 @@ afs_uint32 Path_PreScan(XFILE *X, path_hashinfo *phi, int full)
     my_p.cb_vnode_empty = vnode_keep;
     my_p.cb_vnode_wierd = vnode_keep;
   } else {
+    /* Directories come first, so stop at the first file or symlink.
+     * Header-only vnodes are passed over; in an incremental dump, those
+     * include every directory that didn't change.
+     */
     my_p.cb_vnode_file  = vnode_stop;
     my_p.cb_vnode_link  = vnode_stop;
-    my_p.cb_vnode_empty = vnode_stop;
-    my_p.cb_vnode_wierd = vnode_stop;
   }
   my_p.err_refcon   = p->err_refcon;
   my_p.cb_error     = p->cb_error;
@@ -175,7 +284,16 @@ afs_uint32 Path_PreScan(XFILE *X, path_hashinfo *phi, int full)
   my_p.print_flags  = p->print_flags;
   my_p.repair_flags = p->repair_flags;
 
-  return ParseDumpFile(X, &my_p);
+  /* A prescan can take as long as the real thing; report on it too */
+  my_p.cb_progress     = p->cb_progress;
+  my_p.progress_bytes  = p->progress_bytes;
+  my_p.progress_vnodes = p->progress_vnodes;
+  my_p.trace           = p->trace;
+
+  if (filters) my_p.cb_dumphdr = dumphdr_cb;
+  r = ParseDumpFile(X, &my_p);
+  if (!r && filters) r = add_names(phi);
+  return r;
 }
 
 
@@ -190,10 +308,16 @@ void Path_FreeHashTable(path_hashinfo *phi)
     for (i = 0; i < size; i++)
       for (vhe = phi->hash_table[i]; vhe; vhe = next_vhe) {
         next_vhe = vhe->next;
+        if (vhe->name) free(vhe->name);
         free(vhe);
       }
     free(phi->hash_table);
   }
+  for (vhe = phi->links; vhe; vhe = next_vhe) {
+    next_vhe = vhe->next;
+    free(vhe->name);
+    free(vhe);
+  }
 }
 
 
@@ -206,8 +330,6 @@ afs_uint32 Path_Follow(XFILE *X, path_hashinfo *phi,
   afs_uint32 r, vnum = 1;
 
   if (*path == '/') path++;
-  name = strtok(path, "/");
-
   for (name = strtok(path, "/"); name; name = strtok(0, "/")) {
     if (!(vnum & 1)) {
       if (phi->p->cb_error)
@@ -256,8 +378,8 @@ afs_uint32 Path_Follow(XFILE *X, path_hashinfo *phi,
 }
 
 
-afs_uint32 Path_Build(XFILE *X, path_hashinfo *phi, afs_uint32 vnode,
-                   char **his_path, int fast)
+static afs_uint32 build_path(XFILE *X, path_hashinfo *phi, afs_uint32 vnode,
+                          char **his_path, int fast)
 {
   vhash_ent *vhe;
   char *name, *path = 0, fastbuf[12];
@@ -373,3 +495,22 @@ afs_uint32 Path_Build(XFILE *X, path_hashinfo *phi, afs_uint32 vnode,
   *his_path = path;
   return 0;
 }
+
+
+/* Build the pathname of a vnode.  If the parser has a trace, this is a
+ * span in it, and the seeks and reads it does on X are recorded too.
+ */
+afs_uint32 Path_Build(XFILE *X, path_hashinfo *phi, afs_uint32 vnode,
+                   char **his_path, int fast)
+{
+  xftrace *old_trace = X->trace;
+  afs_uint32 r;
+
+  if (!X->trace) X->trace = phi->p->trace;
+  xftrace_begin(phi->p->trace, "path", "Path_Build");
+  xftrace_arg32(phi->p->trace, "vnode", vnode);
+  r = build_path(X, phi, vnode, his_path, fast);
+  xftrace_end(phi->p->trace);
+  X->trace = old_trace;
+  return r;
+}
@@ -0,0 +1,239 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* sha256.c - SHA-256 message digests
+ *
+ * This is a plain implementation of SHA-256 (FIPS 180-4), used to hash
+ * vnode data as it goes by.  On x86-64 processors with the SHA
+ * extensions, blocks are compressed with the SHA-NI instructions, which
+ * is several times faster; the choice is made once, at run time.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include "dumpscan.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define USE_SHA_NI
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const afs_uint32 K[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+  0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+  0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+  0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+  0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+  0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+#define ROR(x,n)  (((x) >> (n)) | ((x) << (32 - (n))))
+#define S0(x)     (ROR(x, 2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define S1(x)     (ROR(x, 6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define s0(x)     (ROR(x, 7) ^ ROR(x, 18) ^ ((x) >> 3))
+#define s1(x)     (ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+#define CH(x,y,z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+
+/* Compress nblocks 64-byte blocks into the state */
+static void compress_c(afs_uint32 *state, unsigned char *data, afs_uint32 nblocks)
+{
+  afs_uint32 W[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  while (nblocks--) {
+    for (i = 0; i < 16; i++, data += 4)
+      W[i] = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    for (; i < 64; i++)
+      W[i] = s1(W[i - 2]) + W[i - 7] + s0(W[i - 15]) + W[i - 16];
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    for (i = 0; i < 64; i++) {
+      t1 = h + S1(e) + CH(e, f, g) + K[i] + W[i];
+      t2 = S0(a) + MAJ(a, b, c);
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+
+#ifdef USE_SHA_NI
+/* The same, using the SHA extensions.  The state is kept in two
+ * registers, as ABEF and CDGH; each sha256rnds2 does two rounds, and
+ * the message schedule is computed four words at a time.
+ */
+__attribute__((target("sha,sse4.1")))
+static void compress_ni(afs_uint32 *state, unsigned char *data, afs_uint32 nblocks)
+{
+  const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                       0x0405060700010203ULL);
+  __m128i st0, st1, save0, save1, msg, tmp, W[4];
+  int i;
+
+  tmp = _mm_loadu_si128((__m128i *)&state[0]);            /* DCBA */
+  st1 = _mm_loadu_si128((__m128i *)&state[4]);            /* HGFE */
+  tmp = _mm_shuffle_epi32(tmp, 0xb1);                     /* CDAB */
+  st1 = _mm_shuffle_epi32(st1, 0x1b);                     /* EFGH */
+  st0 = _mm_alignr_epi8(tmp, st1, 8);                     /* ABEF */
+  st1 = _mm_blend_epi16(st1, tmp, 0xf0);                  /* CDGH */
+
+  while (nblocks--) {
+    save0 = st0;
+    save1 = st1;
+    for (i = 0; i < 16; i++) {
+      if (i < 4) {
+        msg = _mm_loadu_si128((__m128i *)(data + 16 * i));
+        W[i] = _mm_shuffle_epi8(msg, bswap);
+      } else {
+        tmp = _mm_alignr_epi8(W[(i - 1) & 3], W[(i - 2) & 3], 4);
+        msg = _mm_sha256msg1_epu32(W[i & 3], W[(i - 3) & 3]);
+        msg = _mm_add_epi32(msg, tmp);
+        W[i & 3] = _mm_sha256msg2_epu32(msg, W[(i - 1) & 3]);
+      }
+      msg = _mm_add_epi32(W[i & 3], _mm_loadu_si128((__m128i *)&K[4 * i]));
+      st1 = _mm_sha256rnds2_epu32(st1, st0, msg);
+      msg = _mm_shuffle_epi32(msg, 0x0e);
+      st0 = _mm_sha256rnds2_epu32(st0, st1, msg);
+    }
+    st0 = _mm_add_epi32(st0, save0);
+    st1 = _mm_add_epi32(st1, save1);
+    data += 64;
+  }
+
+  tmp = _mm_shuffle_epi32(st0, 0x1b);                     /* FEBA */
+  st1 = _mm_shuffle_epi32(st1, 0xb1);                     /* DCHG */
+  st0 = _mm_blend_epi16(tmp, st1, 0xf0);                  /* DCBA */
+  st1 = _mm_alignr_epi8(st1, tmp, 8);                     /* HGFE */
+  _mm_storeu_si128((__m128i *)&state[0], st0);
+  _mm_storeu_si128((__m128i *)&state[4], st1);
+}
+
+
+/* Pick compress_ni if the processor has SHA, SSSE3 and SSE4.1 */
+static void compress_init(afs_uint32 *, unsigned char *, afs_uint32);
+static void (*compress)(afs_uint32 *, unsigned char *, afs_uint32) = compress_init;
+
+static void compress_init(afs_uint32 *state, unsigned char *data, afs_uint32 nblocks)
+{
+  unsigned int a, b, c, d;
+
+  compress = compress_c;
+  if (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSSE3) && (c & bit_SSE4_1)
+  &&  __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & bit_SHA))
+    compress = compress_ni;
+  compress(state, data, nblocks);
+}
+#else
+#define compress compress_c
+#endif
+
+
+void Sha256_Init(sha256_ctx *ctx)
+{
+  static const afs_uint32 H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+  memcpy(ctx->state, H0, sizeof(H0));
+  mk64(ctx->count, 0, 0);
+  ctx->buflen = 0;
+}
+
+
+void Sha256_Update(sha256_ctx *ctx, void *data, afs_uint32 len)
+{
+  unsigned char *p = data;
+  u_int64 tmp64;
+  afs_uint32 n;
+
+  add64_32(tmp64, ctx->count, len);
+  cp64(ctx->count, tmp64);
+  if (ctx->buflen) {
+    n = 64 - ctx->buflen;
+    if (n > len) n = len;
+    memcpy(ctx->buf + ctx->buflen, p, n);
+    ctx->buflen += n;
+    p += n;
+    len -= n;
+    if (ctx->buflen < 64) return;
+    compress(ctx->state, ctx->buf, 1);
+    ctx->buflen = 0;
+  }
+  if (len >= 64) {
+    compress(ctx->state, p, len / 64);
+    p += len & ~63;
+    len &= 63;
+  }
+  memcpy(ctx->buf, p, len);
+  ctx->buflen = len;
+}
+
+
+/* Finish up, and store the SHA256_LEN-byte digest in hash */
+void Sha256_Final(sha256_ctx *ctx, unsigned char *hash)
+{
+  afs_uint32 hi, lo;
+  int i;
+
+  hi = (hi64(ctx->count) << 3) | (lo64(ctx->count) >> 29);
+  lo = lo64(ctx->count) << 3;
+  ctx->buf[ctx->buflen++] = 0x80;
+  if (ctx->buflen > 56) {
+    memset(ctx->buf + ctx->buflen, 0, 64 - ctx->buflen);
+    compress(ctx->state, ctx->buf, 1);
+    ctx->buflen = 0;
+  }
+  memset(ctx->buf + ctx->buflen, 0, 56 - ctx->buflen);
+  for (i = 0; i < 4; i++) {
+    ctx->buf[56 + i] = hi >> (24 - 8 * i);
+    ctx->buf[60 + i] = lo >> (24 - 8 * i);
+  }
+  compress(ctx->state, ctx->buf, 1);
+  for (i = 0; i < 8; i++) {
+    hash[4 * i]     = ctx->state[i] >> 24;
+    hash[4 * i + 1] = ctx->state[i] >> 16;
+    hash[4 * i + 2] = ctx->state[i] >> 8;
+    hash[4 * i + 3] = ctx->state[i];
+  }
+}
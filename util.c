@@ -29,6 +29,7 @@
 /* util.c - Useful utilities */
 
 #include <errno.h>
+#include <string.h>
 
 #include "xf_errs.h"
 #include "dumpscan.h"
@@ -102,6 +103,159 @@ void prep_pi(dump_parser *p, tag_parse_info *pi)
     pi->flags |= TPFLAG_SKIP;
   if ((p->flags & DSFLAG_SEEK) && (p->repair_flags & DSFIX_RSKIP))
     pi->flags |= TPFLAG_RSKIP;
+  pi->stats = p->stats;
+}
+
+
+/* Progress reports.  progress_start is called when parsing begins,
+ * progress_vnode after each vnode, and progress_report at the end.
+ * They all do nothing unless there is a progress callback.
+ */
+static double float64(u_int64 *x)
+{
+  return hi64(*x) * 4294967296.0 + lo64(*x);
+}
+
+static void progress_schedule(dump_parser *p)
+{
+  u_int64 tmp64;
+
+  if (p->progress_bytes) add64_32(tmp64, p->progress.offset, p->progress_bytes);
+  else mk64(tmp64, 0xffffffff, 0xffffffff);
+  cp64(p->progress_next, tmp64);
+  p->progress_nextv = p->progress_vnodes
+                    ? p->progress.vnodes + p->progress_vnodes : 0xffffffff;
+}
+
+void progress_start(XFILE *X, dump_parser *p)
+{
+  if (!p->cb_progress) return;
+  memset(&p->progress, 0, sizeof(p->progress));
+  cp64(p->progress.offset, X->filepos);
+  cp64(p->progress_first, X->filepos);
+  if (X->do_size && xfsize(X, &p->progress.total))
+    mk64(p->progress.total, 0, 0);
+  p->progress.eta = -1;
+  clock_gettime(CLOCK_MONOTONIC, &p->progress_start);
+  p->progress_last = p->progress_start;
+  progress_schedule(p);
+}
+
+/* A backup system header may tell us how big the dump is */
+void progress_total(XFILE *X, dump_parser *p, u_int64 *dumplen)
+{
+  u_int64 tmp64;
+
+  if (!p->cb_progress || !zero64(p->progress.total) || zero64(*dumplen))
+    return;
+  add64_64(tmp64, X->filepos, *dumplen);
+  cp64(p->progress.total, tmp64);
+}
+
+afs_uint32 progress_report(XFILE *X, dump_parser *p, int done)
+{
+  dump_progress *P = &p->progress;
+  struct timespec now;
+  double dt, moved;
+
+  if (!p->cb_progress) return 0;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  moved = float64(&X->filepos) - float64(&P->offset);
+  dt = (now.tv_sec - p->progress_last.tv_sec)
+     + (now.tv_nsec - p->progress_last.tv_nsec) / 1e9;
+  P->rate = (dt > 0) ? moved / dt : 0;
+  P->elapsed = (now.tv_sec - p->progress_start.tv_sec)
+             + (now.tv_nsec - p->progress_start.tv_nsec) / 1e9;
+  cp64(P->offset, X->filepos);
+  moved = float64(&P->offset) - float64(&p->progress_first);
+  P->avg_rate = (P->elapsed > 0) ? moved / P->elapsed : 0;
+  if (done) P->eta = 0;
+  else if (zero64(P->total) || P->avg_rate <= 0) P->eta = -1;
+  else if (le64(P->total, P->offset)) P->eta = 0;
+  else P->eta = (float64(&P->total) - float64(&P->offset)) / P->avg_rate;
+  P->done = done;
+  p->progress_last = now;
+  progress_schedule(p);
+  return (p->cb_progress)(P, p->refcon);
+}
+
+afs_uint32 progress_vnode(XFILE *X, dump_parser *p)
+{
+  if (!p->cb_progress) return 0;
+  if (++p->progress.vnodes < p->progress_nextv
+  &&  lt64(X->filepos, p->progress_next)) return 0;
+  return progress_report(X, p, 0);
+}
+
+
+/* Make room for a vnode in an array indexed by vnode number, where
+ * *array has *count elements of size bytes.  The array grows by
+ * doubling, and new elements are zeroed.  Vnode numbers come from the
+ * dump, so those beyond DS_MAXVNODE are rejected as bogus rather than
+ * trusted with an enormous allocation.
+ */
+afs_uint32 GrowVnodeArray(void **array, afs_uint32 *count, size_t size,
+                          afs_uint32 vnode)
+{
+  afs_uint32 n;
+  void *A;
+
+  if (vnode < *count) return 0;
+  if (vnode >= DS_MAXVNODE) return DSERR_BOGUS;
+  for (n = *count ? *count : 1024; n <= vnode && n < DS_MAXVNODE; n *= 2);
+  if (n > DS_MAXVNODE) n = DS_MAXVNODE;
+  if (!(A = realloc(*array, (size_t)n * size))) return ENOMEM;
+  memset((char *)A + (size_t)*count * size, 0, (size_t)(n - *count) * size);
+  *array = A;
+  *count = n;
+  return 0;
+}
+
+
+/* Print a progress report on stderr, as a cb_progress would */
+void PrintProgress(char *who, dump_progress *P)
+{
+  double mb = float64(&P->offset) / 1048576;
+  double total = float64(&P->total) / 1048576;
+  afs_uint32 eta;
+
+  if (P->done) {
+    fprintf(stderr, "%s: done: %.0f MB, %d vnodes in %.1fs (%.1f MB/s)\n",
+            who, mb, P->vnodes, P->elapsed, P->avg_rate / 1048576);
+    return;
+  }
+  fprintf(stderr, "%s: %.0f MB", who, mb);
+  if (total > 0) fprintf(stderr, " of %.0f (%.1f%%)", total, 100 * mb / total);
+  fprintf(stderr, ", %d vnodes, %.1f MB/s (avg %.1f)", P->vnodes,
+          P->rate / 1048576, P->avg_rate / 1048576);
+  if (P->eta >= 0) {
+    eta = (P->eta < 4294967295.0) ? P->eta : 0xffffffff;
+    fprintf(stderr, ", %d:%02d:%02d left", eta / 3600, eta / 60 % 60, eta % 60);
+  }
+  fprintf(stderr, "\n");
+}
+
+
+/* Time spent in callbacks is charged to the callbacks, not the library.
+ * Both of these do nothing unless the parser is keeping statistics or
+ * a trace; in the trace, the callback shows up as a span called name.
+ */
+void cb_timer_start(dump_parser *p, struct timespec *t0, char *name)
+{
+  xftrace_begin(p->trace, "callback", name);
+  if (p->stats) clock_gettime(CLOCK_MONOTONIC, t0);
+}
+
+void cb_timer_stop(dump_parser *p, struct timespec *t0)
+{
+  struct timespec t1;
+
+  xftrace_end(p->trace);
+  if (!p->stats) return;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  p->stats->n_callbacks++;
+  p->stats->cb_time += (t1.tv_sec - t0->tv_sec)
+                     + (t1.tv_nsec - t0->tv_nsec) / 1e9;
 }
 
 
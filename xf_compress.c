@@ -0,0 +1,571 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xf_compress.c - XFILE routines for compressed streams
+ *
+ * A GZ or ZSTD XFILE wraps some other XFILE containing gzip (or zlib)
+ * or zstd compressed data, and reads the uncompressed stream.  Multiple
+ * concatenated gzip members or zstd frames are read as one stream.
+ * Positions (filepos, tell, seek, skip) are all in uncompressed bytes.
+ * A seekable zstd file (one ending in a seek table) opened as ZSTD is
+ * handed to the routines in xf_zstdseek.c instead, as is a ZSTD XFILE
+ * opened for writing, so compressed output is always seekable.  The
+ * name syntax is ZSTD:[level[,threads]::]name, where level is the
+ * compression level used when writing, and threads is the number of
+ * threads used to compress or decompress frames.  Writing gzip is not
+ * supported.
+ *
+ * Data is decompressed a block at a time.  If the underlying XFILE is
+ * seekable, the compressed XFILE is seekable too: recently decompressed
+ * blocks are kept in a cache, and there are two decompression cursors.
+ * A seek back to data no longer in the cache leaves the cursor that is
+ * furthest along where it is, and starts the other one over from the
+ * beginning.  So a trip back to some directory followed by a return to
+ * the current vnode costs at most the distance to the directory, which
+ * in a volume dump is near the beginning, and repeated trips to the
+ * same directories are served from the cache.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#include "xfiles.h"
+#include "xf_errs.h"
+
+#define O_MODE_MASK (O_RDONLY | O_WRONLY | O_RDWR)
+
+extern afs_uint32 xf_ZSEEK_do_open(XFILE *, int, XFILE *, int, int, int);
+extern int xfon_options(char **, afs_uint32 *, afs_uint32 *);
+
+#define ZF_INSIZE   (128 * 1024)       /* compressed input buffer */
+#define ZF_BLKSIZE  65536              /* uncompressed block */
+#define ZF_NCACHE   256                /* cached blocks, if seekable */
+
+/* Cache slot for the block at offset X; assumes ZF_BLKSIZE is 65536
+ * and ZF_NCACHE is a power of 2
+ */
+#define zf_slot(ZF, X) (((hi64(X) << 16) + (lo64(X) >> 16)) % (ZF)->ncache)
+
+/* A block of uncompressed data */
+struct zblock {
+  u_int64 off;                 /* offset in the uncompressed stream */
+  afs_uint32 len;              /* bytes of valid data */
+  char *data;                  /* ZF_BLKSIZE bytes, or null */
+};
+
+/* A decompression cursor */
+struct zcursor {
+  void *stream;                /* codec state; null if unused */
+  char *inbuf;                 /* compressed data */
+  afs_uint32 inpos, inlen;
+  int eof;                     /* no more compressed data */
+  int ended;                   /* between gzip members/zstd frames */
+  int done;                    /* reached the end of the stream */
+  u_int64 cpos;                /* content position just past inbuf */
+  struct zblock blk;           /* block being decompressed into */
+};
+
+/* Operations for a particular compression format */
+struct zcodec {
+  afs_uint32 (*init)(struct zcursor *);
+  afs_uint32 (*reset)(struct zcursor *);
+  afs_uint32 (*run)(struct zcursor *, void *, afs_uint32, afs_uint32 *);
+  void (*end)(struct zcursor *);
+};
+
+typedef struct {
+  XFILE *content;
+  int free_content;
+  struct zcodec *codec;
+  u_int64 start;               /* where the compressed data begins */
+  u_int64 pos;                 /* current uncompressed position */
+  struct zcursor cur[2];
+  int ncur;                    /* cursors in use: 1, or 2 if seekable */
+  struct zcursor *reader;      /* cursor the content is positioned for */
+  struct zblock *cache;        /* direct-mapped block cache */
+  int ncache;
+} ZFILE;
+
+
+/** gzip/zlib, via zlib **/
+
+static afs_uint32 gz_init(struct zcursor *C)
+{
+  z_stream *zs;
+
+  if (!(zs = malloc(sizeof(*zs)))) return ENOMEM;
+  memset(zs, 0, sizeof(*zs));
+  /* 15 + 32: maximum window, and detect gzip or zlib headers */
+  if (inflateInit2(zs, 15 + 32) != Z_OK) {
+    free(zs);
+    return ENOMEM;
+  }
+  C->stream = zs;
+  return 0;
+}
+
+static afs_uint32 gz_reset(struct zcursor *C)
+{
+  return (inflateReset(C->stream) == Z_OK) ? 0 : ERROR_XFILE_BADDATA;
+}
+
+static afs_uint32 gz_run(struct zcursor *C, void *buf, afs_uint32 count,
+                         afs_uint32 *nout)
+{
+  z_stream *zs = C->stream;
+  int r;
+
+  *nout = 0;
+  if (C->ended) {
+    /* Start the next member, if there is one */
+    if (C->inpos == C->inlen) return 0;
+    if (inflateReset(zs) != Z_OK) return ERROR_XFILE_BADDATA;
+    C->ended = 0;
+  }
+
+  zs->next_in = (Bytef *)C->inbuf + C->inpos;
+  zs->avail_in = C->inlen - C->inpos;
+  zs->next_out = buf;
+  zs->avail_out = count;
+  r = inflate(zs, Z_NO_FLUSH);
+  C->inpos = C->inlen - zs->avail_in;
+  *nout = count - zs->avail_out;
+
+  switch (r) {
+    case Z_STREAM_END: C->ended = 1; return 0;
+    case Z_OK:
+    case Z_BUF_ERROR:  return 0;
+    case Z_MEM_ERROR:  return ENOMEM;
+    default:           return ERROR_XFILE_BADDATA;
+  }
+}
+
+static void gz_end(struct zcursor *C)
+{
+  inflateEnd(C->stream);
+  free(C->stream);
+}
+
+static struct zcodec gz_codec = { gz_init, gz_reset, gz_run, gz_end };
+
+
+/** zstd **/
+
+static afs_uint32 zstd_init(struct zcursor *C)
+{
+  if (!(C->stream = ZSTD_createDCtx())) return ENOMEM;
+  return 0;
+}
+
+static afs_uint32 zstd_reset(struct zcursor *C)
+{
+  size_t r = ZSTD_DCtx_reset(C->stream, ZSTD_reset_session_only);
+  return ZSTD_isError(r) ? ERROR_XFILE_BADDATA : 0;
+}
+
+static afs_uint32 zstd_run(struct zcursor *C, void *buf, afs_uint32 count,
+                           afs_uint32 *nout)
+{
+  ZSTD_inBuffer in;
+  ZSTD_outBuffer out;
+  size_t r;
+
+  in.src = C->inbuf + C->inpos;
+  in.size = C->inlen - C->inpos;
+  in.pos = 0;
+  out.dst = buf;
+  out.size = count;
+  out.pos = 0;
+  r = ZSTD_decompressStream(C->stream, &out, &in);
+  C->inpos += in.pos;
+  *nout = out.pos;
+  if (ZSTD_isError(r)) return ERROR_XFILE_BADDATA;
+  /* 0 means a frame is completely decoded and flushed */
+  if (!r) C->ended = 1;
+  else if (in.pos) C->ended = 0;
+  return 0;
+}
+
+static void zstd_end(struct zcursor *C)
+{
+  ZSTD_freeDCtx(C->stream);
+}
+
+static struct zcodec zstd_codec = { zstd_init, zstd_reset, zstd_run, zstd_end };
+
+
+/** Common code **/
+
+/* Set up a cursor at the start of the compressed data */
+static afs_uint32 zf_start(ZFILE *ZF, struct zcursor *C)
+{
+  afs_uint32 code;
+
+  if (!C->inbuf && !(C->inbuf = malloc(ZF_INSIZE))) return ENOMEM;
+  if (!C->blk.data && !(C->blk.data = malloc(ZF_BLKSIZE))) return ENOMEM;
+  if (C->stream) code = (ZF->codec->reset)(C);
+  else code = (ZF->codec->init)(C);
+  if (code) return code;
+
+  C->inpos = C->inlen = 0;
+  C->eof = C->done = 0;
+  C->ended = 1;
+  cp64(C->cpos, ZF->start);
+  mk64(C->blk.off, 0, 0);
+  C->blk.len = 0;
+  if (ZF->reader == C) ZF->reader = 0;
+  return 0;
+}
+
+
+/* Find the block containing pos, if we have it */
+static struct zblock *zf_find(ZFILE *ZF, u_int64 *pos)
+{
+  struct zblock *B;
+  u_int64 end;
+  int i;
+
+  for (i = 0; i < ZF->ncur; i++) {
+    B = &ZF->cur[i].blk;
+    add64_32(end, B->off, B->len);
+    if (ZF->cur[i].stream && le64(B->off, *pos) && lt64(*pos, end)) return B;
+  }
+  if (ZF->ncache) {
+    B = &ZF->cache[zf_slot(ZF, *pos)];
+    add64_32(end, B->off, B->len);
+    if (B->data && le64(B->off, *pos) && lt64(*pos, end)) return B;
+  }
+  return 0;
+}
+
+
+/* Decompress more data with cursor C.  A full block is first moved into
+ * the cache, if there is one, or else simply reused.
+ */
+static afs_uint32 zf_advance(ZFILE *ZF, struct zcursor *C)
+{
+  struct zblock *B, tmp;
+  afs_uint32 code, n, inpos;
+  u_int64 tmp64;
+
+  if (C->blk.len == ZF_BLKSIZE) {
+    add64_32(tmp64, C->blk.off, ZF_BLKSIZE);
+    if (ZF->ncache) {
+      B = &ZF->cache[zf_slot(ZF, C->blk.off)];
+      tmp = *B;
+      *B = C->blk;
+      C->blk = tmp;
+      if (!C->blk.data && !(C->blk.data = malloc(ZF_BLKSIZE))) {
+        C->blk = *B;
+        B->data = 0;
+        return ENOMEM;
+      }
+    }
+    cp64(C->blk.off, tmp64);
+    C->blk.len = 0;
+  }
+
+  for (;;) {
+    inpos = C->inpos;
+    code = (ZF->codec->run)(C, C->blk.data + C->blk.len,
+                            ZF_BLKSIZE - C->blk.len, &n);
+    if (code) return code;
+    if (n) {
+      C->blk.len += n;
+      return 0;
+    }
+    if (C->inpos < C->inlen) {
+      /* Input was available; if none was used, we are stuck */
+      if (C->inpos == inpos) return ERROR_XFILE_BADDATA;
+      continue;
+    }
+
+    /* Need more compressed data */
+    if (C->eof) {
+      if (!C->ended) return ERROR_XFILE_BADDATA;
+      C->done = 1;
+      return 0;
+    }
+    if (ZF->reader != C) {
+      if (ZF->ncur > 1 && (code = xfseek(ZF->content, &C->cpos))) return code;
+      ZF->reader = C;
+    }
+    C->inpos = C->inlen = 0;
+    code = xfreadsome(ZF->content, C->inbuf, ZF_INSIZE, &C->inlen);
+    if (code == (afs_uint32)ERROR_XFILE_EOF) C->eof = 1;
+    else if (code) return code;
+    add64_32(tmp64, C->cpos, C->inlen);
+    cp64(C->cpos, tmp64);
+  }
+}
+
+
+/* Read up to count bytes at the current position, returning as soon as
+ * there are any.  EOF is returned only at a clean end of the compressed
+ * stream; if the compressed data ends in the middle of a gzip member or
+ * zstd frame, that is reported as ERROR_XFILE_BADDATA.
+ */
+static afs_uint32 zf_read(ZFILE *ZF, void *buf, afs_uint32 count,
+                          afs_uint32 *nread)
+{
+  struct zcursor *C;
+  struct zblock *B;
+  afs_uint32 code, n, off;
+  u_int64 upos, cupos, tmp64;
+  int i;
+
+  *nread = 0;
+  if (!count) return 0;
+  mk64(cupos, 0, 0);
+
+  while (!(B = zf_find(ZF, &ZF->pos))) {
+    /* Use the cursor furthest along without being past pos */
+    C = 0;
+    for (i = 0; i < ZF->ncur; i++) {
+      if (!ZF->cur[i].stream) continue;
+      add64_32(upos, ZF->cur[i].blk.off, ZF->cur[i].blk.len);
+      if (gt64(upos, ZF->pos)) continue;
+      if (!C || gt64(upos, cupos)) {
+        C = &ZF->cur[i];
+        cp64(cupos, upos);
+      }
+    }
+
+    if (!C) {
+      /* Start over, keeping the cursor that is furthest along */
+      C = &ZF->cur[0];
+      if (ZF->cur[1].stream) {
+        add64_32(upos, ZF->cur[0].blk.off, ZF->cur[0].blk.len);
+        add64_32(tmp64, ZF->cur[1].blk.off, ZF->cur[1].blk.len);
+        if (lt64(tmp64, upos)) C = &ZF->cur[1];
+      } else if (ZF->ncur > 1) C = &ZF->cur[1];
+      if (code = zf_start(ZF, C)) return code;
+    } else if (C->done) {
+      return ERROR_XFILE_EOF;
+    }
+
+    if (code = zf_advance(ZF, C)) return code;
+  }
+
+  off = get64(ZF->pos) - get64(B->off);
+  n = B->len - off;
+  if (n > count) n = count;
+  memcpy(buf, B->data + off, n);
+  add64_32(tmp64, ZF->pos, n);
+  cp64(ZF->pos, tmp64);
+  *nread = n;
+  return 0;
+}
+
+
+/* do_readsome for compressed xfiles */
+static afs_uint32 xf_Z_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                   afs_uint32 *nread)
+{
+  return zf_read(X->refcon, buf, count, nread);
+}
+
+
+/* do_read for compressed xfiles */
+static afs_uint32 xf_Z_do_read(XFILE *X, void *buf, afs_uint32 count)
+{
+  afs_uint32 n, code;
+  char *p = buf;
+
+  while (count) {
+    if (code = zf_read(X->refcon, p, count, &n)) return code;
+    p += n;
+    count -= n;
+  }
+  return 0;
+}
+
+
+/* do_skip for compressed xfiles.  Data is decompressed when the next
+ * read needs it, so a skip past the end is only noticed then.
+ */
+static afs_uint32 xf_Z_do_skip(XFILE *X, u_int64 *count)
+{
+  ZFILE *ZF = X->refcon;
+  u_int64 tmp64;
+
+  add64_64(tmp64, ZF->pos, *count);
+  cp64(ZF->pos, tmp64);
+  return 0;
+}
+
+
+/* do_seek for compressed xfiles */
+static afs_uint32 xf_Z_do_seek(XFILE *X, u_int64 *offset)
+{
+  ZFILE *ZF = X->refcon;
+
+  cp64(ZF->pos, *offset);
+  return 0;
+}
+
+
+/* do_close for compressed xfiles */
+static afs_uint32 xf_Z_do_close(XFILE *X)
+{
+  ZFILE *ZF = X->refcon;
+  afs_uint32 err;
+  int i;
+
+  err = xfclose(ZF->content);
+  if (ZF->free_content) free(ZF->content);
+  for (i = 0; i < 2; i++) {
+    if (ZF->cur[i].stream) (ZF->codec->end)(&ZF->cur[i]);
+    if (ZF->cur[i].inbuf) free(ZF->cur[i].inbuf);
+    if (ZF->cur[i].blk.data) free(ZF->cur[i].blk.data);
+  }
+  for (i = 0; i < ZF->ncache; i++)
+    if (ZF->cache[i].data) free(ZF->cache[i].data);
+  if (ZF->cache) free(ZF->cache);
+  free(ZF);
+  return err;
+}
+
+
+/* Open a compressed XFILE */
+static afs_uint32 xf_Z_do_open(XFILE *X, int flag, XFILE *content,
+                               int free_content, struct zcodec *codec,
+                               int level, int nthreads)
+{
+  ZFILE *ZF;
+  afs_uint32 code;
+
+  /* zstd output, and zstd files with a seek table, are handled by
+   * xf_zstdseek.c; everything else is read as a stream.  Finding the
+   * seek table needs the size of the content, which only some seekable
+   * XFILEs (not block devices, or wrapped files) know.
+   */
+  if (codec == &zstd_codec && (flag & O_MODE_MASK) != O_RDONLY)
+    return xf_ZSEEK_do_open(X, flag, content, free_content, level, nthreads);
+  if ((flag & O_MODE_MASK) != O_RDONLY) return ERROR_XFILE_RDONLY;
+  if (codec == &zstd_codec && content->is_seekable && content->do_size) {
+    code = xf_ZSEEK_do_open(X, flag, content, free_content, level, nthreads);
+    if (code != (afs_uint32)ERROR_XFILE_NOINDEX) return code;
+  }
+
+  ZF = malloc(sizeof(*ZF));
+  if (!ZF) return ENOMEM;
+  memset(ZF, 0, sizeof(*ZF));
+  ZF->content = content;
+  ZF->free_content = free_content;
+  ZF->codec = codec;
+  ZF->ncur = 1;
+
+  if (content->is_seekable) {
+    if (code = xftell(content, &ZF->start)) goto fail;
+    if (!(ZF->cache = malloc(ZF_NCACHE * sizeof(*ZF->cache)))) {
+      code = ENOMEM;
+      goto fail;
+    }
+    memset(ZF->cache, 0, ZF_NCACHE * sizeof(*ZF->cache));
+    ZF->ncache = ZF_NCACHE;
+    ZF->ncur = 2;
+  }
+  if (code = zf_start(ZF, &ZF->cur[0])) goto fail;
+  ZF->reader = &ZF->cur[0];
+
+  memset(X, 0, sizeof(*X));
+  X->refcon = ZF;
+  X->do_read  = xf_Z_do_read;
+  X->do_readsome = xf_Z_do_readsome;
+  X->do_skip  = xf_Z_do_skip;
+  X->do_close = xf_Z_do_close;
+  if (content->is_seekable) {
+    X->is_seekable = 1;
+    X->do_seek = xf_Z_do_seek;
+  }
+  return 0;
+
+fail:
+  if (ZF->cur[0].stream) (codec->end)(&ZF->cur[0]);
+  if (ZF->cur[0].inbuf) free(ZF->cur[0].inbuf);
+  if (ZF->cur[0].blk.data) free(ZF->cur[0].blk.data);
+  if (ZF->cache) free(ZF->cache);
+  free(ZF);
+  return code;
+}
+
+
+/* Open-by-name helper: open the underlying XFILE, then wrap it */
+static afs_uint32 xf_Z_open_name(XFILE *X, int flag, char *name,
+                                 struct zcodec *codec)
+{
+  XFILE *cX;
+  afs_uint32 err, level = 0, nthreads = -1;
+
+  xfon_options(&name, &level, &nthreads);
+
+  cX = malloc(sizeof(XFILE));
+  if (!cX) return ENOMEM;
+  if (err = xfopen(cX, flag, name)) {
+    free(cX);
+    return err;
+  }
+  if (err = xf_Z_do_open(X, flag, cX, 1, codec, level, nthreads)) {
+    xfclose(cX);
+    free(cX);
+  }
+  return err;
+}
+
+
+/* Wrap an already-open XFILE.  Closing X also closes cX,
+ * but does not free it.
+ */
+afs_uint32 xfopen_gz(XFILE *X, int flag, XFILE *cX)
+{
+  return xf_Z_do_open(X, flag, cX, 0, &gz_codec, 0, -1);
+}
+
+afs_uint32 xfopen_zstd(XFILE *X, int flag, XFILE *cX)
+{
+  return xf_Z_do_open(X, flag, cX, 0, &zstd_codec, 0, -1);
+}
+
+
+/* open-by-name support: GZ:name and ZSTD:[level[,threads]::]name */
+afs_uint32 xfon_gz(XFILE *X, int flag, char *name)
+{
+  return xf_Z_open_name(X, flag, name, &gz_codec);
+}
+
+afs_uint32 xfon_zstd(XFILE *X, int flag, char *name)
+{
+  return xf_Z_open_name(X, flag, name, &zstd_codec);
+}
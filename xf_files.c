@@ -28,22 +28,50 @@
 
 /* xf_files.c - XFILE routines for accessing UNIX files */
 
+#ifdef __linux__
+#define _GNU_SOURCE             /* for splice() */
+#endif
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 #include "xfiles.h"
 #include "xf_errs.h"
 
 #define O_MODE_MASK (O_RDONLY | O_WRONLY | O_RDWR)
 
+/* On Linux, data skipped on a pipe can be moved with splice() instead
+ * of being read into userspace.  For that, we have to know how much
+ * has already been read from the pipe and not yet used, which stdio
+ * doesn't tell.  So a pipe opened for reading is read with read(),
+ * into a buffer of our own, and stdio is used only to close it.  The
+ * FILE must not have been read from before it is made into an XFILE.
+ */
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+#define USE_SPLICE
+#define SPLICE_MAX (1024 * 1024)
+#define PIPE_BUFSIZE 65536
+#endif
+
+/* Private state of a stdio XFILE */
+typedef struct {
+  FILE *F;
+  int fd;                      /* fileno(F), for pipes read directly */
+  int devnull;                 /* Where spliced data is dropped, or -1 */
+  char *rbuf;                  /* Data read from a pipe but not yet used */
+  afs_uint32 rpos, rlen;
+} SFILE;
+
 
 /* do_read for stdio xfiles */
 static afs_uint32 xf_FILE_do_read(XFILE *X, void *buf, afs_uint32 count)
 {
-  FILE *F = X->refcon;
+  FILE *F = ((SFILE *)X->refcon)->F;
 
   /* XXX: handle short and interrupted reads */
   if (fread(buf, count, 1, F) != 1)
@@ -52,10 +80,22 @@ static afs_uint32 xf_FILE_do_read(XFILE *X, void *buf, afs_uint32 count)
 }
 
 
+/* do_readsome for stdio xfiles */
+static afs_uint32 xf_FILE_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                      afs_uint32 *nread)
+{
+  FILE *F = ((SFILE *)X->refcon)->F;
+
+  *nread = fread(buf, 1, count, F);
+  if (*nread) return 0;
+  return ferror(F) ? errno : ERROR_XFILE_EOF;
+}
+
+
 /* do_write for stdio xfiles */
 static afs_uint32 xf_FILE_do_write(XFILE *X, void *buf, afs_uint32 count)
 {
-  FILE *F = X->refcon;
+  FILE *F = ((SFILE *)X->refcon)->F;
 
   /* XXX: handle interrupted writes */
   if (fwrite(buf, count, 1, F) != 1)
@@ -67,7 +107,7 @@ static afs_uint32 xf_FILE_do_write(XFILE *X, void *buf, afs_uint32 count)
 /* do_tell for stdio xfiles */
 static afs_uint32 xf_FILE_do_tell(XFILE *X, u_int64 *offset)
 {
-  FILE *F = X->refcon;
+  FILE *F = ((SFILE *)X->refcon)->F;
   off_t where;
 
   if (!X->is_seekable) {
@@ -85,10 +125,23 @@ static afs_uint32 xf_FILE_do_tell(XFILE *X, u_int64 *offset)
 }
 
 
+/* do_size for stdio xfiles */
+static afs_uint32 xf_FILE_do_size(XFILE *X, u_int64 *size)
+{
+  FILE *F = ((SFILE *)X->refcon)->F;
+  struct stat st;
+
+  if (fflush(F)) return errno;
+  if (fstat(fileno(F), &st)) return errno;
+  set64(*size, st.st_size);
+  return 0;
+}
+
+
 /* do_seek for stdio xfiles */
 static afs_uint32 xf_FILE_do_seek(XFILE *X, u_int64 *offset)
 {
-  FILE *F = X->refcon;
+  FILE *F = ((SFILE *)X->refcon)->F;
   off_t where = get64(*offset);
 
 #ifdef NATIVE_INT64
@@ -105,7 +158,7 @@ static afs_uint32 xf_FILE_do_seek(XFILE *X, u_int64 *offset)
 /* do_skip for stdio xfiles */
 static afs_uint32 xf_FILE_do_skip(XFILE *X, u_int64 *count)
 {
-  FILE *F = X->refcon;
+  FILE *F = ((SFILE *)X->refcon)->F;
   off_t offset = get64(*count);
 
 #ifdef NATIVE_INT64
@@ -119,28 +172,174 @@ static afs_uint32 xf_FILE_do_skip(XFILE *X, u_int64 *count)
 }
 
 
+#ifdef USE_SPLICE
+/* do_read for stdio xfiles on pipes */
+static afs_uint32 xf_PIPE_do_read(XFILE *X, void *buf, afs_uint32 count)
+{
+  SFILE *SF = X->refcon;
+  char *x = buf;
+  afs_uint32 n;
+  ssize_t r;
+
+  while (count) {
+    if (SF->rpos < SF->rlen) {
+      n = SF->rlen - SF->rpos;
+      if (n > count) n = count;
+      memcpy(x, SF->rbuf + SF->rpos, n);
+      SF->rpos += n;
+    } else if (count >= PIPE_BUFSIZE) {
+      /* Big reads go straight to the caller's buffer */
+      if ((r = read(SF->fd, x, count)) < 0) {
+        if (errno == EINTR) continue;
+        return errno;
+      }
+      if (!r) return ERROR_XFILE_EOF;
+      n = r;
+    } else {
+      if ((r = read(SF->fd, SF->rbuf, PIPE_BUFSIZE)) < 0) {
+        if (errno == EINTR) continue;
+        return errno;
+      }
+      if (!r) return ERROR_XFILE_EOF;
+      SF->rpos = 0;
+      SF->rlen = r;
+      continue;
+    }
+    x += n;
+    count -= n;
+  }
+  return 0;
+}
+
+
+/* do_readsome for stdio xfiles on pipes */
+static afs_uint32 xf_PIPE_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                      afs_uint32 *nread)
+{
+  SFILE *SF = X->refcon;
+  ssize_t r;
+
+  *nread = 0;
+  if (SF->rpos < SF->rlen) {
+    *nread = SF->rlen - SF->rpos;
+    if (*nread > count) *nread = count;
+    memcpy(buf, SF->rbuf + SF->rpos, *nread);
+    SF->rpos += *nread;
+    return 0;
+  }
+  while ((r = read(SF->fd, buf, count)) < 0)
+    if (errno != EINTR) return errno;
+  if (!r) return ERROR_XFILE_EOF;
+  *nread = r;
+  return 0;
+}
+
+
+/* do_splice for stdio xfiles on pipes.  Moves up to *count bytes to Y,
+ * which must also be a stdio xfile, or to /dev/null if Y is null.
+ * Sets *count to the number of bytes actually moved; if the kernel
+ * can't splice these files, that may be less than was asked for.
+ */
+static afs_uint32 xf_PIPE_do_splice(XFILE *X, XFILE *Y, u_int64 *count)
+{
+  SFILE *SF = X->refcon;
+  FILE *G = 0;
+  afs_uint32 code = 0, n;
+  u_int64 left, tmp64;
+  off_t where;
+  ssize_t r;
+  int outfd;
+
+  cp64(left, *count);
+  if (Y) {
+    if (Y->do_write != xf_FILE_do_write) goto out;
+    G = ((SFILE *)Y->refcon)->F;
+    outfd = fileno(G);
+  } else {
+    if (SF->devnull < 0 && (SF->devnull = open("/dev/null", O_WRONLY)) < 0)
+      goto out;
+    outfd = SF->devnull;
+  }
+
+  /* First take care of anything we have already read */
+  if (SF->rpos < SF->rlen) {
+    n = SF->rlen - SF->rpos;
+    if (!hi64(left) && n > lo64(left)) n = lo64(left);
+    if (G && fwrite(SF->rbuf + SF->rpos, n, 1, G) != 1) {
+      code = errno;
+      goto out;
+    }
+    SF->rpos += n;
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  if (G && fflush(G)) {
+    code = errno;
+    goto out;
+  }
+
+  while (!zero64(left)) {
+    n = (hi64(left) || lo64(left) > SPLICE_MAX) ? SPLICE_MAX : lo64(left);
+    r = splice(SF->fd, 0, outfd, 0, n, SPLICE_F_MOVE);
+    if (r > 0) {
+      sub64_32(tmp64, left, r);
+      cp64(left, tmp64);
+    } else if (r == 0) {
+      code = ERROR_XFILE_EOF;
+      break;
+    } else if (errno != EINTR) {
+      /* If splice isn't supported here, the caller reads the rest */
+      if (errno != EINVAL && errno != ENOSYS) code = errno;
+      break;
+    }
+  }
+
+  /* Bring stdio's idea of the output position up to date */
+  if (G && (where = lseek(outfd, 0, SEEK_CUR)) != -1)
+    fseeko(G, where, SEEK_SET);
+
+out:
+  sub64_64(tmp64, *count, left);
+  cp64(*count, tmp64);
+  return code;
+}
+#endif /* USE_SPLICE */
+
+
 /* do_close for stdio xfiles */
 static afs_uint32 xf_FILE_do_close(XFILE *X)
 {
-  FILE *F = X->refcon;
+  SFILE *SF = X->refcon;
+  afs_uint32 code = 0;
 
   X->refcon = 0;
-  if (fclose(F)) return errno;
-  return 0;
+  if (fclose(SF->F)) code = errno;
+  if (SF->devnull >= 0) close(SF->devnull);
+  if (SF->rbuf) free(SF->rbuf);
+  free(SF);
+  return code;
 }
 
 
 /* Prepare a stdio XFILE */
-static void prepare(XFILE *X, FILE *F, int xflag)
+static afs_uint32 prepare(XFILE *X, FILE *F, int xflag)
 {
   struct stat st;
+  SFILE *SF;
+
+  if (!(SF = (SFILE *)malloc(sizeof(SFILE)))) return ENOMEM;
+  memset(SF, 0, sizeof(*SF));
+  SF->F = F;
+  SF->fd = fileno(F);
+  SF->devnull = -1;
 
   memset(X, 0, sizeof(*X));
   X->do_read  = xf_FILE_do_read;
+  X->do_readsome = xf_FILE_do_readsome;
   X->do_write = xf_FILE_do_write;
   X->do_tell  = xf_FILE_do_tell;
   X->do_close = xf_FILE_do_close;
-  X->refcon = F;
+  X->refcon = SF;
   if (xflag == O_RDWR) X->is_writable = 1;
 
   if (!fstat(fileno(F), &st)
@@ -149,7 +348,20 @@ static void prepare(XFILE *X, FILE *F, int xflag)
     X->is_seekable = 1;
     X->do_seek = xf_FILE_do_seek;
     X->do_skip = xf_FILE_do_skip;
+    if ((st.st_mode & S_IFMT) == S_IFREG) X->do_size = xf_FILE_do_size;
   }
+#ifdef USE_SPLICE
+  else if (xflag == O_RDONLY) {
+    if (!(SF->rbuf = malloc(PIPE_BUFSIZE))) {
+      free(SF);
+      return ENOMEM;
+    }
+    X->do_read = xf_PIPE_do_read;
+    X->do_readsome = xf_PIPE_do_readsome;
+    X->do_splice = xf_PIPE_do_splice;
+  }
+#endif
+  return 0;
 }
 
 
@@ -170,8 +382,8 @@ afs_uint32 xfopen_path(XFILE *X, int flag, char *path, int mode)
     return code;
   }
 
-  prepare(X, F, xflag);
-  return 0;
+  if (code = prepare(X, F, xflag)) fclose(F);
+  return code;
 }
 
 
@@ -180,8 +392,7 @@ afs_uint32 xfopen_FILE(XFILE *X, int flag, FILE *F)
 {
   flag &= O_MODE_MASK;
   if (flag == O_WRONLY) flag = O_RDWR;
-  prepare(X, F, flag);
-  return 0;
+  return prepare(X, F, flag);
 }
 
 
@@ -189,12 +400,13 @@ afs_uint32 xfopen_FILE(XFILE *X, int flag, FILE *F)
 afs_uint32 xfopen_fd(XFILE *X, int flag, int fd)
 {
   FILE *F;
+  afs_uint32 code;
 
   flag &= O_MODE_MASK;
   if (flag == O_WRONLY) flag = O_RDWR;
   if (!(F = fdopen(fd, (flag == O_RDONLY) ? "r" : "r+"))) return errno;
-  prepare(X, F, flag);
-  return 0;
+  if (code = prepare(X, F, flag)) fclose(F);
+  return code;
 }
 
 
@@ -26,35 +26,218 @@
  * the rights to redistribute these changes.
  */
 
-/* xf_profile.c - XFILE routines for read/write profiling */
+/* xf_profile.c - XFILE routines for read/write profiling
+ *
+ * A profiled XFILE passes every operation through to its content, and
+ * records it in a profile XFILE.  The profile is either text, one line
+ * per operation, or a compact binary form, which costs much less to
+ * produce and can be decoded to text later with xfprof.
+ *
+ * A binary profile starts with the 8-byte magic XFPROF_MAGIC and a
+ * varint giving the wall-clock time (seconds since the epoch) when it
+ * was opened.  Each record then consists of an opcode byte (XFPROF_*)
+ * followed by varints:
+ *
+ *   dt      microseconds since the start of the previous record
+ *   ns      duration of the operation, in nanoseconds (saturates)
+ *   delta   offset of the operation, less the offset at which the
+ *           previous one ended (zigzag-encoded; nonzero for seeks)
+ *   size    bytes read, written, or skipped
+ *   result  error code returned
+ *
+ * delta and result are present only if the opcode byte has the
+ * XFPROF_F_DELTA or XFPROF_F_RESULT bit set; otherwise they are 0.
+ * XFPROF_OPEN records are different: after dt, they have the name (a
+ * length and that many bytes) and the offset of the content when it
+ * was opened.
+ *
+ * Varints are little-endian base 128, with the high bit of each byte
+ * set if more bytes follow.  Records are collected in a buffer and
+ * written XFPROF_BUFSIZE bytes at a time.
+ */
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 
 #include "xfiles.h"
 #include "xf_errs.h"
 
 #define O_MODE_MASK (O_RDONLY | O_WRONLY | O_RDWR)
 
+#define XFPROF_BUFSIZE 65536
+#define XFPROF_MAXREC  64            /* largest record, except OPEN */
+
 typedef struct {
   XFILE *content;
   XFILE *profile;
   int free_content, free_profile;
+  afs_uint32 perr;                   /* first error writing the profile */
+
+  /* For binary profiles */
+  int binary;
+  unsigned char *buf;
+  afs_uint32 buflen;
+  u_int64 pos;                       /* where the last operation ended */
+  struct timespec last;              /* when the last record started */
 } PFILE;
 
 
+/* Append a varint to a buffer; returns its length */
+static int put_varint(unsigned char *p, u_int64 *value)
+{
+  u_int64 v;
+  int n = 0;
+
+  cp64(v, *value);
+  while (hi64(v) || lo64(v) > 0x7f) {
+    p[n++] = (lo64(v) & 0x7f) | 0x80;
+    shift_int64(&v, -7);
+  }
+  p[n++] = lo64(v);
+  return n;
+}
+
+static int put_varint32(unsigned char *p, afs_uint32 value)
+{
+  u_int64 v;
+
+  mk64(v, 0, value);
+  return put_varint(p, &v);
+}
+
+
+/* Note an error writing the profile.  It is returned when the XFILE
+ * is closed, and nothing more is written, so a profile that was cut
+ * short doesn't go unnoticed.
+ */
+static void prof_error(PFILE *PF, afs_uint32 err)
+{
+  if (err && !PF->perr) PF->perr = err;
+}
+
+
+/* Write out buffered binary records */
+static void prof_flush(PFILE *PF)
+{
+  if (PF->buflen && !PF->perr)
+    prof_error(PF, xfwrite(PF->profile, PF->buf, PF->buflen));
+  PF->buflen = 0;
+}
+
+
+/* Write a line of a text profile */
+static void prof_printf(PFILE *PF, char *fmt, ...)
+{
+  va_list alist;
+
+  if (PF->perr) return;
+  va_start(alist, fmt);
+  prof_error(PF, vxfprintf(PF->profile, fmt, alist));
+  va_end(alist);
+}
+
+
+/* Note the time an operation starts */
+static void prof_start(PFILE *PF, struct timespec *t0)
+{
+  if (PF->binary) clock_gettime(CLOCK_MONOTONIC, t0);
+}
+
+
+/* Record an operation in a binary profile.  If where is null, the
+ * operation happened where the last one ended; a null size means 0.
+ * If it succeeded, the next one is expected to start where this one
+ * ended.
+ */
+static void prof_record(PFILE *PF, int op, struct timespec *t0,
+                        u_int64 *where, u_int64 *size, afs_uint32 result)
+{
+  struct timespec t1;
+  unsigned char *p;
+  afs_uint32 dt, ns;
+  u_int64 start, delta, len, tmp64;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if (t1.tv_sec - t0->tv_sec > 3) ns = 0xffffffff;
+  else ns = (afs_uint32)(t1.tv_sec - t0->tv_sec) * 1000000000
+          + t1.tv_nsec - t0->tv_nsec;
+  if (t0->tv_sec - PF->last.tv_sec > 4000) dt = 0xffffffff;
+  else dt = (afs_uint32)(t0->tv_sec - PF->last.tv_sec) * 1000000
+          + t0->tv_nsec / 1000 - PF->last.tv_nsec / 1000;
+  PF->last = *t0;
+
+  cp64(start, where ? *where : PF->pos);
+  if (size) cp64(len, *size);
+  else mk64(len, 0, 0);
+  if (ge64(start, PF->pos)) {
+    sub64_64(delta, start, PF->pos);
+    shift_int64(&delta, 1);
+  } else {
+    sub64_64(delta, PF->pos, start);
+    shift_int64(&delta, 1);
+    sub64_32(tmp64, delta, 1);
+    cp64(delta, tmp64);
+  }
+  if (!result) add64_64(PF->pos, start, len);
+
+  if (hi64(delta) || lo64(delta)) op |= XFPROF_F_DELTA;
+  if (result) op |= XFPROF_F_RESULT;
+
+  p = PF->buf + PF->buflen;
+  *p++ = op;
+  p += put_varint32(p, dt);
+  p += put_varint32(p, ns);
+  if (op & XFPROF_F_DELTA) p += put_varint(p, &delta);
+  p += put_varint(p, &len);
+  if (op & XFPROF_F_RESULT) p += put_varint32(p, result);
+  PF->buflen = p - PF->buf;
+  if (PF->buflen > XFPROF_BUFSIZE - XFPROF_MAXREC) prof_flush(PF);
+}
+
+
 /* do_read for profiled xfiles */
 static afs_uint32 xf_PROFILE_do_read(XFILE *X, void *buf, afs_uint32 count)
 {
   PFILE *PF = X->refcon;
+  struct timespec t0;
   afs_uint32 err;
+  u_int64 size;
 
+  prof_start(PF, &t0);
   err = xfread(PF->content, buf, count);
-  xfprintf(PF->profile, "R %ld =%ld\n", (long)count, (long)err);
+  if (PF->binary) {
+    mk64(size, 0, count);
+    prof_record(PF, XFPROF_READ, &t0, 0, &size, err);
+  } else {
+    prof_printf(PF, "R %ld =%ld\n", (long)count, (long)err);
+  }
+  return err;
+}
+
+
+/* do_readsome for profiled xfiles */
+static afs_uint32 xf_PROFILE_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                         afs_uint32 *nread)
+{
+  PFILE *PF = X->refcon;
+  struct timespec t0;
+  afs_uint32 err;
+  u_int64 size;
+
+  prof_start(PF, &t0);
+  err = xfreadsome(PF->content, buf, count, nread);
+  if (PF->binary) {
+    mk64(size, 0, *nread);
+    prof_record(PF, XFPROF_READSOME, &t0, 0, &size, err);
+  } else {
+    prof_printf(PF, "R %ld =%ld\n", (long)*nread, (long)err);
+  }
   return err;
 }
 
@@ -63,10 +246,18 @@ static afs_uint32 xf_PROFILE_do_read(XFILE *X, void *buf, afs_uint32 count)
 static afs_uint32 xf_PROFILE_do_write(XFILE *X, void *buf, afs_uint32 count)
 {
   PFILE *PF = X->refcon;
+  struct timespec t0;
   afs_uint32 err;
+  u_int64 size;
 
+  prof_start(PF, &t0);
   err = xfwrite(PF->content, buf, count);
-  xfprintf(PF->profile, "W %ld =%ld\n", (long)count, (long)err);
+  if (PF->binary) {
+    mk64(size, 0, count);
+    prof_record(PF, XFPROF_WRITE, &t0, 0, &size, err);
+  } else {
+    prof_printf(PF, "W %ld =%ld\n", (long)count, (long)err);
+  }
   return err;
 }
 
@@ -75,11 +266,15 @@ static afs_uint32 xf_PROFILE_do_write(XFILE *X, void *buf, afs_uint32 count)
 static afs_uint32 xf_PROFILE_do_tell(XFILE *X, u_int64 *offset)
 {
   PFILE *PF = X->refcon;
+  struct timespec t0;
   afs_uint32 err;
 
+  prof_start(PF, &t0);
   err = xftell(PF->content, offset);
-  if (err) xfprintf(PF->profile, "TELL ERR =%ld\n", (long)err);
-  else     xfprintf(PF->profile, "TELL %s =0\n", hexify_int64(offset, 0));
+  if (PF->binary)
+    prof_record(PF, XFPROF_TELL, &t0, err ? 0 : offset, 0, err);
+  else if (err) prof_printf(PF, "TELL ERR =%ld\n", (long)err);
+  else     prof_printf(PF, "TELL %s =0\n", hexify_int64(offset, 0));
   return err;
 }
 
@@ -88,10 +283,15 @@ static afs_uint32 xf_PROFILE_do_tell(XFILE *X, u_int64 *offset)
 static afs_uint32 xf_PROFILE_do_seek(XFILE *X, u_int64 *offset)
 {
   PFILE *PF = X->refcon;
+  struct timespec t0;
   afs_uint32 err;
 
+  prof_start(PF, &t0);
   err = xfseek(PF->content, offset);
-  xfprintf(PF->profile, "SEEK %s =%ld\n", hexify_int64(offset, 0), (long)err);
+  if (PF->binary)
+    prof_record(PF, XFPROF_SEEK, &t0, offset, 0, err);
+  else
+    prof_printf(PF, "SEEK %s =%ld\n", hexify_int64(offset, 0), (long)err);
   return err;
 }
 
@@ -100,10 +300,15 @@ static afs_uint32 xf_PROFILE_do_seek(XFILE *X, u_int64 *offset)
 static afs_uint32 xf_PROFILE_do_skip(XFILE *X, u_int64 *count)
 {
   PFILE *PF = X->refcon;
+  struct timespec t0;
   afs_uint32 err;
 
+  prof_start(PF, &t0);
   err = xfskip64(PF->content, count);
-  xfprintf(PF->profile, "SKIP %s =%ld\n", decimate_int64(count, 0), (long)err);
+  if (PF->binary)
+    prof_record(PF, XFPROF_SKIP, &t0, 0, count, err);
+  else
+    prof_printf(PF, "SKIP %s =%ld\n", decimate_int64(count, 0), (long)err);
   return err;
 }
 
@@ -112,10 +317,18 @@ static afs_uint32 xf_PROFILE_do_skip(XFILE *X, u_int64 *count)
 static afs_uint32 xf_PROFILE_do_close(XFILE *X)
 {
   PFILE *PF = X->refcon;
+  struct timespec t0;
   afs_uint32 err, err2;
 
+  prof_start(PF, &t0);
   err = xfclose(PF->content);
+  if (PF->binary) {
+    prof_record(PF, XFPROF_CLOSE, &t0, 0, 0, err);
+    prof_flush(PF);
+    free(PF->buf);
+  }
   err2 = xfclose(PF->profile);
+  if (!err2) err2 = PF->perr;
   if (PF->free_content) free(PF->content);
   if (PF->free_profile) free(PF->profile);
   free(PF);
@@ -123,10 +336,39 @@ static afs_uint32 xf_PROFILE_do_close(XFILE *X)
 }
 
 
+/* Start a binary profile */
+static afs_uint32 prof_open(PFILE *PF, char *xname)
+{
+  unsigned char *p;
+  afs_uint32 len;
+  u_int64 now;
+
+  if (!(PF->buf = malloc(XFPROF_BUFSIZE))) return ENOMEM;
+  memcpy(PF->buf, XFPROF_MAGIC, 8);
+  mk64(now, 0, time(0));
+  PF->buflen = 8 + put_varint(PF->buf + 8, &now);
+  if (xftell(PF->content, &PF->pos)) mk64(PF->pos, 0, 0);
+  clock_gettime(CLOCK_MONOTONIC, &PF->last);
+
+  len = strlen(xname);
+  if (len > XFPROF_BUFSIZE - 2 * XFPROF_MAXREC)
+    len = XFPROF_BUFSIZE - 2 * XFPROF_MAXREC;
+  p = PF->buf + PF->buflen;
+  *p++ = XFPROF_OPEN;
+  p += put_varint32(p, 0);
+  p += put_varint32(p, len);
+  memcpy(p, xname, len);
+  p += len;
+  p += put_varint(p, &PF->pos);
+  PF->buflen = p - PF->buf;
+  return 0;
+}
+
+
 /* Open a profiled XFILE */
 afs_uint32 xf_PROFILE_do_open(XFILE *X, int flag, char *xname,
                               XFILE *content, int free_content,
-                              XFILE *profile, int free_profile)
+                              XFILE *profile, int free_profile, int binary)
 {
   PFILE *PF;
 
@@ -138,24 +380,36 @@ afs_uint32 xf_PROFILE_do_open(XFILE *X, int flag, char *xname,
   PF->profile = profile;
   PF->free_content = free_content;
   PF->free_profile = free_profile;
+  PF->binary = binary;
+  if (binary && prof_open(PF, xname)) {
+    free(PF);
+    return ENOMEM;
+  }
 
   memset(X, 0, sizeof(*X));
   X->refcon = PF;
   X->do_read  = xf_PROFILE_do_read;
+  X->do_readsome = xf_PROFILE_do_readsome;
   X->do_write = xf_PROFILE_do_write;
   X->do_tell  = xf_PROFILE_do_tell;
   X->do_close = xf_PROFILE_do_close;
   X->is_writable = PF->content->is_writable;
   if (PF->content->is_seekable) {
+    X->is_seekable = 1;
     X->do_seek  = xf_PROFILE_do_seek;
     X->do_skip  = xf_PROFILE_do_skip;
   }
-  xfprintf(PF->profile, "OPEN %s\n", xname);
+  if (!binary) prof_printf(PF, "OPEN %s\n", xname);
   return 0;
 }
 
 
 afs_uint32 xfopen_profile(XFILE *X, int flag, XFILE *cX, XFILE *pX)
 {
-  return xf_PROFILE_do_open(X, flag, "<X>", cX, 0, pX, 0);
+  return xf_PROFILE_do_open(X, flag, "<X>", cX, 0, pX, 0, 0);
+}
+
+afs_uint32 xfopen_bprofile(XFILE *X, int flag, XFILE *cX, XFILE *pX)
+{
+  return xf_PROFILE_do_open(X, flag, "<X>", cX, 0, pX, 0, 1);
 }
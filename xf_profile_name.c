@@ -41,7 +41,7 @@
 
 /* Open a profiled XFILE */
 extern afs_uint32 xf_PROFILE_do_open(XFILE *, int, char *,
-                                     XFILE *, int, XFILE *, int);
+                                     XFILE *, int, XFILE *, int, int);
 
 
 afs_uint32 xfopen_profile_to(XFILE *X, int flag, XFILE *cX, char *profile)
@@ -58,7 +58,7 @@ afs_uint32 xfopen_profile_to(XFILE *X, int flag, XFILE *cX, char *profile)
     return err;
   }
 
-  return xf_PROFILE_do_open(X, flag, "<X>", cX, 0, pX, 1);
+  return xf_PROFILE_do_open(X, flag, "<X>", cX, 0, pX, 1, 0);
 }
 
 afs_uint32 xfopen_profile_name(XFILE *X, int flag, char *content, XFILE *pX)
@@ -75,11 +75,11 @@ afs_uint32 xfopen_profile_name(XFILE *X, int flag, char *content, XFILE *pX)
     return err;
   }
 
-  return xf_PROFILE_do_open(X, flag, content, cX, 1, pX, 0);
+  return xf_PROFILE_do_open(X, flag, content, cX, 1, pX, 0, 0);
 }
 
-afs_uint32 xfopen_profile_name_to(XFILE *X, int flag,
-                                  char *content, char *profile)
+static afs_uint32 profile_name_to(XFILE *X, int flag, char *content,
+                                  char *profile, int binary)
 {
   XFILE *pX, *cX;
   afs_uint32 err;
@@ -108,11 +108,23 @@ afs_uint32 xfopen_profile_name_to(XFILE *X, int flag,
     return err;
   }
 
-  return xf_PROFILE_do_open(X, flag, content, cX, 1, pX, 1);
+  return xf_PROFILE_do_open(X, flag, content, cX, 1, pX, 1, binary);
 }
 
+afs_uint32 xfopen_profile_name_to(XFILE *X, int flag,
+                                  char *content, char *profile)
+{
+  return profile_name_to(X, flag, content, profile, 0);
+}
 
-afs_uint32 xfon_profile(XFILE *X, int flag, char *name)
+afs_uint32 xfopen_bprofile_name_to(XFILE *X, int flag,
+                                   char *content, char *profile)
+{
+  return profile_name_to(X, flag, content, profile, 1);
+}
+
+
+static afs_uint32 profile_name(XFILE *X, int flag, char *name, int binary)
 {
   char *x, *profile, *xname;
   afs_uint32 err;
@@ -130,7 +142,17 @@ afs_uint32 xfon_profile(XFILE *X, int flag, char *name)
     }
   }
   if (!*name) profile = "-";
-  err = xfopen_profile_name_to(X, flag, xname, profile);
+  err = profile_name_to(X, flag, xname, profile, binary);
   free(name);
   return err;
 }
+
+afs_uint32 xfon_profile(XFILE *X, int flag, char *name)
+{
+  return profile_name(X, flag, name, 0);
+}
+
+afs_uint32 xfon_bprofile(XFILE *X, int flag, char *name)
+{
+  return profile_name(X, flag, name, 1);
+}
@@ -0,0 +1,259 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xf_profile_read.c - Read back XFILE profiles
+ *
+ * These routines read a profile written by the profile module, in
+ * either text or binary form, and return one operation at a time.
+ * The offset of each operation is tracked the same way for both forms,
+ * so the result can be used to reproduce the original access pattern.
+ * Times are available only from binary profiles.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "xfiles.h"
+#include "xf_errs.h"
+
+
+/* Get the next byte of input */
+static afs_uint32 get_byte(xfprof_reader *R, int *c)
+{
+  afs_uint32 r;
+
+  if (R->bufpos == R->buflen) {
+    R->bufpos = R->buflen = 0;
+    if (r = xfreadsome(R->X, R->buf, sizeof(R->buf), &R->buflen)) return r;
+  }
+  *c = R->buf[R->bufpos++];
+  return 0;
+}
+
+
+/* Get a varint */
+static afs_uint32 get_varint(xfprof_reader *R, u_int64 *value)
+{
+  unsigned char bytes[10];
+  afs_uint32 r;
+  int c, n;
+
+  for (n = 0; n < 10; ) {
+    if (r = get_byte(R, &c)) return r;
+    bytes[n++] = c;
+    if (!(c & 0x80)) break;
+  }
+  if (n == 10 && (bytes[9] & 0x80)) return ERROR_XFILE_BADPROF;
+  mk64(*value, 0, 0);
+  while (n--) {
+    shift_int64(value, 7);
+    mk64(*value, hi64(*value), lo64(*value) | (bytes[n] & 0x7f));
+  }
+  return 0;
+}
+
+static afs_uint32 get_varint32(xfprof_reader *R, afs_uint32 *value)
+{
+  afs_uint32 r;
+  u_int64 v;
+
+  if (r = get_varint(R, &v)) return r;
+  *value = lo64(v);
+  return 0;
+}
+
+
+/* Parse a 64-bit number in the given base; returns a pointer past it */
+static char *parse_int64(char *x, int base, u_int64 *value)
+{
+  u_int64 tmp64, sum;
+  int d;
+
+  mk64(*value, 0, 0);
+  for (;; x++) {
+    if (isdigit(*x)) d = *x - '0';
+    else if (base == 16 && isxdigit(*x)) d = tolower(*x) - 'a' + 10;
+    else break;
+    if (base == 16) {
+      shift_int64(value, 4);
+      cp64(sum, *value);
+    } else {
+      /* value * 10 == value * 2 + value * 8 */
+      shift_int64(value, 1);
+      cp64(tmp64, *value);
+      shift_int64(&tmp64, 2);
+      add64_64(sum, tmp64, *value);
+    }
+    add64_32(*value, sum, d);
+  }
+  return x;
+}
+
+
+/* Parse the " =result" at the end of a text record */
+static afs_uint32 parse_result(char *x, afs_uint32 *result)
+{
+  if (x[0] != ' ' || x[1] != '=' || !isdigit(x[2])) return ERROR_XFILE_BADPROF;
+  *result = strtoul(x + 2, 0, 10);
+  return 0;
+}
+
+
+/* Read a record from a text profile */
+static afs_uint32 next_text(xfprof_reader *R, xfprof_record *P)
+{
+  char line[1024], *x;
+  afs_uint32 r;
+  int c, n;
+
+  for (n = 0;;) {
+    if (r = get_byte(R, &c)) {
+      if (r == (afs_uint32)ERROR_XFILE_EOF && n) break;
+      return r;
+    }
+    if (c == '\n') break;
+    if (n < sizeof(line) - 1) line[n++] = c;
+  }
+  line[n] = 0;
+
+  if (!strncmp(line, "OPEN ", 5)) {
+    P->op = XFPROF_OPEN;
+    strncpy(P->name, line + 5, sizeof(P->name) - 1);
+    P->name[sizeof(P->name) - 1] = 0;
+    mk64(R->pos, 0, 0);
+    return 0;
+  }
+  if ((line[0] == 'R' || line[0] == 'W') && line[1] == ' ') {
+    P->op = (line[0] == 'R') ? XFPROF_READ : XFPROF_WRITE;
+    x = parse_int64(line + 2, 10, &P->size);
+  } else if (!strncmp(line, "TELL ERR", 8)) {
+    P->op = XFPROF_TELL;
+    x = line + 8;
+  } else if (!strncmp(line, "TELL ", 5)) {
+    P->op = XFPROF_TELL;
+    x = parse_int64(line + 5, 16, &P->offset);
+  } else if (!strncmp(line, "SEEK ", 5)) {
+    P->op = XFPROF_SEEK;
+    x = parse_int64(line + 5, 16, &P->offset);
+  } else if (!strncmp(line, "SKIP ", 5)) {
+    P->op = XFPROF_SKIP;
+    x = parse_int64(line + 5, 10, &P->size);
+  } else {
+    return ERROR_XFILE_BADPROF;
+  }
+  if (r = parse_result(x, &P->result)) return r;
+
+  if ((P->op != XFPROF_TELL && P->op != XFPROF_SEEK) || P->result)
+    cp64(P->offset, R->pos);
+  if (!P->result) add64_64(R->pos, P->offset, P->size);
+  return 0;
+}
+
+
+/* Read a record from a binary profile */
+static afs_uint32 next_binary(xfprof_reader *R, xfprof_record *P)
+{
+  afs_uint32 r, len, i;
+  u_int64 delta, tmp64;
+  int c, op;
+
+  if (r = get_byte(R, &op)) return r;
+  if (r = get_varint32(R, &P->dt)) return r;
+
+  if (op == XFPROF_OPEN) {
+    P->op = op;
+    if (r = get_varint32(R, &len)) return r;
+    for (i = 0; i < len; i++) {
+      if (r = get_byte(R, &c)) return r;
+      if (i < sizeof(P->name) - 1) P->name[i] = c;
+    }
+    P->name[(len < sizeof(P->name) - 1) ? len : sizeof(P->name) - 1] = 0;
+    if (r = get_varint(R, &R->pos)) return r;
+    cp64(P->offset, R->pos);
+    return 0;
+  }
+
+  mk64(delta, 0, 0);
+  if ((r = get_varint32(R, &P->ns))
+  ||  ((op & XFPROF_F_DELTA) && (r = get_varint(R, &delta)))
+  ||  (r = get_varint(R, &P->size))
+  ||  ((op & XFPROF_F_RESULT) && (r = get_varint32(R, &P->result))))
+    return r;
+  P->op = op & XFPROF_OPMASK;
+  if (P->op < XFPROF_CLOSE || P->op > XFPROF_SKIP) return ERROR_XFILE_BADPROF;
+
+  /* Undo the zigzag encoding to find where the operation happened */
+  if (lo64(delta) & 1) {
+    add64_32(tmp64, delta, 1);
+    shift_int64(&tmp64, -1);
+    sub64_64(P->offset, R->pos, tmp64);
+  } else {
+    cp64(tmp64, delta);
+    shift_int64(&tmp64, -1);
+    add64_64(P->offset, R->pos, tmp64);
+  }
+  if (!P->result) add64_64(R->pos, P->offset, P->size);
+  return 0;
+}
+
+
+/* Start reading a profile from X, which must already be open */
+afs_uint32 xfprof_open(xfprof_reader *R, XFILE *X)
+{
+  afs_uint32 r, n;
+  u_int64 when;
+
+  memset(R, 0, sizeof(*R));
+  R->X = X;
+
+  /* Collect enough data to see if it's a binary profile */
+  while (R->buflen < 8) {
+    r = xfreadsome(X, R->buf + R->buflen, sizeof(R->buf) - R->buflen, &n);
+    if (r == (afs_uint32)ERROR_XFILE_EOF) break;
+    if (r) return r;
+    R->buflen += n;
+  }
+  if (R->buflen >= 8 && !memcmp(R->buf, XFPROF_MAGIC, 8)) {
+    R->binary = 1;
+    R->bufpos = 8;
+    if (r = get_varint(R, &when)) return r;
+    R->started = lo64(when);
+  }
+  return 0;
+}
+
+
+/* Get the next record.  Returns ERROR_XFILE_EOF at the end. */
+afs_uint32 xfprof_next(xfprof_reader *R, xfprof_record *P)
+{
+  memset(P, 0, sizeof(*P));
+  return R->binary ? next_binary(R, P) : next_text(R, P);
+}
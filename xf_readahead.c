@@ -0,0 +1,351 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xf_readahead.c - XFILE routines for pipelined (read-ahead) input
+ *
+ * A READAHEAD XFILE wraps some other XFILE, usually a pipe, stdin, or
+ * an AFSDUMP: rx stream, which can only be read sequentially.  A producer
+ * thread reads the underlying XFILE into a ring of large buffers while the
+ * caller consumes data from the other end, so that I/O and parsing overlap
+ * instead of alternating.  When the ring is full, the producer blocks until
+ * the consumer frees a buffer; when it is empty, the consumer blocks until
+ * the producer fills one.
+ *
+ * The ring is a single-producer/single-consumer queue; buffers are handed
+ * off by advancing the head and tail counters, with no locking.  The mutex
+ * and condition variable are used only to put one side to sleep when it
+ * must wait for the other, which happens at most once per buffer.
+ *
+ * Once opened, the underlying XFILE belongs to the producer thread, and
+ * must not be touched by anyone else until the READAHEAD XFILE is closed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "xfiles.h"
+#include "xf_errs.h"
+
+extern int xfon_options(char **, afs_uint32 *, afs_uint32 *);
+
+#define O_MODE_MASK (O_RDONLY | O_WRONLY | O_RDWR)
+
+#define RA_DEFAULT_DEPTH    8
+#define RA_DEFAULT_BUFSIZE  (1024 * 1024)
+
+/* Ordering primitives for the ring counters */
+#define ra_load(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ra_store(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ra_fence()      __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+struct rabuf {
+  char *data;
+  afs_uint32 len;              /* bytes of valid data */
+  afs_uint32 code;             /* error (or EOF) after this buffer */
+};
+
+typedef struct {
+  XFILE *content;
+  int free_content;
+
+  struct rabuf *ring;
+  unsigned int depth;          /* number of buffers in the ring */
+  afs_uint32 bufsize;          /* size of each buffer */
+  unsigned int head;           /* next buffer to fill (producer) */
+  unsigned int tail;           /* next buffer to drain (consumer) */
+  afs_uint32 pos;              /* consumer's offset in ring[tail] */
+
+  int stop;                    /* consumer wants the producer to quit */
+  int waiting;                 /* someone is asleep on cv */
+  pthread_mutex_t lock;
+  pthread_cond_t cv;
+  pthread_t producer;
+} RAFILE;
+
+
+/* Put the caller to sleep until ready(RA) is true */
+static void ra_sleep(RAFILE *RA, int (*ready)(RAFILE *))
+{
+  pthread_mutex_lock(&RA->lock);
+  for (;;) {
+    ra_store(&RA->waiting, 1);
+    ra_fence();
+    if ((ready)(RA)) break;
+    pthread_cond_wait(&RA->cv, &RA->lock);
+  }
+  pthread_mutex_unlock(&RA->lock);
+}
+
+
+/* Wake up the other side, if it is asleep */
+static void ra_wake(RAFILE *RA)
+{
+  ra_fence();
+  if (!ra_load(&RA->waiting)) return;
+  pthread_mutex_lock(&RA->lock);
+  ra_store(&RA->waiting, 0);
+  pthread_cond_broadcast(&RA->cv);
+  pthread_mutex_unlock(&RA->lock);
+}
+
+
+static int ra_has_space(RAFILE *RA)
+{
+  return ra_load(&RA->stop) || RA->head - ra_load(&RA->tail) < RA->depth;
+}
+
+
+static int ra_has_data(RAFILE *RA)
+{
+  return ra_load(&RA->head) != RA->tail;
+}
+
+
+/* The producer thread */
+static void *ra_producer(void *arg)
+{
+  RAFILE *RA = arg;
+  struct rabuf *b;
+  afs_uint32 n, code;
+
+  for (;;) {
+    if (!ra_has_space(RA)) ra_sleep(RA, ra_has_space);
+    if (ra_load(&RA->stop)) break;
+
+    b = &RA->ring[RA->head % RA->depth];
+    b->len = 0;
+    code = 0;
+    while (!code && b->len < RA->bufsize) {
+      code = xfreadsome(RA->content, b->data + b->len, RA->bufsize - b->len, &n);
+      b->len += n;
+    }
+    b->code = code;
+    ra_store(&RA->head, RA->head + 1);
+    ra_wake(RA);
+    if (code) break;
+  }
+  return 0;
+}
+
+
+/* Get the buffer the consumer is working on, waiting for one if needed.
+ * Buffers which have been completely drained are released to the producer.
+ * Returns nonzero on EOF or error, once all data before it has been read.
+ */
+static afs_uint32 ra_current(RAFILE *RA, struct rabuf **bp)
+{
+  struct rabuf *b;
+
+  for (;;) {
+    if (!ra_has_data(RA)) ra_sleep(RA, ra_has_data);
+    b = &RA->ring[RA->tail % RA->depth];
+    if (RA->pos < b->len) break;
+    if (b->code) return b->code;
+    RA->pos = 0;
+    ra_store(&RA->tail, RA->tail + 1);
+    ra_wake(RA);
+  }
+  *bp = b;
+  return 0;
+}
+
+
+/* do_readsome for read-ahead xfiles */
+static afs_uint32 xf_RA_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                    afs_uint32 *nread)
+{
+  RAFILE *RA = X->refcon;
+  struct rabuf *b;
+  afs_uint32 n, code;
+
+  *nread = 0;
+  if (!count) return 0;
+  if (code = ra_current(RA, &b)) return code;
+  n = b->len - RA->pos;
+  if (n > count) n = count;
+  memcpy(buf, b->data + RA->pos, n);
+  RA->pos += n;
+  *nread = n;
+  return 0;
+}
+
+
+/* do_read for read-ahead xfiles */
+static afs_uint32 xf_RA_do_read(XFILE *X, void *buf, afs_uint32 count)
+{
+  afs_uint32 n, code;
+  char *p = buf;
+
+  while (count) {
+    if (code = xf_RA_do_readsome(X, p, count, &n)) return code;
+    p += n;
+    count -= n;
+  }
+  return 0;
+}
+
+
+/* do_skip for read-ahead xfiles; discards data without copying it */
+static afs_uint32 xf_RA_do_skip(XFILE *X, u_int64 *count)
+{
+  RAFILE *RA = X->refcon;
+  struct rabuf *b;
+  afs_uint32 n, code;
+  u_int64 left, tmp64;
+
+  cp64(left, *count);
+  while (!zero64(left)) {
+    if (code = ra_current(RA, &b)) return code;
+    n = b->len - RA->pos;
+    if (!hi64(left) && n > lo64(left)) n = lo64(left);
+    RA->pos += n;
+    sub64_32(tmp64, left, n);
+    cp64(left, tmp64);
+  }
+  return 0;
+}
+
+
+/* do_close for read-ahead xfiles */
+static afs_uint32 xf_RA_do_close(XFILE *X)
+{
+  RAFILE *RA = X->refcon;
+  afs_uint32 err;
+  unsigned int i;
+
+  /* If the producer is blocked reading, this waits for it to finish */
+  ra_store(&RA->stop, 1);
+  ra_wake(RA);
+  pthread_join(RA->producer, 0);
+
+  err = xfclose(RA->content);
+  if (RA->free_content) free(RA->content);
+  for (i = 0; i < RA->depth; i++)
+    free(RA->ring[i].data);
+  free(RA->ring);
+  pthread_cond_destroy(&RA->cv);
+  pthread_mutex_destroy(&RA->lock);
+  free(RA);
+  return err;
+}
+
+
+/* Open a read-ahead XFILE */
+static afs_uint32 xf_RA_do_open(XFILE *X, int flag, XFILE *content,
+                                int free_content, int depth,
+                                afs_uint32 bufsize)
+{
+  RAFILE *RA;
+  unsigned int i;
+
+  if ((flag & O_MODE_MASK) != O_RDONLY) return ERROR_XFILE_RDONLY;
+  if (depth <= 0)  depth   = RA_DEFAULT_DEPTH;
+  if (depth < 2)   depth   = 2;
+  if (!bufsize)    bufsize = RA_DEFAULT_BUFSIZE;
+
+  RA = malloc(sizeof(*RA));
+  if (!RA) return ENOMEM;
+  memset(RA, 0, sizeof(*RA));
+  RA->content = content;
+  RA->free_content = free_content;
+  RA->depth = depth;
+  RA->bufsize = bufsize;
+
+  RA->ring = malloc(depth * sizeof(*RA->ring));
+  if (!RA->ring) {
+    free(RA);
+    return ENOMEM;
+  }
+  memset(RA->ring, 0, depth * sizeof(*RA->ring));
+  for (i = 0; i < RA->depth; i++) {
+    if (!(RA->ring[i].data = malloc(bufsize))) break;
+  }
+  if (i < RA->depth
+  ||  pthread_mutex_init(&RA->lock, 0)) {
+    while (i--) free(RA->ring[i].data);
+    free(RA->ring);
+    free(RA);
+    return ENOMEM;
+  }
+  pthread_cond_init(&RA->cv, 0);
+
+  memset(X, 0, sizeof(*X));
+  X->refcon = RA;
+  X->do_read  = xf_RA_do_read;
+  X->do_readsome = xf_RA_do_readsome;
+  X->do_skip  = xf_RA_do_skip;
+  X->do_close = xf_RA_do_close;
+
+  if (i = pthread_create(&RA->producer, 0, ra_producer, RA)) {
+    for (i = 0; i < RA->depth; i++) free(RA->ring[i].data);
+    free(RA->ring);
+    pthread_cond_destroy(&RA->cv);
+    pthread_mutex_destroy(&RA->lock);
+    free(RA);
+    memset(X, 0, sizeof(*X));
+    return i;
+  }
+  return 0;
+}
+
+
+/* Wrap an already-open XFILE.  A depth or bufsize of 0 selects the
+ * default.  Closing X also closes cX, but does not free it.
+ */
+afs_uint32 xfopen_readahead(XFILE *X, int flag, XFILE *cX,
+                            int depth, afs_uint32 bufsize)
+{
+  return xf_RA_do_open(X, flag, cX, 0, depth, bufsize);
+}
+
+
+/* Open-by-name: READAHEAD:[depth[,bufsize]::]name */
+afs_uint32 xfon_readahead(XFILE *X, int flag, char *name)
+{
+  XFILE *cX;
+  afs_uint32 err, depth = 0, bufsize = 0;
+
+  xfon_options(&name, &depth, &bufsize);
+
+  cX = malloc(sizeof(XFILE));
+  if (!cX) return ENOMEM;
+  if (err = xfopen(cX, flag, name)) {
+    free(cX);
+    return err;
+  }
+  if (err = xf_RA_do_open(X, flag, cX, 1, depth, bufsize)) {
+    xfclose(cX);
+    free(cX);
+  }
+  return err;
+}
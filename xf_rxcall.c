@@ -75,6 +75,19 @@ static afs_uint32 xf_rxcall_do_read(XFILE *X, void *buf, afs_uint32 count)
 }
 
 
+static afs_uint32 xf_rxcall_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                        afs_uint32 *nread)
+{
+  struct rxinfo *i = X->refcon;
+
+  if (i->writemode) return ERROR_XFILE_WRONLY;
+  *nread = rx_Read(i->call, buf, count);
+  if (*nread) return 0;
+  i->code = rx_Error(i->call);
+  return i->code ? i->code : ERROR_XFILE_EOF;
+}
+
+
 static afs_uint32 xf_rxcall_do_write(XFILE *X, void *buf, afs_uint32 count)
 {
   struct rxinfo *i = X->refcon;
@@ -108,6 +121,7 @@ afs_uint32 xfopen_rxcall(XFILE *X, int flag, struct rx_call *call)
   i->call = call;
   i->code = 0;
   X->do_read  = xf_rxcall_do_read;
+  X->do_readsome = xf_rxcall_do_readsome;
   X->do_write = xf_rxcall_do_write;
   X->do_close = xf_rxcall_do_close;
   X->is_writable = (flag != O_RDONLY);
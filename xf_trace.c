@@ -0,0 +1,294 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xf_trace.c - Recording timelines of nested spans
+ *
+ * An xftrace records spans of time, each with a category, a name, and
+ * up to XFTRACE_MAXARGS numeric arguments.  Spans nest; xftrace_begin
+ * starts one inside whatever span is open, xftrace_arg attaches an
+ * argument to the innermost open span, and xftrace_end closes it.
+ * All of these do nothing if given a null xftrace, so callers need not
+ * check whether tracing is enabled.
+ *
+ * Finished spans are kept in memory in binary form, and only formatted
+ * when XFTRACE_NEVENTS of them have been collected, or when the trace
+ * is closed.  The output is JSON in the Chrome trace event format, as
+ * read by chrome://tracing and Perfetto, with each span as a complete
+ * ("X") event.  Times are in microseconds since the trace was opened.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "xfiles.h"
+
+#define XFTRACE_NEVENTS  8192        /* events buffered before writing */
+#define XFTRACE_MAXDEPTH 32          /* deepest nesting recorded */
+#define XFTRACE_MAXARGS  3
+
+typedef struct {
+  char *cat, *name;                  /* must be static strings */
+  struct timespec start, end;
+  int nargs;
+  char *argname[XFTRACE_MAXARGS];
+  u_int64 argval[XFTRACE_MAXARGS];
+} trace_event;
+
+struct xftrace {
+  XFILE out;
+  struct timespec epoch;             /* when the trace was opened */
+  int pid;
+  int depth;                         /* spans open, including unrecorded */
+  trace_event stack[XFTRACE_MAXDEPTH];
+  trace_event *events;
+  int nevents;
+  afs_uint32 written;                /* events written so far */
+  afs_uint32 error;                  /* first error writing the trace */
+};
+
+
+/* Formatting events is most of the cost of tracing, so it is done by
+ * hand rather than with printf.  Each of these appends to a buffer and
+ * returns a pointer to the end of what it added.
+ */
+static char *put_str(char *p, char *s)
+{
+  while (*s) *p++ = *s++;
+  return p;
+}
+
+/* Put a number of at least width digits */
+static char *put_num(char *p, afs_uint32 value, int width)
+{
+  char digits[10];
+  int n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (width-- > n) *p++ = '0';
+  while (n) *p++ = digits[--n];
+  return p;
+}
+
+/* Put the time from t0 to t1, in microseconds with 3 decimal places */
+static char *put_usec(char *p, struct timespec *t0, struct timespec *t1)
+{
+  afs_uint32 sec = t1->tv_sec - t0->tv_sec;
+  long nsec = t1->tv_nsec - t0->tv_nsec;
+
+  if (nsec < 0) {
+    nsec += 1000000000;
+    sec--;
+  }
+  if (sec) {
+    p = put_num(p, sec, 0);
+    p = put_num(p, nsec / 1000, 6);
+  } else {
+    p = put_num(p, nsec / 1000, 0);
+  }
+  *p++ = '.';
+  return put_num(p, nsec % 1000, 3);
+}
+
+
+/* Write a string as a JSON string */
+static afs_uint32 put_string(XFILE *X, char *s)
+{
+  afs_uint32 r;
+  char *x;
+
+  if (r = xfwrite(X, "\"", 1)) return r;
+  for (x = s; *s; s++) {
+    if (*s != '"' && *s != '\\' && (unsigned char)*s >= ' ') continue;
+    if (s > x && (r = xfwrite(X, x, s - x))) return r;
+    if (*s == '"' || *s == '\\') r = xfprintf(X, "\\%c", *s);
+    else r = xfprintf(X, "\\u%04x", (unsigned char)*s);
+    if (r) return r;
+    x = s + 1;
+  }
+  if (s > x && (r = xfwrite(X, x, s - x))) return r;
+  return xfwrite(X, "\"", 1);
+}
+
+
+/* Format and write out buffered events */
+static void trace_flush(xftrace *T)
+{
+  trace_event *E;
+  char buf[512], num[21], *p;
+  afs_uint32 r = 0;
+  int i, j;
+
+  for (i = 0; i < T->nevents && !r; i++) {
+    E = T->events + i;
+    p = buf;
+    if (T->written++) p = put_str(p, ",\n");
+    p = put_str(p, "{\"name\":\"");
+    p = put_str(p, E->name);
+    p = put_str(p, "\",\"cat\":\"");
+    p = put_str(p, E->cat);
+    p = put_str(p, "\",\"ph\":\"X\",\"pid\":");
+    p = put_num(p, T->pid, 0);
+    p = put_str(p, ",\"tid\":1,\"ts\":");
+    p = put_usec(p, &T->epoch, &E->start);
+    p = put_str(p, ",\"dur\":");
+    p = put_usec(p, &E->start, &E->end);
+    for (j = 0; j < E->nargs; j++) {
+      p = put_str(p, j ? ",\"" : ",\"args\":{\"");
+      p = put_str(p, E->argname[j]);
+      p = put_str(p, "\":");
+      p = put_str(p, decimate_int64(&E->argval[j], num));
+    }
+    if (E->nargs) *p++ = '}';
+    *p++ = '}';
+    r = xfwrite(&T->out, buf, p - buf);
+  }
+  if (r && !T->error) T->error = r;
+  T->nevents = 0;
+}
+
+
+/* Open a trace to be written to the named XFILE.
+ * label, if not null, is shown as the name of the process.
+ */
+afs_uint32 xftrace_open(xftrace **TP, char *path, char *label)
+{
+  xftrace *T;
+  afs_uint32 r;
+
+  if (!(T = calloc(1, sizeof(xftrace)))) return ENOMEM;
+  if (!(T->events = malloc(XFTRACE_NEVENTS * sizeof(trace_event)))) {
+    free(T);
+    return ENOMEM;
+  }
+  if (r = xfopen(&T->out, O_RDWR|O_CREAT|O_TRUNC, path)) {
+    free(T->events);
+    free(T);
+    return r;
+  }
+  r = xfsetbuf(&T->out, XFBUFSIZE);
+  if (!r) r = xfprintf(&T->out, "{\"traceEvents\":[\n");
+  T->pid = getpid();
+  if (!r && label) {
+    r = xfprintf(&T->out, "{\"name\":\"process_name\",\"ph\":\"M\","
+                 "\"pid\":%d,\"args\":{\"name\":", T->pid);
+    if (!r) r = put_string(&T->out, label);
+    if (!r) r = xfprintf(&T->out, "}}");
+    T->written++;
+  }
+  if (r) {
+    xfclose(&T->out);
+    free(T->events);
+    free(T);
+    return r;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &T->epoch);
+  *TP = T;
+  return 0;
+}
+
+
+/* Start a span, nested inside any that is already open.  The category
+ * and name are kept by reference and written out as-is, so they should
+ * be string constants with nothing in them that needs quoting.
+ */
+void xftrace_begin(xftrace *T, char *cat, char *name)
+{
+  trace_event *E;
+
+  if (!T) return;
+  if (T->depth++ >= XFTRACE_MAXDEPTH) return;
+  E = T->stack + T->depth - 1;
+  E->cat   = cat;
+  E->name  = name;
+  E->nargs = 0;
+  clock_gettime(CLOCK_MONOTONIC, &E->start);
+}
+
+
+/* Attach an argument to the innermost open span */
+void xftrace_arg(xftrace *T, char *name, u_int64 *value)
+{
+  trace_event *E;
+
+  if (!T || !T->depth || T->depth > XFTRACE_MAXDEPTH) return;
+  E = T->stack + T->depth - 1;
+  if (E->nargs >= XFTRACE_MAXARGS) return;
+  E->argname[E->nargs] = name;
+  cp64(E->argval[E->nargs], *value);
+  E->nargs++;
+}
+
+void xftrace_arg32(xftrace *T, char *name, afs_uint32 value)
+{
+  u_int64 v;
+
+  mk64(v, 0, value);
+  xftrace_arg(T, name, &v);
+}
+
+
+/* End the innermost open span, and record it */
+void xftrace_end(xftrace *T)
+{
+  trace_event *E;
+
+  if (!T || !T->depth) return;
+  if (T->depth-- > XFTRACE_MAXDEPTH) return;
+  E = T->events + T->nevents;
+  *E = T->stack[T->depth];
+  clock_gettime(CLOCK_MONOTONIC, &E->end);
+  if (++T->nevents == XFTRACE_NEVENTS) trace_flush(T);
+}
+
+
+/* Close any open spans, write out the rest of the trace, and free it.
+ * Returns the first error that occurred while writing.
+ */
+afs_uint32 xftrace_close(xftrace *T)
+{
+  afs_uint32 r;
+
+  if (!T) return 0;
+  while (T->depth) xftrace_end(T);
+  trace_flush(T);
+  r = T->error;
+  if (!r) r = xfprintf(&T->out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  if (!r) r = xfclose(&T->out);
+  else xfclose(&T->out);
+  free(T->events);
+  free(T);
+  return r;
+}
@@ -72,6 +72,14 @@ static afs_uint32 xf_voldump_do_read(XFILE *X, void *buf, afs_uint32 count)
 }
 
 
+static afs_uint32 xf_voldump_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                         afs_uint32 *nread)
+{
+  struct vdinfo *i = X->refcon;
+  return xfreadsome(&(i->rx), buf, count, nread);
+}
+
+
 static afs_uint32 xf_voldump_do_write(XFILE *X, void *buf, afs_uint32 count)
 {
   struct vdinfo *i = X->refcon;
@@ -120,6 +128,7 @@ afs_uint32 xfopen_voldump(XFILE *X, struct rx_connection *conn,
   }
 
   X->do_read     = xf_voldump_do_read;
+  X->do_readsome = xf_voldump_do_readsome;
   X->do_write    = xf_voldump_do_write;
   X->do_close    = xf_voldump_do_close;
   X->is_writable = i->rx.is_writable;
@@ -0,0 +1,808 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xf_zstdseek.c - XFILE routines for seekable zstd files
+ *
+ * A seekable zstd file is a series of independently compressed zstd
+ * frames, followed by a seek table giving the compressed and
+ * uncompressed size of each frame.  This is the seekable format from
+ * the zstd distribution (contrib/seekable_format); other zstd tools
+ * decompress such files normally, since the seek table is stored in
+ * a skippable frame.  The file ends with:
+ *
+ *   skippable frame header  magic 0x184D2A5E (LE32), size (LE32)
+ *   for each frame          compressed size (LE32),
+ *                           decompressed size (LE32),
+ *                           [checksum (LE32)]
+ *   footer                  number of frames (LE32),
+ *                           descriptor (8 bits; 0x80 = checksums),
+ *                           magic 0x8F92EAB1 (LE32)
+ *
+ * Seeks and skips go directly to the frame containing the new position,
+ * without decompressing anything before it.  When reading sequentially,
+ * the frames after the current one are handed to a pool of worker
+ * threads, so decompression proceeds in parallel with parsing.
+ * Recently used frames are cached, up to about ZS_CACHE_SIZE bytes.
+ *
+ * Opened for writing, a seekable zstd XFILE compresses its data in
+ * frames of ZS_FRAME_SIZE bytes, which are handed to the worker threads
+ * and written out in order as they finish; the seek table is written
+ * when the XFILE is closed.  Compressing each frame independently
+ * costs a little in compression ratio, but lets the result be read
+ * back with random access, and lets any number of threads work on it.
+ *
+ * Either way, I/O on the underlying XFILE is always done by the
+ * calling thread.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zstd.h>
+
+#include "xfiles.h"
+#include "xf_errs.h"
+
+#define O_MODE_MASK (O_RDONLY | O_WRONLY | O_RDWR)
+
+#define ZS_SKIPPABLE_MAGIC  0x184D2A5E
+#define ZS_SEEKABLE_MAGIC   0x8F92EAB1
+#define ZS_FOOTER_SIZE      9
+#define ZS_MAX_FRAME        (256 * 1024 * 1024)
+#define ZS_FRAME_SIZE       (1024 * 1024)
+#define ZS_CACHE_SIZE       (16 * 1024 * 1024)
+#define ZS_MAX_SLOTS        1024
+#define ZS_DEFAULT_THREADS  4
+#define ZS_MAX_THREADS      64
+
+#define get_le32(p) (((afs_uint32)(p)[0])       | ((afs_uint32)(p)[1] << 8) \
+                  | ((afs_uint32)(p)[2] << 16) | ((afs_uint32)(p)[3] << 24))
+#define put_le32(p, x) ((p)[0] = (x) & 0xff,         (p)[1] = ((x) >> 8) & 0xff, \
+                        (p)[2] = ((x) >> 16) & 0xff, (p)[3] = ((x) >> 24) & 0xff)
+
+struct zsframe {
+  u_int64 coff;                /* offset of compressed frame */
+  u_int64 uoff;                /* offset of its uncompressed data */
+  afs_uint32 csize, usize;
+};
+
+/* Slot states */
+#define ZS_EMPTY   0
+#define ZS_QUEUED  1           /* waiting for a worker */
+#define ZS_BUSY    2           /* being (de)compressed */
+#define ZS_DONE    3           /* ubuf (cbuf, if writing) is valid,
+                                  or code is set */
+#define ZS_FILL    4           /* being filled by xfwrite */
+
+struct zsslot {
+  int frame, state;
+  afs_uint32 code;
+  unsigned long used;          /* for LRU replacement */
+  unsigned char *cbuf;
+  char *ubuf;
+  afs_uint32 cbufsize, ubufsize;
+  afs_uint32 clen, ulen;       /* data in each buffer, if writing */
+};
+
+typedef struct {
+  XFILE *content;
+  int free_content;
+  int writing;
+  struct zsframe *frames;
+  int nframes, maxframes;
+  u_int64 usize;               /* total uncompressed size */
+  u_int64 pos;                 /* current uncompressed position */
+  int last;                    /* last frame read from */
+
+  struct zsslot *slots;
+  int nslots;
+  struct zsslot *cur;          /* slot most recently read from */
+  unsigned long tick;
+  ZSTD_DCtx *dctx;             /* for decompressing in this thread */
+
+  /* For writing; frames are numbered in the order they are filled */
+  int level;
+  int nsubmitted;              /* frames handed off for compression */
+  struct zsslot *fill;         /* slot being filled */
+  ZSTD_CCtx *cctx;             /* for compressing in this thread */
+
+  int nthreads;
+  pthread_t *threads;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cv;
+} ZSFILE;
+
+
+/* Decompress the frame in slot S */
+static afs_uint32 zs_decompress(ZSFILE *ZS, ZSTD_DCtx *dctx, struct zsslot *S)
+{
+  struct zsframe *F = &ZS->frames[S->frame];
+  size_t r;
+
+  if (!dctx) return ENOMEM;
+  r = ZSTD_decompressDCtx(dctx, S->ubuf, F->usize, S->cbuf, F->csize);
+  if (ZSTD_isError(r) || r != F->usize) return ERROR_XFILE_BADDATA;
+  return 0;
+}
+
+
+/* Compress the data in slot S */
+static afs_uint32 zs_compress(ZSFILE *ZS, ZSTD_CCtx *cctx, struct zsslot *S)
+{
+  size_t r;
+
+  if (!cctx) return ENOMEM;
+  r = ZSTD_compressCCtx(cctx, S->cbuf, S->cbufsize, S->ubuf, S->ulen,
+                        ZS->level);
+  if (ZSTD_isError(r)) return EIO;
+  S->clen = r;
+  return 0;
+}
+
+
+/* A worker thread, compressing or decompressing frames */
+static void *zs_worker(void *arg)
+{
+  ZSFILE *ZS = arg;
+  ZSTD_DCtx *dctx = 0;
+  ZSTD_CCtx *cctx = 0;
+  struct zsslot *S;
+  afs_uint32 code;
+  int i;
+
+  if (ZS->writing) cctx = ZSTD_createCCtx();
+  else             dctx = ZSTD_createDCtx();
+  pthread_mutex_lock(&ZS->lock);
+  for (;;) {
+    for (S = 0, i = 0; i < ZS->nslots; i++)
+      if (ZS->slots[i].state == ZS_QUEUED) {
+        S = &ZS->slots[i];
+        break;
+      }
+    if (!S) {
+      if (ZS->stop) break;
+      pthread_cond_wait(&ZS->cv, &ZS->lock);
+      continue;
+    }
+    S->state = ZS_BUSY;
+    pthread_mutex_unlock(&ZS->lock);
+    if (ZS->writing) code = zs_compress(ZS, cctx, S);
+    else             code = zs_decompress(ZS, dctx, S);
+    pthread_mutex_lock(&ZS->lock);
+    S->code = code;
+    S->state = ZS_DONE;
+    pthread_cond_broadcast(&ZS->cv);
+  }
+  pthread_mutex_unlock(&ZS->lock);
+  if (dctx) ZSTD_freeDCtx(dctx);
+  if (cctx) ZSTD_freeCCtx(cctx);
+  return 0;
+}
+
+
+/* Find the slot holding (or waiting for) a frame */
+static struct zsslot *zs_lookup(ZSFILE *ZS, int frame)
+{
+  struct zsslot *S = 0;
+  int i;
+
+  pthread_mutex_lock(&ZS->lock);
+  for (i = 0; i < ZS->nslots; i++)
+    if (ZS->slots[i].state != ZS_EMPTY && ZS->slots[i].frame == frame) {
+      S = &ZS->slots[i];
+      break;
+    }
+  pthread_mutex_unlock(&ZS->lock);
+  return S;
+}
+
+
+/* Read a frame into the least recently used idle slot, and either
+ * queue it for a worker or decompress it here.  Slot keep is not
+ * reused.  Returns an error only for I/O failures; decompression
+ * errors are left in the slot.
+ */
+static afs_uint32 zs_load(ZSFILE *ZS, int frame, struct zsslot *keep,
+                          struct zsslot **sp)
+{
+  struct zsframe *F = &ZS->frames[frame];
+  struct zsslot *S = 0;
+  afs_uint32 code;
+  int i;
+
+  pthread_mutex_lock(&ZS->lock);
+  for (i = 0; i < ZS->nslots; i++) {
+    if (&ZS->slots[i] == keep) continue;
+    if (ZS->slots[i].state == ZS_QUEUED || ZS->slots[i].state == ZS_BUSY)
+      continue;
+    if (!S || ZS->slots[i].used < S->used) S = &ZS->slots[i];
+  }
+  if (S) S->state = ZS_EMPTY;
+  pthread_mutex_unlock(&ZS->lock);
+  if (!S) {
+    *sp = 0;
+    return 0;
+  }
+
+  if (S->cbufsize < F->csize) {
+    free(S->cbuf);
+    S->cbufsize = 0;
+    if (!(S->cbuf = malloc(F->csize))) return ENOMEM;
+    S->cbufsize = F->csize;
+  }
+  if (S->ubufsize < F->usize) {
+    free(S->ubuf);
+    S->ubufsize = 0;
+    if (!(S->ubuf = malloc(F->usize))) return ENOMEM;
+    S->ubufsize = F->usize;
+  }
+  if ((code = xfseek(ZS->content, &F->coff))
+  ||  (code = xfread(ZS->content, S->cbuf, F->csize)))
+    return code;
+
+  S->frame = frame;
+  S->used = ++ZS->tick;
+  if (ZS->nthreads) {
+    pthread_mutex_lock(&ZS->lock);
+    S->state = ZS_QUEUED;
+    pthread_cond_broadcast(&ZS->cv);
+    pthread_mutex_unlock(&ZS->lock);
+  } else {
+    S->code = zs_decompress(ZS, ZS->dctx, S);
+    S->state = ZS_DONE;
+  }
+  *sp = S;
+  return 0;
+}
+
+
+/* Get a decompressed frame, starting work on the ones after it if
+ * we seem to be reading sequentially.
+ */
+static afs_uint32 zs_get(ZSFILE *ZS, int frame, struct zsslot **sp)
+{
+  struct zsslot *S, *P;
+  afs_uint32 code;
+  int i, sequential, done;
+
+  sequential = (frame == ZS->last + 1);
+  ZS->last = frame;
+
+  if (ZS->cur && ZS->cur->frame == frame) {
+    pthread_mutex_lock(&ZS->lock);
+    done = (ZS->cur->state == ZS_DONE);
+    pthread_mutex_unlock(&ZS->lock);
+    if (done) {
+      *sp = ZS->cur;
+      return 0;
+    }
+  }
+  if (!(S = zs_lookup(ZS, frame))) {
+    if (code = zs_load(ZS, frame, 0, &S)) return code;
+    if (!S) return ENOMEM;      /* can't happen; nslots > 0 */
+  }
+  S->used = ++ZS->tick;
+
+  if (ZS->nthreads && sequential) {
+    for (i = frame + 1; i < ZS->nframes && i <= frame + ZS->nthreads; i++) {
+      if (zs_lookup(ZS, i)) continue;
+      if (code = zs_load(ZS, i, S, &P)) return code;
+      if (!P) break;
+    }
+  }
+
+  pthread_mutex_lock(&ZS->lock);
+  while (S->state != ZS_DONE)
+    pthread_cond_wait(&ZS->cv, &ZS->lock);
+  pthread_mutex_unlock(&ZS->lock);
+  if (S->code) {
+    code = S->code;
+    S->state = ZS_EMPTY;
+    return code;
+  }
+  *sp = ZS->cur = S;
+  return 0;
+}
+
+
+/* Find the frame containing the current position */
+static int zs_find(ZSFILE *ZS)
+{
+  int lo = 0, hi = ZS->nframes - 1, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (le64(ZS->frames[mid].uoff, ZS->pos)) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
+
+
+/* do_readsome for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_readsome(XFILE *X, void *buf, afs_uint32 count,
+                                    afs_uint32 *nread)
+{
+  ZSFILE *ZS = X->refcon;
+  struct zsframe *F;
+  struct zsslot *S;
+  afs_uint32 code, off, n;
+  u_int64 tmp64;
+  int frame;
+
+  *nread = 0;
+  if (!count) return 0;
+  if (ge64(ZS->pos, ZS->usize)) return ERROR_XFILE_EOF;
+
+  frame = zs_find(ZS);
+  if (code = zs_get(ZS, frame, &S)) return code;
+  F = &ZS->frames[frame];
+  sub64_64(tmp64, ZS->pos, F->uoff);
+  off = lo64(tmp64);
+  n = F->usize - off;
+  if (n > count) n = count;
+  memcpy(buf, S->ubuf + off, n);
+  add64_32(tmp64, ZS->pos, n);
+  cp64(ZS->pos, tmp64);
+  *nread = n;
+  return 0;
+}
+
+
+/* do_read for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_read(XFILE *X, void *buf, afs_uint32 count)
+{
+  afs_uint32 n, code;
+  char *p = buf;
+
+  while (count) {
+    if (code = xf_ZS_do_readsome(X, p, count, &n)) return code;
+    p += n;
+    count -= n;
+  }
+  return 0;
+}
+
+
+/* do_seek for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_seek(XFILE *X, u_int64 *offset)
+{
+  ZSFILE *ZS = X->refcon;
+
+  cp64(ZS->pos, *offset);
+  return 0;
+}
+
+
+/* do_skip for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_skip(XFILE *X, u_int64 *count)
+{
+  ZSFILE *ZS = X->refcon;
+  u_int64 tmp64;
+
+  add64_64(tmp64, ZS->pos, *count);
+  cp64(ZS->pos, tmp64);
+  return 0;
+}
+
+
+/* do_size for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_size(XFILE *X, u_int64 *size)
+{
+  ZSFILE *ZS = X->refcon;
+
+  cp64(*size, ZS->usize);
+  return 0;
+}
+
+
+/* Write out compressed frames, in order, as they finish.  If wait
+ * is set, wait for the next one to finish if it hasn't already.
+ */
+static afs_uint32 zs_put(ZSFILE *ZS, int wait)
+{
+  struct zsframe *F;
+  struct zsslot *S;
+  afs_uint32 code;
+  int done;
+
+  while (ZS->nframes < ZS->nsubmitted) {
+    if (!(S = zs_lookup(ZS, ZS->nframes))) return EIO;  /* can't happen */
+    pthread_mutex_lock(&ZS->lock);
+    while (wait && S->state != ZS_DONE)
+      pthread_cond_wait(&ZS->cv, &ZS->lock);
+    done = (S->state == ZS_DONE);
+    pthread_mutex_unlock(&ZS->lock);
+    if (!done) return 0;
+    wait = 0;
+    if (S->code) return S->code;
+
+    if (ZS->nframes == ZS->maxframes) {
+      ZS->maxframes = ZS->maxframes ? 2 * ZS->maxframes : 1024;
+      F = realloc(ZS->frames, ZS->maxframes * sizeof(*F));
+      if (!F) return ENOMEM;
+      ZS->frames = F;
+    }
+    if (code = xfwrite(ZS->content, S->cbuf, S->clen)) return code;
+    F = &ZS->frames[ZS->nframes++];
+    F->csize = S->clen;
+    F->usize = S->ulen;
+
+    pthread_mutex_lock(&ZS->lock);
+    S->state = ZS_EMPTY;
+    pthread_mutex_unlock(&ZS->lock);
+  }
+  return 0;
+}
+
+
+/* Hand off the frame being filled for compression */
+static afs_uint32 zs_submit(ZSFILE *ZS)
+{
+  struct zsslot *S = ZS->fill;
+
+  ZS->fill = 0;
+  pthread_mutex_lock(&ZS->lock);
+  S->frame = ZS->nsubmitted++;
+  if (ZS->nthreads) {
+    S->state = ZS_QUEUED;
+    pthread_cond_broadcast(&ZS->cv);
+  }
+  pthread_mutex_unlock(&ZS->lock);
+  if (!ZS->nthreads) {
+    S->code = zs_compress(ZS, ZS->cctx, S);
+    S->state = ZS_DONE;
+  }
+  return zs_put(ZS, 0);
+}
+
+
+/* Get an empty slot to fill, writing out finished frames if needed */
+static afs_uint32 zs_newframe(ZSFILE *ZS)
+{
+  struct zsslot *S;
+  afs_uint32 code;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&ZS->lock);
+    for (S = 0, i = 0; i < ZS->nslots; i++)
+      if (ZS->slots[i].state == ZS_EMPTY) {
+        S = &ZS->slots[i];
+        S->state = ZS_FILL;
+        S->frame = -1;
+        break;
+      }
+    pthread_mutex_unlock(&ZS->lock);
+    if (S) break;
+    if (code = zs_put(ZS, 1)) return code;
+  }
+
+  if (!S->ubuf) {
+    if (!(S->ubuf = malloc(ZS_FRAME_SIZE))) return ENOMEM;
+    S->ubufsize = ZS_FRAME_SIZE;
+  }
+  if (!S->cbuf) {
+    S->cbufsize = ZSTD_compressBound(ZS_FRAME_SIZE);
+    if (!(S->cbuf = malloc(S->cbufsize))) return ENOMEM;
+  }
+  S->ulen = 0;
+  ZS->fill = S;
+  return 0;
+}
+
+
+/* do_write for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_write(XFILE *X, void *buf, afs_uint32 count)
+{
+  ZSFILE *ZS = X->refcon;
+  struct zsslot *S;
+  afs_uint32 code, n;
+  char *p = buf;
+
+  while (count) {
+    if (!ZS->fill && (code = zs_newframe(ZS))) return code;
+    S = ZS->fill;
+    n = S->ubufsize - S->ulen;
+    if (n > count) n = count;
+    memcpy(S->ubuf + S->ulen, p, n);
+    S->ulen += n;
+    p += n;
+    count -= n;
+    if (S->ulen == S->ubufsize && (code = zs_submit(ZS))) return code;
+  }
+  return 0;
+}
+
+
+/* Write out the last frame and the seek table */
+static afs_uint32 zs_finish(ZSFILE *ZS)
+{
+  unsigned char *table, *e;
+  afs_uint32 code, tsize;
+  int i;
+
+  if (ZS->fill && ZS->fill->ulen && (code = zs_submit(ZS))) return code;
+  while (ZS->nframes < ZS->nsubmitted)
+    if (code = zs_put(ZS, 1)) return code;
+
+  tsize = 8 + ZS->nframes * 8 + ZS_FOOTER_SIZE;
+  if (!(table = malloc(tsize))) return ENOMEM;
+  put_le32(table, ZS_SKIPPABLE_MAGIC);
+  put_le32(table + 4, tsize - 8);
+  for (i = 0, e = table + 8; i < ZS->nframes; i++, e += 8) {
+    put_le32(e, ZS->frames[i].csize);
+    put_le32(e + 4, ZS->frames[i].usize);
+  }
+  put_le32(e, ZS->nframes);
+  e[4] = 0;
+  put_le32(e + 5, ZS_SEEKABLE_MAGIC);
+  code = xfwrite(ZS->content, table, tsize);
+  free(table);
+  return code;
+}
+
+
+/* Free everything; used by close and by failed opens */
+static void zs_free(ZSFILE *ZS)
+{
+  int i;
+
+  if (ZS->threads) {
+    pthread_mutex_lock(&ZS->lock);
+    ZS->stop = 1;
+    pthread_cond_broadcast(&ZS->cv);
+    pthread_mutex_unlock(&ZS->lock);
+    for (i = 0; i < ZS->nthreads; i++)
+      pthread_join(ZS->threads[i], 0);
+    free(ZS->threads);
+  }
+  pthread_cond_destroy(&ZS->cv);
+  pthread_mutex_destroy(&ZS->lock);
+  if (ZS->slots) {
+    for (i = 0; i < ZS->nslots; i++) {
+      if (ZS->slots[i].cbuf) free(ZS->slots[i].cbuf);
+      if (ZS->slots[i].ubuf) free(ZS->slots[i].ubuf);
+    }
+    free(ZS->slots);
+  }
+  if (ZS->frames) free(ZS->frames);
+  if (ZS->dctx) ZSTD_freeDCtx(ZS->dctx);
+  if (ZS->cctx) ZSTD_freeCCtx(ZS->cctx);
+  free(ZS);
+}
+
+
+/* do_close for seekable zstd xfiles */
+static afs_uint32 xf_ZS_do_close(XFILE *X)
+{
+  ZSFILE *ZS = X->refcon;
+  afs_uint32 err, code = 0;
+
+  if (ZS->writing) code = zs_finish(ZS);
+  err = xfclose(ZS->content);
+  if (code) err = code;
+  if (ZS->free_content) free(ZS->content);
+  zs_free(ZS);
+  return err;
+}
+
+
+/* Read the seek table from the end of content.  Returns
+ * ERROR_XFILE_NOINDEX if there isn't one.
+ */
+static afs_uint32 zs_read_index(ZSFILE *ZS)
+{
+  unsigned char footer[ZS_FOOTER_SIZE], *table, *e;
+  afs_uint32 code, nframes, esize, tsize;
+  u_int64 start, size, where, coff, uoff, tmp64;
+  int i;
+
+  if ((code = xftell(ZS->content, &start))
+  ||  (code = xfsize(ZS->content, &size)))
+    return code;
+  sub64_64(tmp64, size, start);
+  if (hi64(tmp64) == 0 && lo64(tmp64) < ZS_FOOTER_SIZE + 8)
+    return ERROR_XFILE_NOINDEX;
+
+  sub64_32(where, size, ZS_FOOTER_SIZE);
+  if ((code = xfseek(ZS->content, &where))
+  ||  (code = xfread(ZS->content, footer, ZS_FOOTER_SIZE)))
+    return code;
+  if (get_le32(footer + 5) != ZS_SEEKABLE_MAGIC) return ERROR_XFILE_NOINDEX;
+  if (footer[4] & 0x7c) return ERROR_XFILE_BADDATA;   /* reserved bits */
+
+  nframes = get_le32(footer);
+  esize = (footer[4] & 0x80) ? 12 : 8;
+  if (nframes > (ZS_MAX_FRAME - 8 - ZS_FOOTER_SIZE) / esize)
+    return ERROR_XFILE_BADDATA;
+  tsize = 8 + nframes * esize + ZS_FOOTER_SIZE;
+  sub64_64(tmp64, size, start);
+  if (hi64(tmp64) == 0 && lo64(tmp64) < tsize) return ERROR_XFILE_BADDATA;
+
+  if (!(table = malloc(tsize))) return ENOMEM;
+  sub64_32(where, size, tsize);
+  if ((code = xfseek(ZS->content, &where))
+  ||  (code = xfread(ZS->content, table, tsize - ZS_FOOTER_SIZE))) {
+    free(table);
+    return code;
+  }
+  if (get_le32(table) != ZS_SKIPPABLE_MAGIC
+  ||  get_le32(table + 4) != tsize - 8) {
+    free(table);
+    return ERROR_XFILE_BADDATA;
+  }
+
+  ZS->nframes = nframes;
+  if (!(ZS->frames = malloc((nframes ? nframes : 1) * sizeof(*ZS->frames)))) {
+    free(table);
+    return ENOMEM;
+  }
+  cp64(coff, start);
+  mk64(uoff, 0, 0);
+  for (i = 0, e = table + 8; i < nframes; i++, e += esize) {
+    cp64(ZS->frames[i].coff, coff);
+    cp64(ZS->frames[i].uoff, uoff);
+    ZS->frames[i].csize = get_le32(e);
+    ZS->frames[i].usize = get_le32(e + 4);
+    if (ZS->frames[i].usize > ZS_MAX_FRAME
+    ||  ZS->frames[i].csize > ZS_MAX_FRAME) {
+      free(table);
+      return ERROR_XFILE_BADDATA;
+    }
+    add64_32(tmp64, coff, ZS->frames[i].csize);
+    cp64(coff, tmp64);
+    add64_32(tmp64, uoff, ZS->frames[i].usize);
+    cp64(uoff, tmp64);
+  }
+  free(table);
+
+  /* The frames must exactly fill the space before the seek table */
+  if (ne64(coff, where)) return ERROR_XFILE_BADDATA;
+  cp64(ZS->usize, uoff);
+  return 0;
+}
+
+
+/* Open a seekable zstd XFILE.  When writing, level is the zstd
+ * compression level (0 for zstd's default); nthreads < 0 selects
+ * the default number of worker threads.
+ */
+afs_uint32 xf_ZSEEK_do_open(XFILE *X, int flag, XFILE *content,
+                            int free_content, int level, int nthreads)
+{
+  ZSFILE *ZS;
+  afs_uint32 code;
+  afs_uint32 maxsize;
+  u_int64 where;
+  long ncpu;
+  int i, writing;
+
+  writing = ((flag & O_MODE_MASK) != O_RDONLY);
+  if (writing) {
+    if (!content->is_writable) return ERROR_XFILE_RDONLY;
+  } else {
+    if (!content->is_seekable) return ERROR_XFILE_NOSEEK;
+    if (code = xftell(content, &where)) return code;
+  }
+
+  ZS = malloc(sizeof(*ZS));
+  if (!ZS) return ENOMEM;
+  memset(ZS, 0, sizeof(*ZS));
+  ZS->content = content;
+  ZS->free_content = free_content;
+  ZS->writing = writing;
+  ZS->level = level;
+  ZS->last = -2;
+  pthread_mutex_init(&ZS->lock, 0);
+  pthread_cond_init(&ZS->cv, 0);
+
+  if (!writing && (code = zs_read_index(ZS))) {
+    /* Put things back the way we found them */
+    xfseek(content, &where);
+    zs_free(ZS);
+    return code;
+  }
+
+  if (nthreads < 0) {
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpu > ZS_DEFAULT_THREADS) ? ZS_DEFAULT_THREADS : ncpu;
+    if (nthreads < 2) nthreads = 0;
+  }
+  if (nthreads > ZS_MAX_THREADS) nthreads = ZS_MAX_THREADS;
+
+  if (writing) {
+    /* One frame being filled, and up to two per thread in progress */
+    ZS->nslots = 2 * nthreads + 1;
+    ZS->cctx = ZSTD_createCCtx();
+  } else {
+    /* Enough slots to cache ZS_CACHE_SIZE bytes, plus one for each
+     * frame being decompressed ahead of the current one.
+     */
+    for (maxsize = 1, i = 0; i < ZS->nframes; i++)
+      if (ZS->frames[i].usize > maxsize) maxsize = ZS->frames[i].usize;
+    ZS->nslots = ZS_CACHE_SIZE / maxsize;
+    if (ZS->nslots > ZS->nframes) ZS->nslots = ZS->nframes;
+    if (ZS->nslots > ZS_MAX_SLOTS) ZS->nslots = ZS_MAX_SLOTS;
+    if (ZS->nslots < 2) ZS->nslots = 2;
+    ZS->nslots += nthreads;
+    ZS->dctx = ZSTD_createDCtx();
+  }
+
+  if ((writing ? !ZS->cctx : !ZS->dctx)
+  ||  !(ZS->slots = malloc(ZS->nslots * sizeof(*ZS->slots)))) {
+    zs_free(ZS);
+    return ENOMEM;
+  }
+  memset(ZS->slots, 0, ZS->nslots * sizeof(*ZS->slots));
+
+  if (nthreads) {
+    if (!(ZS->threads = malloc(nthreads * sizeof(pthread_t)))) {
+      zs_free(ZS);
+      return ENOMEM;
+    }
+    for (i = 0; i < nthreads; i++) {
+      if (pthread_create(&ZS->threads[i], 0, zs_worker, ZS)) break;
+      ZS->nthreads++;
+    }
+  }
+
+  memset(X, 0, sizeof(*X));
+  X->refcon = ZS;
+  X->do_close = xf_ZS_do_close;
+  if (writing) {
+    X->do_write = xf_ZS_do_write;
+    X->is_writable = 1;
+  } else {
+    X->do_read  = xf_ZS_do_read;
+    X->do_readsome = xf_ZS_do_readsome;
+    X->do_seek  = xf_ZS_do_seek;
+    X->do_skip  = xf_ZS_do_skip;
+    X->do_size  = xf_ZS_do_size;
+    X->is_seekable = 1;
+  }
+  return 0;
+}
+
+
+/* Wrap an already-open XFILE.  Closing X also closes cX, but does not
+ * free it.  If reading, cX must be seekable; ERROR_XFILE_NOINDEX is
+ * returned, leaving cX where it was, if it does not contain a seek
+ * table.  If writing, data is compressed at the given level.
+ */
+afs_uint32 xfopen_zstdseek(XFILE *X, int flag, XFILE *cX, int level,
+                           int nthreads)
+{
+  return xf_ZSEEK_do_open(X, flag, cX, 0, level, nthreads);
+}
@@ -30,11 +30,75 @@
 #include <sys/types.h>
 #include <string.h>
 #include <errno.h>
+#include <stdlib.h>
 
 #include "xfiles.h"
 #include "xf_errs.h"
 
 #define SKIP_SIZE 65536
+#define PASS_SIZE (256 * 1024)
+
+
+/* Count a call, and the bytes it moved, in an xfstats */
+static void count_io(afs_uint32 *calls, u_int64 *bytes, afs_uint32 count)
+{
+  u_int64 tmp64;
+
+  (*calls)++;
+  add64_32(tmp64, *bytes, count);
+  cp64(*bytes, tmp64);
+}
+
+
+/* Start a span for an operation at offset on X, which is being traced */
+static void trace_op(XFILE *X, char *name, u_int64 *offset)
+{
+  xftrace_begin(X->trace, "io", name);
+  xftrace_arg(X->trace, "offset", offset);
+}
+
+/* End the span for an operation which moved size bytes */
+static void trace_done(XFILE *X, afs_uint32 size)
+{
+  xftrace_arg32(X->trace, "size", size);
+  xftrace_end(X->trace);
+}
+
+
+/* Write out data buffered by xfwrite */
+static afs_uint32 flush_wbuf(XFILE *X)
+{
+  afs_uint32 code;
+  u_int64 tmp64;
+
+  if (X->trace) {
+    sub64_32(tmp64, X->filepos, X->wlen);
+    trace_op(X, "write", &tmp64);
+  }
+  code = (X->do_write)(X, X->wbuf, X->wlen);
+  if (X->trace) trace_done(X, X->wlen);
+  X->wlen = 0;
+  return code;
+}
+
+
+/* Hand data read from X to its passthru.  Small pieces are collected in
+ * X's pass buffer and written out in large chunks; anything bigger than
+ * the buffer goes straight through.
+ */
+static afs_uint32 pass_data(XFILE *X, void *buf, afs_uint32 count)
+{
+  afs_uint32 code;
+
+  if (!X->passbuf) return xfwrite(X->passthru, buf, count);
+  if (X->passlen + count > PASS_SIZE) {
+    if (code = xfflush(X)) return code;
+    if (count >= PASS_SIZE) return xfwrite(X->passthru, buf, count);
+  }
+  memcpy(X->passbuf + X->passlen, buf, count);
+  X->passlen += count;
+  return 0;
+}
 
 
 afs_uint32 xfread(XFILE *X, void *buf, afs_uint32 count)
@@ -42,12 +106,47 @@ afs_uint32 xfread(XFILE *X, void *buf, afs_uint32 count)
   afs_uint32 code;
   u_int64 tmp64;
 
+  if (X->wlen && (code = flush_wbuf(X))) return code;
+  if (X->trace) trace_op(X, "read", &X->filepos);
   code = (X->do_read)(X, buf, count);
+  if (X->trace) trace_done(X, count);
   if (code) return code;
 
   add64_32(tmp64, X->filepos, count);
   cp64(X->filepos, tmp64);
-  if (X->passthru) return xfwrite(X->passthru, buf, count);
+  if (X->stats) count_io(&X->stats->n_read, &X->stats->bytes_read, count);
+  if (X->passthru) return pass_data(X, buf, count);
+  return 0;
+}
+
+
+/* Read up to count bytes, returning as soon as some data is available.
+ * The number of bytes actually read is stored in *nread; EOF is reported
+ * only if there was no data at all.  XFILE types which can't do short
+ * reads fall back on xfread, which reads exactly count bytes or fails.
+ */
+afs_uint32 xfreadsome(XFILE *X, void *buf, afs_uint32 count, afs_uint32 *nread)
+{
+  afs_uint32 code;
+  u_int64 tmp64;
+
+  *nread = 0;
+  if (X->wlen && (code = flush_wbuf(X))) return code;
+  if (!X->do_readsome) {
+    if (code = xfread(X, buf, count)) return code;
+    *nread = count;
+    return 0;
+  }
+
+  if (X->trace) trace_op(X, "readsome", &X->filepos);
+  code = (X->do_readsome)(X, buf, count, nread);
+  if (X->trace) trace_done(X, *nread);
+  if (code) return code;
+
+  add64_32(tmp64, X->filepos, *nread);
+  cp64(X->filepos, tmp64);
+  if (X->stats) count_io(&X->stats->n_read, &X->stats->bytes_read, *nread);
+  if (X->passthru) return pass_data(X, buf, *nread);
   return 0;
 }
 
@@ -58,44 +157,112 @@ afs_uint32 xfwrite(XFILE *X, void *buf, afs_uint32 count)
   u_int64 tmp64;
 
   if (!X->is_writable) return ERROR_XFILE_RDONLY;
-  code = (X->do_write)(X, buf, count);
-  if (code) return code;
+  if (X->wbuf && count < X->wsize) {
+    if (X->wlen + count > X->wsize && (code = flush_wbuf(X))) return code;
+    memcpy(X->wbuf + X->wlen, buf, count);
+    X->wlen += count;
+  } else {
+    /* Large writes go straight through, after anything already buffered */
+    if (X->wlen && (code = flush_wbuf(X))) return code;
+    if (X->trace) trace_op(X, "write", &X->filepos);
+    code = (X->do_write)(X, buf, count);
+    if (X->trace) trace_done(X, count);
+    if (code) return code;
+  }
 
   add64_32(tmp64, X->filepos, count);
   cp64(X->filepos, tmp64);
+  if (X->stats) count_io(&X->stats->n_write, &X->stats->bytes_written, count);
   return 0;
 }
 
 
 afs_uint32 xftell(XFILE *X, u_int64 *offset)
 {
+  afs_uint32 code;
+
+  if (X->stats) X->stats->n_tell++;
+  if (X->wlen && X->do_tell && (code = flush_wbuf(X))) return code;
   if (X->do_tell) return (X->do_tell)(X, offset);
   cp64(*offset, X->filepos);
   return 0;
 }
 
 
+/* Get the total size of X, for types which know it */
+afs_uint32 xfsize(XFILE *X, u_int64 *size)
+{
+  afs_uint32 code;
+
+  if (!X->do_size) return ERROR_XFILE_NOSEEK;
+  if (code = xfflush(X)) return code;
+  return (X->do_size)(X, size);
+}
+
+
 afs_uint32 xfseek(XFILE *X, u_int64 *offset)
 {
   afs_uint32 code;
 
   if (!X->do_seek) return ERROR_XFILE_NOSEEK;
+  if (X->stats) X->stats->n_seek++;
+  if (code = xfflush(X)) return code;
+  if (X->trace) trace_op(X, "seek", offset);
   code = (X->do_seek)(X, offset);
+  if (X->trace) xftrace_end(X->trace);
   if (code) return code;
   cp64(X->filepos, *offset);
   return 0;
 }
 
 
+/* Skip data by having the kernel move it to the passthru, or discard
+ * it, without copying it through our buffers.  Only some XFILE types
+ * can do this.  On return, *left holds the number of bytes which still
+ * need to be skipped the ordinary way.
+ */
+static afs_uint32 splice_skip(XFILE *X, u_int64 *left)
+{
+  afs_uint32 code;
+  u_int64 moved, tmp64;
+
+  if (code = xfflush(X)) return code;
+  if (X->passthru && (code = xfflush(X->passthru))) return code;
+
+  cp64(moved, *left);
+  if (X->trace) trace_op(X, "splice", &X->filepos);
+  code = (X->do_splice)(X, X->passthru, &moved);
+  if (X->trace) {
+    xftrace_arg(X->trace, "size", &moved);
+    xftrace_end(X->trace);
+  }
+
+  add64_64(tmp64, X->filepos, moved);
+  cp64(X->filepos, tmp64);
+  if (X->passthru) {
+    add64_64(tmp64, X->passthru->filepos, moved);
+    cp64(X->passthru->filepos, tmp64);
+  }
+  sub64_64(tmp64, *left, moved);
+  cp64(*left, tmp64);
+  return code;
+}
+
+
 afs_uint32 xfskip(XFILE *X, afs_uint32 count)
 {
   afs_uint32 code;
   u_int64 tmp64;
 
+  if (X->stats) count_io(&X->stats->n_skip, &X->stats->bytes_skipped, count);
+
   /* Use the skip method, if there is one */
   if (X->do_skip && !X->passthru) {
+    if (X->wlen && (code = flush_wbuf(X))) return code;
     mk64(tmp64, 0, count);
+    if (X->trace) trace_op(X, "skip", &X->filepos);
     code = (X->do_skip)(X, &tmp64);
+    if (X->trace) trace_done(X, count);
     if (code) return code;
     add64_32(tmp64, X->filepos, count);
     cp64(X->filepos, tmp64);
@@ -110,6 +277,13 @@ afs_uint32 xfskip(XFILE *X, afs_uint32 count)
     return xfseek(X, &tmp64);
   }
 
+  /* Let the kernel move the data, if possible */
+  if (X->do_splice && count) {
+    mk64(tmp64, 0, count);
+    if (code = splice_skip(X, &tmp64)) return code;
+    count = lo64(tmp64);
+  }
+
   /* Do it the hard/slow way - read all the data to be skipped.
    * This is done if no other method is available, or if we are
    * supposed to be copying all the data to another XFILE
@@ -130,11 +304,23 @@ afs_uint32 xfskip(XFILE *X, afs_uint32 count)
 afs_uint32 xfskip64(XFILE *X, u_int64 *count)
 {
   afs_uint32 code;
-  u_int64 tmp64;
+  u_int64 tmp64, remaining;
+
+  if (X->stats) {
+    X->stats->n_skip++;
+    add64_64(tmp64, X->stats->bytes_skipped, *count);
+    cp64(X->stats->bytes_skipped, tmp64);
+  }
 
   /* Use the skip method, if there is one */
   if (X->do_skip && !X->passthru) {
+    if (X->wlen && (code = flush_wbuf(X))) return code;
+    if (X->trace) trace_op(X, "skip", &X->filepos);
     code = (X->do_skip)(X, count);
+    if (X->trace) {
+      xftrace_arg(X->trace, "size", count);
+      xftrace_end(X->trace);
+    }
     if (code) return code;
     add64_64(tmp64, X->filepos, *count);
     cp64(X->filepos, tmp64);
@@ -149,6 +335,12 @@ afs_uint32 xfskip64(XFILE *X, u_int64 *count)
     return xfseek(X, &tmp64);
   }
 
+  /* Let the kernel move the data, if possible */
+  cp64(remaining, *count);
+  if (X->do_splice && !zero64(remaining)) {
+    if (code = splice_skip(X, &remaining)) return code;
+  }
+
   /* Do it the hard/slow way - read all the data to be skipped.
    * This is done if no other method is available, or if we are
    * supposed to be copying all the data to another XFILE
@@ -156,10 +348,9 @@ afs_uint32 xfskip64(XFILE *X, u_int64 *count)
   {
     char buf[SKIP_SIZE];
     afs_uint32 n;
-    u_int64 remaining, zero;
+    u_int64 zero;
 
     mk64(zero, 0, 0);
-    cp64(remaining, *count);
 
     while (gt64(remaining, zero)) {
       mk64(tmp64, 0, SKIP_SIZE);
@@ -174,28 +365,87 @@ afs_uint32 xfskip64(XFILE *X, u_int64 *count)
 }
 
 
+/* Data read from X is buffered on its way to the passthru, so anyone
+ * else writing to Y must call xfflush(X) first to keep things in order.
+ * If no buffer can be allocated, data is passed through unbuffered.
+ */
 afs_uint32 xfpass(XFILE *X, XFILE *Y)
 {
   if (X->passthru) return ERROR_XFILE_ISPASS;
   if (!Y->is_writable) return ERROR_XFILE_RDONLY;
   X->passthru = Y;
+  X->passbuf = malloc(PASS_SIZE);
+  X->passlen = 0;
   return 0;
 }
 
 
 afs_uint32 xfunpass(XFILE *X)
 {
+  afs_uint32 code;
+
   if (!X->passthru) return ERROR_XFILE_NOPASS;
+  code = xfflush(X);
+  if (X->passbuf) free(X->passbuf);
+  X->passbuf = 0;
   X->passthru = 0;
+  return code;
+}
+
+
+/* Write out any data buffered by X, or for X's passthru */
+afs_uint32 xfflush(XFILE *X)
+{
+  afs_uint32 code = 0, code2;
+
+  if (X->passlen) {
+    code = xfwrite(X->passthru, X->passbuf, X->passlen);
+    X->passlen = 0;
+  }
+  if (X->wlen) {
+    code2 = flush_wbuf(X);
+    if (!code) code = code2;
+  }
+  return code;
+}
+
+
+/* Collect writes to X in a buffer of the given size, so that runs of
+ * small writes (such as the tags making up a vnode header) reach the
+ * underlying object as a single write.  Writes at least as large as
+ * the buffer are not copied.  The buffer is flushed by xfflush, and
+ * before any read, seek, skip, tell, or close.  A size of 0 flushes
+ * and removes the buffer.
+ */
+afs_uint32 xfsetbuf(XFILE *X, afs_uint32 size)
+{
+  afs_uint32 code = 0;
+
+  if (X->wlen) code = flush_wbuf(X);
+  if (X->wbuf) free(X->wbuf);
+  X->wbuf = 0;
+  X->wsize = 0;
+  if (code || !size) return code;
+
+  if (!(X->wbuf = malloc(size))) return ENOMEM;
+  X->wsize = size;
   return 0;
 }
 
 
 afs_uint32 xfclose(XFILE *X)
 {
-  int code = 0;
+  int code = 0, code2;
 
-  if (X->do_close) code = (X->do_close)(X);
+  if (X->passthru) code = xfunpass(X);
+  if (X->wbuf) {
+    code2 = xfsetbuf(X, 0);
+    if (!code) code = code2;
+  }
+  if (X->do_close) {
+    code2 = (X->do_close)(X);
+    if (!code) code = code2;
+  }
   memset(X, 0, sizeof(*X));
   return code;
 }
@@ -34,11 +34,23 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <time.h>
 #include "intNN.h"
 
 struct rx_call;
 struct rx_connection;
 
+/* I/O counters, kept for an XFILE whose stats pointer is set */
+typedef struct {
+  u_int64 bytes_read;                /* read, including to skip */
+  u_int64 bytes_written;
+  u_int64 bytes_skipped;
+  afs_uint32 n_read, n_write, n_tell, n_seek, n_skip;
+} xfstats;
+
+/* A timeline of nested spans, written as Chrome trace JSON; see xf_trace.c */
+typedef struct xftrace xftrace;
+
 /* The XFILE structure */
 typedef struct XFILE XFILE;
 struct XFILE {
@@ -48,14 +60,65 @@ struct XFILE {
   afs_uint32 (*do_seek)(XFILE *, u_int64 *);         /* set position */
   afs_uint32 (*do_skip)(XFILE *, u_int64 *);         /* skip forward */
   afs_uint32 (*do_close)(XFILE *);                   /* close */
+  afs_uint32 (*do_readsome)(XFILE *, void *, afs_uint32, afs_uint32 *);
+                                                  /* read what's there */
+  afs_uint32 (*do_splice)(XFILE *, XFILE *, u_int64 *);
+                                                  /* move data in kernel */
+  afs_uint32 (*do_size)(XFILE *, u_int64 *);         /* get total size */
   u_int64 filepos;                                /* position (counted) */
   int is_seekable;                                /* 1 if seek works */
   int is_writable;                                /* 1 if write works */
   XFILE *passthru;                                /* XFILE to pass thru to */
+  char *passbuf;                                  /* data for passthru */
+  afs_uint32 passlen;                             /* bytes in passbuf */
+  char *wbuf;                                     /* write buffer */
+  afs_uint32 wlen, wsize;                         /* bytes used, size */
+  xfstats *stats;                                 /* I/O counters, if set */
+  xftrace *trace;                                 /* I/O timeline, if set */
   void *refcon;                                   /* type-specific data */
 };
 
 
+/* Default size for xfsetbuf buffers */
+#define XFBUFSIZE 65536
+
+
+/* Binary profile format; see xf_profile.c */
+#define XFPROF_MAGIC    "XFPROF1\n"
+#define XFPROF_OPEN     1
+#define XFPROF_CLOSE    2
+#define XFPROF_READ     3
+#define XFPROF_READSOME 4
+#define XFPROF_WRITE    5
+#define XFPROF_TELL     6
+#define XFPROF_SEEK     7
+#define XFPROF_SKIP     8
+#define XFPROF_OPMASK   0x0f
+#define XFPROF_F_DELTA  0x10        /* record includes offset delta */
+#define XFPROF_F_RESULT 0x20        /* record includes nonzero result */
+
+/* A profile record, as returned by xfprof_next */
+typedef struct {
+  int op;                      /* XFPROF_* */
+  u_int64 offset;              /* where the operation happened */
+  u_int64 size;                /* bytes read, written, or skipped */
+  afs_uint32 result;           /* error code returned */
+  afs_uint32 dt;               /* usec since previous record (binary only) */
+  afs_uint32 ns;               /* duration in nsec (binary only) */
+  char name[256];              /* file name, for XFPROF_OPEN */
+} xfprof_record;
+
+/* State for reading a text or binary profile */
+typedef struct {
+  XFILE *X;
+  int binary;
+  time_t started;              /* when profiling began (binary only) */
+  u_int64 pos;                 /* where the last operation ended */
+  unsigned char buf[65536];
+  afs_uint32 bufpos, buflen;
+} xfprof_reader;
+
+
 /* Functions for opening XFILEs.  For these, the first two arguments are
  * always a pointer to an XFILE to fill in, and the mode in which to
  * open the file.  O_RDONLY, O_WRONLY, and O_RDWR are all permitted, but
@@ -72,15 +135,36 @@ extern afs_uint32 xfopen_rxcall (XFILE *, int, struct rx_call *);
 extern afs_uint32 xfopen_voldump(XFILE *, struct rx_connection *,
                               afs_int32, afs_int32, afs_int32);
 
+extern afs_uint32 xfopen_readahead(XFILE *, int, XFILE *, int, afs_uint32);
+extern afs_uint32 xfopen_gz  (XFILE *, int, XFILE *);
+extern afs_uint32 xfopen_zstd(XFILE *, int, XFILE *);
+extern afs_uint32 xfopen_zstdseek(XFILE *, int, XFILE *, int, int);
+
 extern afs_uint32 xfopen_profile(XFILE *, int, XFILE *, XFILE *);
 extern afs_uint32 xfopen_profile_to(XFILE *, int, XFILE *, char *);
 extern afs_uint32 xfopen_profile_name(XFILE *, int, char *, XFILE *);
 extern afs_uint32 xfopen_profile_name_to(XFILE *, int, char *, char *);
+extern afs_uint32 xfopen_bprofile(XFILE *, int, XFILE *, XFILE *);
+extern afs_uint32 xfopen_bprofile_name_to(XFILE *, int, char *, char *);
 
 extern afs_uint32 xfregister(char *, afs_uint32 (*)(XFILE *, int, char *));
 
+/* Reading profiles */
+extern afs_uint32 xfprof_open(xfprof_reader *, XFILE *);
+extern afs_uint32 xfprof_next(xfprof_reader *, xfprof_record *);
+
+/* Recording timelines */
+extern afs_uint32 xftrace_open(xftrace **, char *, char *);
+extern void xftrace_begin(xftrace *, char *, char *);
+extern void xftrace_arg(xftrace *, char *, u_int64 *);
+extern void xftrace_arg32(xftrace *, char *, afs_uint32);
+extern void xftrace_end(xftrace *);
+extern afs_uint32 xftrace_close(xftrace *);
+
 /* Standard operations on XFILEs */
 extern afs_uint32 xfread(XFILE *, void *, afs_uint32);     /* read data */
+extern afs_uint32 xfreadsome(XFILE *, void *, afs_uint32, afs_uint32 *);
+                                                           /* short read */
 extern afs_uint32 xfwrite(XFILE *, void *, afs_uint32);    /* write data */
 extern afs_uint32 xfprintf(XFILE *, char *, ...);          /* formatted */
 extern afs_uint32 vxfprintf(XFILE *, char *, va_list);     /* formatted VA */
@@ -88,8 +172,11 @@ extern afs_uint32 xftell(XFILE *, u_int64 *);              /* get position */
 extern afs_uint32 xfseek(XFILE *, u_int64 *);              /* set position */
 extern afs_uint32 xfskip(XFILE *, afs_uint32);             /* skip forward */
 extern afs_uint32 xfskip64(XFILE *, u_int64 *);            /* skip forward */
+extern afs_uint32 xfsize(XFILE *, u_int64 *);              /* get size */
 extern afs_uint32 xfpass(XFILE *, XFILE *);                /* set passthru */
 extern afs_uint32 xfunpass(XFILE *);                       /* unset passthru */
+extern afs_uint32 xfflush(XFILE *);                        /* flush buffers */
+extern afs_uint32 xfsetbuf(XFILE *, afs_uint32);           /* buffer writes */
 extern afs_uint32 xfclose(XFILE *);                        /* close */
 
 #endif /* _XFILES_H_ */
@@ -40,6 +40,10 @@ extern afs_uint32 xfon_path(XFILE *, int, char *);
 extern afs_uint32 xfon_fd(XFILE *, int, char *);
 extern afs_uint32 xfon_voldump(XFILE *, int, char *);
 extern afs_uint32 xfon_profile(XFILE *, int, char *);
+extern afs_uint32 xfon_bprofile(XFILE *, int, char *);
+extern afs_uint32 xfon_readahead(XFILE *, int, char *);
+extern afs_uint32 xfon_gz(XFILE *, int, char *);
+extern afs_uint32 xfon_zstd(XFILE *, int, char *);
 extern afs_uint32 xfon_stdio(XFILE *, int);
 
 struct xftype {
@@ -73,10 +77,40 @@ static void register_default_types(void)
   xfregister("FD",      xfon_fd);
   xfregister("AFSDUMP", xfon_voldump);
   xfregister("PROFILE", xfon_profile);
+  xfregister("BPROFILE", xfon_bprofile);
+  xfregister("READAHEAD", xfon_readahead);
+  xfregister("GZ",      xfon_gz);
+  xfregister("ZSTD",    xfon_zstd);
   did_register_defaults = 1;
 }
 
 
+/* Parse the numeric options that some types take before the name, as
+ * in READAHEAD:depth[,bufsize]::name.  The options are recognized only
+ * if the name starts with digits[,digits]::, so a name that is another
+ * typed name, or a path with "::" in it, is left alone.  Returns the
+ * number of options found (0, 1 or 2), and advances *name past them.
+ */
+int xfon_options(char **name, afs_uint32 *opt1, afs_uint32 *opt2)
+{
+  char *x = *name, *comma = 0;
+
+  if (*x < '0' || *x > '9') return 0;
+  while (*x >= '0' && *x <= '9') x++;
+  if (*x == ',') {
+    comma = x++;
+    if (*x < '0' || *x > '9') return 0;
+    while (*x >= '0' && *x <= '9') x++;
+  }
+  if (x[0] != ':' || x[1] != ':') return 0;
+
+  *opt1 = strtoul(*name, 0, 10);
+  if (comma) *opt2 = strtoul(comma + 1, 0, 10);
+  *name = x + 2;
+  return comma ? 2 : 1;
+}
+
+
 afs_uint32 xfopen(XFILE *X, int flag, char *name)
 {
   struct xftype *x;
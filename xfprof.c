@@ -0,0 +1,276 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xfprof.c - Decode and summarize XFILE profiles */
+
+#include <sys/fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "xfiles.h"
+#include "xf_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+char *argv0;
+static char *input_path;
+static int timing, summary;
+
+#define NBUCKETS 65
+
+static char *opnames[] = {
+  "?", "OPEN", "CLOSE", "READ", "READSOME", "WRITE", "TELL", "SEEK", "SKIP"
+};
+#define NOPS (sizeof(opnames) / sizeof(opnames[0]))
+
+static struct {
+  unsigned long count, errors;
+  u_int64 bytes;
+  double ns;
+  unsigned long sizes[NBUCKETS];   /* by log2 of size */
+  unsigned long times[NBUCKETS];   /* by log2 of duration in ns */
+} stats[NOPS];
+static unsigned long seeks[NBUCKETS]; /* by log2 of seek distance */
+static u_int64 last;                  /* where the last operation ended */
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] [file]\n", argv0);
+  fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -s     Print a summary and histograms\n");
+  fprintf(stderr, "  -t     Include times and offsets with each record\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  input_path = 0;
+  timing = summary = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "hst")) != EOF) {
+    switch (c) {
+      case 's': summary      = 1;                         continue;
+      case 't': timing       = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (summary && timing) usage(1, "Can't specify both -s and -t");
+
+  /* Parse non-option arguments */
+  if (argc - optind > 1) usage(1, "Too many arguments!");
+  input_path = (argc == optind) ? "-" : argv[optind];
+}
+
+
+/* Which histogram bucket a value goes in: 0 for 0, else 1 + log2 */
+static int bucket(u_int64 *value)
+{
+  afs_uint32 x;
+  int b;
+
+  if (hi64(*value)) b = 33, x = hi64(*value);
+  else if (lo64(*value)) b = 1, x = lo64(*value);
+  else return 0;
+  while (x >>= 1) b++;
+  return b;
+}
+
+
+static void print_histogram(char *title, unsigned long *h)
+{
+  u_int64 lo, hi, tmp64;
+  char lobuf[21], hibuf[21];
+  int i;
+
+  for (i = 0; i < NBUCKETS && !h[i]; i++);
+  if (i == NBUCKETS) return;
+  printf("\n%s:\n", title);
+  for (; i < NBUCKETS; i++) {
+    if (!h[i]) continue;
+    if (!i) {
+      printf("  %20s   %-20s %10lu\n", "0", "", h[i]);
+      continue;
+    }
+    mk64(lo, 0, 1);
+    shift_int64(&lo, i - 1);
+    cp64(tmp64, lo);
+    shift_int64(&tmp64, 1);
+    sub64_32(hi, tmp64, 1);
+    printf("  %20s - %-20s %10lu\n",
+           decimate_int64(&lo, lobuf), decimate_int64(&hi, hibuf), h[i]);
+  }
+}
+
+
+static void print_summary(void)
+{
+  unsigned long sizes[NBUCKETS];
+  char buf[21], title[64];
+  int op, i;
+
+  printf("%-9s %10s %8s %20s %12s\n",
+         "op", "count", "errors", "bytes", "time (ms)");
+  for (op = 1; op < NOPS; op++) {
+    if (!stats[op].count) continue;
+    printf("%-9s %10lu %8lu %20s %12.3f\n", opnames[op],
+           stats[op].count, stats[op].errors,
+           decimate_int64(&stats[op].bytes, buf), stats[op].ns / 1e6);
+  }
+
+  for (i = 0; i < NBUCKETS; i++)
+    sizes[i] = stats[XFPROF_READ].sizes[i] + stats[XFPROF_READSOME].sizes[i];
+  print_histogram("Read sizes (bytes)", sizes);
+  print_histogram("Write sizes (bytes)", stats[XFPROF_WRITE].sizes);
+  print_histogram("Skip sizes (bytes)", stats[XFPROF_SKIP].sizes);
+  print_histogram("Seek distances (bytes)", seeks);
+  for (op = 1; op < NOPS; op++) {
+    if (!stats[op].count || op == XFPROF_OPEN) continue;
+    sprintf(title, "%s times (ns)", opnames[op]);
+    print_histogram(title, stats[op].times);
+  }
+}
+
+
+/* Print (or count) one record */
+static void do_record(xfprof_record *P, double *clock)
+{
+  u_int64 delta, tmp64;
+  char buf[21];
+  int op = P->op;
+
+  *clock += P->dt;
+  if (op <= 0 || op >= NOPS) return;
+  if (op == XFPROF_OPEN) {
+    if (summary) return;
+    if (timing) printf("%12.6f %10s %16s ", *clock / 1e6, "", "");
+    printf("OPEN %s\n", P->name);
+    return;
+  }
+
+  stats[op].count++;
+  if (P->result) stats[op].errors++;
+  add64_64(tmp64, stats[op].bytes, P->size);
+  cp64(stats[op].bytes, tmp64);
+  stats[op].ns += P->ns;
+  stats[op].sizes[bucket(&P->size)]++;
+  mk64(tmp64, 0, P->ns);
+  stats[op].times[bucket(&tmp64)]++;
+  if (op == XFPROF_SEEK && !P->result) {
+    if (ge64(P->offset, last)) sub64_64(delta, P->offset, last);
+    else                       sub64_64(delta, last, P->offset);
+    seeks[bucket(&delta)]++;
+  }
+  if (!P->result) add64_64(last, P->offset, P->size);
+  if (summary) return;
+
+  if (timing)
+    printf("%12.6f %10lu %16s ", *clock / 1e6, (unsigned long)P->ns,
+           hexify_int64(&P->offset, buf));
+  switch (op) {
+    case XFPROF_READ:
+    case XFPROF_READSOME:
+      printf("R %ld =%ld\n", (long)lo64(P->size), (long)P->result);
+      break;
+    case XFPROF_WRITE:
+      printf("W %ld =%ld\n", (long)lo64(P->size), (long)P->result);
+      break;
+    case XFPROF_TELL:
+      if (P->result) printf("TELL ERR =%ld\n", (long)P->result);
+      else           printf("TELL %s =0\n", hexify_int64(&P->offset, buf));
+      break;
+    case XFPROF_SEEK:
+      printf("SEEK %s =%ld\n", hexify_int64(&P->offset, buf), (long)P->result);
+      break;
+    case XFPROF_SKIP:
+      printf("SKIP %s =%ld\n", decimate_int64(&P->size, buf), (long)P->result);
+      break;
+  }
+}
+
+
+/* Main program */
+int main(int argc, char **argv)
+{
+  XFILE input_file;
+  xfprof_reader R;
+  xfprof_record P;
+  afs_uint32 r;
+  double clock;
+
+  parse_options(argc, argv);
+  initialize_xFil_error_table();
+
+  if (r = xfopen(&input_file, O_RDONLY, input_path)) {
+    afs_com_err(argv0, r, "opening %s", input_path);
+    exit(2);
+  }
+  if (r = xfprof_open(&R, &input_file)) {
+    afs_com_err(argv0, r, "reading %s", input_path);
+    xfclose(&input_file);
+    exit(2);
+  }
+  if (!R.binary && (timing || summary)) {
+    fprintf(stderr, "%s: %s is a text profile; times are not available\n",
+            argv0, input_path);
+  }
+  if (timing && R.binary) printf("# started %s", ctime(&R.started));
+
+  mk64(last, 0, 0);
+  clock = 0;
+  while (!(r = xfprof_next(&R, &P)))
+    do_record(&P, &clock);
+  xfclose(&input_file);
+  if (r == (afs_uint32)ERROR_XFILE_EOF) r = 0;
+
+  if (summary) print_summary();
+  if (r) {
+    afs_com_err(argv0, r, "reading %s", input_path);
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,408 @@
+/*
+ * CMUCS AFStools
+ * dumpscan - routines for scanning and manipulating AFS volume dumps
+ *
+ * Copyright (c) 1998, 2001 Carnegie Mellon University
+ * All Rights Reserved.
+ * 
+ * Permission to use, copy, modify and distribute this software and its
+ * documentation is hereby granted, provided that both the copyright
+ * notice and this permission notice appear in all copies of the
+ * software, derivative works or modified versions, and any portions
+ * thereof, and that both notices appear in supporting documentation.
+ *
+ * CARNEGIE MELLON ALLOWS FREE USE OF THIS SOFTWARE IN ITS "AS IS"
+ * CONDITION.  CARNEGIE MELLON DISCLAIMS ANY LIABILITY OF ANY KIND FOR
+ * ANY DAMAGES WHATSOEVER RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Carnegie Mellon requests users of this software to return to
+ *
+ *  Software Distribution Coordinator  or  Software_Distribution@CS.CMU.EDU
+ *  School of Computer Science
+ *  Carnegie Mellon University
+ *  Pittsburgh PA 15213-3890
+ *
+ * any improvements or extensions that they make and grant Carnegie Mellon
+ * the rights to redistribute these changes.
+ */
+
+/* xfreplay.c - Replay an XFILE profile against a file
+ *
+ * Reads a profile (text or binary) and repeats the same sequence of
+ * reads, seeks, skips and tells against a target XFILE, measuring how
+ * long each takes.  The target may be any name xfopen understands, so
+ * the same access pattern can be run against different storage or
+ * different XFILE types.  If no target is given, the file named in the
+ * profile is used.
+ *
+ * The target is kept at the offset each operation was recorded at; if
+ * it isn't there already (which happens when a text profile doesn't
+ * record a seek, or when writes are not being replayed), it is seeked
+ * there first.  Such seeks are reported as implied seeks.
+ */
+
+#include <sys/fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <afs/stds.h>
+#include <afs/com_err.h>
+
+#include "xfiles.h"
+#include "xf_errs.h"
+
+extern int optind;
+extern char *optarg;
+
+char *argv0;
+static char *profile_path, *target_path;
+static int quiet, verbose, pace, do_writes;
+
+#define REPLAY_BUFSIZE (1024 * 1024)
+
+/* Latencies are kept in a histogram with 8 buckets per power of 2 */
+#define NLAT 240
+
+static char *opnames[] = {
+  "?", "OPEN", "CLOSE", "READ", "READSOME", "WRITE", "TELL", "SEEK", "SKIP"
+};
+#define NOPS (sizeof(opnames) / sizeof(opnames[0]))
+
+static struct {
+  unsigned long count, errors;
+  double bytes, ns;
+  afs_uint32 max;
+  unsigned long lat[NLAT];
+} stats[NOPS];
+
+static unsigned long implied, forward, backward, skipped_writes;
+static double seek_distance;
+
+static XFILE target;
+static int target_open;
+static u_int64 pos;                    /* where the target is now */
+static char *buf;
+
+
+/* Print a usage message and exit */
+static void usage(int status, char *msg)
+{
+  if (msg) fprintf(stderr, "%s: %s\n", argv0, msg);
+  fprintf(stderr, "Usage: %s [options] profile [target]\n", argv0);
+  fprintf(stderr, "  -T     Reproduce the recorded time between operations\n");
+  fprintf(stderr, "         (binary profiles only)\n");
+  fprintf(stderr, "  -h     Print this help message\n");
+  fprintf(stderr, "  -q     Quiet mode (don't print errors)\n");
+  fprintf(stderr, "  -v     Verbose mode\n");
+  fprintf(stderr, "  -w     Replay writes (the target is overwritten!)\n");
+  exit(status);
+}
+
+
+/* Parse the command-line options */
+static void parse_options(int argc, char **argv)
+{
+  int c;
+
+  /* Set the program name */
+  if (argv0 = strrchr(argv[0], '/')) argv0++;
+  else argv0 = argv[0];
+
+  /* Initialize options */
+  profile_path = target_path = 0;
+  quiet = verbose = pace = do_writes = 0;
+
+  /* Parse the options */
+  while ((c = getopt(argc, argv, "Thqvw")) != EOF) {
+    switch (c) {
+      case 'T': pace         = 1;                         continue;
+      case 'q': quiet        = 1;                         continue;
+      case 'v': verbose      = 1;                         continue;
+      case 'w': do_writes    = 1;                         continue;
+      case 'h': usage(0, 0);                              exit(0);
+      default:  usage(1, "Invalid option!");
+    }
+  }
+
+  if (quiet && verbose) usage(1, "Can't specify both -q and -v");
+
+  /* Parse non-option arguments */
+  if (argc - optind < 1) usage(1, "Too few arguments!");
+  if (argc - optind > 2) usage(1, "Too many arguments!");
+  profile_path = argv[optind];
+  if (argc - optind > 1) target_path = argv[optind + 1];
+}
+
+
+static double elapsed(struct timespec *t0, struct timespec *t1)
+{
+  return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+
+/* Which latency bucket a duration goes in.  e is the position of the
+ * highest bit set, which is at most 31, so ns is never shifted by 32.
+ */
+static int lat_bucket(afs_uint32 ns)
+{
+  int e, b;
+
+  if (ns < 8) return ns;
+  for (e = 3; e < 31 && ns >> (e + 1); e++);
+  b = 8 + (e - 3) * 8 + ((ns >> (e - 3)) & 7);
+  return (b < NLAT) ? b : NLAT - 1;
+}
+
+/* The smallest duration in a latency bucket */
+static double lat_value(int b)
+{
+  if (b < 8) return b;
+  b -= 8;
+  return (double)(8 + (b & 7)) * (1 << (b >> 3));
+}
+
+/* Find a latency percentile, in microseconds */
+static double percentile(int op, double pct)
+{
+  unsigned long want, seen;
+  int b;
+
+  want = stats[op].count * pct / 100;
+  if (want >= stats[op].count) want = stats[op].count - 1;
+  for (seen = 0, b = 0; b < NLAT; b++) {
+    seen += stats[op].lat[b];
+    if (seen > want) break;
+  }
+  return lat_value(b) / 1000;
+}
+
+
+static void print_report(double wall)
+{
+  double io = 0, bytes = 0, rate;
+  int op;
+
+  printf("%-8s %9s %6s %14s %9s %9s %9s %9s %9s %9s\n",
+         "op", "count", "errors", "bytes", "MB/s",
+         "p50 (us)", "p90", "p99", "p99.9", "max");
+  for (op = XFPROF_CLOSE; op < NOPS; op++) {
+    if (!stats[op].count) continue;
+    io += stats[op].ns;
+    bytes += stats[op].bytes;
+    rate = stats[op].ns ? stats[op].bytes / stats[op].ns * 1e3 : 0;
+    printf("%-8s %9lu %6lu %14.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+           opnames[op], stats[op].count, stats[op].errors, stats[op].bytes,
+           rate, percentile(op, 50), percentile(op, 90), percentile(op, 99),
+           percentile(op, 99.9), stats[op].max / 1e3);
+  }
+  printf("\n%.3f s elapsed, %.3f s in I/O, %.1f MB/s overall\n",
+         wall / 1e9, io / 1e9, wall ? bytes / wall * 1e3 : 0);
+  printf("Seeks: %lu explicit, %lu implied; %lu forward, %lu backward",
+         stats[XFPROF_SEEK].count, implied, forward, backward);
+  if (forward + backward)
+    printf("; mean distance %.0f bytes", seek_distance / (forward + backward));
+  printf("\n");
+  if (skipped_writes)
+    printf("%lu writes not replayed (use -w)\n", skipped_writes);
+}
+
+
+/* Note a change of position in the target */
+static void count_seek(u_int64 *to)
+{
+  u_int64 dist;
+
+  if (ge64(*to, pos)) {
+    sub64_64(dist, *to, pos);
+    forward++;
+  } else {
+    sub64_64(dist, pos, *to);
+    backward++;
+  }
+  seek_distance += hi64(dist) * 4294967296.0 + lo64(dist);
+}
+
+
+/* Open (or reopen) the target */
+static afs_uint32 open_target(char *name)
+{
+  afs_uint32 r;
+
+  if (target_open) xfclose(&target);
+  target_open = 0;
+  if (r = xfopen(&target, do_writes ? O_RDWR : O_RDONLY, name)) return r;
+  target_open = 1;
+  mk64(pos, 0, 0);
+  if (verbose) fprintf(stderr, "%s: replaying against %s\n", argv0, name);
+  return 0;
+}
+
+
+/* Replay one operation; returns the time it took */
+static afs_uint32 replay(xfprof_record *P, double *ns)
+{
+  struct timespec t0, t1;
+  afs_uint32 r = 0, n;
+  u_int64 left, tmp64;
+
+  *ns = 0;
+
+  /* Get to where the operation happened */
+  if (P->op != XFPROF_SEEK && P->op != XFPROF_TELL && P->op != XFPROF_CLOSE
+  &&  ne64(P->offset, pos)) {
+    if (!target.is_seekable) return ERROR_XFILE_NOSEEK;
+    count_seek(&P->offset);
+    implied++;
+    if (r = xfseek(&target, &P->offset)) return r;
+    cp64(pos, P->offset);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  switch (P->op) {
+    case XFPROF_READ:
+    case XFPROF_READSOME:
+    case XFPROF_WRITE:
+      cp64(left, P->size);
+      while (!r && (hi64(left) || lo64(left))) {
+        n = (hi64(left) || lo64(left) > REPLAY_BUFSIZE)
+          ? REPLAY_BUFSIZE : lo64(left);
+        if (P->op == XFPROF_WRITE) r = xfwrite(&target, buf, n);
+        else                       r = xfread(&target, buf, n);
+        sub64_32(tmp64, left, n);
+        cp64(left, tmp64);
+      }
+      break;
+
+    case XFPROF_SKIP:
+      r = xfskip64(&target, &P->size);
+      break;
+
+    case XFPROF_SEEK:
+      if (P->result) break;
+      count_seek(&P->offset);
+      r = xfseek(&target, &P->offset);
+      break;
+
+    case XFPROF_TELL:
+      r = xftell(&target, &tmp64);
+      break;
+
+    case XFPROF_CLOSE:
+      break;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  *ns = elapsed(&t0, &t1);
+
+  if (!r && !P->result) add64_64(pos, P->offset, P->size);
+  else if (r) xftell(&target, &pos);
+  return r;
+}
+
+
+/* Main program */
+int main(int argc, char **argv)
+{
+  struct timespec start, now, t;
+  XFILE profile;
+  xfprof_reader R;
+  xfprof_record P;
+  afs_uint32 r;
+  double ns, clock, wall;
+  int op, failed = 0;
+
+  parse_options(argc, argv);
+  initialize_xFil_error_table();
+
+  if (!(buf = malloc(REPLAY_BUFSIZE))) {
+    fprintf(stderr, "%s: out of memory\n", argv0);
+    exit(2);
+  }
+  memset(buf, 0, REPLAY_BUFSIZE);
+
+  if (r = xfopen(&profile, O_RDONLY, profile_path)) {
+    afs_com_err(argv0, r, "opening %s", profile_path);
+    exit(2);
+  }
+  if (r = xfprof_open(&R, &profile)) {
+    afs_com_err(argv0, r, "reading %s", profile_path);
+    exit(2);
+  }
+  if (pace && !R.binary) {
+    fprintf(stderr, "%s: %s is a text profile; ignoring -T\n",
+            argv0, profile_path);
+    pace = 0;
+  }
+  if (target_path && (r = open_target(target_path))) {
+    afs_com_err(argv0, r, "opening %s", target_path);
+    exit(2);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  clock = 0;
+  while (!(r = xfprof_next(&R, &P))) {
+    clock += P.dt;
+    if (pace) {
+      /* Wait until the operation's time comes around */
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      ns = clock * 1e3 - elapsed(&start, &now);
+      if (ns > 0) {
+        t.tv_sec = ns / 1e9;
+        t.tv_nsec = ns - t.tv_sec * 1e9;
+        nanosleep(&t, 0);
+      }
+    }
+
+    if (P.op == XFPROF_OPEN) {
+      /* Use the named file, unless a target was given */
+      if (target_path && target_open) continue;
+      if (r = open_target(P.name)) {
+        afs_com_err(argv0, r, "opening %s", P.name);
+        break;
+      }
+      continue;
+    }
+    if (!target_open) {
+      fprintf(stderr, "%s: profile does not name a file\n", argv0);
+      exit(2);
+    }
+    if (P.op == XFPROF_WRITE && !do_writes) {
+      skipped_writes++;
+      continue;
+    }
+
+    op = P.op;
+    r = replay(&P, &ns);
+    if (ns > 4e9) ns = 4e9;
+    stats[op].count++;
+    stats[op].ns += ns;
+    stats[op].lat[lat_bucket(ns)]++;
+    if (ns > stats[op].max) stats[op].max = ns;
+    if (!r) {
+      if (op != XFPROF_SEEK && op != XFPROF_TELL)
+        stats[op].bytes += hi64(P.size) * 4294967296.0 + lo64(P.size);
+    } else if (!P.result) {
+      /* Errors are expected only where they happened originally */
+      stats[op].errors++;
+      if (!quiet) afs_com_err(argv0, r, "replaying %s", opnames[op]);
+    }
+    if (r && !target.is_seekable) {
+      /* No way to get back in step */
+      failed = 1;
+      break;
+    }
+    r = 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  wall = elapsed(&start, &now);
+
+  if (target_open) xfclose(&target);
+  xfclose(&profile);
+  if (r == (afs_uint32)ERROR_XFILE_EOF) r = 0;
+  if (r && !failed && !quiet)
+    afs_com_err(argv0, r, "reading %s", profile_path);
+
+  print_report(wall);
+  exit(r ? 1 : 0);
+}